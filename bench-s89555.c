@@ -0,0 +1,522 @@
+/*
+ * Lamport One-Time Signature Scheme
+ * Microbenchmarks
+ * ==========================================================
+ * This program times the building blocks of key generation, signing and verification and prints the
+ * results as JSON. Every result is a throughput (higher is better): operations, hashes or parses per
+ * second, or MB/s for hash_file. OpenSSL signature schemes are measured the same way as reference points;
+ * schemes the linked OpenSSL does not provide (ML-DSA and SLH-DSA need OpenSSL 3.5) are listed as unavailable.
+ *
+ * USAGE:
+ * Compile with: make bench-s89555 (make bench runs it and compares with bench-baseline.json)
+ * Run with: ./bench-s89555 [-s <seconds>] [-o <output.json>] [-b <baseline.json>] [-t <percent>]
+ * -s  minimum time per benchmark (default 0.5 s)
+ * -o  write the JSON there instead of stdout; a results file can be used as a later baseline
+ * -b  add each baseline value and the change in percent to the results
+ * -t  exit with status 1 if any result is more than <percent> below its baseline
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "lamport_common.h"
+#include "lamport_api.h"
+#include "lamport_hex.h"
+#include "lamport_container.h"
+#include "lamport_wots.h"
+
+#define BENCH_MAX_RESULTS 64
+#define BENCH_MESSAGE_SIZE 1024
+
+typedef struct
+{
+    char name[64];
+    const char *unit;
+    double value;         // 0 if unavailable
+    double baseline;      // 0 if not in the baseline
+    int regression;
+} bench_result;
+
+// One benchmark iteration; returns 0 on failure
+typedef int (*bench_fn)(void *arg);
+
+static bench_result results[BENCH_MAX_RESULTS];
+static int num_results = 0;
+static double min_seconds = 0.5;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Iterations per second: run fn in doubling rounds until one round takes at least min_seconds
+static double measure(bench_fn fn, void *arg)
+{
+    if (!fn(arg)) // warm-up, and a failing benchmark is reported as unavailable
+    {
+        return 0;
+    }
+    for (long iterations = 1;; iterations *= 2)
+    {
+        double start = now_seconds();
+        for (long i = 0; i < iterations; i++)
+        {
+            if (!fn(arg))
+            {
+                return 0;
+            }
+        }
+        double elapsed = now_seconds() - start;
+        if (elapsed >= min_seconds)
+        {
+            return (double)iterations / elapsed;
+        }
+    }
+}
+
+static void add_result(const char *name, const char *unit, double value)
+{
+    if (num_results < BENCH_MAX_RESULTS)
+    {
+        bench_result *result = &results[num_results++];
+        snprintf(result->name, sizeof(result->name), "%s", name);
+        result->unit = unit;
+        result->value = value;
+    }
+    fprintf(stderr, "%-36s %14.1f %s\n", name, value, value > 0 ? unit : "(unavailable)");
+}
+
+// ----------------------------------------------------------------------------
+// Lamport operations
+// ----------------------------------------------------------------------------
+
+typedef struct
+{
+    lamport_ctx *ctx;
+    unsigned char private_key[LAMPORT_PRIVATE_KEY_BYTES];
+    unsigned char public_key[LAMPORT_PUBLIC_KEY_BYTES];
+    unsigned char signature[LAMPORT_SIGNATURE_BYTES];
+    unsigned char digest[HASH_SIZE];
+    unsigned char seed[KEY_SIZE];
+    unsigned char message[BENCH_MESSAGE_SIZE];
+    wots_private_key wots_private;
+    wots_public_key wots_public;
+    unsigned char wots_signature[WOTS_MAX_LEN][HASH_SIZE];
+    char dir[256];
+    char file_name[320];
+} lamport_state;
+
+static int bench_keygen(void *arg)
+{
+    lamport_state *s = arg;
+    return lamport_keygen(s->ctx, s->private_key, s->public_key);
+}
+
+static int bench_public_key(void *arg)
+{
+    lamport_state *s = arg;
+    return lamport_public_key(s->ctx, s->private_key, s->public_key);
+}
+
+static int bench_sign(void *arg)
+{
+    lamport_state *s = arg;
+    return lamport_sign(s->ctx, s->private_key, s->message, sizeof(s->message), s->signature);
+}
+
+static int bench_verify(void *arg)
+{
+    lamport_state *s = arg;
+    return lamport_verify(s->ctx, s->public_key, s->message, sizeof(s->message), s->signature);
+}
+
+static int bench_seed_sign(void *arg)
+{
+    lamport_state *s = arg;
+    return derive_signature_components(s->seed, 0, s->digest, (unsigned char (*)[KEY_SIZE])s->signature);
+}
+
+static int bench_wots_sign(void *arg)
+{
+    lamport_state *s = arg;
+    return wots_sign(&s->wots_private, s->digest, s->wots_signature);
+}
+
+static int bench_wots_verify(void *arg)
+{
+    lamport_state *s = arg;
+    return wots_verify(&s->wots_public, s->wots_signature, s->digest);
+}
+
+static int bench_read_key_hex(void *arg)
+{
+    lamport_state *s = arg;
+    return read_key(s->file_name, (unsigned char (*)[2][KEY_SIZE])s->public_key);
+}
+
+static int bench_read_signature_hex(void *arg)
+{
+    lamport_state *s = arg;
+    return read_signature(s->file_name, (unsigned char (*)[KEY_SIZE])s->signature);
+}
+
+static int bench_open_container(void *arg, uint16_t type, uint32_t num_components)
+{
+    lamport_state *s = arg;
+    container_map map;
+    if (!container_open(s->file_name, type, num_components, &map))
+    {
+        return 0;
+    }
+    container_close(&map);
+    return 1;
+}
+
+static int bench_read_key_binary(void *arg)
+{
+    return bench_open_container(arg, CONTAINER_PUBLIC_KEY, NUM_BITS * 2);
+}
+
+static int bench_read_signature_binary(void *arg)
+{
+    return bench_open_container(arg, CONTAINER_SIGNATURE, NUM_BITS);
+}
+
+static int bench_hash_file(void *arg)
+{
+    lamport_state *s = arg;
+    return hash_file(s->file_name, s->digest);
+}
+
+static void set_file(lamport_state *s, const char *name)
+{
+    snprintf(s->file_name, sizeof(s->file_name), "%s/%s", s->dir, name);
+}
+
+// Write size bytes of the message pattern to the scratch file
+static int write_document(lamport_state *s, size_t size)
+{
+    FILE *file = fopen(s->file_name, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot create %s\n", s->file_name);
+        return 0;
+    }
+    for (size_t written = 0; written < size; written += sizeof(s->message))
+    {
+        size_t n = size - written < sizeof(s->message) ? size - written : sizeof(s->message);
+        fwrite(s->message, 1, n, file);
+    }
+    return fclose(file) == 0;
+}
+
+static int run_lamport_benchmarks(void)
+{
+    static lamport_state s;
+    static const size_t file_sizes[] = { 4096, 1 << 20, 64 << 20 };
+    char name[64];
+
+    s.ctx = lamport_ctx_new();
+    if (s.ctx == NULL)
+    {
+        return 0;
+    }
+    snprintf(s.dir, sizeof(s.dir), "%s/lamport-bench-XXXXXX", getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp");
+    if (mkdtemp(s.dir) == NULL)
+    {
+        fprintf(stderr, "Error: Cannot create a scratch directory\n");
+        lamport_ctx_free(s.ctx);
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(s.message); i++)
+    {
+        s.message[i] = (unsigned char)(i * 131 + 7);
+    }
+    int ok = lamport_keygen(s.ctx, s.private_key, s.public_key) && lamport_digest(s.ctx, s.message, sizeof(s.message), s.digest) &&
+             RAND_bytes(s.seed, KEY_SIZE) == 1 && wots_keygen(WOTS_DEFAULT_W, &s.wots_private, &s.wots_public) &&
+             wots_sign(&s.wots_private, s.digest, s.wots_signature);
+    if (ok)
+    {
+        add_result("lamport.keygen", "ops/s", measure(bench_keygen, &s));
+        add_result("lamport.public_key_derivation", "hashes/s", measure(bench_public_key, &s) * NUM_BITS * 2);
+        add_result("lamport.sign", "ops/s", measure(bench_sign, &s));
+        add_result("lamport.verify", "ops/s", measure(bench_verify, &s));
+        add_result("lamport.sign_seed_key", "ops/s", measure(bench_seed_sign, &s));
+        add_result("wots16.sign", "ops/s", measure(bench_wots_sign, &s));
+        add_result("wots16.verify", "ops/s", measure(bench_wots_verify, &s));
+
+        // Parsing: the files are small and stay in the page cache, so this is parse and syscall cost
+        set_file(&s, "key.pub");
+        ok = hex_write_lines(s.file_name, 0, s.public_key, NUM_BITS * 2);
+        add_result("read_key.hex", "parses/s", ok ? measure(bench_read_key_hex, &s) : 0);
+        set_file(&s, "message.sign");
+        ok = lamport_sign(s.ctx, s.private_key, s.message, sizeof(s.message), s.signature) &&
+             hex_write_lines(s.file_name, 0, s.signature, NUM_BITS);
+        add_result("read_signature.hex", "parses/s", ok ? measure(bench_read_signature_hex, &s) : 0);
+        set_file(&s, "key.bin.pub");
+        ok = container_write(s.file_name, 0, CONTAINER_PUBLIC_KEY, 0, s.public_key, NUM_BITS * 2);
+        add_result("read_key.binary", "parses/s", ok ? measure(bench_read_key_binary, &s) : 0);
+        set_file(&s, "message.bin.sign");
+        ok = container_write(s.file_name, 0, CONTAINER_SIGNATURE, 0, s.signature, NUM_BITS);
+        add_result("read_signature.binary", "parses/s", ok ? measure(bench_read_signature_binary, &s) : 0);
+
+        set_file(&s, "document");
+        for (size_t i = 0; i < sizeof(file_sizes) / sizeof(file_sizes[0]); i++)
+        {
+            ok = write_document(&s, file_sizes[i]);
+            snprintf(name, sizeof(name), "hash_file.%zuKiB", file_sizes[i] / 1024);
+            add_result(name, "MB/s", ok ? measure(bench_hash_file, &s) * (double)file_sizes[i] / 1e6 : 0);
+        }
+        ok = 1;
+    }
+    const char *scratch[] = { "key.pub", "message.sign", "key.bin.pub", "message.bin.sign", "document" };
+    for (size_t i = 0; i < sizeof(scratch) / sizeof(scratch[0]); i++)
+    {
+        set_file(&s, scratch[i]);
+        unlink(s.file_name);
+    }
+    rmdir(s.dir);
+    lamport_ctx_free(s.ctx);
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// OpenSSL reference schemes
+// ----------------------------------------------------------------------------
+
+typedef struct
+{
+    const char *name;      // result name prefix
+    const char *algorithm; // EVP_PKEY algorithm
+    const char *group;     // EC group, NULL for schemes without parameters
+    const char *md;        // digest for EVP_DigestSign, NULL for schemes that hash internally
+} reference_scheme;
+
+static const reference_scheme reference_schemes[] = {
+    { "ref.ed25519", "ED25519", NULL, NULL },
+    { "ref.ecdsa_p256", "EC", "P-256", "SHA256" },
+    { "ref.ml_dsa_65", "ML-DSA-65", NULL, NULL },
+    { "ref.slh_dsa_sha2_128f", "SLH-DSA-SHA2-128f", NULL, NULL },
+    { "ref.slh_dsa_sha2_128s", "SLH-DSA-SHA2-128s", NULL, NULL },
+};
+
+typedef struct
+{
+    const reference_scheme *scheme;
+    EVP_PKEY *pkey;
+    unsigned char message[BENCH_MESSAGE_SIZE];
+    unsigned char signature[65536]; // SLH-DSA-128f signatures are 17088 bytes, the largest here
+    size_t signature_len;
+} reference_state;
+
+static EVP_PKEY *reference_keygen(const reference_scheme *scheme)
+{
+    if (scheme->group != NULL)
+    {
+        return EVP_PKEY_Q_keygen(NULL, NULL, scheme->algorithm, scheme->group);
+    }
+    return EVP_PKEY_Q_keygen(NULL, NULL, scheme->algorithm);
+}
+
+static int bench_reference_keygen(void *arg)
+{
+    reference_state *s = arg;
+    EVP_PKEY *pkey = reference_keygen(s->scheme);
+    EVP_PKEY_free(pkey);
+    return pkey != NULL;
+}
+
+static int bench_reference_sign(void *arg)
+{
+    reference_state *s = arg;
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    s->signature_len = sizeof(s->signature);
+    int ok = mdctx != NULL && EVP_DigestSignInit_ex(mdctx, NULL, s->scheme->md, NULL, NULL, s->pkey, NULL) == 1 &&
+             EVP_DigestSign(mdctx, s->signature, &s->signature_len, s->message, sizeof(s->message)) == 1;
+    EVP_MD_CTX_free(mdctx);
+    return ok;
+}
+
+static int bench_reference_verify(void *arg)
+{
+    reference_state *s = arg;
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = mdctx != NULL && EVP_DigestVerifyInit_ex(mdctx, NULL, s->scheme->md, NULL, NULL, s->pkey, NULL) == 1 &&
+             EVP_DigestVerify(mdctx, s->signature, s->signature_len, s->message, sizeof(s->message)) == 1;
+    EVP_MD_CTX_free(mdctx);
+    return ok;
+}
+
+static void run_reference_benchmarks(void)
+{
+    static reference_state s;
+    char name[64];
+
+    for (size_t i = 0; i < sizeof(reference_schemes) / sizeof(reference_schemes[0]); i++)
+    {
+        s.scheme = &reference_schemes[i];
+        s.pkey = reference_keygen(s.scheme);
+        int available = s.pkey != NULL && bench_reference_sign(&s);
+        snprintf(name, sizeof(name), "%s.keygen", s.scheme->name);
+        add_result(name, "ops/s", available ? measure(bench_reference_keygen, &s) : 0);
+        snprintf(name, sizeof(name), "%s.sign", s.scheme->name);
+        add_result(name, "ops/s", available ? measure(bench_reference_sign, &s) : 0);
+        snprintf(name, sizeof(name), "%s.verify", s.scheme->name);
+        add_result(name, "ops/s", available ? measure(bench_reference_verify, &s) : 0);
+        EVP_PKEY_free(s.pkey);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Baseline comparison and JSON output
+// ----------------------------------------------------------------------------
+
+// Find "name": "<name>" in a results file written by this program and read the "value" after it
+static double baseline_value(const char *text, const char *name)
+{
+    char key[96];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char *entry = strstr(text, key);
+    const char *value = entry != NULL ? strstr(entry, "\"value\": ") : NULL;
+    double v;
+    if (value == NULL || sscanf(value + strlen("\"value\": "), "%lf", &v) != 1)
+    {
+        return 0;
+    }
+    return v;
+}
+
+// Returns the number of results more than threshold percent below their baseline (threshold < 0: none)
+static int compare_baseline(const char *baseline_name, double threshold)
+{
+    FILE *file = fopen(baseline_name, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open baseline file %s\n", baseline_name);
+        return -1;
+    }
+    static char text[1 << 16];
+    size_t len = fread(text, 1, sizeof(text) - 1, file);
+    text[len] = '\0';
+    fclose(file);
+
+    int regressions = 0;
+    for (int i = 0; i < num_results; i++)
+    {
+        bench_result *result = &results[i];
+        result->baseline = baseline_value(text, result->name);
+        if (result->baseline > 0 && result->value > 0)
+        {
+            double change = (result->value / result->baseline - 1) * 100;
+            result->regression = threshold >= 0 && change < -threshold;
+            regressions += result->regression;
+            if (result->regression)
+            {
+                fprintf(stderr, "Regression: %s %.1f %s, baseline %.1f (%+.1f%%)\n", result->name, result->value,
+                        result->unit, result->baseline, change);
+            }
+        }
+    }
+    return regressions;
+}
+
+static void write_json(FILE *out, int have_baseline)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"profile\": \"%s\",\n", LAMPORT_PROFILE_NAME);
+    fprintf(out, "  \"hash_kernel\": \"%s\",\n", hash_batch_kernel());
+    fprintf(out, "  \"hex_codec\": \"%s\",\n", hex_codec());
+    fprintf(out, "  \"openssl\": \"%s\",\n", OpenSSL_version(OPENSSL_VERSION));
+    fprintf(out, "  \"min_seconds\": %g,\n", min_seconds);
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < num_results; i++)
+    {
+        const bench_result *result = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.1f", result->name, result->unit, result->value);
+        if (result->value <= 0)
+        {
+            fprintf(out, ", \"available\": false");
+        }
+        if (have_baseline && result->baseline > 0 && result->value > 0)
+        {
+            fprintf(out, ", \"baseline\": %.1f, \"change_percent\": %.1f, \"regression\": %s", result->baseline,
+                    (result->value / result->baseline - 1) * 100, result->regression ? "true" : "false");
+        }
+        fprintf(out, "}%s\n", i + 1 < num_results ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output_name = NULL, *baseline_name = NULL;
+    double threshold = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Usage: %s [-s <seconds>] [-o <output.json>] [-b <baseline.json>] [-t <percent>]\n", argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-s") == 0)
+        {
+            min_seconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            output_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0)
+        {
+            baseline_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            threshold = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "Profile %s, hash kernel %s, %s\n", LAMPORT_PROFILE_NAME, hash_batch_kernel(), OpenSSL_version(OPENSSL_VERSION));
+    if (!run_lamport_benchmarks())
+    {
+        return 1;
+    }
+    run_reference_benchmarks();
+
+    int regressions = 0;
+    if (baseline_name != NULL && (regressions = compare_baseline(baseline_name, threshold)) < 0)
+    {
+        return 1;
+    }
+    FILE *out = output_name != NULL ? fopen(output_name, "w") : stdout;
+    if (out == NULL)
+    {
+        fprintf(stderr, "Error: Cannot create %s\n", output_name);
+        return 1;
+    }
+    write_json(out, baseline_name != NULL);
+    if (out != stdout && fclose(out) != 0)
+    {
+        fprintf(stderr, "Error: Cannot write %s\n", output_name);
+        return 1;
+    }
+    if (regressions > 0)
+    {
+        fprintf(stderr, "%d result(s) more than %g%% below the baseline\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
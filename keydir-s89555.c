@@ -0,0 +1,115 @@
+/*
+ * Lamport One-Time Signature Scheme
+ * Public Key Directory
+ * ==========================================================
+ * This program indexes many public key files into one directory file, in which a verifier finds a
+ * signer's key by its fingerprint with a single hash table lookup (see lamport_keydir.h).
+ * Signatures made with sign -i name their signer; verify -i <directory> resolves it.
+ *
+ * USAGE:
+ * Compile with: make keydir-s89555
+ * Run with: ./keydir-s89555 <directory file> [-m <list>] [<public key>...]
+ * The list file names one public key file per line, for more keys than fit on a command line.
+ * The directory is rebuilt from scratch and replaces the old file only once it is complete.
+ * With --stats (or LAMPORT_STATS=1) per-phase timings are printed to stderr as JSON lines at exit (see lamport_stats.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lamport_common.h"
+#include "lamport_stats.h"
+#include "lamport_keydir.h"
+
+static int add_name(char ***names, size_t *count, size_t *capacity, const char *name);
+static int read_list(const char *list_name, char ***names, size_t *count, size_t *capacity);
+
+int main(int argc, char *argv[])
+{
+    stats_init("keydir", &argc, argv);
+
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    int ok = argc >= 2;
+
+    for (int i = 2; ok && i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0)
+        {
+            ok = i + 1 < argc && read_list(argv[++i], &names, &count, &capacity);
+        }
+        else
+        {
+            ok = add_name(&names, &count, &capacity, argv[i]);
+        }
+    }
+    if (argc < 2 || (ok && count == 0))
+    {
+        fprintf(stderr, "Usage: %s <directory file> [-m <list>] [<public key>...] [--stats]\n", argv[0]);
+        free(names);
+        return 1;
+    }
+    if (ok)
+    {
+        ok = keydir_build(argv[1], names, count);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        free(names[i]);
+    }
+    free(names);
+    if (!ok)
+    {
+        return 1;
+    }
+
+    printf("Public key directory written to %s\n", argv[1]);
+    return 0;
+}
+
+static int add_name(char ***names, size_t *count, size_t *capacity, const char *name)
+{
+    if (*count == *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        char **grown = realloc(*names, new_capacity * sizeof(char *));
+        if (grown == NULL)
+        {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 0;
+        }
+        *names = grown;
+        *capacity = new_capacity;
+    }
+    size_t len = strlen(name) + 1;
+    if (((*names)[*count] = malloc(len)) == NULL)
+    {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    memcpy((*names)[(*count)++], name, len);
+    return 1;
+}
+
+// One file name per line; blank lines and lines starting with '#' are skipped
+static int read_list(const char *list_name, char ***names, size_t *count, size_t *capacity)
+{
+    FILE *file = fopen(list_name, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open key list %s\n", list_name);
+        return 0;
+    }
+    char line[4096];
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' && line[0] != '#')
+        {
+            ok = add_name(names, count, capacity, line);
+        }
+    }
+    fclose(file);
+    return ok;
+}
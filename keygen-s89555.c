@@ -8,7 +8,18 @@
  *
  * USAGE:
  * Compile with: make keygen-s89555
- * Run with: ./keygen-s89555 [-b]
+ * Run with: ./keygen-s89555 [-b] [-s] [-c]
+ * With -s the private key file holds only a 32-byte seed; the components are derived from it on demand.
+ * With -c the 32-byte compact public key (a hash over all public key components) is also written to lamport-ots.cpub.
+ * Merkle tree (many-time) keys: ./keygen-s89555 -t <height>
+ * Bulk one-time keys: ./keygen-s89555 -n <count> [-j <threads>] writes lamport-keystore.priv and lamport-keystore.pub,
+ * and a fresh lamport-keystore.alloc in which signers claim keys
+ * Winternitz one-time keys: ./keygen-s89555 -w <w> (w = 4, 16 or 256) writes lamport-wots.priv and lamport-wots.pub
+ * HORS few-time keys: ./keygen-s89555 -f <k> <t> writes lamport-hors.priv and lamport-hors.pub; the key is good for
+ * as many signatures as (k, t) allows at 128-bit security (see lamport_hors.h)
+ * Chained one-time keys: ./keygen-s89555 -x writes lamport-chain.priv and lamport-chain.pub, the fingerprint of the
+ * first key; every signature vouches for the next key (see lamport_chain.h)
+ * With --stats (or LAMPORT_STATS=1) per-phase timings are printed to stderr as JSON lines at exit (see lamport_stats.h).
  */
 
 #include <stdio.h>
@@ -18,15 +29,34 @@
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 #include <sys/stat.h>
-#include "lamport_constants.h"
+#include "lamport_common.h"
+#include "lamport_api.h"
+#include "lamport_stats.h"
+#include "lamport_hex.h"
+#include "lamport_merkle.h"
+#include "lamport_container.h"
+#include "lamport_keystore.h"
+#include "lamport_wots.h"
+#include "lamport_hors.h"
+#include "lamport_chain.h"
 
 int write_hex_file(const char *filename, int owner_only, unsigned char data[NUM_BITS][2][KEY_SIZE]);
-int write_binary_file(const char *filename, int owner_only, unsigned char data[NUM_BITS][2][KEY_SIZE]);
+int write_binary_file(const char *filename, uint16_t type, unsigned char data[NUM_BITS][2][KEY_SIZE]);
+int write_seed_file(const char *filename, const unsigned char seed[KEY_SIZE]);
+int generate_merkle_keys(const char *height_arg);
+int generate_keystore(int argc, char *argv[]);
+int generate_wots_keys(const char *w_arg);
+int generate_hors_keys(const char *k_arg, const char *t_arg);
+int generate_chain_keys(void);
 
 int main(int argc, char *argv[]) {
     unsigned char private_key[NUM_BITS][2][KEY_SIZE];
     unsigned char public_key[NUM_BITS][2][KEY_SIZE];
-    int i, j;
+    unsigned char seed[KEY_SIZE];
+    int binary = 0, seed_key = 0, compact = 0;
+    int i;
+
+    stats_init("keygen", &argc, argv);
     
     // checks whether the random number generator has been sufficiently seeded with entropy
     // Entropy is randomness from unpredictable sources like: Mouse movements, Keyboard timings etc.
@@ -34,54 +64,74 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Error: Not enough entropy for random number generation\n");
         return 1;
     }
-    
-    // Generate private key (random values)
-    for (i = 0; i < NUM_BITS; i++) {
-        for (j = 0; j < 2; j++) {
-            if (RAND_priv_bytes(private_key[i][j], KEY_SIZE) != 1) {
-                fprintf(stderr, "Error: Failed to generate random bytes\n");
-                return 1;
-            }
+
+    // Merkle tree mode: 2^height one-time keys under one root public key
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: %s -t <height>\n", argv[0]);
+            return 1;
         }
+        return generate_merkle_keys(argv[2]) ? 0 : 1;
     }
-    
-    // Generate public key (hash of private key components)
-    EVP_MD_CTX *mdctx = EVP_MD_CTX_new(); // Create new hash context
-    if (mdctx == NULL) {
-        fprintf(stderr, "Error: Failed to create hash context\n");
-        return 1;
+    // Bulk mode: N key pairs into one indexed keystore and a public key bundle
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        return generate_keystore(argc, argv) ? 0 : 1;
     }
-    
-    for (i = 0; i < NUM_BITS; i++) {
-        for (j = 0; j < 2; j++) {
-            // Initialize SHA-256 hash
-            if (EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) != 1) { 
-                fprintf(stderr, "Error: Failed to initialize hash\n");
-                EVP_MD_CTX_free(mdctx); // Free hash context
-                return 1;
-            }
-            
-            // Update hash with private key 
-            if (EVP_DigestUpdate(mdctx, private_key[i][j], KEY_SIZE) != 1) { 
-                fprintf(stderr, "Error: Failed to update hash\n");
-                EVP_MD_CTX_free(mdctx);
-                return 1;
-            }
-            
-            unsigned int hash_len;
-            // Finalize hash and store in public key
-            if (EVP_DigestFinal_ex(mdctx, public_key[i][j], &hash_len) != 1) {
-                fprintf(stderr, "Error: Failed to finalize hash\n");
-                EVP_MD_CTX_free(mdctx);
-                return 1;
-            }
+    // Winternitz mode: one W-OTS+ key pair with the given w
+    if (argc > 1 && strcmp(argv[1], "-w") == 0) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: %s -w <w>\n", argv[0]);
+            return 1;
+        }
+        return generate_wots_keys(argv[2]) ? 0 : 1;
+    }
+    // HORS mode: one few-time key pair with the given (k, t)
+    if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+        if (argc != 4) {
+            fprintf(stderr, "Usage: %s -f <k> <t>\n", argv[0]);
+            return 1;
+        }
+        return generate_hors_keys(argv[2], argv[3]) ? 0 : 1;
+    }
+    // Chain mode: the first key of a chain of one-time keys
+    if (argc > 1 && strcmp(argv[1], "-x") == 0) {
+        if (argc != 2) {
+            fprintf(stderr, "Usage: %s -x\n", argv[0]);
+            return 1;
+        }
+        return generate_chain_keys() ? 0 : 1;
+    }
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            seed_key = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            compact = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-b] [-s] [-c] | -t <height> | -n <count> [-j <threads>] | -w <w> | -f <k> <t> | -x [--stats]\n", argv[0]);
+            return 1;
         }
     }
     
-    EVP_MD_CTX_free(mdctx);
+    // Private key from a seed or random; the public key hashes all 512 components in one batch
+    if (seed_key) {
+        // Generate a 32-byte seed and expand it into the private key components
+        if (RAND_priv_bytes(seed, KEY_SIZE) != 1) {
+            fprintf(stderr, "Error: Failed to generate random bytes\n");
+            return 1;
+        }
+        if (!derive_private_components(seed, 0, 0, NUM_BITS * 2, &private_key[0][0][0]) ||
+            !lamport_public_key(NULL, &private_key[0][0][0], &public_key[0][0][0])) {
+            return 1;
+        }
+    } else if (!lamport_keygen(NULL, &private_key[0][0][0], &public_key[0][0][0])) {
+        return 1;
+    }
+    DEBUG_PRINT("Public key derived with the %s hash kernel\n", hash_batch_kernel());
 
-    // Write private key to hex file
-    if (!write_hex_file(PRIV_FILE_NAME, 1, private_key))
+    // Write private key (or only its seed) to hex file
+    if (seed_key ? !write_seed_file(PRIV_FILE_NAME, seed) : !write_hex_file(PRIV_FILE_NAME, 1, private_key))
     {
         return 1;
     }
@@ -95,15 +145,25 @@ int main(int argc, char *argv[]) {
     printf("Private key: %s\n", PRIV_FILE_NAME);
     printf("Public key: %s\n", PUB_FILE_NAME);
 
+    // Compact public key: the only thing a verifier of compact signatures needs
+    if (compact) {
+        unsigned char compact_key[HASH_SIZE];
+        if (!compact_public_key(public_key, compact_key) || !hex_write_lines(COMPACT_PUB_FILE_NAME, 0, compact_key, 1))
+        {
+            return 1;
+        }
+        printf("Compact public key: %s\n", COMPACT_PUB_FILE_NAME);
+    }
+
     // Optionally, if the -b option is provided, write binary files (not required)
-    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+    if (binary) {
         // Write private key to binary file
-        if (!write_binary_file(PRIV_BINARY_FILE_NAME, 1, private_key))
+        if (!write_binary_file(PRIV_BINARY_FILE_NAME, CONTAINER_PRIVATE_KEY, private_key))
         {
             return 1;
         }
         // Write public key to binary file
-        if (!write_binary_file(PUB_BINARY_FILE_NAME, 0, public_key))
+        if (!write_binary_file(PUB_BINARY_FILE_NAME, CONTAINER_PUBLIC_KEY, public_key))
         {
             return 1;
         }
@@ -115,64 +175,180 @@ int main(int argc, char *argv[]) {
 
 int write_hex_file(const char *filename, int owner_only, unsigned char data[NUM_BITS][2][KEY_SIZE])
 {
-    FILE *file = fopen(filename, "w");
-    if (file == NULL)
+    // Each key component becomes one 64-hex-char line; the whole file is written at once
+    return hex_write_lines(filename, owner_only, &data[0][0][0], NUM_BITS * 2);
+}
+
+// Seed private key: a single line with the 32-byte seed in hex
+int write_seed_file(const char *filename, const unsigned char seed[KEY_SIZE])
+{
+    return hex_write_lines(filename, 1, seed, 1);
+}
+
+// not required
+int write_binary_file(const char *filename, uint16_t type, unsigned char data[NUM_BITS][2][KEY_SIZE])
+{
+    // Versioned container: header, integrity tag, then the key components exactly as in memory.
+    // Private keys are readable by the owner only (600).
+    return container_write(filename, type == CONTAINER_PRIVATE_KEY, type, 0, &data[0][0][0], NUM_BITS * 2);
+}
+
+int generate_merkle_keys(const char *height_arg)
+{
+    char *end;
+    long height = strtol(height_arg, &end, 10);
+    if (*height_arg == '\0' || *end != '\0' || height < 0 || height > MSS_MAX_HEIGHT)
     {
-        fprintf(stderr, "Error: Cannot create hex file %s\n", filename);
+        fprintf(stderr, "Error: Tree height must be between 0 and %d\n", MSS_MAX_HEIGHT);
         return 0;
     }
-    // Set file permissions to 600 (read/write for owner only)
-    if (owner_only && chmod(filename, S_IRUSR | S_IWUSR) != 0)
+
+    mss_private_state state;
+    mss_public_key public_key;
+    mss_traversal traversal; // sign -t starts from the authentication path of key 0, kept on the way to the root
+    if (!mss_keygen((unsigned int)height, &state, &public_key, &traversal))
     {
-        fprintf(stderr, "Warning: Could not set secure permissions on file: %s\n", filename);
-        fclose(file);
         return 0;
     }
-    // Write each byte as two hex characters
-    for (int i = 0; i < NUM_BITS; i++)
+    int ok = write_mss_private_state(MSS_PRIV_FILE_NAME, &state, &traversal) &&
+             write_mss_public_key(MSS_PUB_FILE_NAME, &public_key);
+    OPENSSL_cleanse(&state, sizeof(state));
+    if (!ok)
+    {
+        return 0;
+    }
+
+    printf("Merkle tree key pair with %lu one-time keys generated successfully.\n", 1UL << height);
+    printf("Private key: %s\n", MSS_PRIV_FILE_NAME);
+    printf("Public key: %s\n", MSS_PUB_FILE_NAME);
+    return 1;
+}
+
+int generate_keystore(int argc, char *argv[])
+{
+    char *end = "";
+    unsigned long long count = 0;
+    long threads = 0;
+    if (argc == 3 || (argc == 5 && strcmp(argv[3], "-j") == 0))
     {
-        for (int j = 0; j < 2; j++)
+        count = strtoull(argv[2], &end, 10);
+        if (*end == '\0' && argc == 5)
         {
-            for (int k = 0; k < KEY_SIZE; k++)
-            {
-                fprintf(file, "%02x", data[i][j][k]);
-            }
-            fprintf(file, "\n");
+            threads = strtol(argv[4], &end, 10);
         }
     }
-    fclose(file);
+    if ((argc != 3 && argc != 5) || *end != '\0' || count == 0 || threads < 0)
+    {
+        fprintf(stderr, "Usage: %s -n <count> [-j <threads>]\n", argv[0]);
+        return 0;
+    }
+
+    if (!keystore_generate(KEYSTORE_PRIV_FILE_NAME, KEYSTORE_PUB_FILE_NAME, count, (int)threads))
+    {
+        return 0;
+    }
+    // New keys: none of them has been used yet
+    keystore_map keystore;
+    if (!keystore_open(KEYSTORE_PRIV_FILE_NAME, KEYSTORE_PRIVATE, &keystore))
+    {
+        return 0;
+    }
+    int ok = keystore_alloc_create(KEYSTORE_ALLOC_FILE_NAME, &keystore);
+    keystore_close(&keystore);
+    if (!ok)
+    {
+        return 0;
+    }
+    printf("%llu Lamport one-time key pairs generated successfully.\n", count);
+    printf("Private keystore: %s\n", KEYSTORE_PRIV_FILE_NAME);
+    printf("Public key bundle: %s\n", KEYSTORE_PUB_FILE_NAME);
+    printf("Key allocation file: %s\n", KEYSTORE_ALLOC_FILE_NAME);
     return 1;
 }
 
-// not required
-int write_binary_file(const char *filename, int owner_only, unsigned char data[NUM_BITS][2][KEY_SIZE])
+int generate_wots_keys(const char *w_arg)
 {
-    FILE *file = fopen(filename, "wb");
-    if (file == NULL)
+    char *end;
+    unsigned long w = strtoul(w_arg, &end, 10);
+    if (*w_arg == '\0' || *end != '\0' || w > 256)
     {
-        fprintf(stderr, "Error: Cannot create binary file %s\n", filename);
+        fprintf(stderr, "Error: Winternitz parameter must be 4, 16 or 256\n");
         return 0;
     }
-    // Set file permissions to 600 (read/write for owner only)
-    if (owner_only && chmod(filename, S_IRUSR | S_IWUSR) != 0)
+
+    // wots_keygen rejects any other w
+    wots_private_key private_key;
+    wots_public_key public_key;
+    if (!wots_keygen((unsigned int)w, &private_key, &public_key))
     {
-        fprintf(stderr, "Warning: Could not set secure permissions on file: %s\n", filename);
-        fclose(file);
         return 0;
     }
-    // Write each key component as binary data
-    for (int i = 0; i < NUM_BITS; i++)
+    int ok = write_wots_private_key(WOTS_PRIV_FILE_NAME, &private_key) && write_wots_public_key(WOTS_PUB_FILE_NAME, &public_key);
+    OPENSSL_cleanse(&private_key, sizeof(private_key));
+    if (!ok)
     {
-        for (int j = 0; j < 2; j++)
-        {
-            if (fwrite(data[i][j], sizeof(unsigned char), KEY_SIZE, file) != KEY_SIZE)
-            {
-                fprintf(stderr, "Error: Failed to write binary data to file %s\n", filename);
-                fclose(file);
-                return 0;
-            }
-        }
+        return 0;
+    }
+
+    printf("Winternitz (w = %lu) one-time signature key pair generated successfully.\n", w);
+    printf("Private key: %s\n", WOTS_PRIV_FILE_NAME);
+    printf("Public key: %s\n", WOTS_PUB_FILE_NAME);
+    return 1;
+}
+
+int generate_hors_keys(const char *k_arg, const char *t_arg)
+{
+    char *k_end, *t_end;
+    unsigned long k = strtoul(k_arg, &k_end, 10);
+    unsigned long t = strtoul(t_arg, &t_end, 10);
+    if (*k_arg == '\0' || *k_end != '\0' || *t_arg == '\0' || *t_end != '\0' || k > HORS_MAX_K)
+    {
+        fprintf(stderr, "Error: Invalid HORS parameters %s %s\n", k_arg, t_arg);
+        return 0;
+    }
+    // hors_params_init rejects any (k, t) that is not supported or allows no signature
+    hors_params params;
+    if (!hors_params_init((unsigned int)k, t, &params))
+    {
+        return 0;
+    }
+
+    hors_private_key private_key;
+    unsigned char *public_values;
+    if (!hors_keygen(&params, &private_key, &public_values))
+    {
+        return 0;
     }
-    fclose(file);
+    int ok = write_hors_private_key(HORS_PRIV_FILE_NAME, &private_key) &&
+             write_hors_public_key(HORS_PUB_FILE_NAME, &private_key, public_values);
+    OPENSSL_cleanse(&private_key, sizeof(private_key));
+    free(public_values);
+    if (!ok)
+    {
+        return 0;
+    }
+
+    printf("HORS (k = %lu, t = %lu) few-time signature key pair generated successfully.\n", k, t);
+    printf("Signatures per key: %llu\n", (unsigned long long)params.max_signatures);
+    printf("Private key: %s\n", HORS_PRIV_FILE_NAME);
+    printf("Public key: %s\n", HORS_PUB_FILE_NAME);
+    return 1;
+}
+
+int generate_chain_keys(void)
+{
+    chain_private_state state;
+    unsigned char genesis[HASH_SIZE];
+    int ok = chain_keygen(&state, genesis) && write_chain_private_state(CHAIN_PRIV_FILE_NAME, &state) &&
+             write_chain_public_key(CHAIN_PUB_FILE_NAME, genesis);
+    OPENSSL_cleanse(&state, sizeof(state));
+    if (!ok)
+    {
+        return 0;
+    }
+
+    printf("Chained one-time key generated successfully.\n");
+    printf("Private key: %s\n", CHAIN_PRIV_FILE_NAME);
+    printf("Public key: %s (the first key; signatures vouch for the next ones)\n", CHAIN_PUB_FILE_NAME);
     return 1;
 }
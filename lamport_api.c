@@ -0,0 +1,204 @@
+#include "lamport_api.h"
+#include <pthread.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#define API_MDCTX_POOL_SIZE 64       // idle digest contexts kept per lamport_ctx
+#define API_STREAM_CHUNK (64 * 1024) // bytes requested from a lamport_read_fn at a time
+
+struct lamport_ctx {
+    EVP_MD *md;
+    pthread_mutex_t lock; // guards the pool
+    EVP_MD_CTX *pool[API_MDCTX_POOL_SIZE];
+    int pool_count;
+};
+
+struct lamport_hasher {
+    lamport_ctx *ctx;
+    EVP_MD_CTX *mdctx;
+};
+
+lamport_ctx *lamport_ctx_new(void) {
+    lamport_ctx *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return NULL;
+    }
+    ctx->md = EVP_MD_fetch(NULL, LAMPORT_MD_NAME, NULL);
+    if (ctx->md == NULL) {
+        fprintf(stderr, "Error: Hash algorithm %s is not available\n", LAMPORT_MD_NAME);
+        free(ctx);
+        return NULL;
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
+    return ctx;
+}
+
+void lamport_ctx_free(lamport_ctx *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    for (int i = 0; i < ctx->pool_count; i++) {
+        EVP_MD_CTX_free(ctx->pool[i]);
+    }
+    pthread_mutex_destroy(&ctx->lock);
+    EVP_MD_free(ctx->md);
+    free(ctx);
+}
+
+const char *lamport_profile_name(void) {
+    return LAMPORT_PROFILE_NAME;
+}
+
+// Take an idle digest context initialized for H, or create one when the pool is empty
+static EVP_MD_CTX *acquire_mdctx(lamport_ctx *ctx) {
+    EVP_MD_CTX *mdctx = NULL;
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->pool_count > 0) {
+        mdctx = ctx->pool[--ctx->pool_count];
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    if (mdctx == NULL) {
+        mdctx = EVP_MD_CTX_new();
+    }
+    // Re-initializing with the same EVP_MD reuses the provider state of the previous message
+    if (mdctx == NULL || EVP_DigestInit_ex(mdctx, ctx->md, NULL) != 1) {
+        fprintf(stderr, "Error: Failed to initialize hash\n");
+        EVP_MD_CTX_free(mdctx);
+        return NULL;
+    }
+    return mdctx;
+}
+
+static void release_mdctx(lamport_ctx *ctx, EVP_MD_CTX *mdctx) {
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->pool_count < API_MDCTX_POOL_SIZE) {
+        ctx->pool[ctx->pool_count++] = mdctx;
+        mdctx = NULL;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    EVP_MD_CTX_free(mdctx);
+}
+
+int lamport_keygen(lamport_ctx *ctx, unsigned char *private_key, unsigned char *public_key) {
+    if (RAND_priv_bytes(private_key, LAMPORT_PRIVATE_KEY_BYTES) != 1) {
+        fprintf(stderr, "Error: Failed to generate random bytes\n");
+        return 0;
+    }
+    return lamport_public_key(ctx, private_key, public_key);
+}
+
+int lamport_public_key(lamport_ctx *ctx, const unsigned char *private_key, unsigned char *public_key) {
+    (void)ctx; // one-block component hashes use the batch kernels, not EVP
+    return hash_batch(private_key, public_key, NUM_BITS * 2);
+}
+
+int lamport_digest(lamport_ctx *ctx, const void *message, size_t len, unsigned char *digest) {
+    EVP_MD_CTX *mdctx = acquire_mdctx(ctx);
+    if (mdctx == NULL) {
+        return 0;
+    }
+    int ok = EVP_DigestUpdate(mdctx, message, len) == 1 && hash_final(mdctx, digest);
+    release_mdctx(ctx, mdctx);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to hash message\n");
+    }
+    return ok;
+}
+
+int lamport_digest_stream(lamport_ctx *ctx, lamport_read_fn read_fn, void *arg, unsigned char *digest) {
+    unsigned char buffer[API_STREAM_CHUNK];
+    EVP_MD_CTX *mdctx = acquire_mdctx(ctx);
+    if (mdctx == NULL) {
+        return 0;
+    }
+    ssize_t bytes_read;
+    int ok = 1;
+    while (ok && (bytes_read = read_fn(arg, buffer, sizeof(buffer))) != 0) {
+        if (bytes_read < 0) {
+            fprintf(stderr, "Error: Failed to read message\n");
+            ok = 0;
+        } else if (EVP_DigestUpdate(mdctx, buffer, (size_t)bytes_read) != 1) {
+            fprintf(stderr, "Error: Failed to update hash\n");
+            ok = 0;
+        }
+    }
+    ok = ok && hash_final(mdctx, digest);
+    release_mdctx(ctx, mdctx);
+    return ok;
+}
+
+lamport_hasher *lamport_hasher_new(lamport_ctx *ctx) {
+    lamport_hasher *hasher = malloc(sizeof(*hasher));
+    if (hasher == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return NULL;
+    }
+    hasher->ctx = ctx;
+    hasher->mdctx = acquire_mdctx(ctx);
+    if (hasher->mdctx == NULL) {
+        free(hasher);
+        return NULL;
+    }
+    return hasher;
+}
+
+int lamport_hasher_update(lamport_hasher *hasher, const void *data, size_t len) {
+    if (EVP_DigestUpdate(hasher->mdctx, data, len) != 1) {
+        fprintf(stderr, "Error: Failed to update hash\n");
+        return 0;
+    }
+    return 1;
+}
+
+int lamport_hasher_final(lamport_hasher *hasher, unsigned char *digest) {
+    if (!hash_final(hasher->mdctx, digest) || EVP_DigestInit_ex(hasher->mdctx, hasher->ctx->md, NULL) != 1) {
+        fprintf(stderr, "Error: Failed to finalize hash\n");
+        return 0;
+    }
+    return 1;
+}
+
+void lamport_hasher_free(lamport_hasher *hasher) {
+    if (hasher == NULL) {
+        return;
+    }
+    release_mdctx(hasher->ctx, hasher->mdctx);
+    free(hasher);
+}
+
+int lamport_sign_digest(lamport_ctx *ctx, const unsigned char *private_key, const unsigned char *digest, unsigned char *signature) {
+    (void)ctx;
+    for (int bit_index = 0; bit_index < NUM_BITS; bit_index++) {
+        int bit_value = (digest[bit_index / 8] >> (7 - bit_index % 8)) & 1;
+        memcpy(signature + (size_t)bit_index * KEY_SIZE, private_key + ((size_t)bit_index * 2 + bit_value) * KEY_SIZE, KEY_SIZE);
+    }
+    return 1;
+}
+
+int lamport_sign(lamport_ctx *ctx, const unsigned char *private_key, const void *message, size_t len, unsigned char *signature) {
+    unsigned char digest[HASH_SIZE];
+    return lamport_digest(ctx, message, len, digest) && lamport_sign_digest(ctx, private_key, digest, signature);
+}
+
+int lamport_sign_stream(lamport_ctx *ctx, const unsigned char *private_key, lamport_read_fn read_fn, void *arg, unsigned char *signature) {
+    unsigned char digest[HASH_SIZE];
+    return lamport_digest_stream(ctx, read_fn, arg, digest) && lamport_sign_digest(ctx, private_key, digest, signature);
+}
+
+int lamport_verify_digest(lamport_ctx *ctx, const unsigned char *public_key, const unsigned char *signature, const unsigned char *digest) {
+    (void)ctx;
+    // verify_signature only reads its arguments
+    return verify_signature((unsigned char (*)[2][KEY_SIZE])public_key, (unsigned char (*)[KEY_SIZE])signature,
+                            (unsigned char *)digest);
+}
+
+int lamport_verify(lamport_ctx *ctx, const unsigned char *public_key, const void *message, size_t len, const unsigned char *signature) {
+    unsigned char digest[HASH_SIZE];
+    return lamport_digest(ctx, message, len, digest) && lamport_verify_digest(ctx, public_key, signature, digest);
+}
+
+int lamport_verify_stream(lamport_ctx *ctx, const unsigned char *public_key, lamport_read_fn read_fn, void *arg, const unsigned char *signature) {
+    unsigned char digest[HASH_SIZE];
+    return lamport_digest_stream(ctx, read_fn, arg, digest) && lamport_verify_digest(ctx, public_key, signature, digest);
+}
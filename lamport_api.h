@@ -0,0 +1,57 @@
+#ifndef LAMPORT_API_H
+#define LAMPORT_API_H
+
+#include <sys/types.h>
+#include "lamport_common.h"
+
+// In-memory Lamport API (liblamport.a / liblamport.so)
+// ==========================================================
+// Keys and signatures are raw byte buffers in the layout of the binary containers, no files involved:
+//   private key, public key  NUM_BITS * 2 components of KEY_SIZE bytes, component [bit][bit value]
+//   signature                NUM_BITS components, the private key component selected by each digest bit
+// The digest is the profile hash H of the message (LAMPORT_PROFILE_NAME; the sizes below follow it).
+//
+// A lamport_ctx holds H fetched once from the provider and a pool of reusable digest contexts.
+// Apart from that locked pool it is read-only, so one context can be shared by any number of
+// threads for the whole life of a service. A lamport_hasher is one streaming message digest: it is
+// used by one thread at a time, and lamport_hasher_final resets it for the next message.
+// Functions that never hash a message (keygen, public_key, sign_digest, verify_digest) also accept
+// a NULL context. Functions return 1 on success (and for a valid signature) and 0 otherwise.
+
+#define LAMPORT_PRIVATE_KEY_BYTES (NUM_BITS * 2 * KEY_SIZE)
+#define LAMPORT_PUBLIC_KEY_BYTES (NUM_BITS * 2 * KEY_SIZE)
+#define LAMPORT_SIGNATURE_BYTES (NUM_BITS * KEY_SIZE)
+#define LAMPORT_DIGEST_BYTES HASH_SIZE
+
+typedef struct lamport_ctx lamport_ctx;
+typedef struct lamport_hasher lamport_hasher;
+
+// Fill buffer with up to size bytes of the message: bytes read, 0 at the end of the message, -1 on error
+typedef ssize_t (*lamport_read_fn)(void *arg, unsigned char *buffer, size_t size);
+
+lamport_ctx *lamport_ctx_new(void);
+void lamport_ctx_free(lamport_ctx *ctx);
+// The parameter profile the library was built with, e.g. "sha256"
+const char *lamport_profile_name(void);
+
+int lamport_keygen(lamport_ctx *ctx, unsigned char *private_key, unsigned char *public_key);
+// The public key of an existing private key
+int lamport_public_key(lamport_ctx *ctx, const unsigned char *private_key, unsigned char *public_key);
+
+// Message digests: one buffer, a stream pulled through a callback, or pushed piecewise through a hasher
+int lamport_digest(lamport_ctx *ctx, const void *message, size_t len, unsigned char *digest);
+int lamport_digest_stream(lamport_ctx *ctx, lamport_read_fn read_fn, void *arg, unsigned char *digest);
+lamport_hasher *lamport_hasher_new(lamport_ctx *ctx);
+int lamport_hasher_update(lamport_hasher *hasher, const void *data, size_t len);
+int lamport_hasher_final(lamport_hasher *hasher, unsigned char *digest);
+void lamport_hasher_free(lamport_hasher *hasher);
+
+int lamport_sign_digest(lamport_ctx *ctx, const unsigned char *private_key, const unsigned char *digest, unsigned char *signature);
+int lamport_sign(lamport_ctx *ctx, const unsigned char *private_key, const void *message, size_t len, unsigned char *signature);
+int lamport_sign_stream(lamport_ctx *ctx, const unsigned char *private_key, lamport_read_fn read_fn, void *arg, unsigned char *signature);
+
+int lamport_verify_digest(lamport_ctx *ctx, const unsigned char *public_key, const unsigned char *signature, const unsigned char *digest);
+int lamport_verify(lamport_ctx *ctx, const unsigned char *public_key, const void *message, size_t len, const unsigned char *signature);
+int lamport_verify_stream(lamport_ctx *ctx, const unsigned char *public_key, lamport_read_fn read_fn, void *arg, const unsigned char *signature);
+
+#endif // LAMPORT_API_H
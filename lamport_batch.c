@@ -0,0 +1,547 @@
+/*
+ * Lamport One-Time Signature Scheme
+ * Batch Verification
+ * ==========================================================
+ * Verifies many (file, signature, public key) triples in one process on a pool of worker threads.
+ * Items are split evenly between the workers; a worker that runs out of its own items steals
+ * from the tail of another worker's queue, so a few very large files do not leave threads idle.
+ * Every distinct public key file is parsed once, by whichever worker needs it first. With a public key
+ * directory each signature names its signer instead, and the workers share the read-only mapping.
+ */
+
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "lamport_batch.h"
+#include "lamport_hex.h"
+#include "lamport_digest.h"
+#include "lamport_keydir.h"
+
+typedef struct
+{
+    char *file_name;
+    pthread_mutex_t lock;
+    int state; // 0: not loaded yet, 1: loaded, -1: failed to load
+    unsigned char key[NUM_BITS][2][KEY_SIZE];
+} batch_key;
+
+typedef struct
+{
+    char *file_name;
+    char *sig_file_name;
+    size_t key_index;
+    int result; // 1: VALID, 0: INVALID
+} batch_item;
+
+typedef struct
+{
+    batch_item *items;
+    size_t num_items;
+    size_t items_capacity;
+
+    batch_key **keys;
+    size_t num_keys;
+    size_t keys_capacity;
+
+    // Open-addressing table of key file name -> index into keys, so shared keys are parsed once
+    size_t *key_table;
+    size_t key_table_size;
+
+    const keydir_map *keydir; // signer records select the keys (verify -d -i), NULL: use keys
+} batch_set;
+
+// Work-stealing queue: a worker owns items[head..tail), pops from the head, thieves take from the tail
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} work_queue;
+
+typedef struct
+{
+    batch_set *set;
+    work_queue *queues;
+    int num_workers;
+    int self;
+} worker_args;
+
+#define KEY_TABLE_EMPTY ((size_t)-1)
+
+static char *copy_string(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = malloc(len);
+    if (copy != NULL)
+    {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+static size_t hash_name(const char *name)
+{
+    size_t h = 14695981039346656037ULL; // FNV-1a
+    while (*name)
+    {
+        h = (h ^ (unsigned char)*name++) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static int grow_key_table(batch_set *set)
+{
+    size_t new_size = set->key_table_size ? set->key_table_size * 2 : 64;
+    size_t *table = malloc(new_size * sizeof(size_t));
+    if (table == NULL)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < new_size; i++)
+    {
+        table[i] = KEY_TABLE_EMPTY;
+    }
+    for (size_t k = 0; k < set->num_keys; k++)
+    {
+        size_t slot = hash_name(set->keys[k]->file_name) & (new_size - 1);
+        while (table[slot] != KEY_TABLE_EMPTY)
+        {
+            slot = (slot + 1) & (new_size - 1);
+        }
+        table[slot] = k;
+    }
+    free(set->key_table);
+    set->key_table = table;
+    set->key_table_size = new_size;
+    return 1;
+}
+
+// Return the index of the cache entry for a public key file, creating it if needed
+static int lookup_key(batch_set *set, const char *pub_file_name, size_t *key_index)
+{
+    if ((set->num_keys + 1) * 2 > set->key_table_size && !grow_key_table(set))
+    {
+        return 0;
+    }
+    size_t slot = hash_name(pub_file_name) & (set->key_table_size - 1);
+    while (set->key_table[slot] != KEY_TABLE_EMPTY)
+    {
+        if (strcmp(set->keys[set->key_table[slot]]->file_name, pub_file_name) == 0)
+        {
+            *key_index = set->key_table[slot];
+            return 1;
+        }
+        slot = (slot + 1) & (set->key_table_size - 1);
+    }
+
+    if (set->num_keys == set->keys_capacity)
+    {
+        size_t capacity = set->keys_capacity ? set->keys_capacity * 2 : 16;
+        batch_key **keys = realloc(set->keys, capacity * sizeof(batch_key *));
+        if (keys == NULL)
+        {
+            return 0;
+        }
+        set->keys = keys;
+        set->keys_capacity = capacity;
+    }
+    batch_key *key = malloc(sizeof(batch_key));
+    if (key == NULL)
+    {
+        return 0;
+    }
+    key->file_name = copy_string(pub_file_name);
+    if (key->file_name == NULL)
+    {
+        free(key);
+        return 0;
+    }
+    pthread_mutex_init(&key->lock, NULL);
+    key->state = 0;
+
+    set->keys[set->num_keys] = key;
+    set->key_table[slot] = set->num_keys;
+    *key_index = set->num_keys++;
+    return 1;
+}
+
+static int add_item(batch_set *set, const char *file_name, const char *sig_file_name, const char *pub_file_name)
+{
+    if (set->num_items == set->items_capacity)
+    {
+        size_t capacity = set->items_capacity ? set->items_capacity * 2 : 256;
+        batch_item *items = realloc(set->items, capacity * sizeof(batch_item));
+        if (items == NULL)
+        {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 0;
+        }
+        set->items = items;
+        set->items_capacity = capacity;
+    }
+    batch_item *item = &set->items[set->num_items];
+    if (!lookup_key(set, pub_file_name, &item->key_index))
+    {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    item->file_name = copy_string(file_name);
+    item->sig_file_name = copy_string(sig_file_name);
+    if (item->file_name == NULL || item->sig_file_name == NULL)
+    {
+        free(item->file_name);
+        free(item->sig_file_name);
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    item->result = 0;
+    set->num_items++;
+    return 1;
+}
+
+static void free_set(batch_set *set)
+{
+    for (size_t i = 0; i < set->num_items; i++)
+    {
+        free(set->items[i].file_name);
+        free(set->items[i].sig_file_name);
+    }
+    for (size_t k = 0; k < set->num_keys; k++)
+    {
+        pthread_mutex_destroy(&set->keys[k]->lock);
+        free(set->keys[k]->file_name);
+        free(set->keys[k]);
+    }
+    free(set->items);
+    free(set->keys);
+    free(set->key_table);
+}
+
+// Parse a public key the first time any worker needs it
+static batch_key *acquire_key(batch_set *set, size_t key_index)
+{
+    batch_key *key = set->keys[key_index];
+    pthread_mutex_lock(&key->lock);
+    if (key->state == 0)
+    {
+        key->state = read_key(key->file_name, key->key) ? 1 : -1;
+    }
+    pthread_mutex_unlock(&key->lock);
+    return key->state == 1 ? key : NULL;
+}
+
+static void verify_item(batch_set *set, batch_item *item)
+{
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    unsigned char hash[HASH_SIZE];
+    unsigned char (*public_key)[2][KEY_SIZE];
+
+    if (set->keydir != NULL)
+    {
+        unsigned char fingerprint[HASH_SIZE];
+        const unsigned char *record;
+        if (!keydir_read_signer(item->sig_file_name, fingerprint) ||
+            (record = keydir_lookup(set->keydir, fingerprint)) == NULL)
+        {
+            item->result = 0;
+            return;
+        }
+        public_key = (unsigned char (*)[2][KEY_SIZE])record;
+    }
+    else
+    {
+        batch_key *key = acquire_key(set, item->key_index);
+        if (key == NULL)
+        {
+            item->result = 0;
+            return;
+        }
+        public_key = key->key;
+    }
+    // Files are already spread over the pool, so tree digests are computed on this thread only
+    digest_params digest;
+    if (!read_signature(item->sig_file_name, signature) ||
+        !digest_read_trailer(item->sig_file_name, (off_t)NUM_BITS * HEX_LINE_SIZE, &digest))
+    {
+        item->result = 0;
+        return;
+    }
+    digest.threads = 1;
+    if (!digest_file(item->file_name, &digest, hash))
+    {
+        item->result = 0;
+        return;
+    }
+    item->result = verify_signature(public_key, signature, hash);
+}
+
+static int pop_own(work_queue *queue, size_t *index)
+{
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *index = queue->head++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static int steal(work_queue *queue, size_t *index)
+{
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *index = --queue->tail;
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_args *args = arg;
+    size_t index;
+
+    for (;;)
+    {
+        int found = pop_own(&args->queues[args->self], &index);
+        // Own queue is empty: try every other worker once, starting with the next one
+        for (int v = 1; !found && v < args->num_workers; v++)
+        {
+            found = steal(&args->queues[(args->self + v) % args->num_workers], &index);
+        }
+        if (!found)
+        {
+            break; // no queue has work left and no new work is ever added
+        }
+        verify_item(args->set, &args->set->items[index]);
+    }
+    return NULL;
+}
+
+static int run_workers(batch_set *set, int num_threads)
+{
+    if (num_threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? (int)online : 1;
+    }
+    if ((size_t)num_threads > set->num_items)
+    {
+        num_threads = set->num_items > 0 ? (int)set->num_items : 1;
+    }
+
+    work_queue *queues = calloc(num_threads, sizeof(work_queue));
+    worker_args *args = calloc(num_threads, sizeof(worker_args));
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    if (queues == NULL || args == NULL || threads == NULL)
+    {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(queues);
+        free(args);
+        free(threads);
+        return 0;
+    }
+
+    // Resolve the hash kernel and hex codec before any worker uses them
+    const char *kernel = hash_batch_kernel();
+    const char *codec = hex_codec();
+    DEBUG_PRINT("Batch verification with %d workers, %s hash kernel, %s hex codec\n", num_threads, kernel, codec);
+    (void)kernel;
+    (void)codec;
+
+    for (int t = 0; t < num_threads; t++)
+    {
+        pthread_mutex_init(&queues[t].lock, NULL);
+        queues[t].head = set->num_items * t / num_threads;
+        queues[t].tail = set->num_items * (t + 1) / num_threads;
+        args[t].set = set;
+        args[t].queues = queues;
+        args[t].num_workers = num_threads;
+        args[t].self = t;
+    }
+
+    int started = 0;
+    for (int t = 1; t < num_threads; t++)
+    {
+        if (pthread_create(&threads[t], NULL, worker_main, &args[t]) != 0)
+        {
+            fprintf(stderr, "Warning: Could only start %d worker threads\n", t);
+            break;
+        }
+        started = t;
+    }
+    worker_main(&args[0]); // the calling thread is worker 0 and steals any unstarted worker's items
+    for (int t = 1; t <= started; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    for (int t = 0; t < num_threads; t++)
+    {
+        pthread_mutex_destroy(&queues[t].lock);
+    }
+    free(queues);
+    free(args);
+    free(threads);
+    return 1;
+}
+
+// Print the per-item report in input order and return 1 if every item is VALID
+static int report(batch_set *set)
+{
+    size_t valid = 0;
+    for (size_t i = 0; i < set->num_items; i++)
+    {
+        printf("%s: %s\n", set->items[i].file_name, set->items[i].result ? "VALID" : "INVALID");
+        valid += set->items[i].result ? 1 : 0;
+    }
+    printf("%zu of %zu signatures VALID\n", valid, set->num_items);
+    return valid == set->num_items;
+}
+
+int verify_manifest(const char *manifest_name, int num_threads)
+{
+    FILE *manifest = fopen(manifest_name, "r");
+    if (manifest == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open manifest file %s\n", manifest_name);
+        return 0;
+    }
+
+    batch_set set;
+    memset(&set, 0, sizeof(set));
+    char line[4096 * 3];
+    char file_name[4096], sig_file_name[4096], pub_file_name[4096];
+    unsigned long line_number = 0;
+
+    while (fgets(line, sizeof(line), manifest) != NULL)
+    {
+        line_number++;
+        char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#')
+        {
+            continue;
+        }
+        if (sscanf(start, "%4095s %4095s %4095s", file_name, sig_file_name, pub_file_name) != 3)
+        {
+            fprintf(stderr, "Error: Invalid manifest line %lu in %s\n", line_number, manifest_name);
+            fclose(manifest);
+            free_set(&set);
+            return 0;
+        }
+        if (!add_item(&set, file_name, sig_file_name, pub_file_name))
+        {
+            fclose(manifest);
+            free_set(&set);
+            return 0;
+        }
+    }
+    fclose(manifest);
+
+    int all_valid = run_workers(&set, num_threads) && report(&set);
+    free_set(&set);
+    return all_valid;
+}
+
+// Recursively collect every file that has a matching signature file next to it
+static int collect_directory(batch_set *set, const char *dir_name, const char *pub_file_name)
+{
+    DIR *dir = opendir(dir_name);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open directory %s\n", dir_name);
+        return 0;
+    }
+
+    struct dirent *entry;
+    size_t ext_len = strlen(SIGN_EXTENSION);
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        char path[strlen(dir_name) + strlen(entry->d_name) + 2];
+        sprintf(path, "%s/%s", dir_name, entry->d_name);
+
+        // Do not descend into symlinked directories: they can loop back up the tree
+        struct stat st;
+        if (lstat(path, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || S_ISDIR(st.st_mode)))
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            if (!collect_directory(set, path, pub_file_name))
+            {
+                closedir(dir);
+                return 0;
+            }
+            continue;
+        }
+        size_t name_len = strlen(entry->d_name);
+        if (!S_ISREG(st.st_mode) || (name_len > ext_len && strcmp(entry->d_name + name_len - ext_len, SIGN_EXTENSION) == 0))
+        {
+            continue;
+        }
+
+        char sig_path[strlen(path) + ext_len + 1];
+        sprintf(sig_path, "%s%s", path, SIGN_EXTENSION);
+        if (stat(sig_path, &st) == 0 && S_ISREG(st.st_mode) && !add_item(set, path, sig_path, pub_file_name))
+        {
+            closedir(dir);
+            return 0;
+        }
+    }
+    closedir(dir);
+    return 1;
+}
+
+static int compare_items(const void *a, const void *b)
+{
+    return strcmp(((const batch_item *)a)->file_name, ((const batch_item *)b)->file_name);
+}
+
+int verify_directory(const char *dir_name, const char *pub_file_name, const char *keydir_name, int num_threads)
+{
+    batch_set set;
+    keydir_map keydir;
+    memset(&set, 0, sizeof(set));
+
+    if (keydir_name != NULL)
+    {
+        if (!keydir_open(keydir_name, &keydir))
+        {
+            return 0;
+        }
+        set.keydir = &keydir;
+    }
+    if (!collect_directory(&set, dir_name, pub_file_name))
+    {
+        free_set(&set);
+        if (set.keydir != NULL)
+        {
+            keydir_close(&keydir);
+        }
+        return 0;
+    }
+    // readdir order is arbitrary; sort so the report is stable between runs
+    qsort(set.items, set.num_items, sizeof(batch_item), compare_items);
+
+    int all_valid = run_workers(&set, num_threads) && report(&set);
+    free_set(&set);
+    if (set.keydir != NULL)
+    {
+        keydir_close(&keydir);
+    }
+    return all_valid;
+}
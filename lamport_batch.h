@@ -0,0 +1,19 @@
+#ifndef LAMPORT_BATCH_H
+#define LAMPORT_BATCH_H
+
+#include "lamport_common.h"
+
+// Default number of batch verification workers when -j is not given (0 = one per online CPU)
+#define BATCH_DEFAULT_THREADS 0
+
+// Verify every (file, signature, public key) triple listed in a manifest file.
+// Each manifest line is "<file> <signature file> <public key file>"; blank lines and
+// lines starting with '#' are ignored. Returns 1 if every entry is VALID.
+int verify_manifest(const char *manifest_name, int num_threads);
+
+// Verify every file under a directory tree that has a "<file>.sign" next to it,
+// all against the same public key file, or with keydir_name against the key that the signer record
+// of each signature selects from that public key directory. Returns 1 if every entry is VALID.
+int verify_directory(const char *dir_name, const char *pub_file_name, const char *keydir_name, int num_threads);
+
+#endif // LAMPORT_BATCH_H
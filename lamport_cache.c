@@ -0,0 +1,203 @@
+/*
+ * Persistent document digest cache
+ * ==========================================================
+ * Repeated verification of the same large, unchanged files (deploy agents re-checking artifacts on
+ * every rollout) would otherwise read and hash every byte again. The cache maps a file's identity and
+ * change times to its digest in a small mmap'd open-addressing table shared by all processes.
+ */
+
+#include "lamport_cache.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "LMPDCACH"
+#define CACHE_VERSION 2 // 2: tree digests are complemented
+#define CACHE_HEADER_SIZE 64
+#define CACHE_DIGEST_MAX 32 // entries have room for the largest profile digest
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+} cache_header;
+
+typedef struct {
+    uint64_t dev, ino, size;
+    int64_t mtime_sec, ctime_sec;
+    uint32_t mtime_nsec, ctime_nsec;
+    uint32_t kind; // profile << 8 | variant; 0 marks an empty slot
+    uint32_t reserved;
+    unsigned char digest[CACHE_DIGEST_MAX];
+    uint64_t check; // FNV-1a of everything above
+} cache_entry;
+
+#define CACHE_FILE_SIZE (CACHE_HEADER_SIZE + (size_t)DIGEST_CACHE_SLOTS * sizeof(cache_entry))
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER; // flock does not exclude threads of one process
+static int cache_fd = -1;
+static cache_entry *cache_slots = NULL;
+static int cache_strict = 0;
+
+static uint64_t entry_check(const cache_entry *entry) {
+    const unsigned char *bytes = (const unsigned char *)entry;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < offsetof(cache_entry, check); i++) {
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static size_t home_slot(uint64_t dev, uint64_t ino, uint32_t kind) {
+    uint64_t h = (dev * 0x9E3779B97F4A7C15ULL) ^ (ino * 0xC2B2AE3D27D4EB4FULL) ^ kind;
+    h ^= h >> 29;
+    return (size_t)(h % DIGEST_CACHE_SLOTS);
+}
+
+// A freshly created cache file gets its header; anything else must already be a cache of this layout
+static int prepare_file(int fd, const char *file_name) {
+    struct stat st;
+    cache_header header;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Warning: Digest cache %s is not a regular file, cache disabled\n", file_name);
+        return 0;
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        fprintf(stderr, "Warning: Digest cache %s must be owned by you and not writable by others, cache disabled\n", file_name);
+        return 0;
+    }
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.version = CACHE_VERSION;
+        header.slots = DIGEST_CACHE_SLOTS;
+        return ftruncate(fd, (off_t)CACHE_FILE_SIZE) == 0 && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    }
+    if ((size_t)st.st_size != CACHE_FILE_SIZE || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != CACHE_VERSION ||
+        header.slots != DIGEST_CACHE_SLOTS) {
+        fprintf(stderr, "Warning: %s is not a digest cache of this version, cache disabled\n", file_name);
+        return 0;
+    }
+    return 1;
+}
+
+static void open_cache(void) {
+    const char *file_name = getenv("LAMPORT_DIGEST_CACHE");
+    const char *strict = getenv("LAMPORT_DIGEST_CACHE_STRICT");
+    cache_strict = strict != NULL && *strict != '\0' && strcmp(strict, "0") != 0;
+    if (file_name == NULL || *file_name == '\0') {
+        return;
+    }
+    int fd = open(file_name, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        fprintf(stderr, "Warning: Cannot open digest cache %s, cache disabled\n", file_name);
+        return;
+    }
+    flock(fd, LOCK_EX);
+    int ok = prepare_file(fd, file_name);
+    flock(fd, LOCK_UN);
+    void *map = ok ? mmap(NULL, CACHE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    cache_fd = fd;
+    cache_slots = (cache_entry *)((unsigned char *)map + CACHE_HEADER_SIZE);
+}
+
+static int same_file(const cache_entry *entry, const struct stat *st) {
+    return entry->dev == (uint64_t)st->st_dev && entry->ino == (uint64_t)st->st_ino &&
+           entry->size == (uint64_t)st->st_size &&
+           entry->mtime_sec == (int64_t)st->st_mtim.tv_sec && entry->mtime_nsec == (uint32_t)st->st_mtim.tv_nsec &&
+           entry->ctime_sec == (int64_t)st->st_ctim.tv_sec && entry->ctime_nsec == (uint32_t)st->st_ctim.tv_nsec;
+}
+
+int digest_cache_lookup(const char *file_name, unsigned int variant, digest_cache_key *key, unsigned char hash[HASH_SIZE]) {
+    pthread_once(&cache_once, open_cache);
+    key->active = 0;
+    if (cache_slots == NULL || stat(file_name, &key->st) != 0 || !S_ISREG(key->st.st_mode)) {
+        return 0;
+    }
+    key->active = 1;
+    key->kind = (uint32_t)LAMPORT_PROFILE << 8 | (variant & 0xff);
+    clock_gettime(CLOCK_REALTIME, &key->start);
+    if (cache_strict) {
+        return 0;
+    }
+
+    int hit = 0;
+    size_t home = home_slot((uint64_t)key->st.st_dev, (uint64_t)key->st.st_ino, key->kind);
+    pthread_mutex_lock(&cache_lock);
+    flock(cache_fd, LOCK_SH);
+    for (size_t p = 0; p < DIGEST_CACHE_PROBES && !hit; p++) {
+        const cache_entry *entry = &cache_slots[(home + p) % DIGEST_CACHE_SLOTS];
+        if (entry->kind == key->kind && same_file(entry, &key->st) && entry->check == entry_check(entry)) {
+            memcpy(hash, entry->digest, HASH_SIZE);
+            hit = 1;
+        }
+    }
+    flock(cache_fd, LOCK_UN);
+    pthread_mutex_unlock(&cache_lock);
+    return hit;
+}
+
+void digest_cache_store(const char *file_name, const digest_cache_key *key, const unsigned char hash[HASH_SIZE]) {
+    struct stat st;
+    if (!key->active || stat(file_name, &st) != 0) {
+        return;
+    }
+    // Changed while it was hashed, or recently enough that a later write could keep the same times
+    if (st.st_dev != key->st.st_dev || st.st_ino != key->st.st_ino || st.st_size != key->st.st_size ||
+        st.st_mtim.tv_sec != key->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != key->st.st_mtim.tv_nsec ||
+        st.st_ctim.tv_sec != key->st.st_ctim.tv_sec || st.st_ctim.tv_nsec != key->st.st_ctim.tv_nsec ||
+        st.st_mtim.tv_sec + DIGEST_CACHE_RACY_SECONDS > key->start.tv_sec ||
+        st.st_ctim.tv_sec + DIGEST_CACHE_RACY_SECONDS > key->start.tv_sec) {
+        return;
+    }
+
+    cache_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.dev = (uint64_t)st.st_dev;
+    entry.ino = (uint64_t)st.st_ino;
+    entry.size = (uint64_t)st.st_size;
+    entry.mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    entry.mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    entry.ctime_sec = (int64_t)st.st_ctim.tv_sec;
+    entry.ctime_nsec = (uint32_t)st.st_ctim.tv_nsec;
+    entry.kind = key->kind;
+    memcpy(entry.digest, hash, HASH_SIZE);
+    entry.check = entry_check(&entry);
+
+    // Reuse this file's slot (an older version of it), else the first empty one, else evict the home slot
+    size_t home = home_slot(entry.dev, entry.ino, entry.kind);
+    pthread_mutex_lock(&cache_lock);
+    flock(cache_fd, LOCK_EX);
+    size_t target = home;
+    int found = 0;
+    for (size_t p = 0; p < DIGEST_CACHE_PROBES && !found; p++) {
+        size_t slot = (home + p) % DIGEST_CACHE_SLOTS;
+        const cache_entry *old = &cache_slots[slot];
+        if (old->kind == entry.kind && old->dev == entry.dev && old->ino == entry.ino) {
+            target = slot;
+            found = 1;
+        }
+    }
+    for (size_t p = 0; p < DIGEST_CACHE_PROBES && !found; p++) {
+        size_t slot = (home + p) % DIGEST_CACHE_SLOTS;
+        if (cache_slots[slot].kind == 0) {
+            target = slot;
+            found = 1;
+        }
+    }
+    cache_slots[target] = entry;
+    flock(cache_fd, LOCK_UN);
+    pthread_mutex_unlock(&cache_lock);
+}
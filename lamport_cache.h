@@ -0,0 +1,41 @@
+#ifndef LAMPORT_CACHE_H
+#define LAMPORT_CACHE_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "lamport_constants.h"
+
+// Persistent document digest cache (opt-in)
+// ==========================================================
+// With LAMPORT_DIGEST_CACHE=<file>, hash_file and digest_file look a regular file up by device, inode,
+// size, mtime and ctime (nanoseconds) before reading it; the key also holds the parameter profile and the
+// digest mode. The cache is a fixed table of DIGEST_CACHE_SLOTS entries that every process maps shared;
+// lookups take a shared flock, stores an exclusive one. Entries carry a checksum, so a torn write is a miss.
+// Safety rules:
+// - a digest is only stored if the file's stat is unchanged after hashing and its mtime and ctime are at
+//   least DIGEST_CACHE_RACY_SECONDS older than the start of hashing (a write within the same timestamp
+//   tick could otherwise go unnoticed)
+// - the cache file must belong to the current user and must not be writable by group or others, since
+//   anyone who can write it can make a modified file verify; otherwise it is ignored with a warning
+// LAMPORT_DIGEST_CACHE_STRICT=1 (strict mode) never trusts the cache: every file is read and hashed, and
+// the fresh digest replaces the cached one.
+
+#define DIGEST_CACHE_SLOTS 8192
+#define DIGEST_CACHE_PROBES 8
+#define DIGEST_CACHE_RACY_SECONDS 2
+
+// Filled by digest_cache_lookup and handed to digest_cache_store after a miss
+typedef struct {
+    int active; // 0: caching is off or the file cannot be cached
+    uint32_t kind;
+    struct stat st;
+    struct timespec start;
+} digest_cache_key;
+
+// variant tells digest constructions apart: 0 for plain H, chunk_log2 for the tree digest.
+// Returns 1 with the cached digest on a hit.
+int digest_cache_lookup(const char *file_name, unsigned int variant, digest_cache_key *key, unsigned char hash[HASH_SIZE]);
+void digest_cache_store(const char *file_name, const digest_cache_key *key, const unsigned char hash[HASH_SIZE]);
+
+#endif // LAMPORT_CACHE_H
@@ -0,0 +1,369 @@
+/*
+ * Chained one-time keys
+ * ==========================================================
+ * Every signature of a chain commits to the signer's next one-time key, so a verifier that was given the
+ * first key follows the signer from key to key. Its checkpoint file remembers every fingerprint it has
+ * verified, which keeps the cost of a signature at one one-time verification however far the chain grows.
+ */
+
+#include "lamport_chain.h"
+#include "lamport_hex.h"
+#include "lamport_merkle.h"
+#include "lamport_stats.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+static int derive_key_pair(const unsigned char seed[KEY_SIZE], uint64_t number,
+                           unsigned char private_key[NUM_BITS][2][KEY_SIZE],
+                           unsigned char public_key[NUM_BITS][2][KEY_SIZE]) {
+    return derive_private_components(seed, (unsigned long)number, 0, NUM_BITS * 2, &private_key[0][0][0]) &&
+           hash_batch(&private_key[0][0][0], &public_key[0][0][0], NUM_BITS * 2);
+}
+
+int chain_fingerprint(const unsigned char seed[KEY_SIZE], uint64_t number, unsigned char fingerprint[HASH_SIZE]) {
+    unsigned char private_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    int ok = derive_key_pair(seed, number, private_key, public_key) && compact_public_key(public_key, fingerprint);
+    OPENSSL_cleanse(private_key, sizeof(private_key));
+    return ok;
+}
+
+int chain_keygen(chain_private_state *state, unsigned char genesis[HASH_SIZE]) {
+    if (RAND_priv_bytes(state->seed, KEY_SIZE) != 1) {
+        fprintf(stderr, "Error: Failed to generate random bytes\n");
+        return 0;
+    }
+    state->next_key = 0;
+    return chain_fingerprint(state->seed, 0, genesis);
+}
+
+// The value signed with key i: H(0x07 || i || document digest || F_{i+1})
+static int chain_message(const chain_signature *signature, unsigned char message[HASH_SIZE]) {
+    unsigned char prefix = CHAIN_MESSAGE_PREFIX;
+    unsigned char number[8];
+    for (int i = 0; i < 8; i++) {
+        number[i] = (unsigned char)(signature->number >> (8 * i));
+    }
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = mdctx != NULL && hash_init(mdctx) && EVP_DigestUpdate(mdctx, &prefix, 1) == 1 &&
+             EVP_DigestUpdate(mdctx, number, sizeof(number)) == 1 &&
+             EVP_DigestUpdate(mdctx, signature->digest, HASH_SIZE) == 1 &&
+             EVP_DigestUpdate(mdctx, signature->next_key, HASH_SIZE) == 1 && hash_final(mdctx, message);
+    EVP_MD_CTX_free(mdctx);
+    return ok;
+}
+
+int chain_sign(const chain_private_state *state, uint64_t number, const unsigned char *digest, chain_signature *signature) {
+    unsigned char private_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char message[HASH_SIZE];
+
+    signature->number = number;
+    memcpy(signature->digest, digest, HASH_SIZE);
+    if (!chain_fingerprint(state->seed, number + 1, signature->next_key) || !chain_message(signature, message)) {
+        return 0;
+    }
+    stats_begin(STATS_COMPONENT_HASH);
+    int ok = derive_key_pair(state->seed, number, private_key, public_key);
+    stats_end(STATS_COMPONENT_HASH);
+    // Compact signature: the selected private components, then the public key halves that were not selected
+    for (int i = 0; ok && i < NUM_BITS; i++) {
+        int bit_value = (message[i / 8] >> (7 - i % 8)) & 1;
+        memcpy(signature->ots[i], private_key[i][bit_value], KEY_SIZE);
+        memcpy(signature->ots[NUM_BITS + i], public_key[i][1 - bit_value], KEY_SIZE);
+    }
+    OPENSSL_cleanse(private_key, sizeof(private_key));
+    return ok;
+}
+
+int chain_verify_link(const unsigned char fingerprint[HASH_SIZE], chain_signature *signature) {
+    unsigned char message[HASH_SIZE];
+    return chain_message(signature, message) && compact_verify(fingerprint, signature->ots, message);
+}
+
+// ----------------------------------------------------------------------------
+// Checkpoint
+// ----------------------------------------------------------------------------
+
+static int read_checkpoint_key(const chain_checkpoint *checkpoint, uint64_t number, unsigned char fingerprint[HASH_SIZE]) {
+    char line[HEX_LINE_SIZE];
+    stats_begin(STATS_KEY_LOAD);
+    int ok = pread(checkpoint->fd, line, HEX_LINE_SIZE, (off_t)number * HEX_LINE_SIZE) == HEX_LINE_SIZE &&
+             line[HEX_LINE_SIZE - 1] == '\n' && hex_decode(line, HASH_SIZE, fingerprint);
+    stats_end(STATS_KEY_LOAD);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid chain checkpoint line %llu\n", (unsigned long long)number + 1);
+    }
+    return ok;
+}
+
+// Append the next verified fingerprint; it is on disk before the verdict that relies on it is reported
+static int append_checkpoint_key(chain_checkpoint *checkpoint, const unsigned char fingerprint[HASH_SIZE]) {
+    char line[HEX_LINE_SIZE];
+    hex_encode(fingerprint, HASH_SIZE, line);
+    line[HEX_LINE_SIZE - 1] = '\n';
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = pwrite(checkpoint->fd, line, HEX_LINE_SIZE, (off_t)checkpoint->keys * HEX_LINE_SIZE) == HEX_LINE_SIZE &&
+             fsync(checkpoint->fd) == 0;
+    stats_end(STATS_OUTPUT_WRITE);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to extend the chain checkpoint\n");
+        return 0;
+    }
+    checkpoint->keys++;
+    return 1;
+}
+
+int chain_checkpoint_open(const char *file_name, const char *pub_file_name, chain_checkpoint *checkpoint) {
+    unsigned char genesis[HASH_SIZE];
+    unsigned char first[HASH_SIZE];
+    struct stat st;
+
+    if (!read_chain_public_key(pub_file_name, genesis)) {
+        return 0;
+    }
+    // The checkpoint is only ever appended to, so verifiers lock the file itself
+    checkpoint->fd = open(file_name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (checkpoint->fd < 0 || flock(checkpoint->fd, LOCK_EX) != 0 || fstat(checkpoint->fd, &st) != 0) {
+        fprintf(stderr, "Error: Cannot open chain checkpoint %s\n", file_name);
+        if (checkpoint->fd >= 0) {
+            close(checkpoint->fd);
+        }
+        return 0;
+    }
+    // A line cut off by a crash was never reported as verified; drop it
+    checkpoint->keys = (uint64_t)st.st_size / HEX_LINE_SIZE;
+    if (st.st_size % HEX_LINE_SIZE != 0 && ftruncate(checkpoint->fd, (off_t)checkpoint->keys * HEX_LINE_SIZE) != 0) {
+        fprintf(stderr, "Error: Cannot repair chain checkpoint %s\n", file_name);
+        chain_checkpoint_close(checkpoint);
+        return 0;
+    }
+    if (checkpoint->keys == 0) {
+        if (!append_checkpoint_key(checkpoint, genesis)) {
+            chain_checkpoint_close(checkpoint);
+            return 0;
+        }
+        return 1;
+    }
+    if (!read_checkpoint_key(checkpoint, 0, first)) {
+        chain_checkpoint_close(checkpoint);
+        return 0;
+    }
+    if (CRYPTO_memcmp(first, genesis, HASH_SIZE) != 0) {
+        fprintf(stderr, "Error: Chain checkpoint %s belongs to another chain than %s\n", file_name, pub_file_name);
+        chain_checkpoint_close(checkpoint);
+        return 0;
+    }
+    return 1;
+}
+
+void chain_checkpoint_close(chain_checkpoint *checkpoint) {
+    close(checkpoint->fd); // releases the lock
+    checkpoint->fd = -1;
+}
+
+// Verify the links from the newest checkpoint key up to key target
+static int walk_chain(chain_checkpoint *checkpoint, uint64_t target, chain_signature *links, size_t num_links) {
+    unsigned char fingerprint[HASH_SIZE];
+    while (checkpoint->keys <= target) {
+        uint64_t head = checkpoint->keys - 1;
+        chain_signature *link = NULL;
+        for (size_t i = 0; i < num_links && link == NULL; i++) {
+            link = links[i].number == head ? &links[i] : NULL;
+        }
+        if (link == NULL) {
+            fprintf(stderr, "Error: The chain is verified up to key %llu; signatures %llu to %llu are needed as links\n",
+                    (unsigned long long)head, (unsigned long long)head, (unsigned long long)target - 1);
+            return 0;
+        }
+        if (!read_checkpoint_key(checkpoint, head, fingerprint)) {
+            return 0;
+        }
+        if (!chain_verify_link(fingerprint, link)) {
+            fprintf(stderr, "Error: Chain signature %llu does not verify\n", (unsigned long long)head);
+            return 0;
+        }
+        if (!append_checkpoint_key(checkpoint, link->next_key)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int chain_checkpoint_verify(chain_checkpoint *checkpoint, chain_signature *signature, chain_signature *links, size_t num_links) {
+    unsigned char fingerprint[HASH_SIZE];
+    unsigned char next_key[HASH_SIZE];
+
+    if (!walk_chain(checkpoint, signature->number, links, num_links) ||
+        !read_checkpoint_key(checkpoint, signature->number, fingerprint) || !chain_verify_link(fingerprint, signature)) {
+        return 0;
+    }
+    if (signature->number + 1 == checkpoint->keys) {
+        return append_checkpoint_key(checkpoint, signature->next_key);
+    }
+    // An earlier key: a different next key means the key was used for two signatures
+    if (!read_checkpoint_key(checkpoint, signature->number + 1, next_key)) {
+        return 0;
+    }
+    if (CRYPTO_memcmp(next_key, signature->next_key, HASH_SIZE) != 0) {
+        fprintf(stderr, "Error: Signature %llu names another next key than the verified chain; key %llu was used twice\n",
+                (unsigned long long)signature->number, (unsigned long long)signature->number);
+        return 0;
+    }
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+// File formats
+// ----------------------------------------------------------------------------
+
+static int read_private_state(const char *file_name, chain_private_state *state) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    unsigned long long next_key;
+    int ok = fscanf(file, "%llu", &next_key) == 1 && fgetc(file) == '\n' && hex_fread_line(file, state->seed, KEY_SIZE) &&
+             hex_fread_profile(file, file_name) >= 0;
+    fclose(file);
+    state->next_key = ok ? (uint64_t)next_key : 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid chain private key file format\n");
+    }
+    return ok;
+}
+
+int read_chain_private_state(const char *file_name, chain_private_state *state) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_private_state(file_name, state);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+// Write the state to a temporary file, fsync it and rename it over the old one,
+// so a key is marked as used on disk before any signature made with it leaves the process
+static int write_private_state(const char *file_name, const chain_private_state *state) {
+    char tmp_name[strlen(file_name) + 5];
+    sprintf(tmp_name, "%s.tmp", file_name);
+
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create key file %s\n", tmp_name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    fprintf(file, "%llu\n", (unsigned long long)state->next_key);
+    hex_fwrite_line(file, state->seed, KEY_SIZE);
+    hex_fwrite_profile(file);
+    if (fflush(file) != 0 || fsync(fd) != 0) {
+        fprintf(stderr, "Error: Failed to write key file %s\n", tmp_name);
+        fclose(file);
+        unlink(tmp_name);
+        return 0;
+    }
+    fclose(file);
+    if (rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: Cannot replace key file %s\n", file_name);
+        unlink(tmp_name);
+        return 0;
+    }
+    return 1;
+}
+
+int write_chain_private_state(const char *file_name, const chain_private_state *state) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_private_state(file_name, state);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+int chain_claim_key(const char *file_name, chain_private_state *state, uint64_t *number) {
+    // The state file itself is replaced on every signature, so the lock lives on a companion file;
+    // concurrent signers wait for each other rather than fail
+    char lock_name[strlen(file_name) + 6];
+    sprintf(lock_name, "%s.lock", file_name);
+    int lock_fd = open(lock_name, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+        fprintf(stderr, "Error: Cannot lock %s\n", file_name);
+        if (lock_fd >= 0) {
+            close(lock_fd);
+        }
+        return 0;
+    }
+    int ok = read_chain_private_state(file_name, state);
+    if (ok) {
+        *number = state->next_key++;
+        ok = write_chain_private_state(file_name, state);
+    }
+    close(lock_fd);
+    if (!ok) {
+        OPENSSL_cleanse(state, sizeof(*state));
+    }
+    return ok;
+}
+
+int read_chain_public_key(const char *file_name, unsigned char genesis[HASH_SIZE]) {
+    return hex_read_lines(file_name, genesis, 1, "public key");
+}
+
+int write_chain_public_key(const char *file_name, const unsigned char genesis[HASH_SIZE]) {
+    return hex_write_lines(file_name, 0, genesis, 1);
+}
+
+static int read_signature_file(const char *sig_filename, chain_signature *signature, off_t *data_size) {
+    FILE *file = fopen(sig_filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open signature file %s\n", sig_filename);
+        return 0;
+    }
+    unsigned long long number;
+    int ok = fscanf(file, "%llu", &number) == 1 && fgetc(file) == '\n' && hex_fread_line(file, signature->digest, HASH_SIZE) &&
+             hex_fread_line(file, signature->next_key, HASH_SIZE);
+    for (int i = 0; ok && i < 2 * NUM_BITS; i++) {
+        ok = hex_fread_line(file, signature->ots[i], KEY_SIZE);
+    }
+    signature->number = ok ? (uint64_t)number : 0;
+    *data_size = ok ? ftello(file) : 0;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid chain signature file format: %s\n", sig_filename);
+    }
+    return ok;
+}
+
+int read_chain_signature(const char *sig_filename, chain_signature *signature, off_t *data_size) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_signature_file(sig_filename, signature, data_size);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_signature_file(const char *sig_filename, const chain_signature *signature) {
+    FILE *file = fopen(sig_filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create signature file %s\n", sig_filename);
+        return 0;
+    }
+    fprintf(file, "%llu\n", (unsigned long long)signature->number);
+    hex_fwrite_line(file, signature->digest, HASH_SIZE);
+    hex_fwrite_line(file, signature->next_key, HASH_SIZE);
+    for (int i = 0; i < 2 * NUM_BITS; i++) {
+        hex_fwrite_line(file, signature->ots[i], KEY_SIZE);
+    }
+    hex_fwrite_profile(file);
+    return fclose(file) == 0;
+}
+
+int write_chain_signature(const char *sig_filename, const chain_signature *signature) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_signature_file(sig_filename, signature);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
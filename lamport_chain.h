@@ -0,0 +1,75 @@
+#ifndef LAMPORT_CHAIN_H
+#define LAMPORT_CHAIN_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "lamport_common.h"
+
+// Chained one-time keys (keygen -x, sign -x, verify -x)
+// ==========================================================
+// Key i of a chain is Lamport one-time key i derived from a secret seed, and its fingerprint F_i is its
+// compact public key (see lamport_merkle.h). The chain public key is F_0 alone. Signature i is a compact
+// signature of key i over
+//   H(0x07 || i (8 bytes, little-endian) || document digest || F_{i+1})
+// so besides the document it authenticates the signer's next key: whoever trusts F_i can trust F_{i+1}.
+// The signature records the document digest, so a signature is also a link of the chain on its own and
+// can be checked without its document.
+//
+// A verifier keeps a checkpoint file of the fingerprints it has verified, one hex line per key: line i
+// is F_i, and line 0 must match the chain public key. Verifying signature i then costs one pread of
+// line i and one one-time signature check, however long the chain is:
+//   i < lines - 1   an earlier signature; F_{i+1} must match the next line
+//   i = lines - 1   the newest key; F_{i+1} is appended
+//   i >= lines      the signatures in between are needed as links; each is checked and appended once
+// The checkpoint is append-only and locked while a verifier uses it.
+
+// Domain separation from the Merkle, tree digest, Winternitz and HORS hashes (0x00 to 0x04, 0x06)
+// and the batch proof hashes (0x08 to 0x0a)
+#define CHAIN_MESSAGE_PREFIX 0x07
+
+typedef struct {
+    unsigned char seed[KEY_SIZE];
+    uint64_t next_key; // first one-time key that has not been used yet
+} chain_private_state;
+
+typedef struct {
+    uint64_t number;                            // the signer's key i
+    unsigned char digest[HASH_SIZE];            // document digest
+    unsigned char next_key[HASH_SIZE];          // F_{i+1}
+    unsigned char ots[2 * NUM_BITS][KEY_SIZE];  // compact signature of key i
+} chain_signature;
+
+typedef struct {
+    int fd;         // open and locked
+    uint64_t keys;  // verified fingerprints F_0 .. F_{keys-1}
+} chain_checkpoint;
+
+// A new chain; genesis receives F_0
+int chain_keygen(chain_private_state *state, unsigned char genesis[HASH_SIZE]);
+int chain_fingerprint(const unsigned char seed[KEY_SIZE], uint64_t number, unsigned char fingerprint[HASH_SIZE]);
+// Under an exclusive lock on <file_name>.lock: take the next key and write the state back (fsync and rename)
+// before the caller signs with it
+int chain_claim_key(const char *file_name, chain_private_state *state, uint64_t *number);
+int chain_sign(const chain_private_state *state, uint64_t number, const unsigned char *digest, chain_signature *signature);
+// Check a signature against the fingerprint of its key
+int chain_verify_link(const unsigned char fingerprint[HASH_SIZE], chain_signature *signature);
+
+// Open (or start from the chain public key) and lock a checkpoint file
+int chain_checkpoint_open(const char *file_name, const char *pub_file_name, chain_checkpoint *checkpoint);
+// Walk the checkpoint up to the signature with the given links (in any order), then check the signature
+// itself; returns 1 for a VALID signature. Every link and signature that verifies extends the checkpoint.
+int chain_checkpoint_verify(chain_checkpoint *checkpoint, chain_signature *signature, chain_signature *links, size_t num_links);
+void chain_checkpoint_close(chain_checkpoint *checkpoint);
+
+// Files: hex lines (see lamport_hex.h) after a decimal line
+//   private state: "next key", secret seed
+//   public key:    F_0
+//   signature:     "number", document digest, F_{number+1}, 2 * NUM_BITS compact signature lines
+int read_chain_private_state(const char *file_name, chain_private_state *state);
+int write_chain_private_state(const char *file_name, const chain_private_state *state);
+int read_chain_public_key(const char *file_name, unsigned char genesis[HASH_SIZE]);
+int write_chain_public_key(const char *file_name, const unsigned char genesis[HASH_SIZE]);
+int read_chain_signature(const char *sig_filename, chain_signature *signature, off_t *data_size);
+int write_chain_signature(const char *sig_filename, const chain_signature *signature);
+
+#endif // LAMPORT_CHAIN_H
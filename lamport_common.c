@@ -1,6 +1,47 @@
 #include "lamport_common.h"
+#include "lamport_cache.h"
+#include "lamport_hex.h"
+#include "lamport_io.h"
+#include "lamport_midstate.h"
+#include "lamport_stats.h"
+#include <stdint.h>
+#include <pthread.h>
 
-int can_read_file(const char *file_name) {
+#if LAMPORT_X86_KERNELS
+    #include <cpuid.h>
+    #include <immintrin.h>
+#endif
+
+// An explicit fetch: EVP_sha256() and friends would look the implementation up again on every init
+static EVP_MD *fetched_md = NULL;
+static pthread_once_t fetch_md_once = PTHREAD_ONCE_INIT;
+
+static void fetch_md(void) {
+    fetched_md = EVP_MD_fetch(NULL, LAMPORT_MD_NAME, NULL);
+}
+
+const EVP_MD *hash_md(void) {
+    pthread_once(&fetch_md_once, fetch_md);
+    return fetched_md;
+}
+
+int hash_init(EVP_MD_CTX *mdctx) {
+    const EVP_MD *md = hash_md();
+    return md != NULL && EVP_DigestInit_ex(mdctx, md, NULL) == 1;
+}
+
+int hash_final(EVP_MD_CTX *mdctx, unsigned char out[HASH_SIZE]) {
+    unsigned char full[EVP_MAX_MD_SIZE];
+    unsigned int hash_len;
+    if (EVP_DigestFinal_ex(mdctx, full, &hash_len) != 1 || hash_len < HASH_SIZE) {
+        return 0;
+    }
+    memcpy(out, full, HASH_SIZE);
+    stats_count(STATS_HASHES, 1);
+    return 1;
+}
+
+static int check_permissions(const char *file_name) {
     struct stat st;
     if (stat(file_name, &st) != 0) {
         fprintf(stderr, "Error: Cannot access file %s\n", file_name);
@@ -15,118 +56,925 @@ int can_read_file(const char *file_name) {
     }
 }
 
+int can_read_file(const char *file_name) {
+    stats_begin(STATS_PERMISSION_CHECK);
+    int ok = check_permissions(file_name);
+    stats_end(STATS_PERMISSION_CHECK);
+    return ok;
+}
+
 int read_key(const char *file_name, unsigned char key[NUM_BITS][2][KEY_SIZE]) {
-    FILE *file = fopen(file_name, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
-        return 0;
+    // Read key: each line contains exactly 32 bytes (64 hex chars), one read for the whole file
+    return hex_read_lines(file_name, &key[0][0][0], NUM_BITS * 2, "key");
+}
+
+// Read only the private key lines selected by the hash: line bit_index * 2 + bit_value
+int read_key_components(const char *file_name, const unsigned char *hash, unsigned char signature[NUM_BITS][KEY_SIZE]) {
+    size_t line_index[NUM_BITS];
+    for (int bit_index = 0; bit_index < NUM_BITS; bit_index++) {
+        int bit_value = (hash[bit_index / 8] >> (7 - bit_index % 8)) & 1;
+        line_index[bit_index] = (size_t)bit_index * 2 + bit_value;
     }
-    
-    char line[KEY_SIZE * 2 + 2]; // 2 hex chars per byte + newline + null terminator
-    int i, j, k;
-    
-    // Read key: each line contains exactly 32 bytes (64 hex chars)
-    for (i = 0; i < NUM_BITS; i++) {
-        for (j = 0; j < 2; j++) {
-            if (fgets(line, sizeof(line), file) == NULL) { 
-                fprintf(stderr, "Error: Invalid key file format\n");
-                fclose(file);
-                return 0;
-            }
-            
-            // Convert hex string to bytes
-            for (k = 0; k < KEY_SIZE; k++) {
-                if (sscanf(line + k * 2, "%2hhx", &key[i][j][k]) != 1) { // hh for unsigned char, %2 for two hex digits, x for hex
-                    fprintf(stderr, "Error: Invalid hex data in key file\n");
-                    fclose(file);
-                    return 0;
-                }
-            }
-        }
+    stats_begin(STATS_KEY_LOAD);
+    int ok = hex_check_profile_at(file_name, (off_t)NUM_BITS * 2 * HEX_LINE_SIZE) >= 0 &&
+             hex_pread_lines(file_name, line_index, NUM_BITS, &signature[0][0], "key");
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+// Feed one chunk from the I/O engine into the running hash
+static int hash_file_update(void *arg, const unsigned char *buffer, size_t bytes_read) {
+    DEBUG_PRINT("Read %zu bytes from file\n", bytes_read);
+    DEBUG_PRINT("File content (char):\n");
+    for (size_t i = 0; i < bytes_read; i++) {
+        DEBUG_PRINT("%c", buffer[i]); // print buffer content as characters
+    }
+    DEBUG_PRINT("\nFile content (hex):\n");
+    for (size_t i = 0; i < bytes_read; i++) {
+        DEBUG_PRINT("%02x", buffer[i]); // print buffer content in hex
+    }
+    // Update hash with buffer data
+    if (EVP_DigestUpdate((EVP_MD_CTX *)arg, buffer, bytes_read) != 1) {
+        fprintf(stderr, "Error: Failed to update hash\n");
+        return 0;
     }
-    fclose(file);
     return 1;
 }
 
-int hash_file(const char *filename, unsigned char *hash) {
-    FILE *file = fopen(filename, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Error: Cannot open file %s\n", filename);
-        return 0;
+static int hash_document(const char *filename, unsigned char *hash) {
+    // Append-only files resume from their midstate sidecar instead (LAMPORT_MIDSTATE, see lamport_midstate.h)
+    struct stat st;
+    if (midstate_enabled() && stat(filename, &st) == 0 && S_ISREG(st.st_mode)) {
+        uint64_t bytes_read;
+        int ok = midstate_hash_file(filename, hash, &bytes_read);
+        stats_count(STATS_DOCUMENT_BYTES, bytes_read);
+        return ok;
     }
-    
+
     EVP_MD_CTX *mdctx = EVP_MD_CTX_new(); // create new hash context
     if (mdctx == NULL) {
         fprintf(stderr, "Error: Failed to create hash context\n");
-        fclose(file);
         return 0;
     }
     
-    // Initialize SHA-256 hash
-    if (EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) != 1) {
+    // Initialize the profile hash
+    if (!hash_init(mdctx)) {
         fprintf(stderr, "Error: Failed to initialize hash\n");
         EVP_MD_CTX_free(mdctx);
-        fclose(file);
         return 0;
     }
     
-    unsigned char buffer[4096];
-    size_t bytes_read;
-    
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) { // read file in chunks and store in buffer
-        DEBUG_PRINT("Read %zu bytes from file\n", bytes_read);
-        DEBUG_PRINT("File content (char):\n");
-        for (size_t i = 0; i < bytes_read; i++) {
-            DEBUG_PRINT("%c", buffer[i]); // print buffer content as characters
-        }
-        DEBUG_PRINT("\nFile content (hex):\n");
-        for (size_t i = 0; i < bytes_read; i++) {
-            DEBUG_PRINT("%02x", buffer[i]); // print buffer content in hex
-        }
-        // Update hash with buffer data
-        if (EVP_DigestUpdate(mdctx, buffer, bytes_read) != 1) { 
-            fprintf(stderr, "Error: Failed to update hash\n");
-            EVP_MD_CTX_free(mdctx);
-            fclose(file);
-            return 0;
-        }
+    // The backend (mmap, large buffered reads, io_uring, ...) comes from LAMPORT_IO
+    io_stats stats;
+    if (!io_read_file(filename, io_backend_from_env(), hash_file_update, mdctx, &stats)) {
+        EVP_MD_CTX_free(mdctx);
+        return 0;
     }
     
-    unsigned int hash_len;
     // Finalize hash and store in output hash
-    if (EVP_DigestFinal_ex(mdctx, hash, &hash_len) != 1) {
+    if (!hash_final(mdctx, hash)) {
         fprintf(stderr, "Error: Failed to finalize hash\n");
         EVP_MD_CTX_free(mdctx);
-        fclose(file);
         return 0;
     }
     DEBUG_PRINT("\nFinal hash (hex):\n");
-    for (size_t i = 0; i < hash_len; i++) {
+    for (size_t i = 0; i < HASH_SIZE; i++) {
         DEBUG_PRINT("%02x", hash[i]); // print final hash in hex
     }
     DEBUG_PRINT("\n");
     
     EVP_MD_CTX_free(mdctx);
-    fclose(file);
+    stats_count(STATS_DOCUMENT_BYTES, stats.bytes);
+    io_report("hash_file", &stats);
     return 1;
 }
 
-// Optionally, read key from binary file (not required)
-int read_binary_key(const char *file_name, unsigned char key[NUM_BITS][2][KEY_SIZE])
+int hash_file(const char *filename, unsigned char *hash) {
+    digest_cache_key key;
+    stats_begin(STATS_FILE_HASH);
+    int ok = digest_cache_lookup(filename, 0, &key, hash);
+    if (!ok && (ok = hash_document(filename, hash))) {
+        digest_cache_store(filename, &key, hash);
+    }
+    stats_end(STATS_FILE_HASH);
+    return ok;
+}
+
+int read_signature(const char *sig_filename, unsigned char signature[NUM_BITS][KEY_SIZE])
+{
+    // Read signature: each line contains exactly 32 bytes (64 hex chars)
+    return hex_read_lines(sig_filename, &signature[0][0], NUM_BITS, "signature");
+}
+
+int verify_signature(unsigned char public_key[NUM_BITS][2][KEY_SIZE],
+                     unsigned char signature[NUM_BITS][KEY_SIZE],
+                     unsigned char *hash)
 {
-    FILE *file = fopen(file_name, "rb");
-    if (file == NULL)
+    unsigned char computed_hash[NUM_BITS][KEY_SIZE];
+
+    // Hash all 256 signature components in one batch
+    if (!hash_batch(&signature[0][0], &computed_hash[0][0], NUM_BITS))
     {
-        fprintf(stderr, "Error: Cannot open key binary file %s\n", file_name);
+        fprintf(stderr, "Error: Failed to hash signature components\n");
         return 0;
     }
-    // Read key from binary file
-    if (fread(key, sizeof(unsigned char), NUM_BITS * 2 * KEY_SIZE, file) != NUM_BITS * 2 * KEY_SIZE)
+    return verify_hashed_signature(public_key, computed_hash, hash);
+}
+
+int verify_hashed_signature(unsigned char public_key[NUM_BITS][2][KEY_SIZE],
+                            unsigned char computed_hash[NUM_BITS][KEY_SIZE],
+                            const unsigned char *hash)
+{
+    int i, j;
+
+    // For each bit in the hash, compare the hashed signature component with the public key
+    stats_begin(STATS_COMPARE);
+    for (i = 0; i < HASH_SIZE; i++)
     {
-        fprintf(stderr, "Error: Invalid key binary file format\n");
-        fclose(file);
+        for (j = 0; j < 8; j++)
+        {
+            int bit_index = i * 8 + j;
+            int bit_value = (hash[i] >> (7 - j)) & 1;
+            DEBUG_PRINT("Hash byte %d: %02x, using public key[%d][%d]\n", i, computed_hash[bit_index][i], bit_index, bit_value);
+
+            // Compare with the corresponding public key component
+            if (memcmp(computed_hash[bit_index], public_key[bit_index][bit_value], KEY_SIZE) != 0)
+            {
+                stats_end(STATS_COMPARE);
+                return 0; // Verification failed
+            }
+        }
+    }
+
+    stats_end(STATS_COMPARE);
+    return 1; // Verification successful
+}
+
+// The seed is a KEY_SIZE-byte AES key: AES-256 for 32-byte profiles, AES-192 for the 24-byte profile
+#if KEY_SIZE == 32
+    #define SEED_CIPHER() EVP_aes_256_ctr()
+#elif KEY_SIZE == 24
+    #define SEED_CIPHER() EVP_aes_192_ctr()
+#else
+    #error "No seed cipher for this KEY_SIZE"
+#endif
+
+// Position the CTR keystream at component: the IV counter selects the AES block, and the
+// bytes of that block before the component (24-byte components straddle blocks) are skipped
+static int seek_component(EVP_CIPHER_CTX *ctx, unsigned long key_index, size_t component) {
+    static const unsigned char zeros[16];
+    unsigned char iv[16], skipped[16];
+    uint64_t index = key_index;
+    uint64_t offset = (uint64_t)component * KEY_SIZE;
+    uint64_t block = offset / 16;
+    int out_len;
+    for (int i = 0; i < 8; i++) {
+        iv[i] = (unsigned char)(index >> (56 - 8 * i));
+        iv[8 + i] = (unsigned char)(block >> (56 - 8 * i));
+    }
+    return EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) == 1 &&
+           (offset % 16 == 0 || EVP_EncryptUpdate(ctx, skipped, &out_len, zeros, (int)(offset % 16)) == 1);
+}
+
+// Derive count private key components starting at component first (component = bit_index * 2 + bit_value)
+// of one-time key number key_index. The components are the AES-CTR keystream under the secret seed,
+// with the key index in the upper half of the IV and the block counter in the lower half, so any
+// component can be derived on its own without generating the ones before it.
+int derive_private_components(const unsigned char seed[KEY_SIZE], unsigned long key_index,
+                              size_t first, size_t count, unsigned char *out) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Failed to create cipher context\n");
+        return 0;
+    }
+    if (EVP_EncryptInit_ex(ctx, SEED_CIPHER(), NULL, seed, NULL) != 1 || !seek_component(ctx, key_index, first)) {
+        fprintf(stderr, "Error: Failed to initialize key derivation\n");
+        EVP_CIPHER_CTX_free(ctx);
+        return 0;
+    }
+    // CTR keystream = encryption of zeros
+    memset(out, 0, count * KEY_SIZE);
+    int out_len;
+    if (EVP_EncryptUpdate(ctx, out, &out_len, out, (int)(count * KEY_SIZE)) != 1) {
+        fprintf(stderr, "Error: Failed to derive private key components\n");
+        EVP_CIPHER_CTX_free(ctx);
+        return 0;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    return 1;
+}
+
+// Derive only the private key components selected by the message hash: signature[i] = private_key[i][bit i].
+// The AES key schedule is set up once; each component only changes the IV.
+static int derive_selected_components(const unsigned char seed[KEY_SIZE], unsigned long key_index,
+                                const unsigned char *hash, unsigned char signature[NUM_BITS][KEY_SIZE]) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Failed to create cipher context\n");
+        return 0;
+    }
+    if (EVP_EncryptInit_ex(ctx, SEED_CIPHER(), NULL, seed, NULL) != 1) {
+        fprintf(stderr, "Error: Failed to initialize key derivation\n");
+        EVP_CIPHER_CTX_free(ctx);
         return 0;
     }
-    fclose(file);
+
+    static const unsigned char zeros[KEY_SIZE];
+    for (int bit_index = 0; bit_index < NUM_BITS; bit_index++) {
+        int bit_value = (hash[bit_index / 8] >> (7 - bit_index % 8)) & 1;
+        int out_len;
+        if (!seek_component(ctx, key_index, (size_t)bit_index * 2 + bit_value) ||
+            EVP_EncryptUpdate(ctx, signature[bit_index], &out_len, zeros, KEY_SIZE) != 1) {
+            fprintf(stderr, "Error: Failed to derive private key components\n");
+            EVP_CIPHER_CTX_free(ctx);
+            return 0;
+        }
+    }
+    EVP_CIPHER_CTX_free(ctx);
     return 1;
-}
\ No newline at end of file
+}
+
+int derive_signature_components(const unsigned char seed[KEY_SIZE], unsigned long key_index,
+                                const unsigned char *hash, unsigned char signature[NUM_BITS][KEY_SIZE]) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = derive_selected_components(seed, key_index, hash, signature);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+// A seed private key file is a single line of KEY_SIZE hex bytes (and a profile record) instead of NUM_BITS * 2 lines
+int is_seed_key_file(const char *file_name) {
+    struct stat st;
+    return stat(file_name, &st) == 0 && st.st_size >= HEX_LINE_SIZE && st.st_size < HEX_LINE_SIZE + HEX_PROFILE_LINE_MAX;
+}
+
+int read_seed(const char *file_name, unsigned char seed[KEY_SIZE]) {
+    return hex_read_lines(file_name, seed, 1, "seed key");
+}
+
+// ----------------------------------------------------------------------------
+// Batch hashing of fixed KEY_SIZE-byte inputs
+// ----------------------------------------------------------------------------
+// Every key component is exactly one KEY_SIZE-byte message, so its hash is a single
+// compression of a block whose padding is constant. The kernels below hash many
+// such inputs at once instead of paying an EVP Init/Update/Final round-trip each.
+// Each profile compiles only its own kernels, with the message and padding words fixed:
+//   sha256, sha256-192  scalar, AVX2 (8 lanes) and SHA-NI
+//   sha512-256          scalar and AVX2 (4 lanes of 64-bit words) SHA-512 compression
+//   blake2s-256         scalar and AVX2 (8 lanes) BLAKE2s compression
+
+#define SHA256_KERNELS (LAMPORT_PROFILE == LAMPORT_PROFILE_SHA256 || LAMPORT_PROFILE == LAMPORT_PROFILE_SHA256_192)
+
+#if KEY_SIZE % 8 != 0 || KEY_SIZE > 32 || HASH_SIZE > 32
+    #error "hash_batch kernels assume components of at most 32 bytes in whole 64-bit words"
+#endif
+
+#if SHA256_KERNELS
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static uint32_t load_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void store_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define MSG_WORDS (KEY_SIZE / 4)  // message words in the single block
+#define OUT_WORDS (HASH_SIZE / 4) // state words kept (6 of 8 for sha256-192)
+
+// Portable kernel: one compression per input
+static void hash_batch_scalar(const unsigned char *in, unsigned char *out, size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        const unsigned char *msg = in + n * KEY_SIZE;
+        uint32_t w[64];
+        int t;
+
+        for (t = 0; t < MSG_WORDS; t++) {
+            w[t] = load_be32(msg + t * 4);
+        }
+        // Constant padding: 0x80 terminator, zeros, then the message length in bits
+        w[MSG_WORDS] = 0x80000000;
+        for (t = MSG_WORDS + 1; t < 15; t++) {
+            w[t] = 0;
+        }
+        w[15] = KEY_SIZE * 8;
+        for (t = 16; t < 64; t++) {
+            uint32_t s0 = ROTR32(w[t - 15], 7) ^ ROTR32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = ROTR32(w[t - 2], 17) ^ ROTR32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = sha256_iv[0], b = sha256_iv[1], c = sha256_iv[2], d = sha256_iv[3];
+        uint32_t e = sha256_iv[4], f = sha256_iv[5], g = sha256_iv[6], h = sha256_iv[7];
+        for (t = 0; t < 64; t++) {
+            uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[t] + w[t];
+            uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        const uint32_t state[8] = {a + sha256_iv[0], b + sha256_iv[1], c + sha256_iv[2], d + sha256_iv[3],
+                                   e + sha256_iv[4], f + sha256_iv[5], g + sha256_iv[6], h + sha256_iv[7]};
+        for (t = 0; t < OUT_WORDS; t++) {
+            store_be32(out + n * HASH_SIZE + t * 4, state[t]);
+        }
+    }
+}
+
+#if LAMPORT_X86_KERNELS
+
+// AVX2 kernel: eight independent messages, one per 32-bit lane
+#define V_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+__attribute__((target("avx2")))
+static void hash_batch_avx2_8(const unsigned char *in, unsigned char *out) {
+    __m256i w[64];
+    int t, lane;
+
+    for (t = 0; t < MSG_WORDS; t++) {
+        w[t] = _mm256_setr_epi32((int)load_be32(in + 0 * KEY_SIZE + t * 4), (int)load_be32(in + 1 * KEY_SIZE + t * 4),
+                                 (int)load_be32(in + 2 * KEY_SIZE + t * 4), (int)load_be32(in + 3 * KEY_SIZE + t * 4),
+                                 (int)load_be32(in + 4 * KEY_SIZE + t * 4), (int)load_be32(in + 5 * KEY_SIZE + t * 4),
+                                 (int)load_be32(in + 6 * KEY_SIZE + t * 4), (int)load_be32(in + 7 * KEY_SIZE + t * 4));
+    }
+    w[MSG_WORDS] = _mm256_set1_epi32((int)0x80000000);
+    for (t = MSG_WORDS + 1; t < 15; t++) {
+        w[t] = _mm256_setzero_si256();
+    }
+    w[15] = _mm256_set1_epi32(KEY_SIZE * 8);
+    for (t = 16; t < 64; t++) {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR(w[t - 15], 7), V_ROTR(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR(w[t - 2], 17), V_ROTR(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i a = _mm256_set1_epi32((int)sha256_iv[0]), b = _mm256_set1_epi32((int)sha256_iv[1]);
+    __m256i c = _mm256_set1_epi32((int)sha256_iv[2]), d = _mm256_set1_epi32((int)sha256_iv[3]);
+    __m256i e = _mm256_set1_epi32((int)sha256_iv[4]), f = _mm256_set1_epi32((int)sha256_iv[5]);
+    __m256i g = _mm256_set1_epi32((int)sha256_iv[6]), h = _mm256_set1_epi32((int)sha256_iv[7]);
+    for (t = 0; t < 64; t++) {
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR(e, 6), V_ROTR(e, 11)), V_ROTR(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32((int)sha256_k[t]), w[t])));
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR(a, 2), V_ROTR(a, 13)), V_ROTR(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(s0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    uint32_t state[8][8]; // [word][lane]
+    _mm256_storeu_si256((__m256i *)state[0], _mm256_add_epi32(a, _mm256_set1_epi32((int)sha256_iv[0])));
+    _mm256_storeu_si256((__m256i *)state[1], _mm256_add_epi32(b, _mm256_set1_epi32((int)sha256_iv[1])));
+    _mm256_storeu_si256((__m256i *)state[2], _mm256_add_epi32(c, _mm256_set1_epi32((int)sha256_iv[2])));
+    _mm256_storeu_si256((__m256i *)state[3], _mm256_add_epi32(d, _mm256_set1_epi32((int)sha256_iv[3])));
+    _mm256_storeu_si256((__m256i *)state[4], _mm256_add_epi32(e, _mm256_set1_epi32((int)sha256_iv[4])));
+    _mm256_storeu_si256((__m256i *)state[5], _mm256_add_epi32(f, _mm256_set1_epi32((int)sha256_iv[5])));
+    _mm256_storeu_si256((__m256i *)state[6], _mm256_add_epi32(g, _mm256_set1_epi32((int)sha256_iv[6])));
+    _mm256_storeu_si256((__m256i *)state[7], _mm256_add_epi32(h, _mm256_set1_epi32((int)sha256_iv[7])));
+    for (lane = 0; lane < 8; lane++) {
+        for (t = 0; t < OUT_WORDS; t++) {
+            store_be32(out + lane * HASH_SIZE + t * 4, state[t][lane]);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void hash_batch_avx2(const unsigned char *in, unsigned char *out, size_t count) {
+    size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        hash_batch_avx2_8(in + n * KEY_SIZE, out + n * HASH_SIZE);
+    }
+    if (n < count) {
+        hash_batch_scalar(in + n * KEY_SIZE, out + n * HASH_SIZE, count - n);
+    }
+}
+
+// SHA-NI kernel: the sha256rnds2/msg1/msg2 instructions, one message at a time
+__attribute__((target("sha,sse4.1")))
+static void hash_batch_shani(const unsigned char *in, unsigned char *out, size_t count) {
+    const __m128i bswap_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    const __m128i init_dcba = _mm_loadu_si128((const __m128i *)&sha256_iv[0]);
+    const __m128i init_hgfe = _mm_loadu_si128((const __m128i *)&sha256_iv[4]);
+    // Reorder the initial state into the ABEF/CDGH layout the instructions expect
+    __m128i tmp = _mm_shuffle_epi32(init_dcba, 0xB1);
+    __m128i iv1 = _mm_shuffle_epi32(init_hgfe, 0x1B);
+    const __m128i iv_abef = _mm_alignr_epi8(tmp, iv1, 8);
+    const __m128i iv_cdgh = _mm_blend_epi16(iv1, tmp, 0xF0);
+
+    for (size_t n = 0; n < count; n++) {
+        const unsigned char *msg = in + n * KEY_SIZE;
+        __m128i m[16];
+        int j;
+
+        m[0] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)msg), bswap_mask);
+#if KEY_SIZE == 32
+        m[1] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(msg + 16)), bswap_mask);
+        m[2] = _mm_setr_epi32((int)0x80000000, 0, 0, 0);
+#else
+        m[1] = _mm_setr_epi32((int)load_be32(msg + 16), (int)load_be32(msg + 20), (int)0x80000000, 0);
+        m[2] = _mm_setzero_si128();
+#endif
+        m[3] = _mm_setr_epi32(0, 0, 0, KEY_SIZE * 8);
+        for (j = 4; j < 16; j++) {
+            m[j] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m[j - 4], m[j - 3]),
+                                                      _mm_alignr_epi8(m[j - 1], m[j - 2], 4)),
+                                        m[j - 1]);
+        }
+
+        __m128i abef = iv_abef;
+        __m128i cdgh = iv_cdgh;
+        for (j = 0; j < 16; j++) {
+            __m128i wk = _mm_add_epi32(m[j], _mm_loadu_si128((const __m128i *)&sha256_k[j * 4]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));
+        }
+        abef = _mm_add_epi32(abef, iv_abef);
+        cdgh = _mm_add_epi32(cdgh, iv_cdgh);
+
+        // Back to DCBA/HGFE word order, then serialize big-endian
+        tmp = _mm_shuffle_epi32(abef, 0x1B);
+        cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+        __m128i dcba = _mm_blend_epi16(tmp, cdgh, 0xF0);
+        __m128i hgfe = _mm_alignr_epi8(cdgh, tmp, 8);
+        _mm_storeu_si128((__m128i *)(out + n * HASH_SIZE), _mm_shuffle_epi8(dcba, bswap_mask));
+#if HASH_SIZE == 32
+        _mm_storeu_si128((__m128i *)(out + n * HASH_SIZE + 16), _mm_shuffle_epi8(hgfe, bswap_mask));
+#else
+        _mm_storel_epi64((__m128i *)(out + n * HASH_SIZE + 16), _mm_shuffle_epi8(hgfe, bswap_mask));
+#endif
+    }
+}
+
+#endif // LAMPORT_X86_KERNELS
+
+#elif LAMPORT_PROFILE == LAMPORT_PROFILE_SHA512_256
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+// SHA-512/256 initial hash value (FIPS 180-4, 5.3.6.2)
+static const uint64_t sha512_256_iv[8] = {
+    0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL, 0x963877195940eabdULL,
+    0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL, 0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL
+};
+
+static uint64_t load_be64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void store_be64(unsigned char *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+// One 128-byte block: four message words, the 0x80 terminator, zeros and the 256-bit length
+static void hash_batch_scalar(const unsigned char *in, unsigned char *out, size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        const unsigned char *msg = in + n * KEY_SIZE;
+        uint64_t w[80];
+        int t;
+
+        for (t = 0; t < KEY_SIZE / 8; t++) {
+            w[t] = load_be64(msg + t * 8);
+        }
+        w[KEY_SIZE / 8] = 0x8000000000000000ULL;
+        for (t = KEY_SIZE / 8 + 1; t < 15; t++) {
+            w[t] = 0;
+        }
+        w[15] = KEY_SIZE * 8;
+        for (t = 16; t < 80; t++) {
+            uint64_t s0 = ROTR64(w[t - 15], 1) ^ ROTR64(w[t - 15], 8) ^ (w[t - 15] >> 7);
+            uint64_t s1 = ROTR64(w[t - 2], 19) ^ ROTR64(w[t - 2], 61) ^ (w[t - 2] >> 6);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint64_t a = sha512_256_iv[0], b = sha512_256_iv[1], c = sha512_256_iv[2], d = sha512_256_iv[3];
+        uint64_t e = sha512_256_iv[4], f = sha512_256_iv[5], g = sha512_256_iv[6], h = sha512_256_iv[7];
+        for (t = 0; t < 80; t++) {
+            uint64_t t1 = h + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) + ((e & f) ^ (~e & g)) + sha512_k[t] + w[t];
+            uint64_t t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        // SHA-512/256 keeps the first four state words
+        unsigned char *digest = out + n * HASH_SIZE;
+        store_be64(digest + 0, a + sha512_256_iv[0]);
+        store_be64(digest + 8, b + sha512_256_iv[1]);
+        store_be64(digest + 16, c + sha512_256_iv[2]);
+        store_be64(digest + 24, d + sha512_256_iv[3]);
+    }
+}
+
+#if LAMPORT_X86_KERNELS
+
+// AVX2 kernel: four independent messages, one per 64-bit lane (AVX2 has no 64-bit rotate)
+#define V_ROTR64(x, n) _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64 - (n)))
+
+__attribute__((target("avx2")))
+static void hash_batch_avx2_4(const unsigned char *in, unsigned char *out) {
+    __m256i w[80];
+    int t, lane;
+
+    for (t = 0; t < KEY_SIZE / 8; t++) {
+        w[t] = _mm256_setr_epi64x((long long)load_be64(in + 0 * KEY_SIZE + t * 8), (long long)load_be64(in + 1 * KEY_SIZE + t * 8),
+                                  (long long)load_be64(in + 2 * KEY_SIZE + t * 8), (long long)load_be64(in + 3 * KEY_SIZE + t * 8));
+    }
+    w[KEY_SIZE / 8] = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    for (t = KEY_SIZE / 8 + 1; t < 15; t++) {
+        w[t] = _mm256_setzero_si256();
+    }
+    w[15] = _mm256_set1_epi64x(KEY_SIZE * 8);
+    for (t = 16; t < 80; t++) {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR64(w[t - 15], 1), V_ROTR64(w[t - 15], 8)), _mm256_srli_epi64(w[t - 15], 7));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR64(w[t - 2], 19), V_ROTR64(w[t - 2], 61)), _mm256_srli_epi64(w[t - 2], 6));
+        w[t] = _mm256_add_epi64(_mm256_add_epi64(w[t - 16], s0), _mm256_add_epi64(w[t - 7], s1));
+    }
+
+    __m256i a = _mm256_set1_epi64x((long long)sha512_256_iv[0]), b = _mm256_set1_epi64x((long long)sha512_256_iv[1]);
+    __m256i c = _mm256_set1_epi64x((long long)sha512_256_iv[2]), d = _mm256_set1_epi64x((long long)sha512_256_iv[3]);
+    __m256i e = _mm256_set1_epi64x((long long)sha512_256_iv[4]), f = _mm256_set1_epi64x((long long)sha512_256_iv[5]);
+    __m256i g = _mm256_set1_epi64x((long long)sha512_256_iv[6]), h = _mm256_set1_epi64x((long long)sha512_256_iv[7]);
+    for (t = 0; t < 80; t++) {
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR64(e, 14), V_ROTR64(e, 18)), V_ROTR64(e, 41));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi64(_mm256_add_epi64(h, s1), _mm256_add_epi64(ch, _mm256_add_epi64(_mm256_set1_epi64x((long long)sha512_k[t]), w[t])));
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(V_ROTR64(a, 28), V_ROTR64(a, 34)), V_ROTR64(a, 39));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi64(s0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi64(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi64(t1, t2);
+    }
+
+    // SHA-512/256 keeps the first four state words
+    uint64_t state[4][4]; // [word][lane]
+    _mm256_storeu_si256((__m256i *)state[0], _mm256_add_epi64(a, _mm256_set1_epi64x((long long)sha512_256_iv[0])));
+    _mm256_storeu_si256((__m256i *)state[1], _mm256_add_epi64(b, _mm256_set1_epi64x((long long)sha512_256_iv[1])));
+    _mm256_storeu_si256((__m256i *)state[2], _mm256_add_epi64(c, _mm256_set1_epi64x((long long)sha512_256_iv[2])));
+    _mm256_storeu_si256((__m256i *)state[3], _mm256_add_epi64(d, _mm256_set1_epi64x((long long)sha512_256_iv[3])));
+    for (lane = 0; lane < 4; lane++) {
+        for (t = 0; t < 4; t++) {
+            store_be64(out + lane * HASH_SIZE + t * 8, state[t][lane]);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void hash_batch_avx2(const unsigned char *in, unsigned char *out, size_t count) {
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        hash_batch_avx2_4(in + n * KEY_SIZE, out + n * HASH_SIZE);
+    }
+    if (n < count) {
+        hash_batch_scalar(in + n * KEY_SIZE, out + n * HASH_SIZE, count - n);
+    }
+}
+
+#endif // LAMPORT_X86_KERNELS
+
+#elif LAMPORT_PROFILE == LAMPORT_PROFILE_BLAKE2S_256
+
+// BLAKE2s uses the SHA-256 initial hash value as its IV (RFC 7693)
+static const uint32_t blake2s_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const unsigned char blake2s_sigma[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}
+};
+
+static uint32_t load_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+// Parameter block: digest length HASH_SIZE, no key, fanout 1, depth 1
+static void blake2s_param_state(uint32_t h0[8]) {
+    for (int t = 0; t < 8; t++) {
+        h0[t] = blake2s_iv[t];
+    }
+    h0[0] ^= 0x01010000 | HASH_SIZE;
+}
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define BLAKE2S_G(a, b, c, d, x, y) \
+    do { \
+        a = a + b + (x); \
+        d = ROTR32(d ^ a, 16); \
+        c = c + d; \
+        b = ROTR32(b ^ c, 12); \
+        a = a + b + (y); \
+        d = ROTR32(d ^ a, 8); \
+        c = c + d; \
+        b = ROTR32(b ^ c, 7); \
+    } while (0)
+
+// One final 64-byte block: the component, zero padding, byte counter KEY_SIZE, no key
+static void hash_batch_scalar(const unsigned char *in, unsigned char *out, size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        const unsigned char *msg = in + n * KEY_SIZE;
+        uint32_t m[16] = {0}, v[16], h0[8];
+        int t;
+
+        for (t = 0; t < KEY_SIZE / 4; t++) {
+            m[t] = load_le32(msg + t * 4);
+        }
+        blake2s_param_state(h0);
+        for (t = 0; t < 8; t++) {
+            v[t] = h0[t];
+            v[t + 8] = blake2s_iv[t];
+        }
+        v[12] ^= KEY_SIZE;   // bytes hashed so far
+        v[14] ^= 0xffffffff; // last block
+        for (int r = 0; r < 10; r++) {
+            const unsigned char *s = blake2s_sigma[r];
+            BLAKE2S_G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+            BLAKE2S_G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+            BLAKE2S_G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+            BLAKE2S_G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+            BLAKE2S_G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+            BLAKE2S_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+            BLAKE2S_G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+            BLAKE2S_G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+        }
+        for (t = 0; t < HASH_SIZE / 4; t++) {
+            store_le32(out + n * HASH_SIZE + t * 4, h0[t] ^ v[t] ^ v[t + 8]);
+        }
+    }
+}
+
+#if LAMPORT_X86_KERNELS
+
+// AVX2 kernel: eight independent messages, one per 32-bit lane; the byte-aligned
+// rotations (16 and 8) are byte shuffles
+#define V_ROTR32(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+#define V_BLAKE2S_G(a, b, c, d, x, y) \
+    do { \
+        a = _mm256_add_epi32(_mm256_add_epi32(a, b), (x)); \
+        d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+        c = _mm256_add_epi32(c, d); \
+        b = V_ROTR32(_mm256_xor_si256(b, c), 12); \
+        a = _mm256_add_epi32(_mm256_add_epi32(a, b), (y)); \
+        d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+        c = _mm256_add_epi32(c, d); \
+        b = V_ROTR32(_mm256_xor_si256(b, c), 7); \
+    } while (0)
+
+__attribute__((target("avx2")))
+static void hash_batch_avx2_8(const unsigned char *in, unsigned char *out) {
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+                                          1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+    __m256i m[16], v[16];
+    uint32_t h0[8];
+    int t, lane;
+
+    for (t = 0; t < KEY_SIZE / 4; t++) {
+        m[t] = _mm256_setr_epi32((int)load_le32(in + 0 * KEY_SIZE + t * 4), (int)load_le32(in + 1 * KEY_SIZE + t * 4),
+                                 (int)load_le32(in + 2 * KEY_SIZE + t * 4), (int)load_le32(in + 3 * KEY_SIZE + t * 4),
+                                 (int)load_le32(in + 4 * KEY_SIZE + t * 4), (int)load_le32(in + 5 * KEY_SIZE + t * 4),
+                                 (int)load_le32(in + 6 * KEY_SIZE + t * 4), (int)load_le32(in + 7 * KEY_SIZE + t * 4));
+    }
+    for (t = KEY_SIZE / 4; t < 16; t++) {
+        m[t] = _mm256_setzero_si256();
+    }
+    blake2s_param_state(h0);
+    for (t = 0; t < 8; t++) {
+        v[t] = _mm256_set1_epi32((int)h0[t]);
+        v[t + 8] = _mm256_set1_epi32((int)blake2s_iv[t]);
+    }
+    v[12] = _mm256_set1_epi32((int)(blake2s_iv[4] ^ KEY_SIZE));  // bytes hashed so far
+    v[14] = _mm256_set1_epi32((int)(blake2s_iv[6] ^ 0xffffffff)); // last block
+    for (int r = 0; r < 10; r++) {
+        const unsigned char *s = blake2s_sigma[r];
+        V_BLAKE2S_G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        V_BLAKE2S_G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        V_BLAKE2S_G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        V_BLAKE2S_G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        V_BLAKE2S_G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        V_BLAKE2S_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        V_BLAKE2S_G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        V_BLAKE2S_G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    uint32_t state[8][8]; // [word][lane]
+    for (t = 0; t < HASH_SIZE / 4; t++) {
+        _mm256_storeu_si256((__m256i *)state[t],
+                            _mm256_xor_si256(_mm256_set1_epi32((int)h0[t]), _mm256_xor_si256(v[t], v[t + 8])));
+    }
+    for (lane = 0; lane < 8; lane++) {
+        for (t = 0; t < HASH_SIZE / 4; t++) {
+            store_le32(out + lane * HASH_SIZE + t * 4, state[t][lane]);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void hash_batch_avx2(const unsigned char *in, unsigned char *out, size_t count) {
+    size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        hash_batch_avx2_8(in + n * KEY_SIZE, out + n * HASH_SIZE);
+    }
+    if (n < count) {
+        hash_batch_scalar(in + n * KEY_SIZE, out + n * HASH_SIZE, count - n);
+    }
+}
+
+#endif // LAMPORT_X86_KERNELS
+
+#endif // profile kernels
+
+#if LAMPORT_X86_KERNELS
+
+int cpu_has_avx2(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+        return 0;
+    }
+    // The OS must save YMM state on context switch (XCR0 bits 1 and 2)
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6) {
+        return 0;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ebx & bit_AVX2) != 0;
+}
+
+int cpu_has_shani(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return 0;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ebx & (1u << 29)) != 0; // CPUID.(EAX=7,ECX=0):EBX.SHA[bit 29]
+}
+
+int cpu_has_ssse3(void) {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3);
+}
+
+#else
+
+int cpu_has_avx2(void) {
+    return 0;
+}
+
+int cpu_has_shani(void) {
+    return 0;
+}
+
+int cpu_has_ssse3(void) {
+    return 0;
+}
+
+#endif // LAMPORT_X86_KERNELS
+
+typedef void (*hash_batch_fn)(const unsigned char *in, unsigned char *out, size_t count);
+
+static hash_batch_fn batch_kernel = NULL;
+static const char *batch_kernel_name = NULL;
+static pthread_once_t select_batch_kernel_once = PTHREAD_ONCE_INIT; // library callers hash from many threads
+
+// Pick the fastest kernel the CPU supports; LAMPORT_HASH_KERNEL=scalar|avx2|shani forces one
+static void select_batch_kernel(void) {
+    const char *forced = getenv("LAMPORT_HASH_KERNEL");
+
+    batch_kernel = hash_batch_scalar;
+    batch_kernel_name = "scalar";
+    if (forced != NULL && strcmp(forced, "scalar") == 0) {
+        return;
+    }
+#if LAMPORT_X86_KERNELS && SHA256_KERNELS
+    int shani = cpu_has_shani();
+    int avx2 = cpu_has_avx2();
+    if (forced != NULL && strcmp(forced, "avx2") == 0) {
+        shani = 0;
+    } else if (forced != NULL && strcmp(forced, "shani") == 0) {
+        avx2 = 0;
+    }
+    if (shani) {
+        batch_kernel = hash_batch_shani;
+        batch_kernel_name = "shani";
+    } else if (avx2) {
+        batch_kernel = hash_batch_avx2;
+        batch_kernel_name = "avx2";
+    }
+#elif LAMPORT_X86_KERNELS
+    // No SHA-NI for these hashes: "shani" leaves the scalar kernel
+    if (cpu_has_avx2() && (forced == NULL || strcmp(forced, "shani") != 0)) {
+        batch_kernel = hash_batch_avx2;
+        batch_kernel_name = "avx2";
+    }
+#endif
+}
+
+const char *hash_batch_kernel(void) {
+    pthread_once(&select_batch_kernel_once, select_batch_kernel);
+    return batch_kernel_name;
+}
+
+int hash_batch(const unsigned char *in, unsigned char *out, size_t count) {
+    pthread_once(&select_batch_kernel_once, select_batch_kernel);
+    stats_begin(STATS_COMPONENT_HASH);
+    batch_kernel(in, out, count);
+    stats_end(STATS_COMPONENT_HASH);
+    stats_count(STATS_HASHES, count);
+    return 1;
+}
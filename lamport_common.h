@@ -8,9 +8,57 @@
 #include <sys/stat.h>
 #include "lamport_constants.h"
 
+// SIMD kernels are only built for x86 with GCC/Clang intrinsics
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define LAMPORT_X86_KERNELS 1
+#else
+    #define LAMPORT_X86_KERNELS 0
+#endif
+
+// The profile hash function H (see lamport_constants.h), as an OpenSSL algorithm name
+#if LAMPORT_PROFILE == LAMPORT_PROFILE_SHA512_256
+    #define LAMPORT_MD_NAME "SHA2-512/256"
+#elif LAMPORT_PROFILE == LAMPORT_PROFILE_BLAKE2S_256
+    #define LAMPORT_MD_NAME "BLAKE2S-256"
+#else
+    #define LAMPORT_MD_NAME "SHA2-256"
+#endif
+
+// H, fetched from the default provider once per process (NULL if it is unavailable)
+const EVP_MD *hash_md(void);
+// Start H on a context, and finish it into HASH_SIZE bytes (the 192-bit profile keeps the first 24)
+int hash_init(EVP_MD_CTX *mdctx);
+int hash_final(EVP_MD_CTX *mdctx, unsigned char out[HASH_SIZE]);
+
 int can_read_file(const char *file_name);
 int read_key(const char *file_name, unsigned char key[NUM_BITS][2][KEY_SIZE]);
-int read_binary_key(const char *file_name, unsigned char key[NUM_BITS][2][KEY_SIZE]);
+int read_key_components(const char *file_name, const unsigned char *hash, unsigned char signature[NUM_BITS][KEY_SIZE]);
 int hash_file(const char *filename, unsigned char *hash);
+int read_signature(const char *sig_filename, unsigned char signature[NUM_BITS][KEY_SIZE]);
+int verify_signature(unsigned char public_key[NUM_BITS][2][KEY_SIZE],
+                     unsigned char signature[NUM_BITS][KEY_SIZE],
+                     unsigned char *hash);
+// The comparison half of verify_signature, for callers that hashed the signature components themselves
+int verify_hashed_signature(unsigned char public_key[NUM_BITS][2][KEY_SIZE],
+                            unsigned char computed_hash[NUM_BITS][KEY_SIZE],
+                            const unsigned char *hash);
+
+// Derive private key components [first, first + count) of one-time key key_index from a secret seed
+int derive_private_components(const unsigned char seed[KEY_SIZE], unsigned long key_index,
+                              size_t first, size_t count, unsigned char *out);
+// Derive the NUM_BITS components selected by a message hash, without deriving the other half
+int derive_signature_components(const unsigned char seed[KEY_SIZE], unsigned long key_index,
+                                const unsigned char *hash, unsigned char signature[NUM_BITS][KEY_SIZE]);
+int is_seed_key_file(const char *file_name);
+int read_seed(const char *file_name, unsigned char seed[KEY_SIZE]);
+
+// Hash count contiguous KEY_SIZE-byte inputs into count contiguous HASH_SIZE-byte digests
+int hash_batch(const unsigned char *in, unsigned char *out, size_t count);
+const char *hash_batch_kernel(void);
+
+// Runtime CPU feature checks (always 0 on non-x86 builds)
+int cpu_has_avx2(void);
+int cpu_has_shani(void);
+int cpu_has_ssse3(void);
 
 #endif // LAMPORT_COMMON_H
\ No newline at end of file
@@ -1,20 +1,86 @@
 #ifndef LAMPORT_CONSTANTS_H
 #define LAMPORT_CONSTANTS_H
 
+// Parameter profiles, chosen at build time (make PROFILE=<name>, see the Makefile)
+// ==========================================================
+// profile      hash function H                component  message digest
+// sha256       SHA-256                        32 bytes   256 bits (default)
+// sha512-256   SHA-512/256                    32 bytes   256 bits
+// blake2s-256  BLAKE2s-256                    32 bytes   256 bits
+// sha256-192   SHA-256 truncated to 24 bytes  24 bytes   192 bits
+// H is used for everything a signature depends on: the document digest, public key components,
+// Merkle nodes, tree digests and Winternitz chains. Files written by a non-default profile record it
+// (see lamport_hex.h); binary containers and keystores record it in their hash algorithm field.
+#define LAMPORT_PROFILE_SHA256 1
+#define LAMPORT_PROFILE_SHA512_256 2
+#define LAMPORT_PROFILE_BLAKE2S_256 3
+#define LAMPORT_PROFILE_SHA256_192 4
+
+#ifndef LAMPORT_PROFILE
+    #define LAMPORT_PROFILE LAMPORT_PROFILE_SHA256
+#endif
+
+#if LAMPORT_PROFILE == LAMPORT_PROFILE_SHA256
+    #define LAMPORT_PROFILE_NAME "sha256"
+    #define HASH_SIZE 32
+#elif LAMPORT_PROFILE == LAMPORT_PROFILE_SHA512_256
+    #define LAMPORT_PROFILE_NAME "sha512-256"
+    #define HASH_SIZE 32
+#elif LAMPORT_PROFILE == LAMPORT_PROFILE_BLAKE2S_256
+    #define LAMPORT_PROFILE_NAME "blake2s-256"
+    #define HASH_SIZE 32
+#elif LAMPORT_PROFILE == LAMPORT_PROFILE_SHA256_192
+    #define LAMPORT_PROFILE_NAME "sha256-192"
+    #define HASH_SIZE 24
+#else
+    #error "Unknown LAMPORT_PROFILE"
+#endif
+#define LAMPORT_DEFAULT_PROFILE_NAME "sha256" // files without a profile record
+
 // Lamport One-Time Signature Constants
-#define HASH_SIZE 32   // SHA-256 produces 32 bytes
-#define KEY_SIZE 32    // 32 bytes per key component
-#define NUM_BITS 256   // 256 bits in SHA-256 hash
+#define KEY_SIZE HASH_SIZE       // bytes per key component
+#define NUM_BITS (HASH_SIZE * 8) // bits in the message digest
 
 // File names for key storage
 #define PRIV_FILE_NAME "lamport-ots.priv"
 #define PUB_FILE_NAME "lamport-ots.pub"
 #define PRIV_BINARY_FILE_NAME "lamport-ots.bin.priv" // not required, only for understanding purpose
 #define PUB_BINARY_FILE_NAME "lamport-ots.bin.pub" // not required, only for understanding purpose
+#define COMPACT_PUB_FILE_NAME "lamport-ots.cpub" // 32-byte hash of the full public key (keygen -c)
+
+// File names for Merkle tree (many-time) key storage
+#define MSS_PRIV_FILE_NAME "lamport-mss.priv"
+#define MSS_PUB_FILE_NAME "lamport-mss.pub"
+#define MSS_MAX_HEIGHT 20 // at most 2^20 one-time keys under one root
+
+// Bulk keystore (keygen -n): many one-time key pairs in one indexed file plus a public key bundle
+#define KEYSTORE_PRIV_FILE_NAME "lamport-keystore.priv"
+#define KEYSTORE_PUB_FILE_NAME "lamport-keystore.pub"
+#define KEYSTORE_ALLOC_FILE_NAME "lamport-keystore.alloc" // used-key bitmap shared by all signers (sign -k)
+
+// Winternitz (W-OTS+) one-time key pair (keygen -w)
+#define WOTS_PRIV_FILE_NAME "lamport-wots.priv"
+#define WOTS_PUB_FILE_NAME "lamport-wots.pub"
+
+// HORS few-time key pair (keygen -f); the private key file also counts the signatures made with it
+#define HORS_PRIV_FILE_NAME "lamport-hors.priv"
+#define HORS_PUB_FILE_NAME "lamport-hors.pub"
+
+// Chained one-time keys (keygen -x): each signature vouches for the signer's next key
+#define CHAIN_PRIV_FILE_NAME "lamport-chain.priv"
+#define CHAIN_PUB_FILE_NAME "lamport-chain.pub"
+#define CHAIN_CHECKPOINT_FILE_NAME "lamport-chain.verified" // fingerprints a verifier has verified (verify -x)
+
+// Signing daemon (signs with the Merkle tree key)
+#define SIGND_SOCKET_NAME "lamport-signd.sock"
+#define SIGND_DEFAULT_POOL_SIZE 64 // prepared one-time keys kept in locked memory
+#define SIGND_MAX_CLIENTS 64       // connections served at the same time
 
 // Signature file extension
 #define SIGN_EXTENSION ".sign"
 #define SIGN_BINARY_EXTENSION ".bin.sign" // not required, only for understanding purpose
+#define PROOF_EXTENSION ".proof" // inclusion proof of a batch-signed file (sign -r)
+#define MIDSTATE_EXTENSION ".midstate" // resumable hash state of an append-only file (LAMPORT_MIDSTATE=1)
 
 // Debug mode control
 #define DEBUG_MODE 0 // 1: enable debug output, 0: disable
@@ -0,0 +1,192 @@
+#include "lamport_container.h"
+#include "lamport_common.h"
+#include "lamport_stats.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <openssl/crypto.h>
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint16_t get_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Tag = SHA-256(header fields || payload); the tag field itself is not covered
+static int compute_tag(const unsigned char *header, const unsigned char *payload, size_t payload_size, unsigned char tag[CONTAINER_TAG_SIZE]) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    if (mdctx == NULL) {
+        fprintf(stderr, "Error: Failed to create hash context\n");
+        return 0;
+    }
+    unsigned int hash_len;
+    if (EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) != 1 ||
+        EVP_DigestUpdate(mdctx, header, 32) != 1 ||
+        EVP_DigestUpdate(mdctx, payload, payload_size) != 1 ||
+        EVP_DigestFinal_ex(mdctx, tag, &hash_len) != 1) {
+        fprintf(stderr, "Error: Failed to compute container tag\n");
+        EVP_MD_CTX_free(mdctx);
+        return 0;
+    }
+    EVP_MD_CTX_free(mdctx);
+    return 1;
+}
+
+static int write_container(const char *file_name, int owner_only, uint16_t type, uint16_t flags,
+                    const unsigned char *payload, uint32_t num_components) {
+    size_t payload_size = (size_t)num_components * KEY_SIZE;
+    size_t size = CONTAINER_HEADER_SIZE + payload_size;
+    unsigned char *buffer = calloc(1, size);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+
+    memcpy(buffer, CONTAINER_MAGIC, 4);
+    put_le16(buffer + 4, CONTAINER_VERSION);
+    put_le16(buffer + 6, LAMPORT_PROFILE);
+    put_le16(buffer + 8, type);
+    put_le16(buffer + 10, flags);
+    put_le16(buffer + 12, KEY_SIZE);
+    put_le32(buffer + 16, num_components);
+    put_le64(buffer + 24, payload_size);
+    memcpy(buffer + CONTAINER_HEADER_SIZE, payload, payload_size);
+    if (!compute_tag(buffer, buffer + CONTAINER_HEADER_SIZE, payload_size, buffer + 32)) {
+        OPENSSL_cleanse(buffer, size);
+        free(buffer);
+        return 0;
+    }
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, owner_only ? (S_IRUSR | S_IWUSR) : 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create binary file %s\n", file_name);
+        OPENSSL_cleanse(buffer, size);
+        free(buffer);
+        return 0;
+    }
+    // Set file permissions to 600 (read/write for owner only), also when the file already existed
+    int ok = !owner_only || fchmod(fd, S_IRUSR | S_IWUSR) == 0;
+    if (!ok) {
+        fprintf(stderr, "Warning: Could not set secure permissions on file: %s\n", file_name);
+    }
+    size_t done = 0;
+    while (ok && done < size) {
+        ssize_t n = write(fd, buffer + done, size - done);
+        if (n <= 0) {
+            fprintf(stderr, "Error: Failed to write binary data to file %s\n", file_name);
+            ok = 0;
+        } else {
+            done += (size_t)n;
+        }
+    }
+    close(fd);
+    OPENSSL_cleanse(buffer, size);
+    free(buffer);
+    return ok;
+}
+
+int container_write(const char *file_name, int owner_only, uint16_t type, uint16_t flags,
+                    const unsigned char *payload, uint32_t num_components) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_container(file_name, owner_only, type, flags, payload, num_components);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+static int open_container(const char *file_name, uint16_t type, uint32_t num_components, container_map *map) {
+    memset(map, 0, sizeof(*map));
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open binary file %s\n", file_name);
+        return 0;
+    }
+    struct stat st;
+    size_t expected = CONTAINER_HEADER_SIZE + (size_t)num_components * KEY_SIZE;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected) {
+        fprintf(stderr, "Error: Invalid binary file format %s\n", file_name);
+        close(fd);
+        return 0;
+    }
+    void *base = mmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map binary file %s\n", file_name);
+        return 0;
+    }
+
+    const unsigned char *header = base;
+    unsigned char tag[CONTAINER_TAG_SIZE];
+    const char *problem = NULL;
+    if (memcmp(header, CONTAINER_MAGIC, 4) != 0) {
+        problem = "not a Lamport binary file";
+    } else if (get_le16(header + 4) != CONTAINER_VERSION) {
+        problem = "unsupported format version";
+    } else if (get_le16(header + 6) != LAMPORT_PROFILE || get_le16(header + 12) != KEY_SIZE) {
+        problem = "written with a different parameter profile (this build: " LAMPORT_PROFILE_NAME ")";
+    } else if (get_le16(header + 8) != type) {
+        problem = "wrong content type";
+    } else if (get_le32(header + 16) != num_components || get_le64(header + 24) != (uint64_t)num_components * KEY_SIZE) {
+        problem = "wrong number of components";
+    } else if (!compute_tag(header, header + CONTAINER_HEADER_SIZE, (size_t)num_components * KEY_SIZE, tag) ||
+               CRYPTO_memcmp(tag, header + 32, CONTAINER_TAG_SIZE) != 0) {
+        problem = "integrity check failed";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: Invalid binary file %s: %s\n", file_name, problem);
+        munmap(base, expected);
+        return 0;
+    }
+
+    map->base = base;
+    map->size = expected;
+    map->payload = header + CONTAINER_HEADER_SIZE;
+    map->num_components = num_components;
+    map->type = type;
+    map->flags = get_le16(header + 10);
+    return 1;
+}
+
+int container_open(const char *file_name, uint16_t type, uint32_t num_components, container_map *map) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = open_container(file_name, type, num_components, map);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+void container_close(container_map *map) {
+    if (map->base != NULL) {
+        munmap(map->base, map->size);
+    }
+    memset(map, 0, sizeof(*map));
+}
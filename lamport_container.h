@@ -0,0 +1,52 @@
+#ifndef LAMPORT_CONTAINER_H
+#define LAMPORT_CONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lamport_constants.h"
+
+// Binary container for keys and signatures (-b files)
+// ==========================================================
+// offset  size  field
+//      0     4  magic "LOTS"
+//      4     2  format version
+//      6     2  hash algorithm: the parameter profile (LAMPORT_PROFILE_*, see lamport_constants.h)
+//      8     2  content type (CONTAINER_*)
+//     10     2  flags (signatures: digest mode, see lamport_digest.h; otherwise 0)
+//     12     2  component size in bytes (KEY_SIZE)
+//     14     2  reserved (0)
+//     16     4  number of components
+//     20     4  reserved (0)
+//     24     8  payload size in bytes
+//     32    32  integrity tag: SHA-256 over bytes 0..31 and the payload (in every profile)
+//     64     -  payload: the components back to back, exactly as used in memory
+// All integers are little-endian. The payload starts 64-byte aligned, so a mapped file
+// can be used in place as unsigned char [n][KEY_SIZE] without any parsing.
+
+#define CONTAINER_MAGIC "LOTS"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 64
+
+#define CONTAINER_HASH_SHA256 LAMPORT_PROFILE_SHA256
+#define CONTAINER_TAG_SIZE 32
+
+#define CONTAINER_PRIVATE_KEY 1 // NUM_BITS * 2 components
+#define CONTAINER_PUBLIC_KEY 2  // NUM_BITS * 2 components
+#define CONTAINER_SIGNATURE 3   // NUM_BITS components
+
+typedef struct {
+    void *base;                    // start of the mapping
+    size_t size;                   // length of the mapping
+    const unsigned char *payload;  // first component
+    uint32_t num_components;
+    uint16_t type;
+    uint16_t flags;
+} container_map;
+
+int container_write(const char *file_name, int owner_only, uint16_t type, uint16_t flags,
+                    const unsigned char *payload, uint32_t num_components);
+// Map a container read-only and check magic, version, hash algorithm, type, size and integrity tag
+int container_open(const char *file_name, uint16_t type, uint32_t num_components, container_map *map);
+void container_close(container_map *map);
+
+#endif // LAMPORT_CONTAINER_H
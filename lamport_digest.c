@@ -0,0 +1,401 @@
+/*
+ * Parallel tree-hash message digest
+ * ==========================================================
+ * A plain SHA-256 stream can only use one core. In tree mode the file is cut into fixed-size chunks,
+ * worker threads claim chunk indices from a shared counter, read them with pread and hash them
+ * independently, and the chunk digests are then combined in a small Merkle tree.
+ */
+
+#include "lamport_digest.h"
+#include "lamport_common.h"
+#include "lamport_cache.h"
+#include "lamport_hex.h"
+#include "lamport_io.h"
+#include "lamport_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define TRAILER_PREFIX "digest tree-sha256 "
+
+void digest_params_default(digest_params *params) {
+    params->mode = DIGEST_SHA256;
+    params->chunk_log2 = DIGEST_DEFAULT_CHUNK_LOG2;
+    params->threads = 0;
+}
+
+static int hash_parts(const unsigned char *a, size_t a_len, const unsigned char *b, size_t b_len,
+                      const unsigned char *c, size_t c_len, unsigned char out[HASH_SIZE]) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = mdctx != NULL && hash_init(mdctx) &&
+             EVP_DigestUpdate(mdctx, a, a_len) == 1 && EVP_DigestUpdate(mdctx, b, b_len) == 1 &&
+             EVP_DigestUpdate(mdctx, c, c_len) == 1 && hash_final(mdctx, out);
+    EVP_MD_CTX_free(mdctx);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to compute tree digest\n");
+    }
+    return ok;
+}
+
+// Fold the leaf digests into the final digest; leaves is overwritten
+static int tree_root(unsigned char *leaves, size_t count, uint64_t file_size, unsigned int chunk_log2,
+                     unsigned char hash[HASH_SIZE]) {
+    static const unsigned char node_prefix = 0x01;
+    while (count > 1) {
+        size_t parents = 0;
+        for (size_t i = 0; i < count; i += 2, parents++) {
+            unsigned char *parent = leaves + parents * HASH_SIZE;
+            if (i + 1 == count) {
+                memmove(parent, leaves + i * HASH_SIZE, HASH_SIZE);
+            } else if (!hash_parts(&node_prefix, 1, leaves + i * HASH_SIZE, HASH_SIZE,
+                                     leaves + (i + 1) * HASH_SIZE, HASH_SIZE, parent)) {
+                return 0;
+            }
+        }
+        count = parents;
+    }
+    unsigned char header[10];
+    header[0] = 0x02;
+    for (int i = 0; i < 8; i++) {
+        header[1 + i] = (unsigned char)(file_size >> (56 - 8 * i));
+    }
+    header[9] = (unsigned char)chunk_log2;
+    if (!hash_parts(header, sizeof(header), leaves, HASH_SIZE, NULL, 0, hash)) {
+        return 0;
+    }
+    // A plain digest is H(file), so an uncomplemented value would also verify as the plain signature
+    // of the 42-byte file header || root; the trailer that selects the mode is not signed
+    for (size_t i = 0; i < HASH_SIZE; i++) {
+        hash[i] = (unsigned char)~hash[i];
+    }
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+// Sequential leaves (pipes and single-threaded runs), fed by the I/O engine
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    EVP_MD_CTX *mdctx;
+    size_t chunk_size;
+    size_t in_chunk;     // bytes of the current chunk hashed so far
+    unsigned char *leaves;
+    size_t count, capacity;
+    uint64_t total;
+} stream_state;
+
+static int stream_start_leaf(stream_state *s) {
+    static const unsigned char leaf_prefix = 0x00;
+    s->in_chunk = 0;
+    return hash_init(s->mdctx) && EVP_DigestUpdate(s->mdctx, &leaf_prefix, 1) == 1;
+}
+
+static int stream_finish_leaf(stream_state *s) {
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity ? s->capacity * 2 : 64;
+        unsigned char *leaves = realloc(s->leaves, capacity * HASH_SIZE);
+        if (leaves == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 0;
+        }
+        s->leaves = leaves;
+        s->capacity = capacity;
+    }
+    return hash_final(s->mdctx, s->leaves + s->count++ * HASH_SIZE);
+}
+
+static int stream_update(void *arg, const unsigned char *data, size_t len) {
+    stream_state *s = arg;
+    s->total += len;
+    while (len > 0) {
+        size_t take = s->chunk_size - s->in_chunk;
+        if (take > len) {
+            take = len;
+        }
+        if (EVP_DigestUpdate(s->mdctx, data, take) != 1) {
+            fprintf(stderr, "Error: Failed to update hash\n");
+            return 0;
+        }
+        s->in_chunk += take;
+        data += take;
+        len -= take;
+        if (s->in_chunk == s->chunk_size && !(stream_finish_leaf(s) && stream_start_leaf(s))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int digest_tree_stream(const char *filename, unsigned int chunk_log2, unsigned char hash[HASH_SIZE]) {
+    stream_state s;
+    memset(&s, 0, sizeof(s));
+    s.chunk_size = (size_t)1 << chunk_log2;
+    s.mdctx = EVP_MD_CTX_new();
+    if (s.mdctx == NULL || !stream_start_leaf(&s)) {
+        fprintf(stderr, "Error: Failed to create hash context\n");
+        EVP_MD_CTX_free(s.mdctx);
+        return 0;
+    }
+    io_stats stats;
+    int ok = io_read_file(filename, io_backend_from_env(), stream_update, &s, &stats);
+    // The last partial chunk, or the single empty chunk of an empty file
+    if (ok && (s.in_chunk > 0 || s.count == 0)) {
+        ok = stream_finish_leaf(&s);
+    }
+    ok = ok && tree_root(s.leaves, s.count, s.total, chunk_log2, hash);
+    EVP_MD_CTX_free(s.mdctx);
+    free(s.leaves);
+    if (ok) {
+        stats_count(STATS_DOCUMENT_BYTES, stats.bytes);
+        io_report("digest_file", &stats);
+    }
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// Parallel leaves for regular files
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    int fd;
+    uint64_t file_size;
+    size_t chunk_size;
+    size_t num_chunks;
+    size_t next_chunk; // claimed with __atomic_fetch_add
+    int failed;
+    unsigned char *leaves;
+} tree_job;
+
+static void *tree_worker(void *arg) {
+    static const unsigned char leaf_prefix = 0x00;
+    tree_job *job = arg;
+    unsigned char *buffer = malloc(job->chunk_size);
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    if (buffer == NULL || mdctx == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        size_t chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->num_chunks) {
+            break;
+        }
+        uint64_t offset = (uint64_t)chunk * job->chunk_size;
+        size_t len = job->file_size - offset < job->chunk_size ? (size_t)(job->file_size - offset) : job->chunk_size;
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = pread(job->fd, buffer + done, len - done, (off_t)(offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += (size_t)n;
+        }
+        if (done != len || !hash_init(mdctx) ||
+            EVP_DigestUpdate(mdctx, &leaf_prefix, 1) != 1 || EVP_DigestUpdate(mdctx, buffer, len) != 1 ||
+            !hash_final(mdctx, job->leaves + chunk * HASH_SIZE)) {
+            fprintf(stderr, "Error: Failed to read or hash chunk %zu\n", chunk);
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    EVP_MD_CTX_free(mdctx);
+    free(buffer);
+    return NULL;
+}
+
+static int digest_tree_file(const char *filename, const digest_params *params, unsigned char hash[HASH_SIZE]) {
+    int threads = params->threads;
+    if (threads <= 0 && getenv("LAMPORT_DIGEST_THREADS") != NULL) {
+        threads = atoi(getenv("LAMPORT_DIGEST_THREADS"));
+    }
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || threads == 1) {
+        close(fd);
+        return digest_tree_stream(filename, params->chunk_log2, hash);
+    }
+
+    tree_job job;
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.file_size = (uint64_t)st.st_size;
+    job.chunk_size = (size_t)1 << params->chunk_log2;
+    job.num_chunks = job.file_size == 0 ? 1 : (size_t)((job.file_size + job.chunk_size - 1) / job.chunk_size);
+    if ((size_t)threads > job.num_chunks) {
+        threads = (int)job.num_chunks;
+    }
+    job.leaves = malloc(job.num_chunks * HASH_SIZE);
+    pthread_t *workers = calloc((size_t)threads, sizeof(pthread_t));
+    if (job.leaves == NULL || workers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(job.leaves);
+        free(workers);
+        close(fd);
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, tree_worker, &job) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        tree_worker(&job); // no threads available: hash every chunk here
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    close(fd);
+
+    int ok = !job.failed && tree_root(job.leaves, job.num_chunks, job.file_size, params->chunk_log2, hash);
+    if (ok) {
+        stats_count(STATS_DOCUMENT_BYTES, job.file_size);
+    }
+    free(job.leaves);
+    free(workers);
+    return ok;
+}
+
+int digest_file(const char *filename, const digest_params *params, unsigned char hash[HASH_SIZE]) {
+    stats_begin(STATS_FILE_HASH);
+    digest_cache_key key;
+    int ok;
+    if (params->mode == DIGEST_SHA256) {
+        ok = hash_file(filename, hash);
+    } else if (!(ok = digest_cache_lookup(filename, params->chunk_log2, &key, hash)) &&
+               (ok = digest_tree_file(filename, params, hash))) {
+        digest_cache_store(filename, &key, hash);
+    }
+    stats_end(STATS_FILE_HASH);
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// Recording the mode with the signature
+// ----------------------------------------------------------------------------
+
+int digest_format_trailer(const digest_params *params, char out[DIGEST_TRAILER_MAX]) {
+    if (params->mode == DIGEST_SHA256) {
+        out[0] = '\0';
+        return 0;
+    }
+    return snprintf(out, DIGEST_TRAILER_MAX, TRAILER_PREFIX "%u\n", params->chunk_log2);
+}
+
+int digest_parse_trailer(const char *text, size_t len, digest_params *params) {
+    digest_params_default(params);
+    if (len == 0) {
+        return 1;
+    }
+    size_t prefix = strlen(TRAILER_PREFIX);
+    unsigned int chunk_log2 = 0;
+    size_t i = prefix;
+    if (len <= prefix + 1 || memcmp(text, TRAILER_PREFIX, prefix) != 0 || text[len - 1] != '\n') {
+        return 0;
+    }
+    for (; i < len - 1 && i < prefix + 2; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return 0;
+        }
+        chunk_log2 = chunk_log2 * 10 + (unsigned int)(text[i] - '0');
+    }
+    if (i != len - 1 || chunk_log2 < DIGEST_MIN_CHUNK_LOG2 || chunk_log2 > DIGEST_MAX_CHUNK_LOG2) {
+        return 0;
+    }
+    params->mode = DIGEST_TREE_SHA256;
+    params->chunk_log2 = chunk_log2;
+    return 1;
+}
+
+static int append_trailer(const char *sig_filename, const digest_params *params) {
+    char trailer[DIGEST_TRAILER_MAX];
+    int len = digest_format_trailer(params, trailer);
+    if (len == 0) {
+        return 1;
+    }
+    int fd = open(sig_filename, O_WRONLY | O_APPEND);
+    int ok = fd >= 0 && write(fd, trailer, (size_t)len) == len;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write digest mode to signature file %s\n", sig_filename);
+    }
+    return ok;
+}
+
+int digest_append_trailer(const char *sig_filename, const digest_params *params) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = append_trailer(sig_filename, params);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+static int read_trailer(const char *sig_filename, off_t offset, digest_params *params) {
+    int fd = open(sig_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open signature file %s\n", sig_filename);
+        return 0;
+    }
+    // A profile record may come first (see lamport_hex.h), and a signer record last
+    char trailer[HEX_PROFILE_LINE_MAX + DIGEST_TRAILER_MAX + SIGNER_RECORD_SIZE];
+    ssize_t n = pread(fd, trailer, sizeof(trailer), offset);
+    close(fd);
+    int profile_len = hex_check_profile(trailer, n > 0 ? (size_t)n : 0, sig_filename);
+    if (profile_len < 0) {
+        return 0;
+    }
+    size_t signer = strlen(SIGNER_RECORD_PREFIX);
+    if (n >= profile_len + (ssize_t)SIGNER_RECORD_SIZE &&
+        memcmp(trailer + n - SIGNER_RECORD_SIZE, SIGNER_RECORD_PREFIX, signer) == 0 &&
+        (n == profile_len + (ssize_t)SIGNER_RECORD_SIZE || trailer[n - SIGNER_RECORD_SIZE - 1] == '\n')) {
+        n -= (ssize_t)SIGNER_RECORD_SIZE;
+    }
+    if (n < 0 || !digest_parse_trailer(trailer + profile_len, (size_t)n - (size_t)profile_len, params)) {
+        fprintf(stderr, "Error: Unsupported digest mode in signature file %s\n", sig_filename);
+        return 0;
+    }
+    return 1;
+}
+
+int digest_read_trailer(const char *sig_filename, off_t offset, digest_params *params) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_trailer(sig_filename, offset, params);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+uint16_t digest_container_flags(const digest_params *params) {
+    if (params->mode == DIGEST_SHA256) {
+        return 0;
+    }
+    return (uint16_t)(DIGEST_FLAG_TREE | (params->chunk_log2 << 8));
+}
+
+int digest_from_container_flags(uint16_t flags, digest_params *params) {
+    digest_params_default(params);
+    if (flags == 0) {
+        return 1;
+    }
+    unsigned int chunk_log2 = flags >> 8;
+    if ((flags & 0xff) != DIGEST_FLAG_TREE || chunk_log2 < DIGEST_MIN_CHUNK_LOG2 || chunk_log2 > DIGEST_MAX_CHUNK_LOG2) {
+        return 0;
+    }
+    params->mode = DIGEST_TREE_SHA256;
+    params->chunk_log2 = chunk_log2;
+    return 1;
+}
@@ -0,0 +1,57 @@
+#ifndef LAMPORT_DIGEST_H
+#define LAMPORT_DIGEST_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "lamport_constants.h"
+
+// Message digest modes: the 256-bit value that is actually signed
+// ==========================================================
+// DIGEST_SHA256       SHA-256 over the whole file, one sequential stream (default)
+// DIGEST_TREE_SHA256  the file is split into 2^chunk_log2-byte chunks that are hashed in parallel:
+//                       leaf_i = SHA256(0x00 || chunk_i)              (an empty file has one empty chunk)
+//                       node   = SHA256(0x01 || left || right)        (an odd last node moves up unchanged)
+//                       digest = ~SHA256(0x02 || be64(file size) || chunk_log2 || root)   (bitwise complement)
+//                     The complement keeps the two modes apart: a plain digest is H of some file, so a
+//                     tree value that was one would verify as the plain signature of that file.
+// SHA256 here is the profile hash H (see lamport_constants.h); the names keep the default profile's.
+// The mode is recorded with the signature: a trailer line "digest tree-sha256 <chunk_log2>" after the hex
+// signature lines, or the DIGEST_FLAG_TREE flag in a binary container. No trailer means plain SHA-256.
+// A signer record "signer <fingerprint hex>\n" may follow it (sign -i, see lamport_keydir.h); trailer
+// readers skip it.
+
+#define DIGEST_SHA256 0
+#define DIGEST_TREE_SHA256 1
+
+#define DIGEST_DEFAULT_CHUNK_LOG2 22 // 4 MiB chunks
+#define DIGEST_MIN_CHUNK_LOG2 12
+#define DIGEST_MAX_CHUNK_LOG2 30
+#define DIGEST_TRAILER_MAX 64
+#define SIGNER_RECORD_PREFIX "signer "
+#define SIGNER_RECORD_SIZE (sizeof(SIGNER_RECORD_PREFIX) - 1 + 2 * HASH_SIZE + 1)
+
+// Container flags (header offset 10): bit 0 = tree digest, bits 8..15 = chunk_log2
+#define DIGEST_FLAG_TREE 0x0001
+
+typedef struct {
+    int mode;                // DIGEST_*
+    unsigned int chunk_log2; // DIGEST_TREE_SHA256 only
+    int threads;             // hashing threads, 0 = LAMPORT_DIGEST_THREADS or one per CPU; not part of the digest
+} digest_params;
+
+void digest_params_default(digest_params *params);
+// Digest a file with the given construction (DIGEST_SHA256 is hash_file)
+int digest_file(const char *filename, const digest_params *params, unsigned char hash[HASH_SIZE]);
+
+// Append the mode trailer to a signature file (nothing for DIGEST_SHA256)
+int digest_append_trailer(const char *sig_filename, const digest_params *params);
+// Read the mode trailer that starts at offset; a file that ends there is DIGEST_SHA256
+int digest_read_trailer(const char *sig_filename, off_t offset, digest_params *params);
+// Parse one trailer line (with its newline); len 0 means DIGEST_SHA256
+int digest_parse_trailer(const char *text, size_t len, digest_params *params);
+int digest_format_trailer(const digest_params *params, char out[DIGEST_TRAILER_MAX]);
+
+uint16_t digest_container_flags(const digest_params *params);
+int digest_from_container_flags(uint16_t flags, digest_params *params);
+
+#endif // LAMPORT_DIGEST_H
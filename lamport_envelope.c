@@ -0,0 +1,333 @@
+/*
+ * Attached-signature envelope
+ * ==========================================================
+ * Signs and verifies a payload that streams through a pipe: the payload is framed into the envelope
+ * while it is hashed, and the signature follows it, so neither side needs the payload in a file.
+ */
+
+#include "lamport_envelope.h"
+#include "lamport_common.h"
+#include "lamport_stats.h"
+#include <errno.h>
+#include <unistd.h>
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint16_t get_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Read until size bytes or the end of the stream; the number of bytes read, or -1 on error
+static ssize_t read_full(int fd, unsigned char *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buffer + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static int write_full(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+// The rest of the envelope must be there: a short read means it was cut off
+static int read_envelope(int fd, unsigned char *buffer, size_t size) {
+    ssize_t n = read_full(fd, buffer, size);
+    if (n < 0) {
+        fprintf(stderr, "Error: Failed to read the envelope\n");
+        return 0;
+    }
+    if ((size_t)n < size) {
+        fprintf(stderr, "Error: The envelope is truncated\n");
+        return 0;
+    }
+    return 1;
+}
+
+int envelope_write_payload(int in_fd, int out_fd, unsigned char hash[HASH_SIZE], uint64_t *length) {
+    unsigned char header[ENVELOPE_HEADER_SIZE] = {0};
+    memcpy(header, ENVELOPE_MAGIC, 4);
+    put_le16(header + 4, ENVELOPE_VERSION);
+    put_le16(header + 6, LAMPORT_PROFILE);
+    put_le16(header + 8, KEY_SIZE);
+
+    unsigned char *frame = malloc(4 + ENVELOPE_FRAME_SIZE);
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = frame != NULL && mdctx != NULL && hash_init(mdctx) && write_full(out_fd, header, sizeof(header));
+    if (!ok) {
+        fprintf(stderr, frame == NULL || mdctx == NULL ? "Error: Memory allocation failed\n" : "Error: Failed to write the envelope\n");
+    }
+
+    stats_begin(STATS_FILE_HASH);
+    *length = 0;
+    while (ok) {
+        ssize_t n = read_full(in_fd, frame + 4, ENVELOPE_FRAME_SIZE);
+        if (n < 0) {
+            fprintf(stderr, "Error: Failed to read the payload\n");
+            ok = 0;
+            break;
+        }
+        // A short frame is the last one; the zero-length frame after it ends the payload
+        put_le32(frame, (uint32_t)n);
+        if (EVP_DigestUpdate(mdctx, frame + 4, (size_t)n) != 1 || !write_full(out_fd, frame, 4 + (size_t)n)) {
+            fprintf(stderr, "Error: Failed to write the envelope\n");
+            ok = 0;
+            break;
+        }
+        *length += (uint64_t)n;
+        stats_count(STATS_DOCUMENT_BYTES, (uint64_t)n);
+        if (n == 0) {
+            break;
+        }
+        if (n < ENVELOPE_FRAME_SIZE) {
+            put_le32(frame, 0);
+            if (!write_full(out_fd, frame, 4)) {
+                fprintf(stderr, "Error: Failed to write the envelope\n");
+                ok = 0;
+            }
+            break;
+        }
+    }
+    ok = ok && hash_final(mdctx, hash);
+    stats_end(STATS_FILE_HASH);
+
+    EVP_MD_CTX_free(mdctx);
+    free(frame);
+    return ok;
+}
+
+int envelope_write_signature(int out_fd, uint64_t length, unsigned char signature[NUM_BITS][KEY_SIZE]) {
+    unsigned char trailer[8];
+    put_le64(trailer, length);
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_full(out_fd, trailer, sizeof(trailer)) &&
+             write_full(out_fd, &signature[0][0], (size_t)NUM_BITS * KEY_SIZE);
+    stats_end(STATS_OUTPUT_WRITE);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write the envelope\n");
+    }
+    return ok;
+}
+
+// Payload output: where the bytes wait for the verdict (see ENVELOPE_OUTPUT_*)
+typedef struct {
+    int fd;
+    int mode;
+    int spool_fd;  // SPOOL: unlinked temporary file
+    unsigned char *held;
+    size_t held_len;
+    int released;  // STREAM: bytes have been written before the signature was verified
+} payload_output;
+
+static int open_output(payload_output *out, int fd, int mode) {
+    out->fd = fd;
+    out->mode = mode;
+    out->spool_fd = -1;
+    out->held = NULL;
+    out->held_len = 0;
+    out->released = 0;
+    if (mode == ENVELOPE_OUTPUT_SPOOL) {
+        FILE *spool = tmpfile();
+        out->spool_fd = spool != NULL ? dup(fileno(spool)) : -1;
+        if (spool != NULL) {
+            fclose(spool);
+        }
+        if (out->spool_fd < 0) {
+            fprintf(stderr, "Error: Cannot create a temporary file for the payload\n");
+            return 0;
+        }
+    } else if (mode == ENVELOPE_OUTPUT_HOLD || mode == ENVELOPE_OUTPUT_STREAM) {
+        out->held = malloc(ENVELOPE_HOLD_SIZE);
+        if (out->held == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void close_output(payload_output *out) {
+    if (out->spool_fd >= 0) {
+        close(out->spool_fd);
+    }
+    free(out->held);
+}
+
+static int write_payload(int fd, const unsigned char *data, size_t len) {
+    if (!write_full(fd, data, len)) {
+        fprintf(stderr, "Error: Failed to write the payload\n");
+        return 0;
+    }
+    return 1;
+}
+
+static int emit_payload(payload_output *out, const unsigned char *data, size_t len) {
+    if (out->mode == ENVELOPE_OUTPUT_DIRECT) {
+        return write_payload(out->fd, data, len);
+    }
+    if (out->mode == ENVELOPE_OUTPUT_SPOOL) {
+        return write_payload(out->spool_fd, data, len);
+    }
+    if (!out->released && out->held_len + len <= ENVELOPE_HOLD_SIZE) {
+        memcpy(out->held + out->held_len, data, len);
+        out->held_len += len;
+        return 1;
+    }
+    if (out->mode == ENVELOPE_OUTPUT_HOLD) {
+        fprintf(stderr, "Error: The payload is larger than %d MiB and cannot be held back until it is verified; "
+                        "use -o <output>, redirect stdout to a file, or pass --unverified\n", ENVELOPE_HOLD_SIZE >> 20);
+        return 0;
+    }
+    out->released = 1;
+    int ok = write_payload(out->fd, out->held, out->held_len) && write_payload(out->fd, data, len);
+    out->held_len = 0;
+    return ok;
+}
+
+// Write out whatever waited for a VALID verdict
+static int release_payload(payload_output *out) {
+    if (out->mode == ENVELOPE_OUTPUT_SPOOL) {
+        unsigned char *buffer = malloc(ENVELOPE_FRAME_SIZE);
+        int ok = buffer != NULL && lseek(out->spool_fd, 0, SEEK_SET) == 0;
+        ssize_t n = 0;
+        while (ok && (n = read_full(out->spool_fd, buffer, ENVELOPE_FRAME_SIZE)) > 0) {
+            ok = write_full(out->fd, buffer, (size_t)n);
+        }
+        free(buffer);
+        return ok && n == 0;
+    }
+    int ok = write_full(out->fd, out->held, out->held_len);
+    out->held_len = 0;
+    return ok;
+}
+
+int envelope_verify(int in_fd, int out_fd, int output, unsigned char public_key[NUM_BITS][2][KEY_SIZE], int *valid) {
+    unsigned char header[ENVELOPE_HEADER_SIZE];
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    unsigned char hash[HASH_SIZE];
+    unsigned char word[8];
+    uint64_t length = 0;
+
+    *valid = 0;
+    if (!read_envelope(in_fd, header, sizeof(header))) {
+        return 0;
+    }
+    if (memcmp(header, ENVELOPE_MAGIC, 4) != 0 || get_le16(header + 4) != ENVELOPE_VERSION) {
+        fprintf(stderr, "Error: The input is not a signature envelope\n");
+        return 0;
+    }
+    if (get_le16(header + 6) != LAMPORT_PROFILE || get_le16(header + 8) != KEY_SIZE) {
+        fprintf(stderr, "Error: The envelope was signed with another parameter profile (this build: %s)\n", LAMPORT_PROFILE_NAME);
+        return 0;
+    }
+
+    payload_output out;
+    if (!open_output(&out, out_fd, output)) {
+        close_output(&out);
+        return 0;
+    }
+    unsigned char *frame = malloc(ENVELOPE_FRAME_SIZE);
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = frame != NULL && mdctx != NULL && hash_init(mdctx);
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    stats_begin(STATS_FILE_HASH);
+    while (ok) {
+        ok = read_envelope(in_fd, word, 4);
+        uint32_t n = ok ? get_le32(word) : 0;
+        if (n == 0) {
+            break;
+        }
+        if (n > ENVELOPE_FRAME_SIZE) {
+            fprintf(stderr, "Error: Envelope frame of %u bytes exceeds the limit of %d\n", n, ENVELOPE_FRAME_SIZE);
+            ok = 0;
+            break;
+        }
+        ok = read_envelope(in_fd, frame, n) && EVP_DigestUpdate(mdctx, frame, n) == 1 && emit_payload(&out, frame, n);
+        length += n;
+        stats_count(STATS_DOCUMENT_BYTES, n);
+    }
+    ok = ok && hash_final(mdctx, hash);
+    stats_end(STATS_FILE_HASH);
+
+    stats_begin(STATS_KEY_LOAD);
+    ok = ok && read_envelope(in_fd, word, 8) && read_envelope(in_fd, &signature[0][0], sizeof(signature));
+    stats_end(STATS_KEY_LOAD);
+    if (ok && get_le64(word) != length) {
+        fprintf(stderr, "Error: The envelope holds %llu payload bytes, its trailer says %llu\n",
+                (unsigned long long)length, (unsigned long long)get_le64(word));
+        ok = 0;
+    }
+    if (ok && read_full(in_fd, word, 1) != 0) {
+        fprintf(stderr, "Error: Unexpected data after the envelope signature\n");
+        ok = 0;
+    }
+
+    *valid = ok && verify_signature(public_key, signature, hash);
+    if (*valid && !release_payload(&out)) {
+        fprintf(stderr, "Error: Failed to write the payload\n");
+        *valid = ok = 0;
+    }
+    if (!*valid && out.released) {
+        fprintf(stderr, "Warning: Part of the unverified payload was already written out (--unverified)\n");
+    }
+
+    EVP_MD_CTX_free(mdctx);
+    free(frame);
+    close_output(&out);
+    return ok;
+}
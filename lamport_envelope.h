@@ -0,0 +1,50 @@
+#ifndef LAMPORT_ENVELOPE_H
+#define LAMPORT_ENVELOPE_H
+
+#include <stdint.h>
+#include "lamport_constants.h"
+
+// Attached-signature envelope: the payload and its signature in one stream (sign -e, verify -e)
+// ==========================================================
+// offset  size  field
+//      0     4  magic "LENV"
+//      4     2  format version
+//      6     2  hash algorithm: the parameter profile (LAMPORT_PROFILE_*)
+//      8     2  component size in bytes (KEY_SIZE)
+//     10     6  reserved (0)
+//     16     -  payload frames: a 4-byte length n (1 to ENVELOPE_FRAME_SIZE), then n payload bytes
+//      -     4  end of payload: a frame length of 0
+//      -     8  payload length in bytes
+//      -  NUM_BITS * KEY_SIZE  signature: the private key component selected by each digest bit
+// All integers are little-endian. The signed digest is H of the payload, as for a detached signature of
+// the same bytes. The payload length is not known when the envelope starts, so it is framed and the
+// signature follows it: both sides pass over the stream once. sign -e holds one frame in memory.
+//
+// verify -e never writes out payload bytes before the signature has verified, unless asked to:
+//   ENVELOPE_OUTPUT_DIRECT  out_fd is a temporary file that the caller only keeps (renames) if VALID (-o)
+//   ENVELOPE_OUTPUT_SPOOL   the payload waits in an unlinked temporary file, then is copied out (stdout is a file)
+//   ENVELOPE_OUTPUT_HOLD    the payload waits in memory; more than ENVELOPE_HOLD_SIZE bytes is an error (a pipe)
+//   ENVELOPE_OUTPUT_STREAM  as HOLD, but a larger payload is written out before it is verified (--unverified);
+//                           if it then fails, the reader only sees the error and the exit status
+
+#define ENVELOPE_MAGIC "LENV"
+#define ENVELOPE_VERSION 1
+#define ENVELOPE_HEADER_SIZE 16
+#define ENVELOPE_FRAME_SIZE (1 << 20)
+#define ENVELOPE_HOLD_SIZE (16 << 20)
+
+#define ENVELOPE_OUTPUT_DIRECT 0
+#define ENVELOPE_OUTPUT_SPOOL 1
+#define ENVELOPE_OUTPUT_HOLD 2
+#define ENVELOPE_OUTPUT_STREAM 3
+
+// Copy in_fd into out_fd as the header and payload frames of an envelope; hash is the digest to sign
+int envelope_write_payload(int in_fd, int out_fd, unsigned char hash[HASH_SIZE], uint64_t *length);
+// Finish the envelope with the payload length and the signature
+int envelope_write_signature(int out_fd, uint64_t length, unsigned char signature[NUM_BITS][KEY_SIZE]);
+// Read an envelope from in_fd and write its payload to out_fd as output (ENVELOPE_OUTPUT_*) allows;
+// *valid is set if the signature verifies. Returns 0 if the envelope is malformed or cannot be read or
+// written, or if a HOLD payload is too large.
+int envelope_verify(int in_fd, int out_fd, int output, unsigned char public_key[NUM_BITS][2][KEY_SIZE], int *valid);
+
+#endif // LAMPORT_ENVELOPE_H
@@ -0,0 +1,430 @@
+#include "lamport_hex.h"
+#include "lamport_common.h"
+#include "lamport_stats.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if LAMPORT_X86_KERNELS
+    #include <immintrin.h>
+#endif
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+// Nibble value of each ASCII character, 0xff for anything that is not a hex digit
+static unsigned char hex_values[256];
+
+static void init_hex_values(void) {
+    memset(hex_values, 0xff, sizeof(hex_values));
+    for (int i = 0; i < 10; i++) {
+        hex_values['0' + i] = (unsigned char)i;
+    }
+    for (int i = 0; i < 6; i++) {
+        hex_values['a' + i] = (unsigned char)(10 + i);
+        hex_values['A' + i] = (unsigned char)(10 + i);
+    }
+}
+
+static void hex_encode_scalar(const unsigned char *in, size_t len, char *out) {
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = hex_digits[in[i] >> 4];
+        out[2 * i + 1] = hex_digits[in[i] & 0x0f];
+    }
+}
+
+static int hex_decode_scalar(const char *in, size_t len, unsigned char *out) {
+    unsigned char invalid = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char hi = hex_values[(unsigned char)in[2 * i]];
+        unsigned char lo = hex_values[(unsigned char)in[2 * i + 1]];
+        invalid |= (hi | lo) & 0xf0; // 0xff marks a bad character
+        out[i] = (unsigned char)((hi << 4) | (lo & 0x0f));
+    }
+    return invalid == 0;
+}
+
+#if LAMPORT_X86_KERNELS
+
+// SSSE3: 16 bytes <-> 32 hex digits per step, pshufb as the digit lookup table
+__attribute__((target("ssse3")))
+static void hex_encode_ssse3(const unsigned char *in, size_t len, char *out) {
+    const __m128i table = _mm_loadu_si128((const __m128i *)hex_digits);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(bytes, mask));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    hex_encode_scalar(in + i, len - i, out + 2 * i);
+}
+
+// Convert 16 hex digits to nibble values; *valid gets a 0xff byte for every hex digit
+__attribute__((target("ssse3")))
+static __m128i hex_nibbles_ssse3(__m128i chars, __m128i *valid) {
+    __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    *valid = _mm_or_si128(digit, alpha);
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                        _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("ssse3")))
+static int hex_decode_ssse3(const char *in, size_t len, unsigned char *out) {
+    const __m128i weights = _mm_set1_epi16(0x0110); // high nibble * 16 + low nibble * 1
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i valid0, valid1;
+        __m128i n0 = hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *)(in + 2 * i)), &valid0);
+        __m128i n1 = hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *)(in + 2 * i + 16)), &valid1);
+        if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xffff) {
+            return 0;
+        }
+        __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(n0, weights), _mm_maddubs_epi16(n1, weights));
+        _mm_storeu_si128((__m128i *)(out + i), bytes);
+    }
+    return hex_decode_scalar(in + 2 * i, len - i, out + i);
+}
+
+// AVX2: 32 bytes <-> 64 hex digits (one full key line) per step
+__attribute__((target("avx2")))
+static void hex_encode_avx2(const unsigned char *in, size_t len, char *out) {
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hex_digits));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(bytes, mask));
+        // unpack works within 128-bit lanes, so recombine the lane halves in order
+        __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    hex_encode_ssse3(in + i, len - i, out + 2 * i);
+}
+
+__attribute__((target("avx2")))
+static __m256i hex_nibbles_avx2(__m256i chars, __m256i *valid) {
+    __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('9')), _mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)));
+    __m256i alpha = _mm256_andnot_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('f')), _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)));
+    *valid = _mm256_or_si256(digit, alpha);
+    return _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+                           _mm256_and_si256(alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("avx2")))
+static int hex_decode_avx2(const char *in, size_t len, unsigned char *out) {
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i valid0, valid1;
+        __m256i n0 = hex_nibbles_avx2(_mm256_loadu_si256((const __m256i *)(in + 2 * i)), &valid0);
+        __m256i n1 = hex_nibbles_avx2(_mm256_loadu_si256((const __m256i *)(in + 2 * i + 32)), &valid1);
+        if (_mm256_movemask_epi8(_mm256_and_si256(valid0, valid1)) != -1) {
+            return 0;
+        }
+        // packus interleaves the 128-bit lanes; permute restores byte order
+        __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(n0, weights), _mm256_maddubs_epi16(n1, weights));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    return hex_decode_ssse3(in + 2 * i, len - i, out + i);
+}
+
+#endif // LAMPORT_X86_KERNELS
+
+typedef void (*hex_encode_fn)(const unsigned char *in, size_t len, char *out);
+typedef int (*hex_decode_fn)(const char *in, size_t len, unsigned char *out);
+
+static hex_encode_fn encode_kernel = NULL;
+static hex_decode_fn decode_kernel = NULL;
+static const char *codec_name = NULL;
+static pthread_once_t select_hex_codec_once = PTHREAD_ONCE_INIT; // decoding threads must never see hex_values half built
+
+// Pick the widest codec the CPU supports; LAMPORT_HEX_CODEC=scalar|ssse3|avx2 caps it
+static void select_hex_codec(void) {
+    const char *forced = getenv("LAMPORT_HEX_CODEC");
+
+    init_hex_values();
+    encode_kernel = hex_encode_scalar;
+    decode_kernel = hex_decode_scalar;
+    codec_name = "scalar";
+    if (forced != NULL && strcmp(forced, "scalar") == 0) {
+        return;
+    }
+#if LAMPORT_X86_KERNELS
+    if (cpu_has_ssse3()) {
+        encode_kernel = hex_encode_ssse3;
+        decode_kernel = hex_decode_ssse3;
+        codec_name = "ssse3";
+    }
+    if (cpu_has_avx2() && !(forced != NULL && strcmp(forced, "ssse3") == 0)) {
+        encode_kernel = hex_encode_avx2;
+        decode_kernel = hex_decode_avx2;
+        codec_name = "avx2";
+    }
+#endif
+}
+
+const char *hex_codec(void) {
+    pthread_once(&select_hex_codec_once, select_hex_codec);
+    return codec_name;
+}
+
+void hex_encode(const unsigned char *in, size_t len, char *out) {
+    pthread_once(&select_hex_codec_once, select_hex_codec);
+    encode_kernel(in, len, out);
+}
+
+int hex_decode(const char *in, size_t len, unsigned char *out) {
+    pthread_once(&select_hex_codec_once, select_hex_codec);
+    return decode_kernel(in, len, out);
+}
+
+// Decode one fixed-width line; the line must end in exactly one '\n'
+static int decode_line(const char *line, unsigned char *data) {
+    return line[HEX_LINE_SIZE - 1] == '\n' && hex_decode(line, KEY_SIZE, data);
+}
+
+static int read_fully(int fd, char *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buffer + done, size - done);
+        if (n <= 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+// A file from another profile has a different line width or count, so it fails to parse before its
+// profile record is reached; look for the record near the end of the file to report the real cause
+static int foreign_profile(int fd, const char *file_name) {
+    char tail[4 * HEX_PROFILE_LINE_MAX + 1];
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return 0;
+    }
+    off_t start = st.st_size > (off_t)sizeof(tail) - 1 ? st.st_size - ((off_t)sizeof(tail) - 1) : 0;
+    ssize_t n = pread(fd, tail, sizeof(tail) - 1, start);
+    if (n <= 0) {
+        return 0;
+    }
+    tail[n] = '\0';
+    const char *record = strstr(tail, "\nprofile ");
+    return record != NULL && hex_check_profile(record + 1, (size_t)(tail + n - record - 1), file_name) < 0;
+}
+
+static int read_lines(const char *file_name, unsigned char *data, size_t num_lines, const char *what) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open %s file %s\n", what, file_name);
+        return 0;
+    }
+    size_t size = num_lines * HEX_LINE_SIZE;
+    char *text = malloc(size);
+    if (text == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        close(fd);
+        return 0;
+    }
+    if (!read_fully(fd, text, size)) {
+        if (!foreign_profile(fd, file_name)) {
+            fprintf(stderr, "Error: Invalid %s file format\n", what);
+        }
+        OPENSSL_cleanse(text, size);
+        free(text);
+        close(fd);
+        return 0;
+    }
+    char tail[HEX_PROFILE_LINE_MAX];
+    ssize_t tail_len = pread(fd, tail, sizeof(tail), (off_t)size);
+
+    int ok = 1;
+    for (size_t i = 0; ok && i < num_lines; i++) {
+        ok = decode_line(text + i * HEX_LINE_SIZE, data + i * KEY_SIZE);
+    }
+    if (!ok) {
+        if (!foreign_profile(fd, file_name)) {
+            fprintf(stderr, "Error: Invalid hex data in %s file\n", what);
+        }
+    } else {
+        ok = hex_check_profile(tail, tail_len > 0 ? (size_t)tail_len : 0, file_name) >= 0;
+    }
+    close(fd);
+    OPENSSL_cleanse(text, size); // may hold private key material
+    free(text);
+    return ok;
+}
+
+int hex_read_lines(const char *file_name, unsigned char *data, size_t num_lines, const char *what) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_lines(file_name, data, num_lines, what);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int pread_lines(const char *file_name, const size_t *line_index, size_t count, unsigned char *data, const char *what) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open %s file %s\n", what, file_name);
+        return 0;
+    }
+    char line[HEX_LINE_SIZE];
+    int ok = 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = pread(fd, line, HEX_LINE_SIZE, (off_t)(line_index[i] * HEX_LINE_SIZE)) == HEX_LINE_SIZE &&
+             decode_line(line, data + i * KEY_SIZE);
+    }
+    if (!ok && !foreign_profile(fd, file_name)) {
+        fprintf(stderr, "Error: Invalid %s file format\n", what);
+    }
+    OPENSSL_cleanse(line, sizeof(line));
+    close(fd);
+    return ok;
+}
+
+int hex_pread_lines(const char *file_name, const size_t *line_index, size_t count, unsigned char *data, const char *what) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = pread_lines(file_name, line_index, count, data, what);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_lines(const char *file_name, int owner_only, const unsigned char *data, size_t num_lines) {
+    char profile[HEX_PROFILE_LINE_MAX];
+    size_t profile_len = hex_profile_line(profile);
+    size_t size = num_lines * HEX_LINE_SIZE + profile_len;
+    char *text = malloc(size);
+    if (text == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    for (size_t i = 0; i < num_lines; i++) {
+        hex_encode(data + i * KEY_SIZE, KEY_SIZE, text + i * HEX_LINE_SIZE);
+        text[i * HEX_LINE_SIZE + HEX_LINE_SIZE - 1] = '\n';
+    }
+    memcpy(text + num_lines * HEX_LINE_SIZE, profile, profile_len);
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, owner_only ? (S_IRUSR | S_IWUSR) : 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create hex file %s\n", file_name);
+        free(text);
+        return 0;
+    }
+    // Set file permissions to 600 (read/write for owner only), also when the file already existed
+    if (owner_only && fchmod(fd, S_IRUSR | S_IWUSR) != 0) {
+        fprintf(stderr, "Warning: Could not set secure permissions on file: %s\n", file_name);
+        OPENSSL_cleanse(text, size);
+        free(text);
+        close(fd);
+        return 0;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, text + done, size - done);
+        if (n <= 0) {
+            fprintf(stderr, "Error: Failed to write hex file %s\n", file_name);
+            OPENSSL_cleanse(text, size);
+            free(text);
+            close(fd);
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    OPENSSL_cleanse(text, size);
+    free(text);
+    close(fd);
+    return 1;
+}
+
+int hex_write_lines(const char *file_name, int owner_only, const unsigned char *data, size_t num_lines) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_lines(file_name, owner_only, data, num_lines);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+void hex_fwrite_line(FILE *file, const unsigned char *data, size_t len) {
+    char line[HEX_LINE_SIZE];
+    hex_encode(data, len, line);
+    line[len * 2] = '\n';
+    fwrite(line, 1, len * 2 + 1, file);
+}
+
+int hex_fread_line(FILE *file, unsigned char *data, size_t len) {
+    char line[HEX_LINE_SIZE + 1]; // 2 hex chars per byte + newline + null terminator
+    if (fgets(line, sizeof(line), file) == NULL || strlen(line) != len * 2 + 1 || line[len * 2] != '\n') {
+        return 0;
+    }
+    return hex_decode(line, len, data);
+}
+
+size_t hex_profile_line(char out[HEX_PROFILE_LINE_MAX]) {
+    if (strcmp(LAMPORT_PROFILE_NAME, LAMPORT_DEFAULT_PROFILE_NAME) == 0) {
+        return 0;
+    }
+    return (size_t)snprintf(out, HEX_PROFILE_LINE_MAX, "profile %s\n", LAMPORT_PROFILE_NAME);
+}
+
+int hex_check_profile(const char *text, size_t len, const char *file_name) {
+    static const char prefix[] = "profile ";
+    const char *name = LAMPORT_DEFAULT_PROFILE_NAME;
+    size_t name_len = strlen(name), line_len = 0;
+    if (len >= sizeof(prefix) - 1 && memcmp(text, prefix, sizeof(prefix) - 1) == 0) {
+        const char *end = memchr(text, '\n', len);
+        if (end == NULL) {
+            fprintf(stderr, "Error: Invalid parameter profile record in %s\n", file_name);
+            return -1;
+        }
+        name = text + sizeof(prefix) - 1;
+        name_len = (size_t)(end - name);
+        line_len = (size_t)(end - text) + 1;
+    }
+    if (name_len != strlen(LAMPORT_PROFILE_NAME) || memcmp(name, LAMPORT_PROFILE_NAME, name_len) != 0) {
+        fprintf(stderr, "Error: %s was written with parameter profile %.*s, this build uses %s\n", file_name,
+                (int)name_len, name, LAMPORT_PROFILE_NAME);
+        return -1;
+    }
+    return (int)line_len;
+}
+
+int hex_check_profile_at(const char *file_name, off_t offset) {
+    char tail[HEX_PROFILE_LINE_MAX];
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", file_name);
+        return -1;
+    }
+    ssize_t n = pread(fd, tail, sizeof(tail), offset);
+    close(fd);
+    return hex_check_profile(tail, n > 0 ? (size_t)n : 0, file_name);
+}
+
+void hex_fwrite_profile(FILE *file) {
+    char profile[HEX_PROFILE_LINE_MAX];
+    fwrite(profile, 1, hex_profile_line(profile), file);
+}
+
+// Skip the end of the current line, then check (and consume) the profile line if there is one
+int hex_fread_profile(FILE *file, const char *file_name) {
+    char line[HEX_PROFILE_LINE_MAX + 1] = "";
+    int c;
+    while ((c = fgetc(file)) == '\n') {
+    }
+    if (c == 'p') {
+        line[0] = 'p';
+        if (fgets(line + 1, sizeof(line) - 1, file) == NULL) {
+            line[1] = '\0';
+        }
+    } else if (c != EOF) {
+        ungetc(c, file);
+    }
+    return hex_check_profile(line, strlen(line), file_name);
+}
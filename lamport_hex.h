@@ -0,0 +1,43 @@
+#ifndef LAMPORT_HEX_H
+#define LAMPORT_HEX_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include "lamport_constants.h"
+
+// Every hex key, seed and signature file is a sequence of fixed-width lines:
+// exactly KEY_SIZE bytes as 2 * KEY_SIZE hex digits followed by '\n'.
+#define HEX_LINE_SIZE (KEY_SIZE * 2 + 1)
+
+// Encode len bytes as 2 * len lowercase hex digits (no terminator)
+void hex_encode(const unsigned char *in, size_t len, char *out);
+// Decode 2 * len hex digits (either case) into len bytes; returns 0 on any non-hex character
+int hex_decode(const char *in, size_t len, unsigned char *out);
+const char *hex_codec(void);
+
+// Read num_lines fixed-width lines from the start of a file with a single read;
+// what ("key", "signature", ...) is used in error messages
+int hex_read_lines(const char *file_name, unsigned char *data, size_t num_lines, const char *what);
+// Read only the listed lines (line_index[i] -> data + i * KEY_SIZE) with one pread per line
+int hex_pread_lines(const char *file_name, const size_t *line_index, size_t count, unsigned char *data, const char *what);
+// Write num_lines fixed-width lines with a single write; owner_only restricts the file to mode 600
+int hex_write_lines(const char *file_name, int owner_only, const unsigned char *data, size_t num_lines);
+// One hex line of len (<= KEY_SIZE) bytes, for files that mix hex lines with decimal fields
+void hex_fwrite_line(FILE *file, const unsigned char *data, size_t len);
+int hex_fread_line(FILE *file, unsigned char *data, size_t len);
+
+// Parameter profile record: files written by a non-default profile (see lamport_constants.h) end their
+// key or signature data with the line "profile <name>\n", before any digest trailer. A file without it
+// belongs to the default sha256 profile. hex_write_lines and hex_read_lines write and check it themselves.
+#define HEX_PROFILE_LINE_MAX 32
+// This build's profile line; 0 (nothing to write) for the default profile
+size_t hex_profile_line(char out[HEX_PROFILE_LINE_MAX]);
+// Check the text that follows a file's data: returns the length of its profile line (0 if there is none),
+// or -1 with an error message if the file was written by another profile
+int hex_check_profile(const char *text, size_t len, const char *file_name);
+int hex_check_profile_at(const char *file_name, off_t offset);
+void hex_fwrite_profile(FILE *file);
+int hex_fread_profile(FILE *file, const char *file_name);
+
+#endif // LAMPORT_HEX_H
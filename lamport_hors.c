@@ -0,0 +1,410 @@
+#include "lamport_hors.h"
+#include "lamport_hex.h"
+#include "lamport_stats.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+// Domain separation from the Merkle, tree digest and Winternitz hashes (0x00 to 0x04) and batch proofs (0x08 to 0x0a)
+#define HORS_INDEX_PREFIX 0x06
+#define HORS_INDEX_BYTES ((HORS_MAX_K * HORS_MAX_LOG_T / 8 + HASH_SIZE - 1) / HASH_SIZE * HASH_SIZE)
+
+// m^k <= 2^e; m^k is rounded up whenever it is scaled down, so a borderline m is refused
+static int power_at_most(uint64_t m, unsigned int k, unsigned int e) {
+    uint64_t v = 1;
+    unsigned int shift = 0;
+    for (unsigned int i = 0; i < k; i++) {
+        v *= m;
+        while (v > (1ULL << 32)) {
+            v = (v + 1) / 2;
+            shift++;
+        }
+    }
+    while (v > 1) {
+        v = (v + 1) / 2;
+        shift++;
+    }
+    return shift <= e;
+}
+
+int hors_params_init(unsigned int k, unsigned long t, hors_params *params) {
+    unsigned int log_t = 0;
+    while (log_t < HORS_MAX_LOG_T && (1UL << log_t) < t) {
+        log_t++;
+    }
+    if (k == 0 || k > HORS_MAX_K || t != (1UL << log_t) || log_t < HORS_MIN_LOG_T) {
+        fprintf(stderr, "Error: HORS needs 1 <= k <= %d and t a power of two from %lu to %lu\n", HORS_MAX_K,
+                1UL << HORS_MIN_LOG_T, 1UL << HORS_MAX_LOG_T);
+        return 0;
+    }
+    // Largest m = r * k with (m / t)^k <= 2^-HORS_SECURITY_BITS, i.e. m^k <= 2^(k * log_t - HORS_SECURITY_BITS)
+    uint64_t max_signatures = 0;
+    if (k * log_t > (unsigned int)HORS_SECURITY_BITS) {
+        unsigned int e = k * log_t - (unsigned int)HORS_SECURITY_BITS;
+        uint64_t lo = 1, hi = 1ULL << log_t;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo + 1) / 2;
+            if (power_at_most(mid, k, e)) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        max_signatures = lo / k;
+    }
+    if (max_signatures == 0) {
+        fprintf(stderr, "Error: HORS with k = %u and t = %lu allows no signature at %d-bit security\n", k, t, HORS_SECURITY_BITS);
+        return 0;
+    }
+    params->k = k;
+    params->log_t = log_t;
+    params->max_signatures = max_signatures;
+    return 1;
+}
+
+// The k indices a digest selects: consecutive log_t-bit fields of H(prefix || pub_seed || number || hash || counter).
+// The signature number is part of the hashed data, so a signature only verifies under the number it was made with.
+static int select_indices(const hors_params *params, const unsigned char pub_seed[HASH_SIZE], uint64_t number,
+                          const unsigned char *hash, uint32_t indices[HORS_MAX_K]) {
+    unsigned char bits[HORS_INDEX_BYTES];
+    static const unsigned char prefix = HORS_INDEX_PREFIX;
+    unsigned char number_bytes[8];
+    for (int i = 0; i < 8; i++) {
+        number_bytes[i] = (unsigned char)(number >> (56 - 8 * i));
+    }
+    size_t needed = (params->k * params->log_t + 7) / 8;
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = mdctx != NULL;
+    stats_begin(STATS_COMPONENT_HASH);
+    for (uint32_t counter = 0; ok && counter * HASH_SIZE < needed; counter++) {
+        unsigned char counter_bytes[4] = {(unsigned char)(counter >> 24), (unsigned char)(counter >> 16),
+                                          (unsigned char)(counter >> 8), (unsigned char)counter};
+        ok = hash_init(mdctx) && EVP_DigestUpdate(mdctx, &prefix, 1) == 1 &&
+             EVP_DigestUpdate(mdctx, pub_seed, HASH_SIZE) == 1 && EVP_DigestUpdate(mdctx, number_bytes, sizeof(number_bytes)) == 1 &&
+             EVP_DigestUpdate(mdctx, hash, HASH_SIZE) == 1 &&
+             EVP_DigestUpdate(mdctx, counter_bytes, sizeof(counter_bytes)) == 1 && hash_final(mdctx, bits + counter * HASH_SIZE);
+    }
+    stats_end(STATS_COMPONENT_HASH);
+    EVP_MD_CTX_free(mdctx);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to compute HORS indices\n");
+        return 0;
+    }
+    for (unsigned int i = 0; i < params->k; i++) {
+        uint32_t index = 0;
+        for (unsigned int b = i * params->log_t; b < (i + 1) * params->log_t; b++) {
+            index = index << 1 | ((bits[b / 8] >> (7 - b % 8)) & 1);
+        }
+        indices[i] = index;
+    }
+    return 1;
+}
+
+int hors_keygen(const hors_params *params, hors_private_key *private_key, unsigned char **public_values) {
+    size_t t = (size_t)1 << params->log_t;
+    *public_values = NULL;
+    if (RAND_priv_bytes(private_key->seed, KEY_SIZE) != 1 || RAND_bytes(private_key->pub_seed, HASH_SIZE) != 1) {
+        fprintf(stderr, "Error: Failed to generate random bytes\n");
+        return 0;
+    }
+    private_key->params = *params;
+    private_key->used = 0;
+
+    // Secret values come from the seed PRF; the public values are their hashes, computed in one batch
+    unsigned char *secrets = malloc(t * KEY_SIZE);
+    unsigned char *values = malloc(t * HASH_SIZE);
+    if (secrets == NULL || values == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(secrets);
+        free(values);
+        return 0;
+    }
+    int ok = derive_private_components(private_key->seed, 0, 0, t, secrets) && hash_batch(secrets, values, t);
+    OPENSSL_cleanse(secrets, t * KEY_SIZE);
+    free(secrets);
+    if (!ok) {
+        free(values);
+        return 0;
+    }
+    *public_values = values;
+    return 1;
+}
+
+int hors_sign(const hors_private_key *private_key, uint64_t number, const unsigned char *hash,
+              unsigned char signature[HORS_MAX_K][HASH_SIZE]) {
+    uint32_t indices[HORS_MAX_K];
+    if (!select_indices(&private_key->params, private_key->pub_seed, number, hash, indices)) {
+        return 0;
+    }
+    // Only the k selected secrets are derived
+    for (unsigned int i = 0; i < private_key->params.k; i++) {
+        if (!derive_private_components(private_key->seed, 0, indices[i], 1, signature[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Read the k selected public values, one pread per line
+static int read_public_values(const hors_public_key *public_key, const uint32_t *indices, unsigned char values[HORS_MAX_K][HASH_SIZE]) {
+    int fd = open(public_key->file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", public_key->file_name);
+        return 0;
+    }
+    char line[HEX_LINE_SIZE];
+    int ok = 1;
+    for (unsigned int i = 0; ok && i < public_key->params.k; i++) {
+        off_t offset = public_key->values_offset + (off_t)indices[i] * HEX_LINE_SIZE;
+        ok = pread(fd, line, HEX_LINE_SIZE, offset) == HEX_LINE_SIZE && line[HEX_LINE_SIZE - 1] == '\n' &&
+             hex_decode(line, HASH_SIZE, values[i]);
+    }
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid HORS public key file format\n");
+    }
+    return ok;
+}
+
+int hors_verify(const hors_public_key *public_key, uint64_t number, unsigned char signature[HORS_MAX_K][HASH_SIZE],
+                const unsigned char *hash) {
+    uint32_t indices[HORS_MAX_K];
+    unsigned char values[HORS_MAX_K][HASH_SIZE];
+    unsigned char computed[HORS_MAX_K][HASH_SIZE];
+    if (number >= public_key->params.max_signatures) {
+        fprintf(stderr, "Error: Signature number %llu is beyond the budget of %llu signatures of this key\n",
+                (unsigned long long)number, (unsigned long long)public_key->params.max_signatures);
+        return 0;
+    }
+    if (!select_indices(&public_key->params, public_key->pub_seed, number, hash, indices)) {
+        return 0;
+    }
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_public_values(public_key, indices, values);
+    stats_end(STATS_KEY_LOAD);
+    if (!ok || !hash_batch(&signature[0][0], &computed[0][0], public_key->params.k)) {
+        return 0;
+    }
+    stats_begin(STATS_COMPARE);
+    int valid = CRYPTO_memcmp(computed, values, (size_t)public_key->params.k * HASH_SIZE) == 0;
+    stats_end(STATS_COMPARE);
+    return valid;
+}
+
+// ----------------------------------------------------------------------------
+// File formats
+// ----------------------------------------------------------------------------
+
+// Decimal "k t <count>" header line; the parameters are recomputed from k and t
+static int read_header(FILE *file, hors_params *params, uint64_t *count) {
+    unsigned int k;
+    unsigned long t;
+    unsigned long long value;
+    if (fscanf(file, "%u %lu %llu", &k, &t, &value) != 3 || fgetc(file) != '\n' || !hors_params_init(k, t, params)) {
+        return 0;
+    }
+    *count = (uint64_t)value;
+    return 1;
+}
+
+static int read_private_key(const char *file_name, hors_private_key *private_key) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    int ok = read_header(file, &private_key->params, &private_key->used) && hex_fread_line(file, private_key->seed, KEY_SIZE) &&
+             hex_fread_line(file, private_key->pub_seed, HASH_SIZE) && hex_fread_profile(file, file_name) >= 0;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid HORS private key file format\n");
+    }
+    return ok;
+}
+
+int read_hors_private_key(const char *file_name, hors_private_key *private_key) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_private_key(file_name, private_key);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+// Write the private key to a temporary file, fsync it and rename it over the old one,
+// so the signature count is on disk before any signature it covers leaves the process
+static int write_private_key(const char *file_name, const hors_private_key *private_key) {
+    char tmp_name[strlen(file_name) + 5];
+    sprintf(tmp_name, "%s.tmp", file_name);
+
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create key file %s\n", tmp_name);
+        return 0;
+    }
+    FILE *file = fdopen(fd, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create key file %s\n", tmp_name);
+        close(fd);
+        return 0;
+    }
+    fprintf(file, "%u %lu %llu\n", private_key->params.k, 1UL << private_key->params.log_t,
+            (unsigned long long)private_key->used);
+    hex_fwrite_line(file, private_key->seed, KEY_SIZE);
+    hex_fwrite_line(file, private_key->pub_seed, HASH_SIZE);
+    hex_fwrite_profile(file);
+    if (fflush(file) != 0 || fsync(fd) != 0) {
+        fprintf(stderr, "Error: Failed to write key file %s\n", tmp_name);
+        fclose(file);
+        unlink(tmp_name);
+        return 0;
+    }
+    fclose(file);
+    if (rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: Cannot replace key file %s\n", file_name);
+        unlink(tmp_name);
+        return 0;
+    }
+    return 1;
+}
+
+int write_hors_private_key(const char *file_name, const hors_private_key *private_key) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_private_key(file_name, private_key);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+int hors_claim_signature(const char *file_name, hors_private_key *private_key, uint64_t *number) {
+    // The key file itself is replaced on every signature, so the lock lives on a companion file;
+    // concurrent signers wait for each other rather than fail
+    char lock_name[strlen(file_name) + 6];
+    sprintf(lock_name, "%s.lock", file_name);
+    int lock_fd = open(lock_name, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+        fprintf(stderr, "Error: Cannot lock %s\n", file_name);
+        if (lock_fd >= 0) {
+            close(lock_fd);
+        }
+        return 0;
+    }
+    int ok = read_hors_private_key(file_name, private_key);
+    if (ok && private_key->used >= private_key->params.max_signatures) {
+        fprintf(stderr, "Error: All %llu signatures of %s have been used; generate a new key\n",
+                (unsigned long long)private_key->params.max_signatures, file_name);
+        ok = 0;
+    }
+    if (ok) {
+        *number = private_key->used++;
+        ok = write_hors_private_key(file_name, private_key);
+    }
+    close(lock_fd);
+    if (!ok) {
+        OPENSSL_cleanse(private_key, sizeof(*private_key));
+    }
+    return ok;
+}
+
+static int read_public_key(const char *file_name, hors_public_key *public_key) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    // The header fixes the number of public value lines; the file must end right after them
+    uint64_t max_signatures = 0;
+    struct stat st;
+    int ok = read_header(file, &public_key->params, &max_signatures) && max_signatures == public_key->params.max_signatures &&
+             hex_fread_line(file, public_key->pub_seed, HASH_SIZE) && fstat(fileno(file), &st) == 0;
+    off_t end = ok ? ftello(file) + ((off_t)1 << public_key->params.log_t) * HEX_LINE_SIZE : 0;
+    public_key->values_offset = ok ? ftello(file) : 0;
+    fclose(file);
+    int profile_len = ok ? hex_check_profile_at(file_name, end) : -1;
+    ok = ok && profile_len >= 0 && st.st_size == end + profile_len;
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid HORS public key file format\n");
+    }
+    public_key->file_name = file_name;
+    return ok;
+}
+
+int read_hors_public_key(const char *file_name, hors_public_key *public_key) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_public_key(file_name, public_key);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_public_key(const char *file_name, const hors_private_key *private_key, const unsigned char *public_values) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create hex file %s\n", file_name);
+        return 0;
+    }
+    size_t t = (size_t)1 << private_key->params.log_t;
+    fprintf(file, "%u %lu %llu\n", private_key->params.k, (unsigned long)t,
+            (unsigned long long)private_key->params.max_signatures);
+    hex_fwrite_line(file, private_key->pub_seed, HASH_SIZE);
+    for (size_t i = 0; i < t; i++) {
+        hex_fwrite_line(file, public_values + i * HASH_SIZE, HASH_SIZE);
+    }
+    hex_fwrite_profile(file);
+    return fclose(file) == 0;
+}
+
+int write_hors_public_key(const char *file_name, const hors_private_key *private_key, const unsigned char *public_values) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_public_key(file_name, private_key, public_values);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+static int read_signature_file(const char *sig_filename, unsigned int k, uint64_t *number, unsigned char signature[HORS_MAX_K][HASH_SIZE],
+                               off_t *data_size) {
+    FILE *file = fopen(sig_filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open signature file %s\n", sig_filename);
+        return 0;
+    }
+    unsigned long long value;
+    int ok = fscanf(file, "%llu", &value) == 1 && fgetc(file) == '\n';
+    for (unsigned int i = 0; ok && i < k; i++) {
+        ok = hex_fread_line(file, signature[i], HASH_SIZE);
+    }
+    *number = ok ? (uint64_t)value : 0;
+    *data_size = ok ? ftello(file) : 0;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid HORS signature file format\n");
+    }
+    return ok;
+}
+
+int read_hors_signature(const char *sig_filename, unsigned int k, uint64_t *number, unsigned char signature[HORS_MAX_K][HASH_SIZE],
+                        off_t *data_size) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_signature_file(sig_filename, k, number, signature, data_size);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_signature_file(const char *sig_filename, unsigned int k, uint64_t number, unsigned char signature[HORS_MAX_K][HASH_SIZE]) {
+    FILE *file = fopen(sig_filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create signature file %s\n", sig_filename);
+        return 0;
+    }
+    fprintf(file, "%llu\n", (unsigned long long)number);
+    for (unsigned int i = 0; i < k; i++) {
+        hex_fwrite_line(file, signature[i], HASH_SIZE);
+    }
+    hex_fwrite_profile(file);
+    return fclose(file) == 0;
+}
+
+int write_hors_signature(const char *sig_filename, unsigned int k, uint64_t number, unsigned char signature[HORS_MAX_K][HASH_SIZE]) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_signature_file(sig_filename, k, number, signature);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
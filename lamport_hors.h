@@ -0,0 +1,83 @@
+#ifndef LAMPORT_HORS_H
+#define LAMPORT_HORS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "lamport_common.h"
+
+// HORS few-time signatures (Reyzin and Reyzin, "Better than BiBa")
+// ==========================================================
+// The private key is t = 2^log_t secret values derived from a seed, the public key their hashes.
+// Signature number n of a digest selects k of the t indices (k * log_t bits of
+// H(0x06 || public seed || be64(n) || digest || counter)), and the signature reveals the k selected secrets.
+// Verification hashes the k revealed values and compares them with the k selected public key lines, which
+// are read on their own.
+//
+// Every signature reveals up to k more of the t secrets. After r signatures a forger who picks a message
+// finds all k indices revealed with probability at most (r * k / t)^k, so the key is good for
+//   max signatures = floor(2^(log_t - HORS_SECURITY_BITS / k) / k)
+// signatures. The signer counts them in the private key file and refuses to sign once the budget is used
+// up; each signature carries its number and the verifier rejects numbers beyond the budget. The number
+// selects the indices along with the digest, so a signature cannot be passed off under another number.
+//
+//   k    t        max signatures  signature   public key   (32-byte profiles, 128-bit security)
+//   16   65536    16              512 bytes   2 MiB
+//   32   65536    128             1 KiB       2 MiB
+//   32   1048576  2048            1 KiB       32 MiB
+//   64   4096     16              2 KiB       128 KiB
+// (Lamport: one signature per 16 KiB public key, 8 KiB signatures)
+
+#define HORS_MAX_K 64
+#define HORS_MIN_LOG_T 8
+#define HORS_MAX_LOG_T 20
+#define HORS_SECURITY_BITS (HASH_SIZE * 4) // 128 bits for 32-byte profiles, 96 for sha256-192
+
+typedef struct {
+    unsigned int k;
+    unsigned int log_t;
+    uint64_t max_signatures;
+} hors_params;
+
+typedef struct {
+    unsigned char seed[KEY_SIZE];      // secret: the t values are derived from it
+    unsigned char pub_seed[HASH_SIZE]; // public: selects this key's indices for a digest
+    hors_params params;
+    uint64_t used;                     // signatures made so far
+} hors_private_key;
+
+// The public key stays on disk: only its header is read, and verification reads the k selected lines
+typedef struct {
+    const char *file_name;
+    unsigned char pub_seed[HASH_SIZE];
+    hors_params params;
+    off_t values_offset; // file offset of public value 0
+} hors_public_key;
+
+// t must be a power of two from 2^HORS_MIN_LOG_T to 2^HORS_MAX_LOG_T and k at most HORS_MAX_K;
+// fails if (k, t) allows no signature at HORS_SECURITY_BITS
+int hors_params_init(unsigned int k, unsigned long t, hors_params *params);
+
+// public_values receives t * HASH_SIZE bytes (malloc'd, free with free)
+int hors_keygen(const hors_params *params, hors_private_key *private_key, unsigned char **public_values);
+// number is the one hors_claim_signature handed out
+int hors_sign(const hors_private_key *private_key, uint64_t number, const unsigned char *hash,
+              unsigned char signature[HORS_MAX_K][HASH_SIZE]);
+int hors_verify(const hors_public_key *public_key, uint64_t number, unsigned char signature[HORS_MAX_K][HASH_SIZE],
+                const unsigned char *hash);
+
+// Files: hex lines (see lamport_hex.h) after a decimal header line
+//   private key: "k t used", secret seed, public seed
+//   public key:  "k t max_signatures", public seed, t public values
+//   signature:   "number", k revealed values
+int read_hors_private_key(const char *file_name, hors_private_key *private_key);
+int write_hors_private_key(const char *file_name, const hors_private_key *private_key);
+// Under an exclusive lock on <file_name>.lock: check the budget, count one more signature and write the
+// private key back (fsync and rename) before the caller signs with it; number is the new signature's number
+int hors_claim_signature(const char *file_name, hors_private_key *private_key, uint64_t *number);
+int read_hors_public_key(const char *file_name, hors_public_key *public_key);
+int write_hors_public_key(const char *file_name, const hors_private_key *private_key, const unsigned char *public_values);
+int read_hors_signature(const char *sig_filename, unsigned int k, uint64_t *number, unsigned char signature[HORS_MAX_K][HASH_SIZE],
+                        off_t *data_size);
+int write_hors_signature(const char *sig_filename, unsigned int k, uint64_t number, unsigned char signature[HORS_MAX_K][HASH_SIZE]);
+
+#endif // LAMPORT_HORS_H
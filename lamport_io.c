@@ -0,0 +1,400 @@
+#include "lamport_io.h"
+#include "lamport_common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define LAMPORT_HAVE_URING 1
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>
+    #endif
+#endif
+#ifndef LAMPORT_HAVE_URING
+    #define LAMPORT_HAVE_URING 0
+#endif
+
+#define IO_STDIO_BUFFER_SIZE 4096
+#define IO_ALIGNMENT 4096
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int io_backend_from_env(void) {
+    const char *name = getenv("LAMPORT_IO");
+    if (name == NULL) {
+        return IO_BACKEND_AUTO;
+    }
+    if (strcmp(name, "stdio") == 0) {
+        return IO_BACKEND_STDIO;
+    }
+    if (strcmp(name, "mmap") == 0) {
+        return IO_BACKEND_MMAP;
+    }
+    if (strcmp(name, "buffered") == 0) {
+        return IO_BACKEND_BUFFERED;
+    }
+    if (strcmp(name, "uring") == 0) {
+        return IO_BACKEND_URING;
+    }
+    return IO_BACKEND_AUTO;
+}
+
+static int read_stdio(int fd, io_consumer consumer, void *arg, io_stats *stats) {
+    FILE *file = fdopen(fd, "rb");
+    if (file == NULL) {
+        close(fd);
+        return 0;
+    }
+    unsigned char buffer[IO_STDIO_BUFFER_SIZE];
+    size_t bytes_read;
+    int ok = 1;
+    while (ok && (bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) { // read file in chunks and store in buffer
+        stats->bytes += bytes_read;
+        ok = consumer(arg, buffer, bytes_read);
+    }
+    if (ok && ferror(file)) {
+        fprintf(stderr, "Error: Failed to read file\n");
+        ok = 0;
+    }
+    fclose(file);
+    return ok;
+}
+
+static int read_buffered(int fd, io_consumer consumer, void *arg, io_stats *stats) {
+    void *buffer;
+    if (posix_memalign(&buffer, IO_ALIGNMENT, IO_BUFFER_SIZE) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    // Let the kernel read ahead aggressively; not all file types support it, so ignore failures
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int ok = 1;
+    for (;;) {
+        ssize_t n = read(fd, buffer, IO_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "Error: Failed to read file\n");
+            ok = 0;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        stats->bytes += (uint64_t)n;
+        if (!consumer(arg, buffer, (size_t)n)) {
+            ok = 0;
+            break;
+        }
+    }
+    free(buffer);
+    return ok;
+}
+
+static int read_mmap(int fd, uint64_t size, io_consumer consumer, void *arg, io_stats *stats) {
+    for (uint64_t offset = 0; offset < size; offset += IO_MMAP_WINDOW) {
+        size_t len = (size_t)(size - offset < IO_MMAP_WINDOW ? size - offset : IO_MMAP_WINDOW);
+        void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, (off_t)offset);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "Error: Cannot map file\n");
+            return 0;
+        }
+        madvise(data, len, MADV_SEQUENTIAL);
+        madvise(data, len, MADV_WILLNEED);
+        int ok = consumer(arg, data, len);
+        munmap(data, len);
+        if (!ok) {
+            return 0;
+        }
+        stats->bytes += len;
+    }
+    return 1;
+}
+
+#if LAMPORT_HAVE_URING
+
+// Minimal io_uring driver on the raw system calls (no liburing dependency)
+typedef struct {
+    int ring_fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+} uring;
+
+static int uring_setup(uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->ring_fd < 0) {
+        return 0;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->ring_fd);
+        return 0;
+    }
+    ring->cq_ring = single_mmap ? ring->sq_ring
+                                : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       ring->ring_fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != MAP_FAILED && !single_mmap) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->ring_fd);
+        return 0;
+    }
+
+    unsigned char *sq = ring->sq_ring;
+    unsigned char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+static void uring_teardown(uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->ring_fd);
+}
+
+static int uring_submit_read(uring *ring, int fd, void *buffer, unsigned len, uint64_t offset, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return syscall(__NR_io_uring_enter, ring->ring_fd, 1, 0, 0, NULL, 0) == 1;
+}
+
+// Block until one completion is available and return it
+static int uring_wait(uring *ring, uint64_t *user_data, int *result) {
+    for (;;) {
+        unsigned head = *ring->cq_head;
+        if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            *user_data = cqe->user_data;
+            *result = cqe->res;
+            __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+            return 1;
+        }
+        if (syscall(__NR_io_uring_enter, ring->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+            return 0;
+        }
+    }
+}
+
+// Two buffers in flight: while one chunk is being hashed, the kernel fills the other.
+// Returns -1 if io_uring is unusable here (nothing has been consumed yet), so the caller can fall back.
+static int read_uring(int fd, uint64_t size, io_consumer consumer, void *arg, io_stats *stats) {
+    uring ring;
+    if (!uring_setup(&ring, 4)) {
+        return -1;
+    }
+    void *buffers[2] = {NULL, NULL};
+    if (posix_memalign(&buffers[0], IO_ALIGNMENT, IO_BUFFER_SIZE) != 0 ||
+        posix_memalign(&buffers[1], IO_ALIGNMENT, IO_BUFFER_SIZE) != 0) {
+        free(buffers[0]);
+        uring_teardown(&ring);
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+
+    uint64_t slot_offset[2] = {0, 0};
+    int slot_result[2] = {0, 0};
+    int slot_done[2] = {1, 1}; // nothing in flight
+    uint64_t next_offset = 0;
+    int ok = 1;
+
+    for (int slot = 0; slot < 2 && next_offset < size; slot++) {
+        uint64_t remaining = size - next_offset;
+        unsigned len = (unsigned)(remaining < IO_BUFFER_SIZE ? remaining : IO_BUFFER_SIZE);
+        slot_offset[slot] = next_offset;
+        slot_done[slot] = 0;
+        if (!uring_submit_read(&ring, fd, buffers[slot], len, next_offset, (uint64_t)slot)) {
+            ok = -1;
+        }
+        next_offset += len;
+    }
+
+    int current = 0;
+    uint64_t consumed = 0;
+    while (ok == 1 && consumed < size) {
+        // Completions can arrive out of order; the chunks must be hashed in order
+        while (!slot_done[current]) {
+            uint64_t user_data;
+            int result;
+            if (!uring_wait(&ring, &user_data, &result)) {
+                ok = consumed == 0 ? -1 : 0;
+                break;
+            }
+            slot_result[user_data & 1] = result;
+            slot_done[user_data & 1] = 1;
+        }
+        if (ok != 1) {
+            break;
+        }
+
+        uint64_t remaining = size - slot_offset[current];
+        size_t expected = (size_t)(remaining < IO_BUFFER_SIZE ? remaining : IO_BUFFER_SIZE);
+        if (slot_result[current] < 0) {
+            // e.g. -EINVAL from kernels without IORING_OP_READ: only recoverable before anything was hashed
+            ok = consumed == 0 ? -1 : 0;
+            break;
+        }
+        size_t got = (size_t)slot_result[current];
+        while (got < expected) {
+            // Short read: fetch the rest of this chunk synchronously
+            ssize_t n = pread(fd, (unsigned char *)buffers[current] + got, expected - got, (off_t)(slot_offset[current] + got));
+            if (n <= 0) {
+                fprintf(stderr, "Error: Failed to read file\n");
+                ok = 0;
+                break;
+            }
+            got += (size_t)n;
+        }
+        if (ok != 1 || !consumer(arg, buffers[current], expected)) {
+            ok = 0;
+            break;
+        }
+        consumed += expected;
+        stats->bytes += expected;
+
+        // Refill this buffer with the chunk after the one still in flight
+        if (next_offset < size) {
+            uint64_t left = size - next_offset;
+            unsigned len = (unsigned)(left < IO_BUFFER_SIZE ? left : IO_BUFFER_SIZE);
+            slot_offset[current] = next_offset;
+            slot_done[current] = 0;
+            if (!uring_submit_read(&ring, fd, buffers[current], len, next_offset, (uint64_t)current)) {
+                ok = 0;
+                break;
+            }
+            next_offset += len;
+        }
+        current ^= 1;
+    }
+
+    // Never free a buffer the kernel may still write into
+    for (int slot = 0; slot < 2; slot++) {
+        while (!slot_done[slot]) {
+            uint64_t user_data;
+            int result;
+            if (!uring_wait(&ring, &user_data, &result)) {
+                break;
+            }
+            slot_done[user_data & 1] = 1;
+        }
+    }
+    free(buffers[0]);
+    free(buffers[1]);
+    uring_teardown(&ring);
+    return ok;
+}
+
+#endif // LAMPORT_HAVE_URING
+
+int io_read_file(const char *file_name, int backend, io_consumer consumer, void *arg, io_stats *stats) {
+    io_stats local;
+    if (stats == NULL) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", file_name);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Cannot access file %s\n", file_name);
+        close(fd);
+        return 0;
+    }
+    // Only regular files have a size to map or to schedule reads against
+    int regular = S_ISREG(st.st_mode);
+    // A read() of a file that shrinks just ends early; a mapped page past the new end raises SIGBUS
+    if (backend == IO_BACKEND_AUTO) {
+        backend = IO_BACKEND_BUFFERED;
+    }
+    if (!regular && (backend == IO_BACKEND_MMAP || backend == IO_BACKEND_URING)) {
+        backend = IO_BACKEND_BUFFERED;
+    }
+
+    double start = now_seconds();
+    int ok;
+    if (backend == IO_BACKEND_STDIO) {
+        stats->backend = "stdio";
+        ok = read_stdio(fd, consumer, arg, stats); // closes fd
+        fd = -1;
+    } else if (backend == IO_BACKEND_MMAP) {
+        stats->backend = "mmap";
+        ok = read_mmap(fd, (uint64_t)st.st_size, consumer, arg, stats);
+    } else {
+        ok = -1;
+#if LAMPORT_HAVE_URING
+        if (backend == IO_BACKEND_URING) {
+            stats->backend = "uring";
+            ok = read_uring(fd, (uint64_t)st.st_size, consumer, arg, stats);
+        }
+#endif
+        if (ok == -1) {
+            stats->backend = "buffered";
+            ok = read_buffered(fd, consumer, arg, stats);
+        }
+    }
+    stats->seconds = now_seconds() - start;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok == 1;
+}
+
+void io_report(const char *label, const io_stats *stats) {
+    if (getenv("LAMPORT_IO_STATS") == NULL) {
+        return;
+    }
+    double megabytes = stats->bytes / (1024.0 * 1024.0);
+    fprintf(stderr, "%s: %s backend, %.1f MB in %.3f s (%.1f MB/s)\n", label, stats->backend, megabytes, stats->seconds,
+            stats->seconds > 0 ? megabytes / stats->seconds : 0.0);
+}
@@ -0,0 +1,33 @@
+#ifndef LAMPORT_IO_H
+#define LAMPORT_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// File reading backends behind hash_file. LAMPORT_IO=stdio|mmap|buffered|uring selects one;
+// the default (auto) is buffered reads. mmap is opt-in: a file truncated while it is mapped raises SIGBUS.
+#define IO_BACKEND_AUTO 0
+#define IO_BACKEND_STDIO 1    // fread with a small stack buffer (the original loop)
+#define IO_BACKEND_MMAP 2     // mmap in windows + madvise(MADV_SEQUENTIAL)
+#define IO_BACKEND_BUFFERED 3 // large page-aligned buffer + posix_fadvise(POSIX_FADV_SEQUENTIAL)
+#define IO_BACKEND_URING 4    // io_uring with two buffers: one is read while the other is hashed
+
+#define IO_BUFFER_SIZE (1024 * 1024)         // buffered and io_uring read size
+#define IO_MMAP_WINDOW (64UL * 1024 * 1024)  // bytes mapped at a time
+
+// Called for every chunk of the file, in file order; return 0 to abort the read
+typedef int (*io_consumer)(void *arg, const unsigned char *data, size_t len);
+
+typedef struct {
+    const char *backend; // backend that actually read the file
+    uint64_t bytes;
+    double seconds;
+} io_stats;
+
+int io_backend_from_env(void);
+// Stream a file through consumer; stats may be NULL
+int io_read_file(const char *file_name, int backend, io_consumer consumer, void *arg, io_stats *stats);
+// Print "<label>: <backend>, <MB> in <s> (<MB/s>)" to stderr when LAMPORT_IO_STATS is set
+void io_report(const char *label, const io_stats *stats);
+
+#endif // LAMPORT_IO_H
@@ -0,0 +1,307 @@
+/*
+ * Public key directory
+ * ==========================================================
+ * A verifier that trusts many signers keeps all their public keys in one mapped file with an
+ * open-addressing table keyed by fingerprint. Resolving the key of a signature costs one table probe,
+ * instead of opening and parsing a hex key file per signer.
+ */
+
+#include "lamport_keydir.h"
+#include "lamport_common.h"
+#include "lamport_hex.h"
+#include "lamport_merkle.h"
+#include "lamport_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define KEYDIR_ALIGNMENT 4096
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint16_t get_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint64_t records_offset(uint64_t num_slots) {
+    uint64_t end = KEYDIR_HEADER_SIZE + num_slots * KEYDIR_SLOT_SIZE;
+    return (end + KEYDIR_ALIGNMENT - 1) / KEYDIR_ALIGNMENT * KEYDIR_ALIGNMENT;
+}
+
+static int pwrite_fully(int fd, const void *buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pwrite(fd, (const unsigned char *)buffer + done, size - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+int keydir_fingerprint(unsigned char public_key[NUM_BITS][2][KEY_SIZE], unsigned char fingerprint[HASH_SIZE]) {
+    return compact_public_key(public_key, fingerprint);
+}
+
+// ----------------------------------------------------------------------------
+// Building
+// ----------------------------------------------------------------------------
+
+// Insert a fingerprint into the table as key number; 0 if it is already there
+static int insert_slot(unsigned char *slots, uint64_t num_slots, const unsigned char fingerprint[HASH_SIZE], uint64_t number) {
+    uint64_t slot = get_le64(fingerprint) & (num_slots - 1);
+    while (get_le64(slots + slot * KEYDIR_SLOT_SIZE + HASH_SIZE) != 0) {
+        if (memcmp(slots + slot * KEYDIR_SLOT_SIZE, fingerprint, HASH_SIZE) == 0) {
+            return 0;
+        }
+        slot = (slot + 1) & (num_slots - 1);
+    }
+    memcpy(slots + slot * KEYDIR_SLOT_SIZE, fingerprint, HASH_SIZE);
+    put_le64(slots + slot * KEYDIR_SLOT_SIZE + HASH_SIZE, number + 1);
+    return 1;
+}
+
+// Records are written as the keys are read; the header and the table go in last
+static int build_file(int fd, const char *tmp_name, char *const *pub_file_names, size_t count, uint64_t *num_keys) {
+    uint64_t num_slots = 8;
+    while (num_slots < 2 * (uint64_t)count) {
+        num_slots *= 2;
+    }
+    uint64_t first = records_offset(num_slots);
+    unsigned char *table = calloc(1, KEYDIR_HEADER_SIZE + num_slots * KEYDIR_SLOT_SIZE);
+    if (table == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 0;
+    }
+    unsigned char *slots = table + KEYDIR_HEADER_SIZE;
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char fingerprint[HASH_SIZE];
+    int ok = 1;
+    *num_keys = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = read_key(pub_file_names[i], public_key) && keydir_fingerprint(public_key, fingerprint);
+        if (ok && !insert_slot(slots, num_slots, fingerprint, *num_keys)) {
+            fprintf(stderr, "Warning: %s is already in the directory, skipped\n", pub_file_names[i]);
+            continue;
+        }
+        if (ok && !pwrite_fully(fd, public_key, KEYDIR_RECORD_SIZE, first + *num_keys * KEYDIR_RECORD_SIZE)) {
+            fprintf(stderr, "Error: Failed to write key directory %s\n", tmp_name);
+            ok = 0;
+        }
+        *num_keys += ok;
+    }
+
+    memcpy(table, KEYDIR_MAGIC, 4);
+    put_le16(table + 4, KEYDIR_VERSION);
+    put_le16(table + 6, LAMPORT_PROFILE);
+    put_le16(table + 8, KEY_SIZE);
+    put_le16(table + 10, NUM_BITS * 2);
+    put_le64(table + 16, *num_keys);
+    put_le64(table + 24, num_slots);
+    put_le64(table + 32, first);
+    if (ok && (!pwrite_fully(fd, table, KEYDIR_HEADER_SIZE + num_slots * KEYDIR_SLOT_SIZE, 0) ||
+               ftruncate(fd, (off_t)(first + *num_keys * KEYDIR_RECORD_SIZE)) != 0 || fsync(fd) != 0)) {
+        fprintf(stderr, "Error: Failed to write key directory %s\n", tmp_name);
+        ok = 0;
+    }
+    free(table);
+    return ok;
+}
+
+int keydir_build(const char *file_name, char *const *pub_file_names, size_t count) {
+    if (count == 0) {
+        fprintf(stderr, "Error: No public keys to index\n");
+        return 0;
+    }
+    char tmp_name[strlen(file_name) + 5];
+    sprintf(tmp_name, "%s.tmp", file_name);
+    int fd = open(tmp_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create key directory %s\n", tmp_name);
+        return 0;
+    }
+    uint64_t num_keys;
+    int ok = build_file(fd, tmp_name, pub_file_names, count, &num_keys);
+    close(fd);
+    if (ok && rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: Cannot replace key directory %s\n", file_name);
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp_name);
+    }
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// Lookup
+// ----------------------------------------------------------------------------
+
+static int open_keydir(const char *file_name, keydir_map *map) {
+    memset(map, 0, sizeof(*map));
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open key directory %s\n", file_name);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < KEYDIR_HEADER_SIZE) {
+        fprintf(stderr, "Error: Invalid key directory %s\n", file_name);
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map key directory %s\n", file_name);
+        return 0;
+    }
+
+    // Only the header is checked: the cost of opening does not grow with the number of keys
+    const unsigned char *header = base;
+    uint64_t num_keys = get_le64(header + 16);
+    uint64_t num_slots = get_le64(header + 24);
+    uint64_t first = get_le64(header + 32);
+    const char *problem = NULL;
+    if (memcmp(header, KEYDIR_MAGIC, 4) != 0) {
+        problem = "not a key directory";
+    } else if (get_le16(header + 4) != KEYDIR_VERSION) {
+        problem = "unsupported format version";
+    } else if (get_le16(header + 6) != LAMPORT_PROFILE || get_le16(header + 8) != KEY_SIZE ||
+               get_le16(header + 10) != NUM_BITS * 2) {
+        problem = "written with a different parameter profile (this build: " LAMPORT_PROFILE_NAME ")";
+    } else if (num_slots == 0 || (num_slots & (num_slots - 1)) != 0 || num_slots > size / KEYDIR_SLOT_SIZE ||
+               num_keys >= num_slots || first != records_offset(num_slots) ||
+               size != first + num_keys * KEYDIR_RECORD_SIZE) {
+        problem = "wrong size";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: Invalid key directory %s: %s\n", file_name, problem);
+        munmap(base, size);
+        return 0;
+    }
+
+    map->base = base;
+    map->size = size;
+    map->num_keys = num_keys;
+    map->num_slots = num_slots;
+    map->slots = header + KEYDIR_HEADER_SIZE;
+    map->records = header + first;
+    return 1;
+}
+
+int keydir_open(const char *file_name, keydir_map *map) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = open_keydir(file_name, map);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static const unsigned char *find_record(const keydir_map *map, const unsigned char fingerprint[HASH_SIZE]) {
+    uint64_t slot = get_le64(fingerprint) & (map->num_slots - 1);
+    // The table is never full, so an empty slot ends every probe sequence
+    for (uint64_t probes = 0; probes < map->num_slots; probes++) {
+        const unsigned char *entry = map->slots + slot * KEYDIR_SLOT_SIZE;
+        uint64_t number = get_le64(entry + HASH_SIZE);
+        if (number == 0) {
+            return NULL;
+        }
+        if (memcmp(entry, fingerprint, HASH_SIZE) == 0) {
+            return number <= map->num_keys ? map->records + (number - 1) * KEYDIR_RECORD_SIZE : NULL;
+        }
+        slot = (slot + 1) & (map->num_slots - 1);
+    }
+    return NULL;
+}
+
+const unsigned char *keydir_lookup(const keydir_map *map, const unsigned char fingerprint[HASH_SIZE]) {
+    char hex[2 * HASH_SIZE + 1];
+    hex_encode(fingerprint, HASH_SIZE, hex);
+    hex[2 * HASH_SIZE] = '\0';
+
+    stats_begin(STATS_KEY_LOAD);
+    const unsigned char *record = find_record(map, fingerprint);
+    stats_end(STATS_KEY_LOAD);
+    if (record == NULL) {
+        fprintf(stderr, "Error: Signer %s is not in the key directory\n", hex);
+    }
+    return record;
+}
+
+void keydir_close(keydir_map *map) {
+    if (map->base != NULL) {
+        munmap(map->base, map->size);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+// ----------------------------------------------------------------------------
+// Signer records
+// ----------------------------------------------------------------------------
+
+int keydir_append_signer(const char *sig_filename, const unsigned char fingerprint[HASH_SIZE]) {
+    char record[SIGNER_RECORD_SIZE];
+    memcpy(record, SIGNER_RECORD_PREFIX, strlen(SIGNER_RECORD_PREFIX));
+    hex_encode(fingerprint, HASH_SIZE, record + strlen(SIGNER_RECORD_PREFIX));
+    record[SIGNER_RECORD_SIZE - 1] = '\n';
+
+    stats_begin(STATS_OUTPUT_WRITE);
+    int fd = open(sig_filename, O_WRONLY | O_APPEND);
+    int ok = fd >= 0 && write(fd, record, SIGNER_RECORD_SIZE) == (ssize_t)SIGNER_RECORD_SIZE;
+    if (fd >= 0) {
+        close(fd);
+    }
+    stats_end(STATS_OUTPUT_WRITE);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write signer to signature file %s\n", sig_filename);
+    }
+    return ok;
+}
+
+// The signer record is always the last line of the file
+int keydir_read_signer(const char *sig_filename, unsigned char fingerprint[HASH_SIZE]) {
+    char record[SIGNER_RECORD_SIZE];
+    stats_begin(STATS_KEY_LOAD);
+    int fd = open(sig_filename, O_RDONLY);
+    struct stat st;
+    int ok = fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= (off_t)SIGNER_RECORD_SIZE &&
+             pread(fd, record, SIGNER_RECORD_SIZE, st.st_size - (off_t)SIGNER_RECORD_SIZE) == (ssize_t)SIGNER_RECORD_SIZE;
+    if (fd >= 0) {
+        close(fd);
+    }
+    stats_end(STATS_KEY_LOAD);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open signature file %s\n", sig_filename);
+        return 0;
+    }
+    if (!ok || memcmp(record, SIGNER_RECORD_PREFIX, strlen(SIGNER_RECORD_PREFIX)) != 0 ||
+        record[SIGNER_RECORD_SIZE - 1] != '\n' ||
+        !hex_decode(record + strlen(SIGNER_RECORD_PREFIX), HASH_SIZE, fingerprint)) {
+        fprintf(stderr, "Error: Signature file %s does not name its signer (sign -i)\n", sig_filename);
+        return 0;
+    }
+    return 1;
+}
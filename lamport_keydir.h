@@ -0,0 +1,62 @@
+#ifndef LAMPORT_KEYDIR_H
+#define LAMPORT_KEYDIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lamport_constants.h"
+
+// Public key directory: many Lamport public keys indexed by fingerprint (keydir-s89555)
+// ==========================================================
+// offset  size  field
+//      0     4  magic "LKDR"
+//      4     2  format version
+//      6     2  hash algorithm: the parameter profile (LAMPORT_PROFILE_*)
+//      8     2  component size in bytes (KEY_SIZE)
+//     10     2  components per key (NUM_BITS * 2)
+//     12     4  reserved (0)
+//     16     8  number of keys N
+//     24     8  number of slots S (a power of two, at least 2 * N)
+//     32     8  offset of the first key record
+//     40    24  reserved (0)
+//     64  S*E  slot table, E = HASH_SIZE + 8: fingerprint, then key number + 1 (0: empty slot)
+//      -     -  key records, KEYDIR_RECORD_SIZE bytes each: the raw public key components
+// All integers are little-endian. A key's fingerprint is its compact public key (keygen -c), the hash of
+// all its components. The home slot of a fingerprint is its first 8 bytes modulo S, and collisions probe
+// the following slots, so a lookup touches one or two table entries and one record however many keys
+// the directory holds. The file is mapped, not read: opening it only checks the header, and a lookup
+// trusts the slot's fingerprint. A damaged record is not detected here; signatures simply fail to verify
+// against it, and whoever can write the directory could add keys to it anyway.
+//
+// A signature made with sign -i ends with the signer record "signer <fingerprint hex>\n", after the
+// profile record and the digest trailer; verify -i <directory> looks its key up by that fingerprint.
+
+#define KEYDIR_MAGIC "LKDR"
+#define KEYDIR_VERSION 1
+#define KEYDIR_HEADER_SIZE 64
+#define KEYDIR_SLOT_SIZE (HASH_SIZE + 8)
+#define KEYDIR_RECORD_SIZE (NUM_BITS * 2 * KEY_SIZE)
+
+typedef struct {
+    void *base;
+    size_t size;
+    uint64_t num_keys;
+    uint64_t num_slots;
+    const unsigned char *slots;
+    const unsigned char *records;
+} keydir_map;
+
+// The fingerprint of a public key
+int keydir_fingerprint(unsigned char public_key[NUM_BITS][2][KEY_SIZE], unsigned char fingerprint[HASH_SIZE]);
+// Index the hex public key files into a new directory, replacing file_name once it is complete;
+// a key that is listed twice is stored once
+int keydir_build(const char *file_name, char *const *pub_file_names, size_t count);
+int keydir_open(const char *file_name, keydir_map *map);
+// Public key with this fingerprint as unsigned char [NUM_BITS][2][KEY_SIZE], or NULL (with an error message)
+const unsigned char *keydir_lookup(const keydir_map *map, const unsigned char fingerprint[HASH_SIZE]);
+void keydir_close(keydir_map *map);
+
+// Signer records of signature files
+int keydir_append_signer(const char *sig_filename, const unsigned char fingerprint[HASH_SIZE]);
+int keydir_read_signer(const char *sig_filename, unsigned char fingerprint[HASH_SIZE]);
+
+#endif // LAMPORT_KEYDIR_H
@@ -0,0 +1,534 @@
+/*
+ * Bulk key generation into an indexed keystore
+ * ==========================================================
+ * Worker threads claim key indices from a shared counter. Each key is one RAND_priv_bytes call for all
+ * NUM_BITS * 2 components (OpenSSL 3 keeps a private DRBG per thread, so the workers never contend for one),
+ * its public key is derived with hash_batch, and both records are written in place with pwrite.
+ * The files are written under a temporary name, the header and offset table go in last, and the files
+ * are fsync'ed and renamed, so a keystore that can be opened is always complete.
+ */
+
+#include "lamport_keystore.h"
+#include "lamport_common.h"
+#include "lamport_stats.h"
+#include "lamport_container.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint16_t get_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint64_t records_offset(uint64_t num_keys) {
+    uint64_t end = KEYSTORE_HEADER_SIZE + num_keys * 8;
+    return (end + KEYSTORE_ALIGNMENT - 1) / KEYSTORE_ALIGNMENT * KEYSTORE_ALIGNMENT;
+}
+
+static int pwrite_fully(int fd, const void *buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pwrite(fd, (const unsigned char *)buffer + done, size - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+// Tag = SHA-256(header fields || offset table)
+static int compute_tag(const unsigned char *header, const unsigned char *table, uint64_t num_keys, unsigned char tag[CONTAINER_TAG_SIZE]) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    unsigned int hash_len;
+    int ok = mdctx != NULL && EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) == 1 &&
+             EVP_DigestUpdate(mdctx, header, 32) == 1 && EVP_DigestUpdate(mdctx, table, (size_t)num_keys * 8) == 1 &&
+             EVP_DigestFinal_ex(mdctx, tag, &hash_len) == 1;
+    EVP_MD_CTX_free(mdctx);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to compute keystore tag\n");
+    }
+    return ok;
+}
+
+// Header and offset table of a keystore with num_keys records
+static unsigned char *build_index(uint16_t type, uint64_t num_keys, size_t *size) {
+    *size = KEYSTORE_HEADER_SIZE + (size_t)num_keys * 8;
+    unsigned char *index = calloc(1, *size);
+    if (index == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    uint64_t first = records_offset(num_keys);
+    memcpy(index, KEYSTORE_MAGIC, 4);
+    put_le16(index + 4, KEYSTORE_VERSION);
+    put_le16(index + 6, LAMPORT_PROFILE);
+    put_le16(index + 8, type);
+    put_le16(index + 12, KEY_SIZE);
+    put_le16(index + 14, NUM_BITS * 2);
+    put_le64(index + 16, num_keys);
+    put_le64(index + 24, first);
+    for (uint64_t i = 0; i < num_keys; i++) {
+        put_le64(index + KEYSTORE_HEADER_SIZE + i * 8, first + i * KEYSTORE_RECORD_STRIDE);
+    }
+    if (!compute_tag(index, index + KEYSTORE_HEADER_SIZE, num_keys, index + 32)) {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+typedef struct {
+    int priv_fd;
+    int pub_fd;
+    uint64_t num_keys;
+    uint64_t first_record;
+    uint64_t next_key; // claimed with __atomic_fetch_add
+    int failed;
+} keygen_job;
+
+static void *keygen_worker(void *arg) {
+    keygen_job *job = arg;
+    unsigned char private_key[KEYSTORE_RECORD_SIZE];
+    unsigned char public_key[KEYSTORE_RECORD_SIZE];
+
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        uint64_t key = __atomic_fetch_add(&job->next_key, 1, __ATOMIC_RELAXED);
+        if (key >= job->num_keys) {
+            break;
+        }
+        uint64_t offset = job->first_record + key * KEYSTORE_RECORD_STRIDE;
+        const char *problem = NULL;
+        if (RAND_priv_bytes(private_key, sizeof(private_key)) != 1) {
+            problem = "Failed to generate random bytes";
+        } else if (!hash_batch(private_key, public_key, NUM_BITS * 2)) {
+            problem = "Failed to hash private key components";
+        } else if (!pwrite_fully(job->priv_fd, private_key, sizeof(private_key), offset) ||
+                   !pwrite_fully(job->pub_fd, public_key, sizeof(public_key), offset)) {
+            problem = "Failed to write keystore";
+        }
+        if (problem != NULL) {
+            fprintf(stderr, "Error: %s (key %llu)\n", problem, (unsigned long long)key);
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    OPENSSL_cleanse(private_key, sizeof(private_key));
+    return NULL;
+}
+
+static int create_file(const char *file_name, int owner_only, uint64_t size) {
+    int fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, owner_only ? (S_IRUSR | S_IWUSR) : 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create keystore file %s\n", file_name);
+        return -1;
+    }
+    if ((owner_only && fchmod(fd, S_IRUSR | S_IWUSR) != 0) || ftruncate(fd, (off_t)size) != 0) {
+        fprintf(stderr, "Error: Cannot prepare keystore file %s\n", file_name);
+        close(fd);
+        unlink(file_name);
+        return -1;
+    }
+    return fd;
+}
+
+// Header and offset table go in last, then the file is made durable
+static int finish_file(int fd, uint16_t type, uint64_t num_keys, const char *tmp_name, const char *file_name) {
+    size_t size;
+    unsigned char *index = build_index(type, num_keys, &size);
+    int ok = index != NULL && pwrite_fully(fd, index, size, 0) && fsync(fd) == 0;
+    free(index);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write keystore file %s\n", tmp_name);
+        return 0;
+    }
+    if (rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: Cannot replace keystore file %s\n", file_name);
+        return 0;
+    }
+    return 1;
+}
+
+int keystore_generate(const char *priv_file_name, const char *pub_file_name, uint64_t num_keys, int num_threads) {
+    if (num_keys == 0) {
+        fprintf(stderr, "Error: Number of keys must be at least 1\n");
+        return 0;
+    }
+    if (num_threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? (int)online : 1;
+    }
+    if ((uint64_t)num_threads > num_keys) {
+        num_threads = (int)num_keys;
+    }
+    // Resolve the hash kernel before the workers start
+    hash_batch_kernel();
+
+    char priv_tmp[strlen(priv_file_name) + 5];
+    char pub_tmp[strlen(pub_file_name) + 5];
+    sprintf(priv_tmp, "%s.tmp", priv_file_name);
+    sprintf(pub_tmp, "%s.tmp", pub_file_name);
+
+    keygen_job job;
+    memset(&job, 0, sizeof(job));
+    job.num_keys = num_keys;
+    job.first_record = records_offset(num_keys);
+    uint64_t size = job.first_record + num_keys * KEYSTORE_RECORD_STRIDE;
+    job.priv_fd = create_file(priv_tmp, 1, size);
+    if (job.priv_fd < 0) {
+        return 0;
+    }
+    job.pub_fd = create_file(pub_tmp, 0, size);
+    if (job.pub_fd < 0) {
+        close(job.priv_fd);
+        unlink(priv_tmp);
+        return 0;
+    }
+
+    pthread_t *workers = calloc((size_t)num_threads, sizeof(pthread_t));
+    int started = 0;
+    for (; workers != NULL && started < num_threads; started++) {
+        if (pthread_create(&workers[started], NULL, keygen_worker, &job) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        keygen_worker(&job); // no threads available: generate every key here
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+
+    int ok = !job.failed && finish_file(job.priv_fd, KEYSTORE_PRIVATE, num_keys, priv_tmp, priv_file_name) &&
+             finish_file(job.pub_fd, KEYSTORE_PUBLIC, num_keys, pub_tmp, pub_file_name);
+    close(job.priv_fd);
+    close(job.pub_fd);
+    if (!ok) {
+        unlink(priv_tmp);
+        unlink(pub_tmp);
+    }
+    return ok;
+}
+
+static int open_keystore(const char *file_name, uint16_t type, keystore_map *map) {
+    memset(map, 0, sizeof(*map));
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open keystore file %s\n", file_name);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < KEYSTORE_HEADER_SIZE) {
+        fprintf(stderr, "Error: Invalid keystore file format %s\n", file_name);
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map keystore file %s\n", file_name);
+        return 0;
+    }
+
+    const unsigned char *header = base;
+    uint64_t num_keys = get_le64(header + 16);
+    uint64_t first = get_le64(header + 24);
+    unsigned char tag[CONTAINER_TAG_SIZE];
+    const char *problem = NULL;
+    if (memcmp(header, KEYSTORE_MAGIC, 4) != 0) {
+        problem = "not a Lamport keystore";
+    } else if (get_le16(header + 4) != KEYSTORE_VERSION) {
+        problem = "unsupported format version";
+    } else if (get_le16(header + 6) != LAMPORT_PROFILE || get_le16(header + 12) != KEY_SIZE ||
+               get_le16(header + 14) != NUM_BITS * 2) {
+        problem = "written with a different parameter profile (this build: " LAMPORT_PROFILE_NAME ")";
+    } else if (get_le16(header + 8) != type) {
+        problem = "wrong content type";
+    } else if (num_keys == 0 || num_keys > (size - KEYSTORE_HEADER_SIZE) / (8 + KEYSTORE_RECORD_SIZE) ||
+               first != records_offset(num_keys)) {
+        problem = "wrong number of keys";
+    } else if (!compute_tag(header, header + KEYSTORE_HEADER_SIZE, num_keys, tag) ||
+               CRYPTO_memcmp(tag, header + 32, CONTAINER_TAG_SIZE) != 0) {
+        problem = "integrity check failed";
+    }
+    // Every record must lie inside the file
+    for (uint64_t i = 0; problem == NULL && i < num_keys; i++) {
+        uint64_t offset = get_le64(header + KEYSTORE_HEADER_SIZE + i * 8);
+        if (offset < first || offset % KEYSTORE_ALIGNMENT != 0 || offset > size - KEYSTORE_RECORD_SIZE) {
+            problem = "bad offset table";
+        }
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: Invalid keystore file %s: %s\n", file_name, problem);
+        munmap(base, size);
+        return 0;
+    }
+
+    map->base = base;
+    map->size = size;
+    map->num_keys = num_keys;
+    map->offsets = header + KEYSTORE_HEADER_SIZE;
+    map->type = type;
+    return 1;
+}
+
+int keystore_open(const char *file_name, uint16_t type, keystore_map *map) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = open_keystore(file_name, type, map);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+const unsigned char *keystore_key(const keystore_map *map, uint64_t index) {
+    if (index >= map->num_keys) {
+        fprintf(stderr, "Error: Key %llu is not in the keystore (%llu keys)\n", (unsigned long long)index,
+                (unsigned long long)map->num_keys);
+        return NULL;
+    }
+    return (const unsigned char *)map->base + get_le64(map->offsets + index * 8);
+}
+
+void keystore_close(keystore_map *map) {
+    if (map->base != NULL) {
+        munmap(map->base, map->size);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+// ----------------------------------------------------------------------------
+// Key allocation
+// ----------------------------------------------------------------------------
+
+#define ALLOC_NEXT 48
+#define ALLOC_CLAIMS 56
+#define ALLOC_SYNCED 64
+
+static size_t alloc_file_size(uint64_t num_keys) {
+    return KEYSTORE_ALLOC_HEADER_SIZE + (size_t)((num_keys + 63) / 64) * 8;
+}
+
+static uint64_t *alloc_word(const keystore_alloc *alloc, size_t offset) {
+    return (uint64_t *)((unsigned char *)alloc->base + offset);
+}
+
+// The keystore tag alone does not tell two keystores of the same size apart (it does not cover the keys),
+// so the identity also hashes the first key record
+static int keystore_id(const keystore_map *keystore, unsigned char id[CONTAINER_TAG_SIZE]) {
+    const unsigned char *first = keystore_key(keystore, 0);
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    unsigned int hash_len = 0;
+    int ok = first != NULL && mdctx != NULL && EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) == 1 &&
+             EVP_DigestUpdate(mdctx, KEYSTORE_ALLOC_MAGIC, 4) == 1 &&
+             EVP_DigestUpdate(mdctx, (const unsigned char *)keystore->base + 32, CONTAINER_TAG_SIZE) == 1 &&
+             EVP_DigestUpdate(mdctx, first, KEYSTORE_RECORD_SIZE) == 1 && EVP_DigestFinal_ex(mdctx, id, &hash_len) == 1;
+    EVP_MD_CTX_free(mdctx);
+    return ok && hash_len == CONTAINER_TAG_SIZE;
+}
+
+// Write a fresh allocation file under tmp_name
+static int write_alloc_file(const char *tmp_name, const keystore_map *keystore) {
+    size_t size = alloc_file_size(keystore->num_keys);
+    unsigned char header[KEYSTORE_ALLOC_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    if (!keystore_id(keystore, header + 16)) {
+        fprintf(stderr, "Error: Cannot identify the keystore\n");
+        return 0;
+    }
+    memcpy(header, KEYSTORE_ALLOC_MAGIC, 4);
+    put_le16(header + 4, KEYSTORE_ALLOC_VERSION);
+    put_le64(header + 8, keystore->num_keys);
+    int fd = create_file(tmp_name, 1, size);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = pwrite_fully(fd, header, sizeof(header), 0) && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write key allocation file %s\n", tmp_name);
+        unlink(tmp_name);
+    }
+    return ok;
+}
+
+int keystore_alloc_create(const char *file_name, const keystore_map *keystore) {
+    char tmp_name[strlen(file_name) + 5];
+    sprintf(tmp_name, "%s.tmp", file_name);
+    if (!write_alloc_file(tmp_name, keystore)) {
+        return 0;
+    }
+    if (rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: Cannot replace key allocation file %s\n", file_name);
+        unlink(tmp_name);
+        return 0;
+    }
+    return 1;
+}
+
+// Several signers may find the file missing at once: link() lets exactly one of them install it
+static int create_missing_alloc(const char *file_name, const keystore_map *keystore) {
+    char tmp_name[strlen(file_name) + 32];
+    sprintf(tmp_name, "%s.%ld.tmp", file_name, (long)getpid());
+    if (!write_alloc_file(tmp_name, keystore)) {
+        return 0;
+    }
+    int created = link(tmp_name, file_name) == 0;
+    int ok = created || errno == EEXIST;
+    unlink(tmp_name);
+    if (created) {
+        fprintf(stderr, "Warning: No key allocation file, created %s; keys used before it existed are not known to it\n", file_name);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Cannot create key allocation file %s\n", file_name);
+    }
+    return ok;
+}
+
+int keystore_alloc_open(const char *file_name, const keystore_map *keystore, keystore_alloc *alloc) {
+    memset(alloc, 0, sizeof(*alloc));
+    int fd = open(file_name, O_RDWR);
+    if (fd < 0 && errno == ENOENT && create_missing_alloc(file_name, keystore)) {
+        fd = open(file_name, O_RDWR);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open key allocation file %s\n", file_name);
+        return 0;
+    }
+    struct stat st;
+    size_t size = alloc_file_size(keystore->num_keys);
+    unsigned char id[CONTAINER_TAG_SIZE];
+    const char *problem = NULL;
+    if (!keystore_id(keystore, id)) {
+        problem = "cannot identify the keystore";
+    } else if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) {
+        problem = "wrong size";
+    } else if ((st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        problem = "writable by others";
+    }
+    void *base = problem == NULL ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (problem == NULL && base == MAP_FAILED) {
+        problem = "cannot map it";
+    }
+    const unsigned char *header = base;
+    if (problem == NULL && (memcmp(header, KEYSTORE_ALLOC_MAGIC, 4) != 0 || get_le16(header + 4) != KEYSTORE_ALLOC_VERSION)) {
+        problem = "not a key allocation file";
+    } else if (problem == NULL && (get_le64(header + 8) != keystore->num_keys ||
+                                   memcmp(header + 16, id, CONTAINER_TAG_SIZE) != 0)) {
+        problem = "it belongs to a different keystore";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: Invalid key allocation file %s: %s\n", file_name, problem);
+        if (base != MAP_FAILED) {
+            munmap(base, size);
+        }
+        return 0;
+    }
+    alloc->base = base;
+    alloc->size = size;
+    alloc->num_keys = keystore->num_keys;
+    // A torn write-back before a crash can leave the durable count ahead of the claim count; never trust
+    // more than was claimed, or a later claim could skip its flush
+    uint64_t claims = __atomic_load_n(alloc_word(alloc, ALLOC_CLAIMS), __ATOMIC_ACQUIRE);
+    uint64_t synced = __atomic_load_n(alloc_word(alloc, ALLOC_SYNCED), __ATOMIC_ACQUIRE);
+    while (synced > claims && !__atomic_compare_exchange_n(alloc_word(alloc, ALLOC_SYNCED), &synced, claims, 1,
+                                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    }
+    return 1;
+}
+
+// Set bit index unless it is already set
+static int claim_bit(keystore_alloc *alloc, uint64_t index) {
+    uint64_t *word = alloc_word(alloc, KEYSTORE_ALLOC_HEADER_SIZE + (size_t)(index / 64) * 8);
+    uint64_t mask = (uint64_t)1 << (index % 64);
+    uint64_t old = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    do {
+        if (old & mask) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(word, &old, old | mask, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    // The claim count goes up after the bit is set, so a signer that syncs up to this count covers the bit
+    alloc->claim = __atomic_add_fetch(alloc_word(alloc, ALLOC_CLAIMS), 1, __ATOMIC_ACQ_REL);
+    return 1;
+}
+
+int keystore_claim_next(keystore_alloc *alloc, uint64_t *index) {
+    for (;;) {
+        uint64_t i = __atomic_fetch_add(alloc_word(alloc, ALLOC_NEXT), 1, __ATOMIC_ACQ_REL);
+        if (i >= alloc->num_keys) {
+            fprintf(stderr, "Error: All %llu keys of the keystore have been used\n", (unsigned long long)alloc->num_keys);
+            return 0;
+        }
+        if (claim_bit(alloc, i)) {
+            *index = i;
+            return 1;
+        }
+    }
+}
+
+int keystore_claim(keystore_alloc *alloc, uint64_t index) {
+    if (index >= alloc->num_keys) {
+        fprintf(stderr, "Error: Key %llu is not in the keystore (%llu keys)\n", (unsigned long long)index,
+                (unsigned long long)alloc->num_keys);
+        return 0;
+    }
+    if (!claim_bit(alloc, index)) {
+        fprintf(stderr, "Error: Key %llu of the keystore has already been used\n", (unsigned long long)index);
+        return 0;
+    }
+    return 1;
+}
+
+int keystore_alloc_sync(keystore_alloc *alloc) {
+    uint64_t *synced = alloc_word(alloc, ALLOC_SYNCED);
+    if (__atomic_load_n(synced, __ATOMIC_ACQUIRE) >= alloc->claim) {
+        return 1; // another signer's flush already wrote our bit
+    }
+    // Everything claimed up to now is in the mapping; one flush makes all of it durable
+    uint64_t target = __atomic_load_n(alloc_word(alloc, ALLOC_CLAIMS), __ATOMIC_ACQUIRE);
+    if (msync(alloc->base, alloc->size, MS_SYNC) != 0) {
+        fprintf(stderr, "Error: Cannot write the key allocation file to disk\n");
+        return 0;
+    }
+    uint64_t old = __atomic_load_n(synced, __ATOMIC_ACQUIRE);
+    while (old < target && !__atomic_compare_exchange_n(synced, &old, target, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    }
+    return 1;
+}
+
+uint64_t keystore_alloc_used(const keystore_alloc *alloc) {
+    return __atomic_load_n(alloc_word(alloc, ALLOC_CLAIMS), __ATOMIC_ACQUIRE);
+}
+
+void keystore_alloc_close(keystore_alloc *alloc) {
+    if (alloc->base != NULL) {
+        munmap(alloc->base, alloc->size);
+    }
+    memset(alloc, 0, sizeof(*alloc));
+}
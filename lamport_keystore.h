@@ -0,0 +1,95 @@
+#ifndef LAMPORT_KEYSTORE_H
+#define LAMPORT_KEYSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lamport_constants.h"
+
+// Indexed keystore for bulk one-time keys (keygen -n) and its public key bundle
+// ==========================================================
+// offset  size  field
+//      0     4  magic "LKST"
+//      4     2  format version
+//      6     2  hash algorithm: the parameter profile (LAMPORT_PROFILE_*)
+//      8     2  content type (KEYSTORE_PRIVATE or KEYSTORE_PUBLIC)
+//     10     2  flags, reserved (0)
+//     12     2  component size in bytes (KEY_SIZE)
+//     14     2  components per key (NUM_BITS * 2)
+//     16     8  number of keys N
+//     24     8  offset of the first key record
+//     32    32  integrity tag: SHA-256 over bytes 0..31 and the offset table
+//     64  8*N  offset table: file offset of key i
+//      -     -  key records, KEYSTORE_RECORD_SIZE bytes each, KEYSTORE_RECORD_STRIDE apart (4096-byte aligned)
+// All integers are little-endian. Key i of the private keystore and key i of the public bundle
+// form one key pair. The tag covers the header and the offset table, not the key records.
+
+#define KEYSTORE_MAGIC "LKST"
+#define KEYSTORE_VERSION 1
+#define KEYSTORE_HEADER_SIZE 64
+#define KEYSTORE_ALIGNMENT 4096
+#define KEYSTORE_RECORD_SIZE (NUM_BITS * 2 * KEY_SIZE)
+#define KEYSTORE_RECORD_STRIDE ((KEYSTORE_RECORD_SIZE + KEYSTORE_ALIGNMENT - 1) / KEYSTORE_ALIGNMENT * KEYSTORE_ALIGNMENT)
+
+#define KEYSTORE_PRIVATE 1
+#define KEYSTORE_PUBLIC 2
+
+typedef struct {
+    void *base;                   // start of the mapping
+    size_t size;                  // length of the mapping
+    uint64_t num_keys;
+    const unsigned char *offsets; // offset table
+    uint16_t type;
+} keystore_map;
+
+// Generate num_keys key pairs on num_threads threads (0 = one per CPU) into a keystore and its public bundle
+int keystore_generate(const char *priv_file_name, const char *pub_file_name, uint64_t num_keys, int num_threads);
+// Map a keystore read-only and check the header, the offset table and its integrity tag
+int keystore_open(const char *file_name, uint16_t type, keystore_map *map);
+// Key record index as unsigned char [NUM_BITS][2][KEY_SIZE], or NULL if there is no such key
+const unsigned char *keystore_key(const keystore_map *map, uint64_t index);
+void keystore_close(keystore_map *map);
+
+// Key allocation file: which keys of a private keystore have been handed out
+// ==========================================================
+// offset  size  field
+//      0     4  magic "LKAL"
+//      4     2  format version
+//      6     2  reserved (0)
+//      8     8  number of keys N
+//     16    32  keystore identity: SHA-256 of "LKAL", the keystore's integrity tag and its key record 0
+//     48     8  next index for automatic allocation
+//     56     8  claims made so far
+//     64     8  claims known to be on disk
+//    128  8*W  used-key bitmap, W = ceil(N / 64) words; bit i % 64 of word i / 64 is set once key i is used
+// The counters and the bitmap are 64-bit words in host byte order that every signer maps shared and
+// updates with atomic instructions: automatic allocation takes the next index with fetch-and-add and
+// claims its bit with compare-and-swap, skipping keys that were claimed explicitly. A bit is never
+// cleared, so no key is handed out twice, and no lock is taken. Before a key is used its claim is made
+// durable with msync; a signer whose claim was already covered by another signer's msync skips its own
+// (group commit), so concurrent signers share the flushes.
+
+#define KEYSTORE_ALLOC_MAGIC "LKAL"
+#define KEYSTORE_ALLOC_VERSION 1
+#define KEYSTORE_ALLOC_HEADER_SIZE 128
+
+typedef struct {
+    void *base;
+    size_t size;
+    uint64_t num_keys;
+    uint64_t claim; // sequence number of this process's last claim
+} keystore_alloc;
+
+// Create a fresh allocation file for a keystore, replacing any old one (keygen -n)
+int keystore_alloc_create(const char *file_name, const keystore_map *keystore);
+// Map the allocation file of a keystore, creating it if there is none yet
+int keystore_alloc_open(const char *file_name, const keystore_map *keystore, keystore_alloc *alloc);
+// Claim the next unused key, or key index itself; fails if the keys are used up or index is taken
+int keystore_claim_next(keystore_alloc *alloc, uint64_t *index);
+int keystore_claim(keystore_alloc *alloc, uint64_t index);
+// Make this process's claims durable
+int keystore_alloc_sync(keystore_alloc *alloc);
+// Number of keys claimed so far
+uint64_t keystore_alloc_used(const keystore_alloc *alloc);
+void keystore_alloc_close(keystore_alloc *alloc);
+
+#endif // LAMPORT_KEYSTORE_H
@@ -0,0 +1,564 @@
+#include "lamport_merkle.h"
+#include "lamport_hex.h"
+#include "lamport_stats.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+// Domain separation between leaf hashes and interior node hashes
+#define MSS_LEAF_PREFIX 0x00
+#define MSS_NODE_PREFIX 0x01
+
+static int hash_prefixed(unsigned char prefix, const unsigned char *data1, size_t len1,
+                         const unsigned char *data2, size_t len2, unsigned char out[HASH_SIZE]) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    if (mdctx == NULL) {
+        fprintf(stderr, "Error: Failed to create hash context\n");
+        return 0;
+    }
+    stats_begin(STATS_COMPONENT_HASH);
+    int ok = hash_init(mdctx) &&
+             EVP_DigestUpdate(mdctx, &prefix, 1) == 1 &&
+             EVP_DigestUpdate(mdctx, data1, len1) == 1 &&
+             (len2 == 0 || EVP_DigestUpdate(mdctx, data2, len2) == 1) &&
+             hash_final(mdctx, out);
+    stats_end(STATS_COMPONENT_HASH);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to compute tree hash\n");
+    }
+    EVP_MD_CTX_free(mdctx);
+    return ok;
+}
+
+static int hash_children(const unsigned char left[HASH_SIZE], const unsigned char right[HASH_SIZE], unsigned char out[HASH_SIZE]) {
+    return hash_prefixed(MSS_NODE_PREFIX, left, HASH_SIZE, right, HASH_SIZE, out);
+}
+
+int mss_leaf_hash(unsigned char public_key[NUM_BITS][2][KEY_SIZE], unsigned char leaf[HASH_SIZE]) {
+    return hash_prefixed(MSS_LEAF_PREFIX, &public_key[0][0][0], NUM_BITS * 2 * KEY_SIZE, NULL, 0, leaf);
+}
+
+// Derive one-time key number leaf from the seed and return both halves of its key pair
+static int derive_key_pair(const unsigned char seed[KEY_SIZE], unsigned long leaf,
+                           unsigned char private_key[NUM_BITS][2][KEY_SIZE],
+                           unsigned char public_key[NUM_BITS][2][KEY_SIZE]) {
+    if (!derive_private_components(seed, leaf, 0, NUM_BITS * 2, &private_key[0][0][0])) {
+        return 0;
+    }
+    return hash_batch(&private_key[0][0][0], &public_key[0][0][0], NUM_BITS * 2);
+}
+
+static int compute_leaf(const unsigned char seed[KEY_SIZE], unsigned long leaf, unsigned char node[HASH_SIZE]) {
+    unsigned char private_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    int ok = derive_key_pair(seed, leaf, private_key, public_key) && mss_leaf_hash(public_key, node);
+    OPENSSL_cleanse(private_key, sizeof(private_key));
+    return ok;
+}
+
+static unsigned int count_bits(unsigned long v) {
+    unsigned int count = 0;
+    for (; v != 0; v &= v - 1) {
+        count++;
+    }
+    return count;
+}
+
+// While leaf is in the window (leaf >> l) of level l, the traversal builds the node that level needs in the
+// next window, ((leaf >> l) + 1) ^ 1. The last window of a level needs none.
+static int has_upcoming(unsigned int height, unsigned int l, unsigned long leaf) {
+    return (leaf >> l) + 1 < (1UL << (height - l));
+}
+
+static unsigned long upcoming_index(unsigned int l, unsigned long leaf) {
+    return ((leaf >> l) + 1) ^ 1UL;
+}
+
+// Keep a node of the whole tree if the traversal for traversal->leaf holds it: an authentication path node,
+// or a node on the stack of a higher level (one per set bit of the leaves that stack has done)
+static void traversal_capture(mss_traversal *traversal, unsigned int height, unsigned int level, unsigned long index,
+                              const unsigned char node[HASH_SIZE]) {
+    unsigned long leaf = traversal->leaf;
+    if (level < height && index == ((leaf >> level) ^ 1UL)) {
+        memcpy(traversal->auth_path[level], node, HASH_SIZE);
+    }
+    for (unsigned int l = level + 1; l < height; l++) {
+        unsigned long done = leaf & ((1UL << l) - 1);
+        if (!has_upcoming(height, l, leaf) || ((done >> level) & 1) == 0) {
+            continue;
+        }
+        unsigned long first = (upcoming_index(l, leaf) << l) + (done >> (level + 1) << (level + 1));
+        if (index << level == first) {
+            memcpy(traversal->stack[l][count_bits(done >> (level + 1))], node, HASH_SIZE);
+        }
+    }
+}
+
+// Treehash: root of the subtree of the given height whose leftmost leaf is first_leaf.
+// Leaves are generated left to right and equal-height nodes are merged on a stack,
+// so at most height + 1 nodes are held at any time. With a traversal (whole tree only),
+// the nodes it needs are kept on the way.
+static int treehash(const unsigned char seed[KEY_SIZE], unsigned long first_leaf, unsigned int height, unsigned char root[HASH_SIZE],
+                    mss_traversal *traversal) {
+    unsigned char stack[MSS_MAX_HEIGHT + 1][HASH_SIZE];
+    unsigned int node_height[MSS_MAX_HEIGHT + 1];
+    int top = 0;
+
+    for (unsigned long leaf = first_leaf; leaf < first_leaf + (1UL << height); leaf++) {
+        if (!compute_leaf(seed, leaf, stack[top])) {
+            return 0;
+        }
+        node_height[top++] = 0;
+        if (traversal != NULL) {
+            traversal_capture(traversal, height, 0, leaf, stack[top - 1]);
+        }
+        while (top >= 2 && node_height[top - 1] == node_height[top - 2]) {
+            if (!hash_children(stack[top - 2], stack[top - 1], stack[top - 2])) {
+                return 0;
+            }
+            node_height[top - 2]++;
+            top--;
+            if (traversal != NULL) {
+                traversal_capture(traversal, height, node_height[top - 1], leaf >> node_height[top - 1], stack[top - 1]);
+            }
+        }
+    }
+    memcpy(root, stack[0], HASH_SIZE);
+    return 1;
+}
+
+int mss_keygen(unsigned int height, mss_private_state *state, mss_public_key *public_key, mss_traversal *traversal) {
+    if (height > MSS_MAX_HEIGHT) {
+        fprintf(stderr, "Error: Tree height must be between 0 and %d\n", MSS_MAX_HEIGHT);
+        return 0;
+    }
+    if (RAND_priv_bytes(state->seed, KEY_SIZE) != 1) {
+        fprintf(stderr, "Error: Failed to generate random bytes\n");
+        return 0;
+    }
+    state->height = height;
+    state->next_leaf = 0;
+    public_key->height = height;
+    if (traversal != NULL) {
+        traversal->leaf = 0;
+    }
+    return treehash(state->seed, 0, height, public_key->root, traversal);
+}
+
+int mss_traversal_init(const mss_private_state *state, mss_traversal *traversal) {
+    unsigned char root[HASH_SIZE];
+    traversal->leaf = state->next_leaf;
+    if (state->next_leaf >= (1UL << state->height)) {
+        return 1;
+    }
+    return treehash(state->seed, 0, state->height, root, traversal);
+}
+
+int mss_traversal_next(const mss_private_state *state, mss_traversal *traversal) {
+    unsigned long leaf = traversal->leaf;
+    for (unsigned int l = 0; l < state->height; l++) {
+        if (!has_upcoming(state->height, l, leaf)) {
+            continue;
+        }
+        // One more leaf of the upcoming node; the stack holds one node per set bit of done
+        unsigned long done = leaf & ((1UL << l) - 1);
+        unsigned char (*stack)[HASH_SIZE] = traversal->stack[l];
+        unsigned int top = count_bits(done);
+        if (!compute_leaf(state->seed, (upcoming_index(l, leaf) << l) + done, stack[top])) {
+            return 0;
+        }
+        for (unsigned long carry = done; carry & 1; carry >>= 1) {
+            if (!hash_children(stack[top - 1], stack[top], stack[top - 1])) {
+                return 0;
+            }
+            top--;
+        }
+        // The node is complete exactly when the next leaf enters the window that needs it
+        if (((leaf + 1) & ((1UL << l) - 1)) == 0) {
+            memcpy(traversal->auth_path[l], stack[0], HASH_SIZE);
+        }
+    }
+    traversal->leaf = leaf + 1;
+    return 1;
+}
+
+int mss_rebuild_public_key(unsigned char ots[NUM_BITS][KEY_SIZE], unsigned char complement[NUM_BITS][KEY_SIZE],
+                           const unsigned char *hash, unsigned char public_key[NUM_BITS][2][KEY_SIZE]) {
+    unsigned char revealed[NUM_BITS][KEY_SIZE];
+    if (!hash_batch(&ots[0][0], &revealed[0][0], NUM_BITS)) {
+        return 0;
+    }
+    for (int i = 0; i < NUM_BITS; i++) {
+        int bit_value = (hash[i / 8] >> (7 - i % 8)) & 1;
+        memcpy(public_key[i][bit_value], revealed[i], KEY_SIZE);
+        memcpy(public_key[i][1 - bit_value], complement[i], KEY_SIZE);
+    }
+    return 1;
+}
+
+size_t mss_tree_size(unsigned int height) {
+    return ((2UL << height) - 1) * HASH_SIZE;
+}
+
+int mss_build_tree(const unsigned char seed[KEY_SIZE], unsigned int height, unsigned char *tree) {
+    size_t width = 1UL << height;
+    for (size_t leaf = 0; leaf < width; leaf++) {
+        if (!compute_leaf(seed, leaf, tree + leaf * HASH_SIZE)) {
+            return 0;
+        }
+    }
+    // Each level follows the one below it
+    unsigned char *level = tree;
+    for (; width > 1; width /= 2) {
+        unsigned char *parent = level + width * HASH_SIZE;
+        for (size_t i = 0; i < width / 2; i++) {
+            if (!hash_children(level + 2 * i * HASH_SIZE, level + (2 * i + 1) * HASH_SIZE, parent + i * HASH_SIZE)) {
+                return 0;
+            }
+        }
+        level = parent;
+    }
+    return 1;
+}
+
+static int prepare_key_pair(const mss_private_state *state, unsigned long leaf, mss_prepared_key *key) {
+    if (leaf >= (1UL << state->height)) {
+        fprintf(stderr, "Error: One-time key index %lu is outside the tree\n", leaf);
+        return 0;
+    }
+    key->leaf_index = leaf;
+    if (!derive_key_pair(state->seed, leaf, key->private_key, key->public_key)) {
+        OPENSSL_cleanse(key->private_key, sizeof(key->private_key));
+        return 0;
+    }
+    return 1;
+}
+
+int mss_prepare_key(const mss_private_state *state, const unsigned char *tree, unsigned long leaf, mss_prepared_key *key) {
+    if (!prepare_key_pair(state, leaf, key)) {
+        return 0;
+    }
+
+    // The sibling at level l is the root of the height-l subtree next to the leaf's ancestor
+    const unsigned char *level = tree;
+    for (unsigned int l = 0; l < state->height; l++) {
+        unsigned long sibling = (leaf >> l) ^ 1UL;
+        if (tree != NULL) {
+            memcpy(key->auth_path[l], level + sibling * HASH_SIZE, HASH_SIZE);
+            level += (1UL << (state->height - l)) * HASH_SIZE;
+        } else if (!treehash(state->seed, sibling << l, l, key->auth_path[l], NULL)) {
+            OPENSSL_cleanse(key->private_key, sizeof(key->private_key));
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void mss_sign_prepared(const mss_prepared_key *key, unsigned int height, const unsigned char *hash, mss_signature *signature) {
+    signature->leaf_index = key->leaf_index;
+    digest_params_default(&signature->digest);
+    for (int i = 0; i < NUM_BITS; i++) {
+        int bit_value = (hash[i / 8] >> (7 - i % 8)) & 1;
+        memcpy(signature->ots[i], key->private_key[i][bit_value], KEY_SIZE);
+        memcpy(signature->complement[i], key->public_key[i][1 - bit_value], KEY_SIZE);
+    }
+    memcpy(signature->auth_path, key->auth_path, (size_t)height * HASH_SIZE);
+}
+
+int mss_sign(const mss_private_state *state, const mss_traversal *traversal, const unsigned char *hash, mss_signature *signature) {
+    mss_prepared_key key;
+    if (!prepare_key_pair(state, traversal->leaf, &key)) {
+        return 0;
+    }
+    memcpy(key.auth_path, traversal->auth_path, (size_t)state->height * HASH_SIZE);
+    mss_sign_prepared(&key, state->height, hash, signature);
+    OPENSSL_cleanse(&key, sizeof(key));
+    return 1;
+}
+
+int mss_verify(const mss_public_key *public_key, const mss_signature *signature, const unsigned char *hash) {
+    unsigned char ots_public_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char node[HASH_SIZE];
+
+    if (signature->leaf_index >= (1UL << public_key->height)) {
+        return 0;
+    }
+    if (!mss_rebuild_public_key((unsigned char (*)[KEY_SIZE])signature->ots, (unsigned char (*)[KEY_SIZE])signature->complement,
+                                hash, ots_public_key) ||
+        !mss_leaf_hash(ots_public_key, node)) {
+        return 0;
+    }
+    for (unsigned int l = 0; l < public_key->height; l++) {
+        int ok = ((signature->leaf_index >> l) & 1) ? hash_children(signature->auth_path[l], node, node)
+                                                    : hash_children(node, signature->auth_path[l], node);
+        if (!ok) {
+            return 0;
+        }
+    }
+    stats_begin(STATS_COMPARE);
+    int valid = CRYPTO_memcmp(node, public_key->root, HASH_SIZE) == 0;
+    stats_end(STATS_COMPARE);
+    return valid;
+}
+
+// ----------------------------------------------------------------------------
+// File formats (hex text, one 32-byte value per line)
+// ----------------------------------------------------------------------------
+
+// Nodes on the stack of level l for a traversal at leaf
+static unsigned int stack_size(unsigned int height, unsigned int l, unsigned long leaf) {
+    return has_upcoming(height, l, leaf) ? count_bits(leaf & ((1UL << l) - 1)) : 0;
+}
+
+static int read_traversal(FILE *file, const mss_private_state *state, mss_traversal *traversal) {
+    unsigned long leaf;
+    if (fscanf(file, " traversal %lu", &leaf) != 1 || fgetc(file) != '\n' || leaf != state->next_leaf) {
+        return 0;
+    }
+    for (unsigned int l = 0; l < state->height; l++) {
+        if (!hex_fread_line(file, traversal->auth_path[l], HASH_SIZE)) {
+            return 0;
+        }
+    }
+    for (unsigned int l = 0; l < state->height; l++) {
+        for (unsigned int i = 0; i < stack_size(state->height, l, leaf); i++) {
+            if (!hex_fread_line(file, traversal->stack[l][i], HASH_SIZE)) {
+                return 0;
+            }
+        }
+    }
+    traversal->leaf = leaf;
+    return 1;
+}
+
+static int read_private_state(const char *file_name, mss_private_state *state, mss_traversal *traversal) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    if (!hex_fread_line(file, state->seed, KEY_SIZE) ||
+        fscanf(file, "%u %lu", &state->height, &state->next_leaf) != 2 ||
+        state->height > MSS_MAX_HEIGHT || hex_fread_profile(file, file_name) < 0) {
+        fprintf(stderr, "Error: Invalid Merkle private key file format\n");
+        fclose(file);
+        return 0;
+    }
+    // A missing or stale traversal state is not an error: the signer rebuilds it
+    if (traversal != NULL && !read_traversal(file, state, traversal)) {
+        traversal->leaf = state->next_leaf + 1;
+    }
+    fclose(file);
+    return 1;
+}
+
+int read_mss_private_state(const char *file_name, mss_private_state *state, mss_traversal *traversal) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_private_state(file_name, state, traversal);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+// Write the private state to a temporary file, fsync it and rename it over the old one,
+// so a used leaf index is on disk before any signature made with it leaves the process
+static int write_private_state(const char *file_name, const mss_private_state *state, const mss_traversal *traversal) {
+    char tmp_name[strlen(file_name) + 5];
+    sprintf(tmp_name, "%s.tmp", file_name);
+
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create key file %s\n", tmp_name);
+        return 0;
+    }
+    FILE *file = fdopen(fd, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create key file %s\n", tmp_name);
+        close(fd);
+        return 0;
+    }
+    hex_fwrite_line(file, state->seed, KEY_SIZE);
+    fprintf(file, "%u %lu\n", state->height, state->next_leaf);
+    hex_fwrite_profile(file);
+    if (traversal != NULL && traversal->leaf == state->next_leaf) {
+        fprintf(file, "traversal %lu\n", traversal->leaf);
+        for (unsigned int l = 0; l < state->height; l++) {
+            hex_fwrite_line(file, traversal->auth_path[l], HASH_SIZE);
+        }
+        for (unsigned int l = 0; l < state->height; l++) {
+            for (unsigned int i = 0; i < stack_size(state->height, l, traversal->leaf); i++) {
+                hex_fwrite_line(file, traversal->stack[l][i], HASH_SIZE);
+            }
+        }
+    }
+    if (fflush(file) != 0 || fsync(fd) != 0) {
+        fprintf(stderr, "Error: Failed to write key file %s\n", tmp_name);
+        fclose(file);
+        unlink(tmp_name);
+        return 0;
+    }
+    fclose(file);
+    if (rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: Cannot replace key file %s\n", file_name);
+        unlink(tmp_name);
+        return 0;
+    }
+    return 1;
+}
+
+int write_mss_private_state(const char *file_name, const mss_private_state *state, const mss_traversal *traversal) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_private_state(file_name, state, traversal);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+int compact_public_key(unsigned char public_key[NUM_BITS][2][KEY_SIZE], unsigned char compact[HASH_SIZE]) {
+    return mss_leaf_hash(public_key, compact);
+}
+
+int compact_verify(const unsigned char compact[HASH_SIZE], unsigned char signature[2 * NUM_BITS][KEY_SIZE], const unsigned char *hash) {
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char leaf[HASH_SIZE];
+    if (!mss_rebuild_public_key(signature, signature + NUM_BITS, hash, public_key) || !mss_leaf_hash(public_key, leaf)) {
+        return 0;
+    }
+    stats_begin(STATS_COMPARE);
+    int valid = CRYPTO_memcmp(leaf, compact, HASH_SIZE) == 0;
+    stats_end(STATS_COMPARE);
+    return valid;
+}
+
+int mss_lock_private_state(const char *file_name) {
+    // The state file itself is replaced on every update, so the lock lives on a companion file
+    char lock_name[strlen(file_name) + 6];
+    sprintf(lock_name, "%s.lock", file_name);
+    int fd = open(lock_name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create lock file %s\n", lock_name);
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Error: %s is in use by another signer (is the signing daemon running?)\n", file_name);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int read_public_key(const char *file_name, mss_public_key *public_key) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    if (!hex_fread_line(file, public_key->root, HASH_SIZE) ||
+        fscanf(file, "%u", &public_key->height) != 1 ||
+        public_key->height > MSS_MAX_HEIGHT || hex_fread_profile(file, file_name) < 0) {
+        fprintf(stderr, "Error: Invalid Merkle public key file format\n");
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    return 1;
+}
+
+int read_mss_public_key(const char *file_name, mss_public_key *public_key) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_public_key(file_name, public_key);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_public_key(const char *file_name, const mss_public_key *public_key) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create hex file %s\n", file_name);
+        return 0;
+    }
+    hex_fwrite_line(file, public_key->root, HASH_SIZE);
+    fprintf(file, "%u\n", public_key->height);
+    hex_fwrite_profile(file);
+    fclose(file);
+    return 1;
+}
+
+int write_mss_public_key(const char *file_name, const mss_public_key *public_key) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_public_key(file_name, public_key);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+// Signature layout: 256 revealed components, 256 unrevealed public halves,
+// the leaf index in decimal, then height authentication path nodes from the leaf up
+static int read_signature_file(const char *sig_filename, unsigned int height, mss_signature *signature) {
+    FILE *sig_file = fopen(sig_filename, "r");
+    if (sig_file == NULL) {
+        fprintf(stderr, "Error: Cannot open signature file %s\n", sig_filename);
+        return 0;
+    }
+    int ok = 1;
+    for (int i = 0; ok && i < NUM_BITS; i++) {
+        ok = hex_fread_line(sig_file, signature->ots[i], KEY_SIZE);
+    }
+    for (int i = 0; ok && i < NUM_BITS; i++) {
+        ok = hex_fread_line(sig_file, signature->complement[i], KEY_SIZE);
+    }
+    char line[32];
+    ok = ok && fgets(line, sizeof(line), sig_file) != NULL && sscanf(line, "%lu", &signature->leaf_index) == 1;
+    for (unsigned int l = 0; ok && l < height; l++) {
+        ok = hex_fread_line(sig_file, signature->auth_path[l], HASH_SIZE);
+    }
+    // Optional profile record and digest mode trailer
+    if (ok && hex_fread_profile(sig_file, sig_filename) < 0) {
+        fclose(sig_file);
+        return 0;
+    }
+    char trailer[DIGEST_TRAILER_MAX];
+    size_t trailer_len = ok ? fread(trailer, 1, sizeof(trailer), sig_file) : 0;
+    if (!ok || !digest_parse_trailer(trailer, trailer_len, &signature->digest)) {
+        ok = 0;
+        fprintf(stderr, "Error: Invalid Merkle signature file format\n");
+    }
+    fclose(sig_file);
+    return ok;
+}
+
+int read_mss_signature(const char *sig_filename, unsigned int height, mss_signature *signature) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_signature_file(sig_filename, height, signature);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_signature_file(const char *sig_filename, unsigned int height, const mss_signature *signature) {
+    FILE *sig_file = fopen(sig_filename, "w");
+    if (sig_file == NULL) {
+        fprintf(stderr, "Error: Cannot create signature file %s\n", sig_filename);
+        return 0;
+    }
+    for (int i = 0; i < NUM_BITS; i++) {
+        hex_fwrite_line(sig_file, signature->ots[i], KEY_SIZE);
+    }
+    for (int i = 0; i < NUM_BITS; i++) {
+        hex_fwrite_line(sig_file, signature->complement[i], KEY_SIZE);
+    }
+    fprintf(sig_file, "%lu\n", signature->leaf_index);
+    for (unsigned int l = 0; l < height; l++) {
+        hex_fwrite_line(sig_file, signature->auth_path[l], HASH_SIZE);
+    }
+    hex_fwrite_profile(sig_file);
+    char trailer[DIGEST_TRAILER_MAX];
+    fwrite(trailer, 1, (size_t)digest_format_trailer(&signature->digest, trailer), sig_file);
+    fclose(sig_file);
+    return 1;
+}
+
+int write_mss_signature(const char *sig_filename, unsigned int height, const mss_signature *signature) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_signature_file(sig_filename, height, signature);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
@@ -0,0 +1,88 @@
+#ifndef LAMPORT_MERKLE_H
+#define LAMPORT_MERKLE_H
+
+#include "lamport_common.h"
+#include "lamport_digest.h"
+
+// Merkle signature scheme: 2^height Lamport one-time keys, all derived from one secret seed,
+// authenticated by a single 32-byte root. Leaf i is the hash of the full public key of
+// one-time key i; the root is built with treehash, so key generation holds only O(height) nodes.
+
+typedef struct {
+    unsigned char seed[KEY_SIZE];
+    unsigned int height;
+    unsigned long next_leaf; // first one-time key that has not been used yet
+} mss_private_state;
+
+typedef struct {
+    unsigned char root[HASH_SIZE];
+    unsigned int height;
+} mss_public_key;
+
+typedef struct {
+    unsigned long leaf_index;
+    unsigned char ots[NUM_BITS][KEY_SIZE];        // revealed private key components
+    unsigned char complement[NUM_BITS][KEY_SIZE]; // public key halves that were not revealed
+    unsigned char auth_path[MSS_MAX_HEIGHT][HASH_SIZE];
+    digest_params digest;                         // how the signed message digest was computed
+} mss_signature;
+
+// A one-time key with everything needed to sign, so signing itself is only a selection of components
+typedef struct {
+    unsigned long leaf_index;
+    unsigned char private_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char auth_path[MSS_MAX_HEIGHT][HASH_SIZE];
+} mss_prepared_key;
+
+// Merkle tree traversal for sign -t, kept in lamport-mss.priv next to next_leaf: the authentication path of
+// leaf, and for every level l the treehash stack of the authentication node that level needs from the next
+// multiple of 2^l on. Each signature adds one leaf to every stack, and a stack completes just as its node
+// is needed, so signing costs at most height leaf derivations instead of 2^height.
+typedef struct {
+    unsigned long leaf; // the one-time key this state signs next
+    unsigned char auth_path[MSS_MAX_HEIGHT][HASH_SIZE];
+    unsigned char stack[MSS_MAX_HEIGHT][MSS_MAX_HEIGHT][HASH_SIZE]; // level l holds popcount(leaf mod 2^l) nodes
+} mss_traversal;
+
+// traversal (may be NULL) receives the traversal state for leaf 0
+int mss_keygen(unsigned int height, mss_private_state *state, mss_public_key *public_key, mss_traversal *traversal);
+// Traversal state for state->next_leaf from one pass over the tree (about 2^height leaf derivations)
+int mss_traversal_init(const mss_private_state *state, mss_traversal *traversal);
+// Move the traversal state on to the next leaf (at most height leaf derivations)
+int mss_traversal_next(const mss_private_state *state, mss_traversal *traversal);
+// Sign with one-time key traversal->leaf
+int mss_sign(const mss_private_state *state, const mss_traversal *traversal, const unsigned char *hash, mss_signature *signature);
+
+// All 2^(height+1) - 1 nodes of the tree, level by level starting with the leaves (tree may then be passed to mss_prepare_key)
+size_t mss_tree_size(unsigned int height);
+int mss_build_tree(const unsigned char seed[KEY_SIZE], unsigned int height, unsigned char *tree);
+// Derive one-time key leaf and its authentication path; with tree == NULL the path is recomputed with treehash
+int mss_prepare_key(const mss_private_state *state, const unsigned char *tree, unsigned long leaf, mss_prepared_key *key);
+void mss_sign_prepared(const mss_prepared_key *key, unsigned int height, const unsigned char *hash, mss_signature *signature);
+// Take an exclusive lock that keeps other signers (sign -t, the signing daemon) off the private key; returns the lock fd or -1
+int mss_lock_private_state(const char *file_name);
+int mss_verify(const mss_public_key *public_key, const mss_signature *signature, const unsigned char *hash);
+
+// Hash a full one-time public key into a tree leaf
+int mss_leaf_hash(unsigned char public_key[NUM_BITS][2][KEY_SIZE], unsigned char leaf[HASH_SIZE]);
+// Rebuild the full one-time public key from revealed components and the unrevealed halves
+int mss_rebuild_public_key(unsigned char ots[NUM_BITS][KEY_SIZE], unsigned char complement[NUM_BITS][KEY_SIZE],
+                           const unsigned char *hash, unsigned char public_key[NUM_BITS][2][KEY_SIZE]);
+
+// Compact one-time public key: the leaf hash of the full public key, i.e. a tree of height 0.
+// A compact signature is NUM_BITS revealed components followed by the NUM_BITS unrevealed public key halves.
+int compact_public_key(unsigned char public_key[NUM_BITS][2][KEY_SIZE], unsigned char compact[HASH_SIZE]);
+int compact_verify(const unsigned char compact[HASH_SIZE], unsigned char signature[2 * NUM_BITS][KEY_SIZE], const unsigned char *hash);
+
+// The private state file may end with the traversal state: "traversal <leaf>", the height authentication
+// path lines, then the stack lines of each level. traversal (may be NULL) receives it; traversal->leaf is
+// left different from next_leaf if the file has none for next_leaf (as after the signing daemon used it).
+int read_mss_private_state(const char *file_name, mss_private_state *state, mss_traversal *traversal);
+int write_mss_private_state(const char *file_name, const mss_private_state *state, const mss_traversal *traversal);
+int read_mss_public_key(const char *file_name, mss_public_key *public_key);
+int write_mss_public_key(const char *file_name, const mss_public_key *public_key);
+int read_mss_signature(const char *sig_filename, unsigned int height, mss_signature *signature);
+int write_mss_signature(const char *sig_filename, unsigned int height, const mss_signature *signature);
+
+#endif // LAMPORT_MERKLE_H
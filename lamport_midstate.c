@@ -0,0 +1,285 @@
+/*
+ * Resumable document hashing
+ * ==========================================================
+ * Append-only files are hashed from where the previous hash of the same file stopped: the SHA-256
+ * chaining value after the last whole block is kept in a sidecar and restored into a fresh context.
+ */
+
+#include "lamport_midstate.h"
+#include "lamport_common.h"
+#include "lamport_io.h"
+#include "lamport_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+
+#define MIDSTATE_RESUMABLE (LAMPORT_PROFILE == LAMPORT_PROFILE_SHA256 || LAMPORT_PROFILE == LAMPORT_PROFILE_SHA256_192)
+#define SHA256_BLOCK 64
+
+static int midstate_state = -1; // -1: LAMPORT_MIDSTATE not read yet
+
+int midstate_enabled(void) {
+    if (midstate_state < 0) {
+        const char *value = getenv("LAMPORT_MIDSTATE");
+        midstate_state = value != NULL && *value != '\0' && strcmp(value, "0") != 0;
+        if (midstate_state && !MIDSTATE_RESUMABLE) {
+            fprintf(stderr, "Warning: LAMPORT_MIDSTATE needs a SHA-256 profile (this build: %s), files are hashed in full\n",
+                    LAMPORT_PROFILE_NAME);
+            midstate_state = 0;
+        }
+    }
+    return midstate_state;
+}
+
+#if MIDSTATE_RESUMABLE
+
+// OpenSSL 3 cannot export the state of an EVP digest; the SHA256_CTX API can, and although it is
+// deprecated it runs the same implementation
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t length;
+    uint32_t h[8];
+    unsigned char fingerprint[HASH_SIZE];
+} sidecar;
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint16_t get_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int pread_full(int fd, unsigned char *buffer, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, buffer + done, size - done, offset + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+// H(length || first sample || last sample) of the prefix [0, length); the samples overlap for short prefixes
+static int prefix_fingerprint(int fd, uint64_t length, unsigned char fingerprint[HASH_SIZE]) {
+    unsigned char head[MIDSTATE_SAMPLE_SIZE], tail[MIDSTATE_SAMPLE_SIZE], encoded_length[8];
+    size_t sample = length < MIDSTATE_SAMPLE_SIZE ? (size_t)length : MIDSTATE_SAMPLE_SIZE;
+    put_le64(encoded_length, length);
+    if (!pread_full(fd, head, sample, 0) || !pread_full(fd, tail, sample, (off_t)(length - sample))) {
+        return 0;
+    }
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = mdctx != NULL && hash_init(mdctx) && EVP_DigestUpdate(mdctx, encoded_length, sizeof(encoded_length)) == 1 &&
+             EVP_DigestUpdate(mdctx, head, sample) == 1 && EVP_DigestUpdate(mdctx, tail, sample) == 1 &&
+             hash_final(mdctx, fingerprint);
+    EVP_MD_CTX_free(mdctx);
+    return ok;
+}
+
+// A usable sidecar for this file as it is now, or 0 to hash it from the start
+static int load_sidecar(const char *sidecar_name, int fd, const struct stat *st, sidecar *state) {
+    unsigned char data[MIDSTATE_FILE_SIZE];
+    unsigned char tag[SHA256_DIGEST_LENGTH];
+    unsigned char fingerprint[HASH_SIZE];
+    struct stat sidecar_st;
+
+    int sidecar_fd = open(sidecar_name, O_RDONLY | O_CLOEXEC);
+    if (sidecar_fd < 0) {
+        return 0; // first hash of this file
+    }
+    int ok = fstat(sidecar_fd, &sidecar_st) == 0;
+    if (ok && (sidecar_st.st_uid != geteuid() || (sidecar_st.st_mode & (S_IWGRP | S_IWOTH)) != 0)) {
+        fprintf(stderr, "Warning: Midstate sidecar %s must be owned by you and not writable by others, ignored\n", sidecar_name);
+        close(sidecar_fd);
+        return 0;
+    }
+    ok = ok && sidecar_st.st_size == MIDSTATE_FILE_SIZE && pread_full(sidecar_fd, data, sizeof(data), 0);
+    close(sidecar_fd);
+    SHA256(data, 96, tag);
+    if (!ok || memcmp(data, MIDSTATE_MAGIC, 4) != 0 || get_le16(data + 4) != MIDSTATE_VERSION ||
+        get_le16(data + 6) != LAMPORT_PROFILE || CRYPTO_memcmp(tag, data + 96, sizeof(tag)) != 0) {
+        fprintf(stderr, "Warning: Invalid midstate sidecar %s, hashing from the start\n", sidecar_name);
+        return 0;
+    }
+    state->dev = get_le64(data + 8);
+    state->ino = get_le64(data + 16);
+    state->length = get_le64(data + 24);
+    for (int i = 0; i < 8; i++) {
+        state->h[i] = get_le32(data + 32 + 4 * i);
+    }
+    memcpy(state->fingerprint, data + 64, HASH_SIZE);
+
+    // Same file, not shorter, and the sampled prefix is what was hashed
+    if (state->dev != (uint64_t)st->st_dev || state->ino != (uint64_t)st->st_ino || state->length % SHA256_BLOCK != 0 ||
+        state->length > (uint64_t)st->st_size || !prefix_fingerprint(fd, state->length, fingerprint) ||
+        CRYPTO_memcmp(fingerprint, state->fingerprint, HASH_SIZE) != 0) {
+        fprintf(stderr, "Warning: The file no longer matches its midstate sidecar %s, hashing from the start\n", sidecar_name);
+        return 0;
+    }
+    return 1;
+}
+
+// The sidecar only saves work, so failing to write it is a warning
+static void store_sidecar(const char *sidecar_name, int fd, sidecar *state) {
+    unsigned char data[MIDSTATE_FILE_SIZE] = {0};
+    if (!prefix_fingerprint(fd, state->length, state->fingerprint)) {
+        return;
+    }
+    memcpy(data, MIDSTATE_MAGIC, 4);
+    put_le16(data + 4, MIDSTATE_VERSION);
+    put_le16(data + 6, LAMPORT_PROFILE);
+    put_le64(data + 8, state->dev);
+    put_le64(data + 16, state->ino);
+    put_le64(data + 24, state->length);
+    for (int i = 0; i < 8; i++) {
+        put_le32(data + 32 + 4 * i, state->h[i]);
+    }
+    memcpy(data + 64, state->fingerprint, HASH_SIZE);
+    SHA256(data, 96, data + 96);
+
+    char tmp_name[strlen(sidecar_name) + 5];
+    sprintf(tmp_name, "%s.tmp", sidecar_name);
+    int tmp_fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    int ok = tmp_fd >= 0 && write(tmp_fd, data, sizeof(data)) == (ssize_t)sizeof(data);
+    if (tmp_fd >= 0) {
+        ok = close(tmp_fd) == 0 && ok;
+    }
+    if (!ok || rename(tmp_name, sidecar_name) != 0) {
+        fprintf(stderr, "Warning: Cannot write midstate sidecar %s\n", sidecar_name);
+        unlink(tmp_name);
+    }
+}
+
+int midstate_hash_file(const char *file_name, unsigned char hash[HASH_SIZE], uint64_t *bytes_read) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    struct timespec start, end;
+    struct stat st;
+    sidecar state;
+    SHA256_CTX ctx;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    *bytes_read = 0;
+    int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", file_name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    char sidecar_name[strlen(file_name) + strlen(MIDSTATE_EXTENSION) + 1];
+    sprintf(sidecar_name, "%s%s", file_name, MIDSTATE_EXTENSION);
+
+    SHA256_Init(&ctx);
+    uint64_t offset = 0;
+    uint64_t resumed = load_sidecar(sidecar_name, fd, &st, &state) ? state.length : 0;
+    if (resumed > 0) {
+        for (int i = 0; i < 8; i++) {
+            ctx.h[i] = state.h[i];
+        }
+        ctx.Nl = (SHA_LONG)(resumed << 3);
+        ctx.Nh = (SHA_LONG)(resumed >> 29);
+        offset = resumed;
+    }
+    posix_fadvise(fd, (off_t)offset, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Only whole blocks go into the context, so after the last read it holds the chaining value
+    // at the last block boundary; the partial block is hashed on a copy
+    unsigned char *buffer = malloc(IO_BUFFER_SIZE + SHA256_BLOCK);
+    size_t pending = 0;
+    int ok = buffer != NULL;
+    while (ok) {
+        ssize_t n = pread(fd, buffer + pending, IO_BUFFER_SIZE, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        offset += (uint64_t)n;
+        *bytes_read += (uint64_t)n;
+        pending += (size_t)n;
+        size_t whole = pending & ~(size_t)(SHA256_BLOCK - 1);
+        SHA256_Update(&ctx, buffer, whole);
+        memmove(buffer, buffer + whole, pending - whole);
+        pending -= whole;
+    }
+    if (!ok) {
+        fprintf(stderr, buffer == NULL ? "Error: Memory allocation failed\n" : "Error: Failed to read file %s\n", file_name);
+        free(buffer);
+        close(fd);
+        return 0;
+    }
+    state.dev = (uint64_t)st.st_dev;
+    state.ino = (uint64_t)st.st_ino;
+    state.length = offset - pending;
+    memcpy(state.h, ctx.h, sizeof(state.h));
+    SHA256_CTX last = ctx;
+    SHA256_Update(&last, buffer, pending);
+    SHA256_Final(digest, &last);
+    memcpy(hash, digest, HASH_SIZE); // sha256-192 keeps the first 24 bytes, as hash_final does
+    free(buffer);
+
+    if (state.length != resumed) {
+        store_sidecar(sidecar_name, fd, &state);
+    }
+    close(fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    io_stats stats = {resumed > 0 ? "midstate (resumed)" : "midstate", *bytes_read,
+                      (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9};
+    io_report("hash_file", &stats);
+    return 1;
+}
+
+#else
+
+int midstate_hash_file(const char *file_name, unsigned char hash[HASH_SIZE], uint64_t *bytes_read) {
+    (void)hash;
+    *bytes_read = 0;
+    fprintf(stderr, "Error: Cannot resume the hash of %s with profile %s\n", file_name, LAMPORT_PROFILE_NAME);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef LAMPORT_MIDSTATE_H
+#define LAMPORT_MIDSTATE_H
+
+#include <stdint.h>
+#include "lamport_constants.h"
+
+// Resumable document hashing for append-only files (opt-in)
+// ==========================================================
+// With LAMPORT_MIDSTATE=1, hash_file keeps a sidecar <file>.midstate next to each regular file it hashes:
+// the SHA-256 chaining value after the file's last whole 64-byte block, and how many bytes that covers.
+// The next hash of the same file resumes from there and reads only what was appended since, so signing
+// or verifying a growing log costs time in proportion to the new bytes, not to the whole file.
+//
+// offset  size  field
+//      0     4  magic "LMID"
+//      4     2  format version
+//      6     2  hash algorithm: the parameter profile (LAMPORT_PROFILE_*)
+//      8     8  device of the file
+//     16     8  inode of the file
+//     24     8  prefix length L in bytes (a multiple of 64)
+//     32    32  SHA-256 chaining value after L bytes (eight 32-bit words)
+//     64    32  prefix fingerprint: H(L || the first and the last MIDSTATE_SAMPLE_SIZE bytes of the prefix)
+//     96    32  integrity tag: SHA-256 over bytes 0..95
+// All integers are little-endian. A sidecar is only used if the file is still the same inode on the same
+// device, is at least L bytes long and its prefix fingerprint matches; otherwise the file is hashed from
+// the start and the sidecar replaced. The fingerprint catches a rotated, truncated or rewritten log, but it
+// samples the prefix, so an edit in the middle of a file that is not append-only goes unnoticed: only use
+// this for files that are never modified in place. Like the digest cache, a sidecar that is not owned by
+// you or that others can write is ignored with a warning.
+// Only profiles whose H is SHA-256 (sha256, sha256-192) can resume; others always hash the whole file.
+
+#define MIDSTATE_MAGIC "LMID"
+#define MIDSTATE_VERSION 1
+#define MIDSTATE_FILE_SIZE 128
+#define MIDSTATE_SAMPLE_SIZE 4096
+
+// 1 if LAMPORT_MIDSTATE is set and this profile can resume a hash
+int midstate_enabled(void);
+// The plain digest H of a file, resumed from its sidecar when possible; bytes_read counts what was read
+int midstate_hash_file(const char *file_name, unsigned char hash[HASH_SIZE], uint64_t *bytes_read);
+
+#endif // LAMPORT_MIDSTATE_H
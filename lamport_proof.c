@@ -0,0 +1,284 @@
+/*
+ * Batch signing with inclusion proofs
+ * ==========================================================
+ * Signing a release one file at a time burns one one-time key and one full signature per file.
+ * Here all files are digested by a pool of workers that claim file indices from a shared counter,
+ * the digests are combined in a Merkle tree, and only the tree's root is signed. A file is then
+ * checked with its own small proof and the shared batch signature in O(log N) hashes.
+ */
+
+#include "lamport_proof.h"
+#include "lamport_hex.h"
+#include "lamport_stats.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Domain separation from the Merkle, tree digest, Winternitz, HORS and chain hashes (0x00 to 0x07)
+#define PROOF_LEAF_PREFIX 0x08
+#define PROOF_NODE_PREFIX 0x09
+#define PROOF_ROOT_PREFIX 0x0a
+
+static int hash_prefixed(unsigned char prefix, const unsigned char *data1, size_t len1,
+                         const unsigned char *data2, size_t len2, unsigned char out[HASH_SIZE]) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    if (mdctx == NULL) {
+        fprintf(stderr, "Error: Failed to create hash context\n");
+        return 0;
+    }
+    int ok = hash_init(mdctx) &&
+             EVP_DigestUpdate(mdctx, &prefix, 1) == 1 &&
+             EVP_DigestUpdate(mdctx, data1, len1) == 1 &&
+             (len2 == 0 || EVP_DigestUpdate(mdctx, data2, len2) == 1) &&
+             hash_final(mdctx, out);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to compute batch tree hash\n");
+    }
+    EVP_MD_CTX_free(mdctx);
+    return ok;
+}
+
+static int root_digest(const unsigned char root[HASH_SIZE], uint64_t count, unsigned char hash[HASH_SIZE]) {
+    unsigned char be_count[8];
+    for (int i = 0; i < 8; i++) {
+        be_count[i] = (unsigned char)(count >> (56 - 8 * i));
+    }
+    if (!hash_prefixed(PROOF_ROOT_PREFIX, be_count, sizeof(be_count), root, HASH_SIZE, hash)) {
+        return 0;
+    }
+    // The batch signature is an ordinary Lamport signature; complemented, its value is no plain file digest
+    for (size_t i = 0; i < HASH_SIZE; i++) {
+        hash[i] = (unsigned char)~hash[i];
+    }
+    return 1;
+}
+
+// Number of sibling nodes on the path of leaf index in a tree of count leaves
+static unsigned int proof_depth(uint64_t index, uint64_t count) {
+    unsigned int depth = 0;
+    for (uint64_t n = count; n > 1; n = (n + 1) / 2, index /= 2) {
+        if ((index ^ 1) < n) {
+            depth++;
+        }
+    }
+    return depth;
+}
+
+// ----------------------------------------------------------------------------
+// Parallel file digests
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    char *const *files;
+    size_t count;
+    size_t next_file; // claimed with __atomic_fetch_add
+    int failed;
+    digest_params digest;
+    unsigned char *leaves;
+} hash_job;
+
+static void *hash_worker(void *arg) {
+    hash_job *job = arg;
+    unsigned char file_hash[HASH_SIZE];
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        size_t i = __atomic_fetch_add(&job->next_file, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) {
+            break;
+        }
+        if (!digest_file(job->files[i], &job->digest, file_hash) ||
+            !hash_prefixed(PROOF_LEAF_PREFIX, file_hash, HASH_SIZE, NULL, 0, job->leaves + i * HASH_SIZE)) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+int batch_tree_build(char *const files[], size_t count, const digest_params *digest, int num_threads, batch_tree *tree) {
+    memset(tree, 0, sizeof(*tree));
+    if (count == 0) {
+        fprintf(stderr, "Error: No files to sign\n");
+        return 0;
+    }
+    if (num_threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? (int)online : 1;
+    }
+    if ((size_t)num_threads > count) {
+        num_threads = (int)count;
+    }
+
+    // Level sizes: count, ceil(count / 2), ..., 1
+    size_t total = 0;
+    tree->count = count;
+    for (uint64_t n = count;; n = (n + 1) / 2) {
+        tree->level_offset[tree->num_levels++] = total;
+        total += n;
+        if (n == 1) {
+            break;
+        }
+    }
+    tree->nodes = malloc(total * HASH_SIZE);
+    pthread_t *workers = calloc((size_t)num_threads, sizeof(pthread_t));
+    if (tree->nodes == NULL || workers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(workers);
+        batch_tree_free(tree);
+        return 0;
+    }
+
+    hash_job job;
+    memset(&job, 0, sizeof(job));
+    job.files = files;
+    job.count = count;
+    job.digest = *digest;
+    job.leaves = tree->nodes;
+    if (num_threads > 1) {
+        job.digest.threads = 1; // the files are already spread over the workers
+    }
+    // This thread is one of the workers
+    int started = 0;
+    for (; started < num_threads - 1; started++) {
+        if (pthread_create(&workers[started], NULL, hash_worker, &job) != 0) {
+            break;
+        }
+    }
+    hash_worker(&job);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+    if (job.failed) {
+        batch_tree_free(tree);
+        return 0;
+    }
+
+    stats_begin(STATS_COMPONENT_HASH);
+    uint64_t n = count;
+    for (unsigned int l = 0; l + 1 < tree->num_levels; l++, n = (n + 1) / 2) {
+        const unsigned char *level = tree->nodes + tree->level_offset[l] * HASH_SIZE;
+        unsigned char *parents = tree->nodes + tree->level_offset[l + 1] * HASH_SIZE;
+        for (uint64_t i = 0; i < n; i += 2) {
+            unsigned char *parent = parents + (i / 2) * HASH_SIZE;
+            if (i + 1 == n) {
+                memcpy(parent, level + i * HASH_SIZE, HASH_SIZE);
+            } else if (!hash_prefixed(PROOF_NODE_PREFIX, level + i * HASH_SIZE, HASH_SIZE,
+                                      level + (i + 1) * HASH_SIZE, HASH_SIZE, parent)) {
+                stats_end(STATS_COMPONENT_HASH);
+                batch_tree_free(tree);
+                return 0;
+            }
+        }
+    }
+    stats_end(STATS_COMPONENT_HASH);
+    return 1;
+}
+
+void batch_tree_free(batch_tree *tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+}
+
+int batch_tree_digest(const batch_tree *tree, unsigned char hash[HASH_SIZE]) {
+    const unsigned char *root = tree->nodes + tree->level_offset[tree->num_levels - 1] * HASH_SIZE;
+    return root_digest(root, tree->count, hash);
+}
+
+void batch_tree_proof(const batch_tree *tree, uint64_t index, const digest_params *digest, batch_proof *proof) {
+    memset(proof, 0, sizeof(*proof));
+    proof->index = index;
+    proof->count = tree->count;
+    proof->digest = *digest;
+    proof->digest.threads = 0;
+    uint64_t n = tree->count;
+    for (unsigned int l = 0; n > 1; l++, n = (n + 1) / 2, index /= 2) {
+        if ((index ^ 1) < n) {
+            memcpy(proof->path[proof->depth++], tree->nodes + (tree->level_offset[l] + (index ^ 1)) * HASH_SIZE, HASH_SIZE);
+        }
+    }
+}
+
+int batch_proof_digest(const batch_proof *proof, const unsigned char file_hash[HASH_SIZE], unsigned char hash[HASH_SIZE]) {
+    unsigned char node[HASH_SIZE];
+    uint64_t index = proof->index;
+    unsigned int next = 0;
+
+    stats_begin(STATS_COMPONENT_HASH);
+    int ok = hash_prefixed(PROOF_LEAF_PREFIX, file_hash, HASH_SIZE, NULL, 0, node);
+    for (uint64_t n = proof->count; ok && n > 1; n = (n + 1) / 2, index /= 2) {
+        if ((index ^ 1) >= n) {
+            continue; // promoted without a sibling
+        }
+        const unsigned char *sibling = proof->path[next++];
+        ok = index & 1 ? hash_prefixed(PROOF_NODE_PREFIX, sibling, HASH_SIZE, node, HASH_SIZE, node)
+                       : hash_prefixed(PROOF_NODE_PREFIX, node, HASH_SIZE, sibling, HASH_SIZE, node);
+    }
+    ok = ok && root_digest(node, proof->count, hash);
+    stats_end(STATS_COMPONENT_HASH);
+    return ok;
+}
+
+static int read_proof(const char *file_name, batch_proof *proof) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open proof file %s\n", file_name);
+        return 0;
+    }
+    char line[64];
+    unsigned long long index, count;
+    int ok = fgets(line, sizeof(line), file) != NULL && sscanf(line, "%llu %llu", &index, &count) == 2 &&
+             count > 0 && index < count;
+    if (ok) {
+        proof->index = index;
+        proof->count = count;
+        proof->depth = proof_depth(index, count);
+    }
+    for (unsigned int l = 0; ok && l < proof->depth; l++) {
+        ok = hex_fread_line(file, proof->path[l], HASH_SIZE);
+    }
+    // Optional profile record and digest mode trailer
+    if (ok && hex_fread_profile(file, file_name) < 0) {
+        fclose(file);
+        return 0;
+    }
+    char trailer[DIGEST_TRAILER_MAX];
+    size_t trailer_len = ok ? fread(trailer, 1, sizeof(trailer), file) : 0;
+    if (!ok || !digest_parse_trailer(trailer, trailer_len, &proof->digest)) {
+        ok = 0;
+        fprintf(stderr, "Error: Invalid proof file format in %s\n", file_name);
+    }
+    fclose(file);
+    return ok;
+}
+
+int read_batch_proof(const char *file_name, batch_proof *proof) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_proof(file_name, proof);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_proof(const char *file_name, const batch_proof *proof) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create proof file %s\n", file_name);
+        return 0;
+    }
+    fprintf(file, "%llu %llu\n", (unsigned long long)proof->index, (unsigned long long)proof->count);
+    for (unsigned int l = 0; l < proof->depth; l++) {
+        hex_fwrite_line(file, proof->path[l], HASH_SIZE);
+    }
+    hex_fwrite_profile(file);
+    char trailer[DIGEST_TRAILER_MAX];
+    fwrite(trailer, 1, (size_t)digest_format_trailer(&proof->digest, trailer), file);
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error: Cannot write proof file %s\n", file_name);
+        return 0;
+    }
+    return 1;
+}
+
+int write_batch_proof(const char *file_name, const batch_proof *proof) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_proof(file_name, proof);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
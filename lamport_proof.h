@@ -0,0 +1,52 @@
+#ifndef LAMPORT_PROOF_H
+#define LAMPORT_PROOF_H
+
+#include <stdint.h>
+#include "lamport_common.h"
+#include "lamport_digest.h"
+
+// Batch signing: one Lamport signature over many files
+// ==========================================================
+// The files are digested (in parallel) and their digests become the leaves of a Merkle tree:
+//   leaf_i = H(0x08 || file digest_i)
+//   node   = H(0x09 || left || right)           (an odd last node moves up unchanged)
+//   signed = ~H(0x0a || be64(number of files) || root)  (bitwise complement)
+// Only the signed value gets a Lamport signature (the batch signature file), in the plain signature
+// format with lamport-ots.priv. The complement stops plain verify from accepting that signature for
+// the 41-byte file 0x0a || count || root, as with the tree digest (lamport_digest.h). Every file gets an
+// inclusion proof "<file>.proof": its leaf index and the file count as "<index> <count>\n", then the
+// sibling nodes from the leaf up as hex lines (at most ceil(log2(count)) of them; levels where the node
+// is promoted have none), then the optional profile record and digest mode trailer of the file digest.
+// The prefixes keep batch nodes apart from the Merkle key (0x00, 0x01), tree digest (0x02), Winternitz
+// (0x03, 0x04), HORS (0x06) and chain (0x07) hashes.
+
+#define PROOF_MAX_DEPTH 64
+
+typedef struct {
+    uint64_t count;          // files in the batch
+    unsigned int num_levels; // including the leaf level and the root
+    size_t level_offset[PROOF_MAX_DEPTH + 1]; // first node of each level in nodes
+    unsigned char *nodes;    // every level, leaves first
+} batch_tree;
+
+typedef struct {
+    uint64_t index, count;
+    unsigned int depth; // sibling nodes in path
+    unsigned char path[PROOF_MAX_DEPTH][HASH_SIZE];
+    digest_params digest; // how the file digest was computed
+} batch_proof;
+
+// Digest files[0..count) on num_threads workers (0 = one per online CPU) and build the tree over them
+int batch_tree_build(char *const files[], size_t count, const digest_params *digest, int num_threads, batch_tree *tree);
+void batch_tree_free(batch_tree *tree);
+// The value that the batch signature signs
+int batch_tree_digest(const batch_tree *tree, unsigned char hash[HASH_SIZE]);
+void batch_tree_proof(const batch_tree *tree, uint64_t index, const digest_params *digest, batch_proof *proof);
+
+// Recompute the signed value from a file digest and its proof: depth + 2 hashes
+int batch_proof_digest(const batch_proof *proof, const unsigned char file_hash[HASH_SIZE], unsigned char hash[HASH_SIZE]);
+
+int read_batch_proof(const char *file_name, batch_proof *proof);
+int write_batch_proof(const char *file_name, const batch_proof *proof);
+
+#endif // LAMPORT_PROOF_H
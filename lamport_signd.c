@@ -0,0 +1,108 @@
+#include "lamport_signd.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+size_t signd_response_size(unsigned int height) {
+    return SIGND_RESPONSE_HEADER_SIZE + (size_t)2 * NUM_BITS * KEY_SIZE + (size_t)height * HASH_SIZE;
+}
+
+size_t signd_encode_response(int status, unsigned int height, const mss_signature *signature, unsigned char *out) {
+    memset(out, 0, SIGND_RESPONSE_HEADER_SIZE);
+    out[0] = (unsigned char)status;
+    out[1] = (unsigned char)height;
+    if (status != SIGND_STATUS_OK) {
+        return SIGND_RESPONSE_HEADER_SIZE;
+    }
+    for (int i = 0; i < 8; i++) {
+        out[8 + i] = (unsigned char)((uint64_t)signature->leaf_index >> (56 - 8 * i));
+    }
+    unsigned char *p = out + SIGND_RESPONSE_HEADER_SIZE;
+    memcpy(p, signature->ots, sizeof(signature->ots));
+    p += sizeof(signature->ots);
+    memcpy(p, signature->complement, sizeof(signature->complement));
+    p += sizeof(signature->complement);
+    memcpy(p, signature->auth_path, (size_t)height * HASH_SIZE);
+    return signd_response_size(height);
+}
+
+int signd_read_fully(int fd, void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, (unsigned char *)buffer + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+int signd_write_fully(int fd, const void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = send(fd, (const unsigned char *)buffer + done, size - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+int signd_request(const char *socket_name, const unsigned char hash[HASH_SIZE], mss_signature *signature, unsigned int *height) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_name) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_name);
+        return 0;
+    }
+    strcpy(addr.sun_path, socket_name);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error: Cannot connect to signing daemon at %s\n", socket_name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+
+    unsigned char request[SIGND_REQUEST_SIZE];
+    memcpy(request, SIGND_MAGIC, 4);
+    memcpy(request + 4, hash, HASH_SIZE);
+    unsigned char header[SIGND_RESPONSE_HEADER_SIZE];
+    if (!signd_write_fully(fd, request, sizeof(request)) || !signd_read_fully(fd, header, sizeof(header))) {
+        fprintf(stderr, "Error: No response from signing daemon\n");
+        close(fd);
+        return 0;
+    }
+    if (header[0] != SIGND_STATUS_OK || header[1] > MSS_MAX_HEIGHT) {
+        fprintf(stderr, header[0] == SIGND_STATUS_EXHAUSTED ? "Error: All one-time keys of the signing daemon have been used\n"
+                                                            : "Error: Signing daemon failed to sign\n");
+        close(fd);
+        return 0;
+    }
+    *height = header[1];
+    uint64_t leaf_index = 0;
+    for (int i = 0; i < 8; i++) {
+        leaf_index = (leaf_index << 8) | header[8 + i];
+    }
+    signature->leaf_index = (unsigned long)leaf_index;
+    digest_params_default(&signature->digest);
+    int ok = signd_read_fully(fd, signature->ots, sizeof(signature->ots)) &&
+             signd_read_fully(fd, signature->complement, sizeof(signature->complement)) &&
+             signd_read_fully(fd, signature->auth_path, (size_t)*height * HASH_SIZE);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "Error: Truncated response from signing daemon\n");
+    }
+    return ok;
+}
@@ -0,0 +1,31 @@
+#ifndef LAMPORT_SIGND_H
+#define LAMPORT_SIGND_H
+
+#include "lamport_merkle.h"
+
+// Signing daemon protocol (Unix domain stream socket, any number of requests per connection)
+// ==========================================================
+// request:  "LSG1" || 32-byte message digest
+// response: status (1 byte) || tree height (1 byte) || 6 reserved bytes || be64 leaf index
+//           || 256 revealed components || 256 unrevealed public key halves || height auth path nodes
+// The signature fields are only present when the status is SIGND_STATUS_OK.
+
+#define SIGND_MAGIC "LSG1"
+#define SIGND_REQUEST_SIZE (4 + HASH_SIZE)
+#define SIGND_RESPONSE_HEADER_SIZE 16
+
+#define SIGND_STATUS_OK 0
+#define SIGND_STATUS_EXHAUSTED 1 // every one-time key of the tree has been used
+#define SIGND_STATUS_ERROR 2
+
+size_t signd_response_size(unsigned int height);
+// Encode a response into out (signd_response_size(height) bytes for SIGND_STATUS_OK, the header otherwise)
+size_t signd_encode_response(int status, unsigned int height, const mss_signature *signature, unsigned char *out);
+
+// Client side: sign a digest with the daemon listening on socket_name
+int signd_request(const char *socket_name, const unsigned char hash[HASH_SIZE], mss_signature *signature, unsigned int *height);
+
+int signd_read_fully(int fd, void *buffer, size_t size);
+int signd_write_fully(int fd, const void *buffer, size_t size);
+
+#endif // LAMPORT_SIGND_H
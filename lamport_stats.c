@@ -0,0 +1,220 @@
+#include "lamport_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+    #if __has_include(<sys/sdt.h>)
+        #include <sys/sdt.h>
+        #define LAMPORT_HAVE_SDT 1
+    #endif
+#endif
+#ifdef LAMPORT_HAVE_SDT
+    #define PROBE_PHASE(event, name) DTRACE_PROBE1(lamport, event, name)
+#else
+    #define PROBE_PHASE(event, name) ((void)(name))
+#endif
+
+// /proc/self/io fields, in the order they are kept in io_sample
+#define IO_FIELDS 4
+static const char *const io_field_names[IO_FIELDS] = { "rchar", "wchar", "syscr", "syscw" };
+
+typedef struct {
+    uint64_t value[IO_FIELDS]; // bytes_read, bytes_written, read_syscalls, write_syscalls
+    uint64_t own_reads, own_bytes; // reads of /proc/self/io itself before this sample
+} io_sample;
+
+typedef struct {
+    unsigned long calls;
+    double wall, cpu;
+    io_sample io;
+} phase_stats;
+
+// A phase in progress on one thread
+typedef struct {
+    int depth;
+    double wall_start, cpu_start;
+    io_sample io_start;
+} phase_timer;
+
+static const char *const phase_names[STATS_NUM_PHASES] = {
+    "permission_check", "key_load", "file_hash", "component_hash", "compare", "output_write"
+};
+// Hashing and comparing do no I/O and can run millions of times (Merkle keygen), so they skip the I/O samples
+static const int phase_does_io[STATS_NUM_PHASES] = { 1, 1, 1, 0, 0, 1 };
+
+int stats_enabled = 0;
+uint64_t stats_counters[STATS_NUM_COUNTERS];
+
+static const char *stats_tool;
+static const char *stats_target; // NULL: stderr
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER; // guards phases and the I/O samples
+static phase_stats phases[STATS_NUM_PHASES];
+static __thread phase_timer timers[STATS_NUM_PHASES];
+static double start_wall, start_cpu;
+static io_sample start_io;
+static int io_fd = -1;
+static uint64_t own_reads, own_bytes;
+
+static double clock_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Read the I/O counters (with stats_lock held). Every sample is itself a read system call; those are
+// counted so that io_delta can leave them out.
+static void sample_io(io_sample *sample) {
+    char text[512];
+    memset(sample, 0, sizeof(*sample));
+    if (io_fd < 0) {
+        return;
+    }
+    sample->own_reads = own_reads;
+    sample->own_bytes = own_bytes;
+    ssize_t len = pread(io_fd, text, sizeof(text) - 1, 0);
+    if (len <= 0) {
+        return;
+    }
+    text[len] = '\0';
+    for (int i = 0; i < IO_FIELDS; i++) {
+        const char *field = strstr(text, io_field_names[i]);
+        if (field != NULL) {
+            sample->value[i] = strtoull(field + strlen(io_field_names[i]) + 1, NULL, 10);
+        }
+    }
+    own_reads++;
+    own_bytes += (uint64_t)len;
+}
+
+static void io_delta(const io_sample *earlier, const io_sample *later, io_sample *delta) {
+    for (int i = 0; i < IO_FIELDS; i++) {
+        delta->value[i] = later->value[i] - earlier->value[i];
+    }
+    delta->value[0] -= later->own_bytes - earlier->own_bytes;
+    delta->value[2] -= later->own_reads - earlier->own_reads;
+}
+
+static void print_line(FILE *out, const char *phase, double wall, double cpu, unsigned long calls, const io_sample *io) {
+    fprintf(out, "{\"tool\": \"%s\", \"phase\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f", stats_tool, phase, wall, cpu);
+    if (calls > 0) {
+        fprintf(out, ", \"calls\": %lu", calls);
+    }
+    if (io != NULL && io_fd >= 0) {
+        fprintf(out, ", \"read_syscalls\": %llu, \"write_syscalls\": %llu, \"bytes_read\": %llu, \"bytes_written\": %llu",
+                (unsigned long long)io->value[2], (unsigned long long)io->value[3], (unsigned long long)io->value[0],
+                (unsigned long long)io->value[1]);
+    }
+}
+
+static void stats_report(void) {
+    io_sample end_io, total_io;
+    pthread_mutex_lock(&stats_lock);
+    double wall = clock_ms(CLOCK_MONOTONIC) - start_wall;
+    double cpu = clock_ms(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+    sample_io(&end_io);
+
+    FILE *out = stats_target != NULL ? fopen(stats_target, "a") : stderr;
+    if (out == NULL) {
+        fprintf(stderr, "Warning: Cannot open stats file %s\n", stats_target);
+        pthread_mutex_unlock(&stats_lock);
+        return;
+    }
+    for (int p = 0; p < STATS_NUM_PHASES; p++) {
+        if (phases[p].calls > 0) {
+            print_line(out, phase_names[p], phases[p].wall, phases[p].cpu, phases[p].calls,
+                       phase_does_io[p] ? &phases[p].io : NULL);
+            fprintf(out, "}\n");
+        }
+    }
+    io_delta(&start_io, &end_io, &total_io);
+    print_line(out, "total", wall, cpu, 0, &total_io);
+    fprintf(out, ", \"document_bytes\": %llu, \"hashes\": %llu}\n",
+            (unsigned long long)stats_counters[STATS_DOCUMENT_BYTES], (unsigned long long)stats_counters[STATS_HASHES]);
+    if (out != stderr) {
+        fclose(out);
+    }
+    if (io_fd >= 0) {
+        close(io_fd);
+        io_fd = -1;
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_init(const char *tool, int *argc, char *argv[]) {
+    const char *env = getenv("LAMPORT_STATS");
+    int j = 1;
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats_enabled = 1;
+        } else {
+            argv[j++] = argv[i];
+        }
+    }
+    *argc = j;
+    argv[j] = NULL;
+    if (env != NULL && *env != '\0' && strcmp(env, "0") != 0) {
+        stats_enabled = 1;
+        stats_target = strcmp(env, "1") == 0 ? NULL : env;
+    }
+    if (!stats_enabled) {
+        return;
+    }
+    stats_tool = tool;
+    io_fd = open("/proc/self/io", O_RDONLY);
+    start_wall = clock_ms(CLOCK_MONOTONIC);
+    start_cpu = clock_ms(CLOCK_PROCESS_CPUTIME_ID);
+    sample_io(&start_io);
+    atexit(stats_report);
+}
+
+void stats_begin(int phase) {
+    PROBE_PHASE(phase__begin, phase_names[phase]);
+    if (!stats_enabled) {
+        return;
+    }
+    phase_timer *t = &timers[phase];
+    if (t->depth++ == 0) {
+        if (phase_does_io[phase]) {
+            pthread_mutex_lock(&stats_lock);
+            sample_io(&t->io_start);
+            pthread_mutex_unlock(&stats_lock);
+        }
+        t->wall_start = clock_ms(CLOCK_MONOTONIC);
+        t->cpu_start = clock_ms(CLOCK_PROCESS_CPUTIME_ID);
+    }
+}
+
+void stats_end(int phase) {
+    PROBE_PHASE(phase__end, phase_names[phase]);
+    if (!stats_enabled) {
+        return;
+    }
+    phase_timer *t = &timers[phase];
+    if (--t->depth > 0) {
+        pthread_mutex_lock(&stats_lock);
+        phases[phase].calls++;
+        pthread_mutex_unlock(&stats_lock);
+        return;
+    }
+    double wall = clock_ms(CLOCK_MONOTONIC) - t->wall_start;
+    double cpu = clock_ms(CLOCK_PROCESS_CPUTIME_ID) - t->cpu_start;
+    pthread_mutex_lock(&stats_lock);
+    phase_stats *p = &phases[phase];
+    p->calls++;
+    p->wall += wall;
+    p->cpu += cpu;
+    if (phase_does_io[phase]) {
+        io_sample io_end, delta;
+        sample_io(&io_end);
+        io_delta(&t->io_start, &io_end, &delta);
+        for (int i = 0; i < IO_FIELDS; i++) {
+            p->io.value[i] += delta.value[i];
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
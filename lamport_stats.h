@@ -0,0 +1,55 @@
+#ifndef LAMPORT_STATS_H
+#define LAMPORT_STATS_H
+
+#include <stdint.h>
+
+// Runtime phase timing (--stats or LAMPORT_STATS)
+// ==========================================================
+// With --stats on the command line, or LAMPORT_STATS=1 in the environment, a tool prints JSON lines to
+// stderr when it exits: one per phase that ran, then a "total" line. LAMPORT_STATS=<path> appends them to
+// that file instead. Each phase line holds:
+//   wall_ms, cpu_ms      wall clock and process CPU time spent in the phase (CPU includes worker threads)
+//   calls                how often the phase was entered
+//   read_syscalls, write_syscalls, bytes_read, bytes_written
+//                        I/O system calls and bytes from /proc/self/io (omitted where that is unavailable;
+//                        mmap'd reads are not system calls, so document bytes are counted separately)
+// The total line adds document_bytes (bytes fed to the message digest) and hashes (component and chain
+// hashes plus EVP digests). Phases may nest (a Merkle signature read also loads its key); time is inclusive.
+// Phases are timed on every thread and may overlap (verify hashes the document while it loads the key),
+// so phase times can add up to more than the total, and overlapping phases share their I/O counts.
+//
+// USDT probes: when <sys/sdt.h> is available, provider "lamport" has probes phase__begin and phase__end
+// (argument: phase name) at the same points, whether or not stats are enabled, e.g.
+//   bpftrace -e 'usdt:./sign-s89555:lamport:phase__begin { @[str(arg0)] = count(); }'
+
+#define STATS_PERMISSION_CHECK 0 // private key file permission checks
+#define STATS_KEY_LOAD 1         // reading and parsing keys and signatures
+#define STATS_FILE_HASH 2        // hashing the document
+#define STATS_COMPONENT_HASH 3   // key component, chain and tree node hashes
+#define STATS_COMPARE 4          // comparing recomputed values with the public key
+#define STATS_OUTPUT_WRITE 5     // writing keys and signatures
+#define STATS_NUM_PHASES 6
+
+#define STATS_DOCUMENT_BYTES 0
+#define STATS_HASHES 1
+#define STATS_NUM_COUNTERS 2
+
+extern int stats_enabled;
+extern uint64_t stats_counters[STATS_NUM_COUNTERS];
+
+// Enable stats if --stats is among the arguments (it is removed from argv) or LAMPORT_STATS is set;
+// the report is printed at exit. tool names the program in every line.
+void stats_init(const char *tool, int *argc, char *argv[]);
+
+// Phase bracketing, from any thread; nesting is tracked per thread
+void stats_begin(int phase);
+void stats_end(int phase);
+
+// Counters can be bumped from any thread
+static inline void stats_count(int counter, uint64_t n) {
+    if (stats_enabled) {
+        __atomic_fetch_add(&stats_counters[counter], n, __ATOMIC_RELAXED);
+    }
+}
+
+#endif // LAMPORT_STATS_H
@@ -0,0 +1,292 @@
+#include "lamport_wots.h"
+#include "lamport_hex.h"
+#include "lamport_stats.h"
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+// Domain separation from the Merkle leaf (0x00) and node (0x01) hashes and the tree digest (0x02)
+#define WOTS_PRF_PREFIX 0x03
+#define WOTS_CHAIN_PREFIX 0x04
+
+int wots_params_init(unsigned int w, wots_params *params) {
+    if (w != 4 && w != 16 && w != 256) {
+        fprintf(stderr, "Error: Winternitz parameter must be 4, 16 or 256\n");
+        return 0;
+    }
+    params->w = w;
+    params->log_w = w == 4 ? 2 : w == 16 ? 4 : 8;
+    params->len1 = (8 * HASH_SIZE) / params->log_w;
+    // len2 = floor(log2(len1 * (w - 1)) / log_w) + 1
+    unsigned int max_checksum = params->len1 * (w - 1), log2_checksum = 0;
+    while (max_checksum >>= 1) {
+        log2_checksum++;
+    }
+    params->len2 = log2_checksum / params->log_w + 1;
+    params->len = params->len1 + params->len2;
+    return 1;
+}
+
+// Split bytes into out_len base-w digits, most significant first
+static void base_w(const wots_params *params, const unsigned char *in, unsigned int *out, unsigned int out_len) {
+    unsigned int total = 0;
+    int bits = 0;
+    for (unsigned int i = 0; i < out_len; i++) {
+        if (bits == 0) {
+            total = *in++;
+            bits = 8;
+        }
+        bits -= (int)params->log_w;
+        out[i] = (total >> bits) & (params->w - 1);
+    }
+}
+
+// Message digits followed by checksum digits
+static void chain_lengths(const wots_params *params, const unsigned char *hash, unsigned int digits[WOTS_MAX_LEN]) {
+    base_w(params, hash, digits, params->len1);
+    unsigned int checksum = 0;
+    for (unsigned int i = 0; i < params->len1; i++) {
+        checksum += params->w - 1 - digits[i];
+    }
+    // Left-align the checksum in whole bytes before splitting it
+    unsigned int checksum_bits = params->len2 * params->log_w;
+    checksum <<= (8 - checksum_bits % 8) % 8;
+    unsigned char checksum_bytes[2];
+    checksum_bytes[0] = (unsigned char)(checksum >> 8);
+    checksum_bytes[1] = (unsigned char)checksum;
+    base_w(params, checksum_bytes, digits + params->len1, params->len2);
+}
+
+// Advance x from position start by steps chain steps: x = F(key, x XOR mask)
+static int chain(EVP_MD_CTX *mdctx, const unsigned char pub_seed[HASH_SIZE], unsigned int chain_index,
+                 unsigned int start, unsigned int steps, unsigned char x[HASH_SIZE]) {
+    unsigned char address[1 + HASH_SIZE + 9];
+    unsigned char key[HASH_SIZE], mask[HASH_SIZE], masked[HASH_SIZE];
+    static const unsigned char chain_prefix = WOTS_CHAIN_PREFIX;
+
+    address[0] = WOTS_PRF_PREFIX;
+    memcpy(address + 1, pub_seed, HASH_SIZE);
+    for (int i = 0; i < 4; i++) {
+        address[1 + HASH_SIZE + i] = (unsigned char)(chain_index >> (24 - 8 * i));
+    }
+    for (unsigned int step = start; step < start + steps; step++) {
+        for (int i = 0; i < 4; i++) {
+            address[1 + HASH_SIZE + 4 + i] = (unsigned char)(step >> (24 - 8 * i));
+        }
+        address[sizeof(address) - 1] = 0;
+        if (!hash_init(mdctx) || EVP_DigestUpdate(mdctx, address, sizeof(address)) != 1 ||
+            !hash_final(mdctx, key)) {
+            return 0;
+        }
+        address[sizeof(address) - 1] = 1;
+        if (!hash_init(mdctx) || EVP_DigestUpdate(mdctx, address, sizeof(address)) != 1 ||
+            !hash_final(mdctx, mask)) {
+            return 0;
+        }
+        for (int i = 0; i < HASH_SIZE; i++) {
+            masked[i] = x[i] ^ mask[i];
+        }
+        if (!hash_init(mdctx) || EVP_DigestUpdate(mdctx, &chain_prefix, 1) != 1 ||
+            EVP_DigestUpdate(mdctx, key, HASH_SIZE) != 1 || EVP_DigestUpdate(mdctx, masked, HASH_SIZE) != 1 ||
+            !hash_final(mdctx, x)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Run chain i of every element from its own start position for its own number of steps
+static int run_chains(const unsigned char pub_seed[HASH_SIZE], const wots_params *params, const unsigned int *start,
+                      const unsigned int *steps, unsigned char values[WOTS_MAX_LEN][HASH_SIZE]) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    int ok = mdctx != NULL;
+    stats_begin(STATS_COMPONENT_HASH);
+    for (unsigned int i = 0; ok && i < params->len; i++) {
+        ok = chain(mdctx, pub_seed, i, start[i], steps[i], values[i]);
+    }
+    stats_end(STATS_COMPONENT_HASH);
+    EVP_MD_CTX_free(mdctx);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to compute hash chains\n");
+    }
+    return ok;
+}
+
+int wots_keygen(unsigned int w, wots_private_key *private_key, wots_public_key *public_key) {
+    wots_params params;
+    unsigned int start[WOTS_MAX_LEN], steps[WOTS_MAX_LEN];
+    if (!wots_params_init(w, &params)) {
+        return 0;
+    }
+    if (RAND_priv_bytes(private_key->seed, KEY_SIZE) != 1 || RAND_bytes(private_key->pub_seed, HASH_SIZE) != 1) {
+        fprintf(stderr, "Error: Failed to generate random bytes\n");
+        return 0;
+    }
+    private_key->w = w;
+    memcpy(public_key->pub_seed, private_key->pub_seed, HASH_SIZE);
+    public_key->w = w;
+
+    // Chain starts come from the seed PRF; the public key is the end of every chain
+    if (!derive_private_components(private_key->seed, 0, 0, params.len, &public_key->chains[0][0])) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < params.len; i++) {
+        start[i] = 0;
+        steps[i] = w - 1;
+    }
+    return run_chains(public_key->pub_seed, &params, start, steps, public_key->chains);
+}
+
+int wots_sign(const wots_private_key *private_key, const unsigned char *hash, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE]) {
+    wots_params params;
+    unsigned int digits[WOTS_MAX_LEN], start[WOTS_MAX_LEN];
+    if (!wots_params_init(private_key->w, &params)) {
+        return 0;
+    }
+    chain_lengths(&params, hash, digits);
+    if (!derive_private_components(private_key->seed, 0, 0, params.len, &signature[0][0])) {
+        return 0;
+    }
+    memset(start, 0, sizeof(start));
+    return run_chains(private_key->pub_seed, &params, start, digits, signature);
+}
+
+int wots_verify(const wots_public_key *public_key, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE], const unsigned char *hash) {
+    wots_params params;
+    unsigned int digits[WOTS_MAX_LEN], steps[WOTS_MAX_LEN];
+    unsigned char ends[WOTS_MAX_LEN][HASH_SIZE];
+    if (!wots_params_init(public_key->w, &params)) {
+        return 0;
+    }
+    // Complete every chain from the revealed position to the end
+    chain_lengths(&params, hash, digits);
+    for (unsigned int i = 0; i < params.len; i++) {
+        steps[i] = params.w - 1 - digits[i];
+    }
+    memcpy(ends, signature, (size_t)params.len * HASH_SIZE);
+    if (!run_chains(public_key->pub_seed, &params, digits, steps, ends)) {
+        return 0;
+    }
+    stats_begin(STATS_COMPARE);
+    int valid = CRYPTO_memcmp(ends, public_key->chains, (size_t)params.len * HASH_SIZE) == 0;
+    stats_end(STATS_COMPARE);
+    return valid;
+}
+
+// ----------------------------------------------------------------------------
+// File formats
+// ----------------------------------------------------------------------------
+
+// Decimal w on a line of its own
+static int read_w(FILE *file, unsigned int *w) {
+    return fscanf(file, "%u", w) == 1 && fgetc(file) == '\n' && (*w == 4 || *w == 16 || *w == 256);
+}
+
+static int read_private_key(const char *file_name, wots_private_key *private_key) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    int ok = read_w(file, &private_key->w) && hex_fread_line(file, private_key->seed, KEY_SIZE) &&
+             hex_fread_line(file, private_key->pub_seed, HASH_SIZE) && hex_fread_profile(file, file_name) >= 0;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid Winternitz private key file format\n");
+    }
+    return ok;
+}
+
+int read_wots_private_key(const char *file_name, wots_private_key *private_key) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_private_key(file_name, private_key);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_private_key(const char *file_name, const wots_private_key *private_key) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create key file %s\n", file_name);
+        return 0;
+    }
+    // Set file permissions to 600 (read/write for owner only)
+    if (fchmod(fileno(file), S_IRUSR | S_IWUSR) != 0) {
+        fprintf(stderr, "Warning: Could not set secure permissions on file: %s\n", file_name);
+    }
+    fprintf(file, "%u\n", private_key->w);
+    hex_fwrite_line(file, private_key->seed, KEY_SIZE);
+    hex_fwrite_line(file, private_key->pub_seed, HASH_SIZE);
+    hex_fwrite_profile(file);
+    return fclose(file) == 0;
+}
+
+int write_wots_private_key(const char *file_name, const wots_private_key *private_key) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_private_key(file_name, private_key);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+static int read_public_key(const char *file_name, wots_public_key *public_key) {
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open key file %s\n", file_name);
+        return 0;
+    }
+    // w comes first and fixes the number of chain end lines
+    wots_params params;
+    int ok = read_w(file, &public_key->w) && wots_params_init(public_key->w, &params) &&
+             hex_fread_line(file, public_key->pub_seed, HASH_SIZE);
+    for (unsigned int i = 0; ok && i < params.len; i++) {
+        ok = hex_fread_line(file, public_key->chains[i], HASH_SIZE);
+    }
+    ok = ok && hex_fread_profile(file, file_name) >= 0 && fgetc(file) == EOF;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Invalid Winternitz public key file format\n");
+    }
+    return ok;
+}
+
+int read_wots_public_key(const char *file_name, wots_public_key *public_key) {
+    stats_begin(STATS_KEY_LOAD);
+    int ok = read_public_key(file_name, public_key);
+    stats_end(STATS_KEY_LOAD);
+    return ok;
+}
+
+static int write_public_key(const char *file_name, const wots_public_key *public_key) {
+    wots_params params;
+    if (!wots_params_init(public_key->w, &params)) {
+        return 0;
+    }
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create hex file %s\n", file_name);
+        return 0;
+    }
+    fprintf(file, "%u\n", public_key->w);
+    hex_fwrite_line(file, public_key->pub_seed, HASH_SIZE);
+    for (unsigned int i = 0; i < params.len; i++) {
+        hex_fwrite_line(file, public_key->chains[i], HASH_SIZE);
+    }
+    hex_fwrite_profile(file);
+    return fclose(file) == 0;
+}
+
+int write_wots_public_key(const char *file_name, const wots_public_key *public_key) {
+    stats_begin(STATS_OUTPUT_WRITE);
+    int ok = write_public_key(file_name, public_key);
+    stats_end(STATS_OUTPUT_WRITE);
+    return ok;
+}
+
+int read_wots_signature(const char *sig_filename, unsigned int w, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE]) {
+    wots_params params;
+    return wots_params_init(w, &params) && hex_read_lines(sig_filename, &signature[0][0], params.len, "signature");
+}
+
+int write_wots_signature(const char *sig_filename, unsigned int w, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE]) {
+    wots_params params;
+    return wots_params_init(w, &params) && hex_write_lines(sig_filename, 0, &signature[0][0], params.len);
+}
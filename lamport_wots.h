@@ -0,0 +1,62 @@
+#ifndef LAMPORT_WOTS_H
+#define LAMPORT_WOTS_H
+
+#include "lamport_common.h"
+
+// Winternitz one-time signatures (W-OTS+, as in RFC 8391 with SHA-256)
+// ==========================================================
+// The 256-bit digest is written as len1 base-w digits, followed by len2 digits of the checksum
+// sum(w - 1 - digit). Every digit has its own hash chain of length w - 1: the private key is the
+// chain starts, the public key the chain ends, and the signature reveals the element at position
+// digit in each chain. Every chain step is F(key, x XOR mask), with key and mask derived from a
+// public seed and the chain/step position, so all chains and steps are domain separated.
+//
+//   w     len1  len2  len   signature   public key   (32-byte profiles)
+//   4     128   5     133   4256 bytes  4256 bytes
+//   16    64    3     67    2144 bytes  2144 bytes
+//   256   32    2     34    1088 bytes  1088 bytes
+// (Lamport: 8192-byte signatures, 16384-byte public keys)
+// Larger w means fewer, longer chains: smaller keys and signatures for more hashing.
+
+#define WOTS_MAX_LEN 133 // len for w = 4
+#define WOTS_DEFAULT_W 16
+
+typedef struct {
+    unsigned int w;
+    unsigned int log_w;
+    unsigned int len1; // message digits
+    unsigned int len2; // checksum digits
+    unsigned int len;
+} wots_params;
+
+typedef struct {
+    unsigned char seed[KEY_SIZE];      // secret: chain starts are derived from it
+    unsigned char pub_seed[HASH_SIZE]; // public: chain keys and masks are derived from it
+    unsigned int w;
+} wots_private_key;
+
+typedef struct {
+    unsigned char pub_seed[HASH_SIZE];
+    unsigned int w;
+    unsigned char chains[WOTS_MAX_LEN][HASH_SIZE]; // chain ends
+} wots_public_key;
+
+// w must be 4, 16 or 256
+int wots_params_init(unsigned int w, wots_params *params);
+
+int wots_keygen(unsigned int w, wots_private_key *private_key, wots_public_key *public_key);
+int wots_sign(const wots_private_key *private_key, const unsigned char *hash, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE]);
+int wots_verify(const wots_public_key *public_key, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE], const unsigned char *hash);
+
+// Files: hex lines (see lamport_hex.h); keys start with a decimal "w" line
+//   private key: w, secret seed, public seed
+//   public key:  w, public seed, len chain ends
+//   signature:   len chain elements
+int read_wots_private_key(const char *file_name, wots_private_key *private_key);
+int write_wots_private_key(const char *file_name, const wots_private_key *private_key);
+int read_wots_public_key(const char *file_name, wots_public_key *public_key);
+int write_wots_public_key(const char *file_name, const wots_public_key *public_key);
+int read_wots_signature(const char *sig_filename, unsigned int w, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE]);
+int write_wots_signature(const char *sig_filename, unsigned int w, unsigned char signature[WOTS_MAX_LEN][HASH_SIZE]);
+
+#endif // LAMPORT_WOTS_H
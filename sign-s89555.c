@@ -6,40 +6,195 @@
  * The signature is written to a file with the same name as the input file, but with a ".sign" extension.
  * The private key file must be readable only by the user, and the program checks the file permissions before reading.
  * The program uses OpenSSL for hashing and file operations.
+ * With -t the next unused one-time key of the Merkle tree key (lamport-mss.priv) is used instead,
+ * and the signature also carries the leaf index and its authentication path.
+ * If the private key file holds only a seed (keygen -s), just the 256 components selected by the hash are derived.
+ * With -d the digest is signed by the signing daemon (signd-s89555) with the next one-time key of its Merkle tree key;
+ * the signature file is the same as with -t.
+ * With -k <index> one-time key <index> of the bulk keystore (keygen -n) is used, with -k next the next unused one.
+ * Either way the key is first claimed in lamport-keystore.alloc, so no key is ever used twice, even by concurrent signers.
+ * With -c the signature is self-contained for a compact public key (keygen -c): it also carries the NUM_BITS public key
+ * halves that were not revealed, derived from the other private key halves.
+ * With -w the Winternitz one-time key (keygen -w) is used: one chain element per base-w digit of the hash and checksum.
+ * With -f the HORS few-time key (keygen -f) is used: k secret values selected by the hash are revealed. The signature
+ * is counted in lamport-hors.priv before it is made, and signing fails once the key's budget is used up.
+ * With -x the next key of the key chain (keygen -x) is used, and the signature also vouches for the key after it, so
+ * verifiers follow the chain from its first key (see lamport_chain.h).
+ * With -i the signature ends with the signer's key fingerprint (the compact key of lamport-ots.pub), so a verifier
+ * can find the key in a public key directory (keydir-s89555, verify -i).
+ * With -p the signed value is the parallel tree-hash digest of the file (see lamport_digest.h) instead of its
+ * plain SHA-256; the mode is recorded in the signature so that verification uses the same construction.
+ * With -r <batch signature> <file>... many files are signed at once: their digests are combined in a Merkle tree
+ * whose root is signed with the one-time key, and every file gets an inclusion proof <file>.proof (see lamport_proof.h).
+ * With -e the document streams from stdin to an attached-signature envelope on stdout (see lamport_envelope.h):
+ * ./sign-s89555 -e < document > document.env. The one-time key is the same as in the default mode.
+ * With --stats (or LAMPORT_STATS=1) per-phase timings are printed to stderr as JSON lines at exit (see lamport_stats.h).
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "lamport_common.h"
+#include "lamport_api.h"
+#include "lamport_stats.h"
+#include "lamport_hex.h"
+#include "lamport_merkle.h"
+#include "lamport_container.h"
+#include "lamport_digest.h"
+#include "lamport_signd.h"
+#include "lamport_keystore.h"
+#include "lamport_wots.h"
+#include "lamport_hors.h"
+#include "lamport_proof.h"
+#include "lamport_keydir.h"
+#include "lamport_envelope.h"
+#include "lamport_chain.h"
 
-int create_signature(const char *sig_filename, unsigned char private_key[NUM_BITS][2][KEY_SIZE], const unsigned char *hash);
-int create_binary_signature(const char *sig_filename, unsigned char private_key[NUM_BITS][2][KEY_SIZE], const unsigned char *hash);
+int create_signature(const char *sig_filename, const unsigned char *hash);
+int create_seed_signature(const char *sig_filename, const unsigned char *hash);
+int write_signature(const char *sig_filename, unsigned char signature[NUM_BITS][KEY_SIZE]);
+int create_binary_signature(const char *sig_filename, const unsigned char private_key[NUM_BITS][2][KEY_SIZE], const unsigned char *hash,
+                            const digest_params *digest);
+int create_merkle_signature(const char *filename, const digest_params *digest);
+int create_daemon_signature(const char *filename, const digest_params *digest);
+int create_keystore_signature(const char *filename, int next_key, uint64_t key_index, const digest_params *digest);
+int create_compact_signature(const char *sig_filename, const unsigned char *hash, int seed_key);
+int create_wots_signature(const char *filename, const digest_params *digest);
+int create_hors_signature(const char *filename, const digest_params *digest);
+int create_batch_signature(int argc, char *argv[]);
+int create_envelope(void);
+int create_chain_signature(const char *filename, const digest_params *digest);
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2 && argc != 3)
+    stats_init("sign", &argc, argv);
+    if (argc > 1 && strcmp(argv[1], "-r") == 0)
     {
-        fprintf(stderr, "Usage: %s <filename> [-b]\n", argv[0]);
+        return create_batch_signature(argc, argv) ? 0 : 1;
+    }
+    if (argc == 2 && strcmp(argv[1], "-e") == 0)
+    {
+        return create_envelope() ? 0 : 1;
+    }
+    int binary = 0, merkle = 0, daemon = 0, keystore = 0, next_key = 0, compact = 0, wots = 0, hors = 0, chain = 0, identify = 0, usage_error = argc < 2;
+    uint64_t key_index = 0;
+    digest_params digest;
+    digest_params_default(&digest);
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0)
+        {
+            binary = 1;
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            merkle = 1;
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            compact = 1;
+        }
+        else if (strcmp(argv[i], "-d") == 0)
+        {
+            daemon = 1;
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            wots = 1;
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            hors = 1;
+        }
+        else if (strcmp(argv[i], "-x") == 0)
+        {
+            chain = 1;
+        }
+        else if (strcmp(argv[i], "-i") == 0)
+        {
+            identify = 1;
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+        {
+            char *end;
+            keystore = 1;
+            if (strcmp(argv[++i], "next") == 0)
+            {
+                next_key = 1;
+            }
+            else
+            {
+                key_index = strtoull(argv[i], &end, 10);
+                usage_error |= *argv[i] == '\0' || *end != '\0';
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            digest.mode = DIGEST_TREE_SHA256;
+        }
+        else
+        {
+            usage_error = 1;
+        }
+    }
+    if (usage_error || binary + merkle + daemon + keystore + compact + wots + hors + chain > 1 ||
+        (identify && merkle + daemon + keystore + compact + wots + hors + chain > 0))
+    {
+        fprintf(stderr, "Usage: %s <filename> [-b | -c | -t | -d | -k <index>|next | -w | -f | -x] [-i] [-p] [--stats]\n", argv[0]);
+        fprintf(stderr, "       %s -r <batch signature> [-p] [-j <threads>] [-m <list>] [<file>...] [--stats]\n", argv[0]);
+        fprintf(stderr, "       %s -e [--stats] < <document> > <envelope>\n", argv[0]);
         return 1;
     }
 
     const char *filename = argv[1];
-    unsigned char private_key[NUM_BITS][2][KEY_SIZE];
+    if (keystore)
+    {
+        return create_keystore_signature(filename, next_key, key_index, &digest) ? 0 : 1;
+    }
+    if (wots)
+    {
+        return create_wots_signature(filename, &digest) ? 0 : 1;
+    }
+    if (hors)
+    {
+        return create_hors_signature(filename, &digest) ? 0 : 1;
+    }
+    if (chain)
+    {
+        return create_chain_signature(filename, &digest) ? 0 : 1;
+    }
+    if (daemon)
+    {
+        return create_daemon_signature(filename, &digest) ? 0 : 1;
+    }
+    if (merkle)
+    {
+        // Hold the key lock so neither another sign -t nor the signing daemon can use the same one-time key
+        if (!can_read_file(MSS_PRIV_FILE_NAME))
+        {
+            return 1;
+        }
+        int lock_fd = mss_lock_private_state(MSS_PRIV_FILE_NAME);
+        if (lock_fd < 0)
+        {
+            return 1;
+        }
+        int ok = create_merkle_signature(filename, &digest);
+        close(lock_fd);
+        return ok ? 0 : 1;
+    }
     unsigned char hash[HASH_SIZE];
 
-    // Read private key
+    // Check the private key; its components are only read once the hash selects them
     if (!can_read_file(PRIV_FILE_NAME))
     {
         return 1;
     }
-    if (!read_key(PRIV_FILE_NAME, private_key))
-    {
-        return 1;
-    }
+    int seed_key = is_seed_key_file(PRIV_FILE_NAME);
 
     // Hash the input file
-    if (!hash_file(filename, hash))
+    if (!digest_file(filename, &digest, hash))
     {
         return 1;
     }
@@ -49,29 +204,47 @@ int main(int argc, char *argv[])
     sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
 
     // Create signature
-    if (!create_signature(sig_filename, private_key, hash))
+    if (compact ? !create_compact_signature(sig_filename, hash, seed_key)
+                : seed_key ? !create_seed_signature(sig_filename, hash) : !create_signature(sig_filename, hash))
     {
         return 1;
     }
+    if (!digest_append_trailer(sig_filename, &digest))
+    {
+        return 1;
+    }
+    if (identify)
+    {
+        unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+        unsigned char fingerprint[HASH_SIZE];
+        if (!read_key(PUB_FILE_NAME, public_key) || !keydir_fingerprint(public_key, fingerprint) ||
+            !keydir_append_signer(sig_filename, fingerprint))
+        {
+            return 1;
+        }
+    }
 
     printf("Signature successfully created for file: %s\n", filename);
     printf("Signature file: %s\n", sig_filename);
 
     // Optionally, check if -b option is provided for binary signature (not required)
-    if (argc == 3 && strcmp(argv[2], "-b") == 0)
+    if (binary)
     {
-        unsigned char private_binary_key[NUM_BITS][2][KEY_SIZE];
+        container_map private_binary_key;
         if (!can_read_file(PRIV_BINARY_FILE_NAME))
         {
             return 1;
         }
-        if (!read_binary_key(PRIV_BINARY_FILE_NAME, private_binary_key))
+        // Map the binary private key container and use it in place
+        if (!container_open(PRIV_BINARY_FILE_NAME, CONTAINER_PRIVATE_KEY, NUM_BITS * 2, &private_binary_key))
         {
             return 1;
         }
         char sig_binary_filename[strlen(filename) + strlen(SIGN_BINARY_EXTENSION) + 1];
         sprintf(sig_binary_filename, "%s%s", filename, SIGN_BINARY_EXTENSION);
-        if (!create_binary_signature(sig_binary_filename, private_binary_key, hash))
+        int ok = create_binary_signature(sig_binary_filename, (const unsigned char (*)[2][KEY_SIZE])private_binary_key.payload, hash, &digest);
+        container_close(&private_binary_key);
+        if (!ok)
         {
             return 1;
         }
@@ -81,67 +254,490 @@ int main(int argc, char *argv[])
     return 0;
 }
 
-int create_signature(const char *sig_filename, unsigned char private_key[NUM_BITS][2][KEY_SIZE], const unsigned char *hash)
+// Hex private key: the lines are fixed-width, so only the selected component of each bit is read
+int create_signature(const char *sig_filename, const unsigned char *hash)
 {
-    FILE *sig_file = fopen(sig_filename, "w");
-    if (sig_file == NULL)
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    DEBUG_PRINT("\nCreating signature file: %s ...\n", sig_filename);
+    if (!read_key_components(PRIV_FILE_NAME, hash, signature))
     {
-        fprintf(stderr, "Error: Cannot create signature file %s\n", sig_filename);
         return 0;
     }
-    DEBUG_PRINT("\nCreating signature file: %s ...\n", sig_filename);
-    int i, j, k;
-    for (i = 0; i < HASH_SIZE; i++) // for each byte in the hash
+    int ok = write_signature(sig_filename, signature);
+    OPENSSL_cleanse(signature, sizeof(signature));
+    return ok;
+}
+
+// Seed private key: derive only the selected component for each bit of the hash
+int create_seed_signature(const char *sig_filename, const unsigned char *hash)
+{
+    unsigned char seed[KEY_SIZE];
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+
+    if (!read_seed(PRIV_FILE_NAME, seed))
+    {
+        return 0;
+    }
+    DEBUG_PRINT("\nDeriving signature components from seed for: %s ...\n", sig_filename);
+    int ok = derive_signature_components(seed, 0, hash, signature);
+    OPENSSL_cleanse(seed, sizeof(seed));
+    return ok && write_signature(sig_filename, signature);
+}
+
+// Compact signature: the selected components, then the public key halves that were not selected.
+// Those are the hashes of the private key components selected by the inverted hash.
+int create_compact_signature(const char *sig_filename, const unsigned char *hash, int seed_key)
+{
+    unsigned char signature[2 * NUM_BITS][KEY_SIZE];
+    unsigned char other_half[NUM_BITS][KEY_SIZE];
+    unsigned char inverted_hash[HASH_SIZE];
+    unsigned char seed[KEY_SIZE];
+    int ok;
+
+    for (int i = 0; i < HASH_SIZE; i++)
+    {
+        inverted_hash[i] = (unsigned char)~hash[i];
+    }
+    if (seed_key)
+    {
+        ok = read_seed(PRIV_FILE_NAME, seed) && derive_signature_components(seed, 0, hash, signature) &&
+             derive_signature_components(seed, 0, inverted_hash, other_half);
+        OPENSSL_cleanse(seed, sizeof(seed));
+    }
+    else
+    {
+        ok = read_key_components(PRIV_FILE_NAME, hash, signature) &&
+             read_key_components(PRIV_FILE_NAME, inverted_hash, other_half);
+    }
+    ok = ok && hash_batch(&other_half[0][0], &signature[NUM_BITS][0], NUM_BITS) &&
+         hex_write_lines(sig_filename, 0, &signature[0][0], 2 * NUM_BITS);
+    OPENSSL_cleanse(signature, sizeof(signature));
+    OPENSSL_cleanse(other_half, sizeof(other_half));
+    return ok;
+}
+
+int write_signature(const char *sig_filename, unsigned char signature[NUM_BITS][KEY_SIZE])
+{
+    // Each signature component as one 64-hex-char line, written with a single write
+    return hex_write_lines(sig_filename, 0, &signature[0][0], NUM_BITS);
+}
+
+// Optionally, create binary signature file (not required)
+int create_binary_signature(const char *sig_filename, const unsigned char private_key[NUM_BITS][2][KEY_SIZE], const unsigned char *hash,
+                            const digest_params *digest)
+{
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    DEBUG_PRINT("\nCreating binary signature file: %s ...\n", sig_filename);
+    // For each bit in the hash, select the corresponding private key component
+    if (!lamport_sign_digest(NULL, &private_key[0][0][0], hash, &signature[0][0]))
+    {
+        return 0;
+    }
+    // Write the selected components as a signature container; the flags record the digest mode
+    int ok = container_write(sig_filename, 0, CONTAINER_SIGNATURE, digest_container_flags(digest), &signature[0][0], NUM_BITS);
+    OPENSSL_cleanse(signature, sizeof(signature));
+    return ok;
+}
+
+// Sign with the next unused one-time key of the Merkle tree key
+int create_merkle_signature(const char *filename, const digest_params *digest)
+{
+    mss_private_state state;
+    mss_traversal traversal;
+    mss_signature signature;
+    mss_public_key public_key;
+    unsigned char hash[HASH_SIZE];
+
+    if (!read_mss_private_state(MSS_PRIV_FILE_NAME, &state, &traversal))
+    {
+        return 0;
+    }
+    if (!digest_file(filename, digest, hash))
+    {
+        OPENSSL_cleanse(&state, sizeof(state));
+        return 0;
+    }
+    if (state.next_leaf >= (1UL << state.height))
+    {
+        fprintf(stderr, "Error: All %lu one-time keys of %s have been used\n", 1UL << state.height, MSS_PRIV_FILE_NAME);
+        OPENSSL_cleanse(&state, sizeof(state));
+        return 0;
+    }
+
+    // The key file holds the traversal state for next_leaf, unless it predates it or the signing daemon
+    // used the key since; then one pass over the tree rebuilds it
+    unsigned long leaf = state.next_leaf;
+    unsigned int height = state.height;
+    int ok = (traversal.leaf == leaf || mss_traversal_init(&state, &traversal)) && mss_sign(&state, &traversal, hash, &signature);
+    // A damaged traversal state would only make invalid signatures: check against the public key
+    if (ok && access(MSS_PUB_FILE_NAME, F_OK) == 0 && read_mss_public_key(MSS_PUB_FILE_NAME, &public_key) &&
+        !mss_verify(&public_key, &signature, hash))
+    {
+        fprintf(stderr, "Warning: The traversal state in %s is damaged, rebuilding it\n", MSS_PRIV_FILE_NAME);
+        ok = mss_traversal_init(&state, &traversal) && mss_sign(&state, &traversal, hash, &signature);
+    }
+
+    // Burn the one-time key on disk, with the traversal state for the next one, before the signature is written,
+    // so a crash can never lead to reuse
+    state.next_leaf++;
+    ok = ok && mss_traversal_next(&state, &traversal) && write_mss_private_state(MSS_PRIV_FILE_NAME, &state, &traversal);
+    OPENSSL_cleanse(&state, sizeof(state));
+    if (!ok)
+    {
+        OPENSSL_cleanse(&signature, sizeof(signature));
+        return 0;
+    }
+    signature.digest = *digest;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+    if (!write_mss_signature(sig_filename, height, &signature))
+    {
+        return 0;
+    }
+    printf("Merkle signature successfully created for file: %s (one-time key %lu of %lu)\n", filename, leaf, 1UL << height);
+    printf("Signature file: %s\n", sig_filename);
+    return 1;
+}
+
+// Let the signing daemon sign the digest; the key was burned on disk before the daemon replied
+int create_daemon_signature(const char *filename, const digest_params *digest)
+{
+    mss_signature signature;
+    unsigned char hash[HASH_SIZE];
+    unsigned int height;
+    const char *socket_name = getenv("LAMPORT_SIGND_SOCKET") != NULL ? getenv("LAMPORT_SIGND_SOCKET") : SIGND_SOCKET_NAME;
+
+    if (!digest_file(filename, digest, hash) || !signd_request(socket_name, hash, &signature, &height))
+    {
+        return 0;
+    }
+    signature.digest = *digest;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+    if (!write_mss_signature(sig_filename, height, &signature))
+    {
+        return 0;
+    }
+    printf("Merkle signature successfully created by the signing daemon for file: %s (one-time key %lu of %lu)\n",
+           filename, signature.leaf_index, 1UL << height);
+    printf("Signature file: %s\n", sig_filename);
+    return 1;
+}
+
+// Sign with one key of the bulk keystore; the keystore is mapped and the key used in place
+int create_keystore_signature(const char *filename, int next_key, uint64_t key_index, const digest_params *digest)
+{
+    keystore_map keystore;
+    keystore_alloc alloc;
+    unsigned char hash[HASH_SIZE];
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+
+    if (!can_read_file(KEYSTORE_PRIV_FILE_NAME) || !digest_file(filename, digest, hash) ||
+        !keystore_open(KEYSTORE_PRIV_FILE_NAME, KEYSTORE_PRIVATE, &keystore))
     {
-        for (j = 0; j < 8; j++) // for each bit in the byte
+        return 0;
+    }
+    // Claim the key and get the claim onto disk before the key is used
+    if (!keystore_alloc_open(KEYSTORE_ALLOC_FILE_NAME, &keystore, &alloc))
+    {
+        keystore_close(&keystore);
+        return 0;
+    }
+    int claimed = (next_key ? keystore_claim_next(&alloc, &key_index) : keystore_claim(&alloc, key_index)) &&
+                  keystore_alloc_sync(&alloc);
+    keystore_alloc_close(&alloc);
+    if (!claimed)
+    {
+        keystore_close(&keystore);
+        return 0;
+    }
+    const unsigned char (*private_key)[2][KEY_SIZE] = (const unsigned char (*)[2][KEY_SIZE])keystore_key(&keystore, key_index);
+    if (private_key == NULL)
+    {
+        keystore_close(&keystore);
+        return 0;
+    }
+    int ok = lamport_sign_digest(NULL, &private_key[0][0][0], hash, &signature[0][0]);
+    keystore_close(&keystore);
+    if (!ok)
+    {
+        OPENSSL_cleanse(signature, sizeof(signature));
+        return 0;
+    }
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+    ok = write_signature(sig_filename, signature) && digest_append_trailer(sig_filename, digest);
+    OPENSSL_cleanse(signature, sizeof(signature));
+    if (!ok)
+    {
+        return 0;
+    }
+    printf("Signature successfully created for file: %s (keystore key %llu)\n", filename, (unsigned long long)key_index);
+    printf("Signature file: %s\n", sig_filename);
+    return 1;
+}
+
+int create_wots_signature(const char *filename, const digest_params *digest)
+{
+    wots_private_key private_key;
+    unsigned char hash[HASH_SIZE];
+    unsigned char signature[WOTS_MAX_LEN][HASH_SIZE];
+
+    if (!can_read_file(WOTS_PRIV_FILE_NAME) || !digest_file(filename, digest, hash) ||
+        !read_wots_private_key(WOTS_PRIV_FILE_NAME, &private_key))
+    {
+        return 0;
+    }
+    int ok = wots_sign(&private_key, hash, signature);
+    unsigned int w = private_key.w;
+    OPENSSL_cleanse(&private_key, sizeof(private_key));
+    if (!ok)
+    {
+        return 0;
+    }
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+    if (!write_wots_signature(sig_filename, w, signature) || !digest_append_trailer(sig_filename, digest))
+    {
+        return 0;
+    }
+    printf("Signature successfully created for file: %s (Winternitz, w = %u)\n", filename, w);
+    printf("Signature file: %s\n", sig_filename);
+    return 1;
+}
+
+int create_hors_signature(const char *filename, const digest_params *digest)
+{
+    hors_private_key private_key;
+    unsigned char hash[HASH_SIZE];
+    unsigned char signature[HORS_MAX_K][HASH_SIZE];
+    uint64_t number;
+
+    // Count the signature on disk before it is made, so a crash can never exceed the key's budget
+    if (!can_read_file(HORS_PRIV_FILE_NAME) || !digest_file(filename, digest, hash) ||
+        !hors_claim_signature(HORS_PRIV_FILE_NAME, &private_key, &number))
+    {
+        return 0;
+    }
+    int ok = hors_sign(&private_key, number, hash, signature);
+    hors_params params = private_key.params;
+    OPENSSL_cleanse(&private_key, sizeof(private_key));
+    if (!ok)
+    {
+        return 0;
+    }
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+    ok = write_hors_signature(sig_filename, params.k, number, signature) && digest_append_trailer(sig_filename, digest);
+    OPENSSL_cleanse(signature, sizeof(signature));
+    if (!ok)
+    {
+        return 0;
+    }
+    printf("Signature successfully created for file: %s (HORS, signature %llu of %llu)\n", filename,
+           (unsigned long long)number + 1, (unsigned long long)params.max_signatures);
+    printf("Signature file: %s\n", sig_filename);
+    if (number + 1 == params.max_signatures)
+    {
+        fprintf(stderr, "Warning: This was the last signature of %s; generate a new key\n", HORS_PRIV_FILE_NAME);
+    }
+    return 1;
+}
+
+// Read file names, one per line, from a list file; blank lines and lines starting with '#' are skipped
+static int read_file_list(const char *list_name, char ***files, size_t *count, size_t *capacity)
+{
+    FILE *list = fopen(list_name, "r");
+    if (list == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open file list %s\n", list_name);
+        return 0;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int ok = 1;
+    while (ok && (len = getline(&line, &line_size, list)) >= 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#')
+        {
+            continue;
+        }
+        if (*count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            char **grown = realloc(*files, *capacity * sizeof(char *));
+            ok = grown != NULL;
+            *files = ok ? grown : *files;
+        }
+        if (ok && ((*files)[*count] = strdup(line)) != NULL)
         {
-            int bit_index = i * 8 + j;
-            int bit_value = (hash[i] >> (7 - j)) & 1; // Right-shifts to move the desired bit to position 0 and masks it
-            DEBUG_PRINT("Hash byte %d: %02x, using private key[%d][%d]\n", i, hash[i], bit_index, bit_value);
+            (*count)++;
+        }
+        else
+        {
+            ok = 0;
+            fprintf(stderr, "Error: Memory allocation failed\n");
+        }
+    }
+    free(line);
+    fclose(list);
+    return ok;
+}
 
-            // Write the selected private key component as hex (32 bytes per line + newline)
-            for (k = 0; k < KEY_SIZE; k++)
-            {
-                fprintf(sig_file, "%02x", private_key[bit_index][bit_value][k]);
-            }
-            fprintf(sig_file, "\n");
+// Batch mode: one one-time signature over the Merkle root of many files, plus an inclusion proof per file
+int create_batch_signature(int argc, char *argv[])
+{
+    const char *sig_filename = argc > 2 ? argv[2] : NULL;
+    const char *list_name = NULL;
+    int num_threads = 0;
+    digest_params digest;
+    digest_params_default(&digest);
+
+    // Files from the command line first, then those from the list
+    size_t count = 0, capacity = (size_t)argc;
+    char **files = malloc(capacity * sizeof(char *));
+    int ok = files != NULL;
+    for (int i = 3; ok && i < argc; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0)
+        {
+            digest.mode = DIGEST_TREE_SHA256;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
         }
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            list_name = argv[++i];
+        }
+        else
+        {
+            ok = (files[count] = strdup(argv[i])) != NULL;
+            count += ok;
+        }
+    }
+    if (ok && sig_filename == NULL)
+    {
+        fprintf(stderr, "Usage: %s -r <batch signature> [-p] [-j <threads>] [-m <list>] [<file>...]\n", argv[0]);
+        ok = 0;
+    }
+    ok = ok && (list_name == NULL || read_file_list(list_name, &files, &count, &capacity));
+
+    // Check the private key before any file is hashed
+    batch_tree tree;
+    unsigned char hash[HASH_SIZE];
+    int seed_key = 0;
+    ok = ok && can_read_file(PRIV_FILE_NAME);
+    if (ok)
+    {
+        seed_key = is_seed_key_file(PRIV_FILE_NAME);
+        ok = batch_tree_build(files, count, &digest, num_threads, &tree);
+    }
+    if (ok)
+    {
+        // Sign the root, then hand out the proofs
+        ok = batch_tree_digest(&tree, hash) &&
+             (seed_key ? create_seed_signature(sig_filename, hash) : create_signature(sig_filename, hash));
+        for (size_t f = 0; ok && f < count; f++)
+        {
+            batch_proof proof;
+            char proof_filename[strlen(files[f]) + strlen(PROOF_EXTENSION) + 1];
+            sprintf(proof_filename, "%s%s", files[f], PROOF_EXTENSION);
+            batch_tree_proof(&tree, f, &digest, &proof);
+            ok = write_batch_proof(proof_filename, &proof);
+        }
+        batch_tree_free(&tree);
+    }
+    if (ok)
+    {
+        printf("Batch signature successfully created for %zu files\n", count);
+        printf("Signature file: %s\n", sig_filename);
+        printf("Proof files: <file>%s\n", PROOF_EXTENSION);
+    }
+    for (size_t f = 0; files != NULL && f < count; f++)
+    {
+        free(files[f]);
+    }
+    free(files);
+    return ok;
+}
+
+// Attached signature: stdin streams into the envelope on stdout, and the signature follows the payload.
+// Messages go to stderr, since stdout is the envelope.
+int create_envelope(void)
+{
+    unsigned char hash[HASH_SIZE];
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    unsigned char seed[KEY_SIZE];
+    uint64_t length;
+    int ok;
+
+    if (isatty(STDOUT_FILENO))
+    {
+        fprintf(stderr, "Error: The envelope is binary; redirect stdout to a file or pipe\n");
+        return 0;
     }
-    fclose(sig_file);
+    if (!can_read_file(PRIV_FILE_NAME) || !envelope_write_payload(STDIN_FILENO, STDOUT_FILENO, hash, &length))
+    {
+        return 0;
+    }
+    if (is_seed_key_file(PRIV_FILE_NAME))
+    {
+        ok = read_seed(PRIV_FILE_NAME, seed) && derive_signature_components(seed, 0, hash, signature);
+        OPENSSL_cleanse(seed, sizeof(seed));
+    }
+    else
+    {
+        ok = read_key_components(PRIV_FILE_NAME, hash, signature);
+    }
+    ok = ok && envelope_write_signature(STDOUT_FILENO, length, signature);
+    OPENSSL_cleanse(signature, sizeof(signature));
+    if (!ok)
+    {
+        return 0;
+    }
+    fprintf(stderr, "Signature envelope created for %llu payload bytes\n", (unsigned long long)length);
     return 1;
 }
 
-// Optionally, create binary signature file (not required)
-int create_binary_signature(const char *sig_filename, unsigned char private_key[NUM_BITS][2][KEY_SIZE], const unsigned char *hash)
+// Chain mode: the key is marked as used on disk before the signature is made
+int create_chain_signature(const char *filename, const digest_params *digest)
 {
-    // Create binary signature file
-    FILE *sig_file = fopen(sig_filename, "wb");
-    if (sig_file == NULL)
+    chain_private_state state;
+    chain_signature signature;
+    unsigned char hash[HASH_SIZE];
+    uint64_t number;
+
+    if (!can_read_file(CHAIN_PRIV_FILE_NAME) || !digest_file(filename, digest, hash) ||
+        !chain_claim_key(CHAIN_PRIV_FILE_NAME, &state, &number))
     {
-        fprintf(stderr, "Error: Cannot create binary signature file %s\n", sig_filename);
         return 0;
     }
-    DEBUG_PRINT("\nCreating binary signature file: %s ...\n", sig_filename);
-    // For each bit in the hash, write the corresponding private key component
-    int i, j;
-    for (i = 0; i < HASH_SIZE; i++)
-    { // for each byte in the hash
-        for (j = 0; j < 8; j++)
-        { // for each bit in the byte
-            // Determine which private key component to use based on the bit value
-            int bit_index = i * 8 + j;
-            int bit_value = (hash[i] >> (7 - j)) & 1; // Right-shifts to move the desired bit to position 0 and masks it
-            DEBUG_PRINT("Hash byte %d: %02x, using private key[%d][%d]\n", i, hash[i], bit_index, bit_value);
-
-            // Write the selected private key component as binary data
-            if (fwrite(private_key[bit_index][bit_value], sizeof(unsigned char), KEY_SIZE, sig_file) != KEY_SIZE)
-            {
-                fprintf(stderr, "Error: Failed to write binary signature data\n");
-                fclose(sig_file);
-                return 0;
-            }
-        }
+    int ok = chain_sign(&state, number, hash, &signature);
+    OPENSSL_cleanse(&state, sizeof(state));
+    if (!ok)
+    {
+        return 0;
+    }
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+    if (!write_chain_signature(sig_filename, &signature) || !digest_append_trailer(sig_filename, digest))
+    {
+        return 0;
     }
-    fclose(sig_file);
+    printf("Signature successfully created for file: %s (chain key %llu)\n", filename, (unsigned long long)number);
+    printf("Signature file: %s\n", sig_filename);
     return 1;
 }
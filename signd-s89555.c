@@ -0,0 +1,455 @@
+/*
+ * Lamport One-Time Signature Scheme
+ * Signing Daemon
+ * ==========================================================
+ * This program keeps the Merkle tree key (keygen -t) open and signs message digests sent over a Unix domain socket.
+ * A background thread keeps a pool of prepared one-time keys (private key, public key and authentication path)
+ * in locked memory, so a request only selects components and copies them into the reply. Each client connection
+ * is served on its own thread, so a slow or idle client does not hold up the others.
+ *
+ * One-time key safety: before a block of one-time keys enters the pool, the index of the first key after the block
+ * is written to lamport-mss.priv and fsync'ed. Every key handed out has therefore been burned on disk before the
+ * reply is sent; keys still in the pool when the daemon stops are skipped, never reused.
+ * While the daemon runs it holds the key lock, so sign -t cannot use the same key file.
+ *
+ * USAGE:
+ * Compile with: make signd-s89555
+ * Run with: ./signd-s89555 [-s <socket>] [-n <pool size>]
+ * Clients: ./sign-s89555 <filename> -d (LAMPORT_SIGND_SOCKET overrides the socket path)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <openssl/crypto.h>
+#include "lamport_common.h"
+#include "lamport_merkle.h"
+#include "lamport_signd.h"
+
+typedef struct
+{
+    mss_private_state state;   // state.next_leaf is the first key not yet reserved on disk
+    unsigned char *tree;       // all tree nodes, for O(height) authentication paths
+    mss_prepared_key *slots;   // ring of prepared keys, locked in memory
+    size_t pool_size;
+    size_t head;               // oldest prepared key
+    size_t count;              // prepared keys ready to sign
+    int exhausted;             // every one-time key has been reserved
+    int failed;                // the key file could not be updated; nothing more is handed out
+    int stop;
+    int clients;               // connections being served
+    pthread_mutex_t lock;
+    pthread_cond_t key_ready;
+    pthread_cond_t need_keys;
+    pthread_cond_t client_done;
+} key_pool;
+
+typedef struct
+{
+    key_pool *pool;
+    int client;
+} client_args;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int sig);
+static int open_pool(key_pool *pool, size_t pool_size);
+static void close_pool(key_pool *pool);
+static void *refill_keys(void *arg);
+static int sign_digest(key_pool *pool, const unsigned char *hash, mss_signature *signature);
+static int open_socket(const char *socket_name);
+static int start_client(key_pool *pool, int client);
+static void *client_thread(void *arg);
+static void serve_client(key_pool *pool, int client);
+
+int main(int argc, char *argv[])
+{
+    const char *socket_name = SIGND_SOCKET_NAME;
+    long pool_size = SIGND_DEFAULT_POOL_SIZE;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+        {
+            socket_name = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+        {
+            pool_size = atol(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s <socket>] [-n <pool size>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (pool_size < 1)
+    {
+        fprintf(stderr, "Error: Pool size must be at least 1\n");
+        return 1;
+    }
+
+    // Keep sign -t and other daemons off the key while it is in use here
+    if (!can_read_file(MSS_PRIV_FILE_NAME))
+    {
+        return 1;
+    }
+    int lock_fd = mss_lock_private_state(MSS_PRIV_FILE_NAME);
+    if (lock_fd < 0)
+    {
+        return 1;
+    }
+
+    static key_pool pool;
+    if (!open_pool(&pool, (size_t)pool_size))
+    {
+        close(lock_fd);
+        return 1;
+    }
+    int listen_fd = open_socket(socket_name);
+    if (listen_fd < 0)
+    {
+        close_pool(&pool);
+        close(lock_fd);
+        return 1;
+    }
+
+    printf("Signing daemon listening on %s (%lu of %lu one-time keys left, pool of %ld)\n", socket_name,
+           (1UL << pool.state.height) - pool.state.next_leaf, 1UL << pool.state.height, pool_size);
+    fflush(stdout);
+
+    // Signals go to the main thread only, so that they interrupt accept()
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    pthread_t refill_thread;
+    int started = pthread_create(&refill_thread, NULL, refill_keys, &pool) == 0;
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (!started)
+    {
+        fprintf(stderr, "Error: Cannot start key pool thread\n");
+        close(listen_fd);
+        unlink(socket_name);
+        close_pool(&pool);
+        close(lock_fd);
+        return 1;
+    }
+
+    // No SA_RESTART: a signal interrupts accept() so the loop can shut down
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    while (!stop_requested)
+    {
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0)
+        {
+            continue; // EINTR on shutdown, or a client that went away
+        }
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+        start_client(&pool, client);
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    }
+
+    // Client threads see stop_requested after their current request or receive timeout
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.need_keys);
+    pthread_cond_broadcast(&pool.key_ready);
+    while (pool.clients > 0)
+    {
+        pthread_cond_wait(&pool.client_done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    pthread_join(refill_thread, NULL);
+
+    close(listen_fd);
+    unlink(socket_name);
+    printf("Signing daemon stopped (%zu reserved one-time keys were not used)\n", pool.count);
+    close_pool(&pool);
+    close(lock_fd);
+    return 0;
+}
+
+static void handle_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Load the key, build the tree and allocate the locked key pool
+static int open_pool(key_pool *pool, size_t pool_size)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (mlock(&pool->state, sizeof(pool->state)) != 0)
+    {
+        fprintf(stderr, "Warning: Could not lock the key seed in memory\n");
+    }
+    if (!read_mss_private_state(MSS_PRIV_FILE_NAME, &pool->state, NULL))
+    {
+        return 0;
+    }
+    pool->exhausted = pool->state.next_leaf >= (1UL << pool->state.height);
+
+    pool->tree = malloc(mss_tree_size(pool->state.height));
+    if (pool->tree == NULL)
+    {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        OPENSSL_cleanse(&pool->state, sizeof(pool->state));
+        return 0;
+    }
+    if (!mss_build_tree(pool->state.seed, pool->state.height, pool->tree))
+    {
+        close_pool(pool);
+        return 0;
+    }
+    // The root is the last node of the tree; it must match the published public key
+    mss_public_key public_key;
+    if (access(MSS_PUB_FILE_NAME, F_OK) == 0 && read_mss_public_key(MSS_PUB_FILE_NAME, &public_key) &&
+        (public_key.height != pool->state.height ||
+         memcmp(public_key.root, pool->tree + mss_tree_size(pool->state.height) - HASH_SIZE, HASH_SIZE) != 0))
+    {
+        fprintf(stderr, "Error: %s does not belong to %s\n", MSS_PUB_FILE_NAME, MSS_PRIV_FILE_NAME);
+        close_pool(pool);
+        return 0;
+    }
+
+    size_t size = pool_size * sizeof(mss_prepared_key);
+    void *slots = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slots == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        close_pool(pool);
+        return 0;
+    }
+    // Prepared keys never reach swap or core dumps
+    if (mlock(slots, size) != 0)
+    {
+        fprintf(stderr, "Warning: Could not lock the key pool in memory (check ulimit -l)\n");
+    }
+#ifdef MADV_DONTDUMP
+    madvise(slots, size, MADV_DONTDUMP);
+#endif
+    pool->slots = slots;
+    pool->pool_size = pool_size;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->key_ready, NULL);
+    pthread_cond_init(&pool->need_keys, NULL);
+    pthread_cond_init(&pool->client_done, NULL);
+    return 1;
+}
+
+static void close_pool(key_pool *pool)
+{
+    if (pool->slots != NULL)
+    {
+        size_t size = pool->pool_size * sizeof(mss_prepared_key);
+        OPENSSL_cleanse(pool->slots, size);
+        munlock(pool->slots, size);
+        munmap(pool->slots, size);
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->key_ready);
+        pthread_cond_destroy(&pool->need_keys);
+        pthread_cond_destroy(&pool->client_done);
+    }
+    free(pool->tree);
+    OPENSSL_cleanse(&pool->state, sizeof(pool->state));
+    munlock(&pool->state, sizeof(pool->state));
+    memset(pool, 0, sizeof(*pool));
+}
+
+// Background thread: whenever the pool is half empty, reserve a block of keys on disk and prepare them
+static void *refill_keys(void *arg)
+{
+    key_pool *pool = arg;
+    unsigned long total = 1UL << pool->state.height;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop)
+    {
+        if (pool->exhausted || pool->failed || pool->count > pool->pool_size / 2)
+        {
+            pthread_cond_wait(&pool->need_keys, &pool->lock);
+            continue;
+        }
+        size_t block = pool->pool_size - pool->count;
+        if (block > total - pool->state.next_leaf)
+        {
+            block = total - pool->state.next_leaf;
+        }
+        unsigned long first = pool->state.next_leaf;
+        size_t tail = (pool->head + pool->count) % pool->pool_size;
+        pthread_mutex_unlock(&pool->lock);
+
+        // Burn the whole block on disk before any of its keys can be handed out. The daemon has the whole
+        // tree, so it drops the traversal state; the next sign -t rebuilds it once.
+        pool->state.next_leaf = first + block;
+        int ok = write_mss_private_state(MSS_PRIV_FILE_NAME, &pool->state, NULL);
+        for (size_t i = 0; ok && i < block; i++)
+        {
+            // Slots from tail onwards are free until count covers them
+            ok = mss_prepare_key(&pool->state, pool->tree, first + i, &pool->slots[(tail + i) % pool->pool_size]);
+            pthread_mutex_lock(&pool->lock);
+            pool->count += ok ? 1 : 0;
+            pthread_cond_signal(&pool->key_ready);
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->failed = !ok;
+        pool->exhausted = pool->state.next_leaf >= total;
+        pthread_cond_broadcast(&pool->key_ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Sign with the oldest prepared key; returns a SIGND_STATUS_* value
+static int sign_digest(key_pool *pool, const unsigned char *hash, mss_signature *signature)
+{
+    int status = SIGND_STATUS_OK;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == 0 && !pool->exhausted && !pool->failed && !pool->stop)
+    {
+        pthread_cond_wait(&pool->key_ready, &pool->lock);
+    }
+    if (pool->count == 0)
+    {
+        status = pool->exhausted ? SIGND_STATUS_EXHAUSTED : SIGND_STATUS_ERROR;
+    }
+    else
+    {
+        // The slot is wiped before the lock is released, so the key is gone from memory as well
+        mss_prepared_key *key = &pool->slots[pool->head];
+        mss_sign_prepared(key, pool->state.height, hash, signature);
+        OPENSSL_cleanse(key, sizeof(*key));
+        pool->head = (pool->head + 1) % pool->pool_size;
+        pool->count--;
+        if (pool->count <= pool->pool_size / 2)
+        {
+            pthread_cond_signal(&pool->need_keys);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return status;
+}
+
+static int open_socket(const char *socket_name)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_name) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: Socket path too long: %s\n", socket_name);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_name);
+
+    // Replace a stale socket from an earlier run, but never any other kind of file
+    struct stat st;
+    if (lstat(socket_name, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(socket_name);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t old_mask = umask(0077); // socket only usable by the owner
+    int ok = fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(old_mask);
+    if (!ok || listen(fd, 64) != 0)
+    {
+        fprintf(stderr, "Error: Cannot listen on %s\n", socket_name);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Serve a connection on a detached thread; at most SIGND_MAX_CLIENTS run at once
+static int start_client(key_pool *pool, int client)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->clients >= SIGND_MAX_CLIENTS)
+    {
+        pthread_cond_wait(&pool->client_done, &pool->lock);
+    }
+    pool->clients++;
+    pthread_mutex_unlock(&pool->lock);
+
+    client_args *args = malloc(sizeof(client_args));
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ok = args != NULL && pthread_attr_init(&attr) == 0;
+    if (ok)
+    {
+        args->pool = pool;
+        args->client = client;
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        ok = pthread_create(&thread, &attr, client_thread, args) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Warning: Cannot start a client thread, connection dropped\n");
+        free(args);
+        close(client);
+        pthread_mutex_lock(&pool->lock);
+        pool->clients--;
+        pthread_cond_signal(&pool->client_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return ok;
+}
+
+static void *client_thread(void *arg)
+{
+    client_args *args = arg;
+    key_pool *pool = args->pool;
+    serve_client(pool, args->client);
+    close(args->client);
+    free(args);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->clients--;
+    pthread_cond_broadcast(&pool->client_done);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void serve_client(key_pool *pool, int client)
+{
+    // A stalled client must not keep its thread, or the shutdown, waiting for long
+    struct timeval timeout = {5, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    unsigned char request[SIGND_REQUEST_SIZE];
+    unsigned char response[SIGND_RESPONSE_HEADER_SIZE + 2 * NUM_BITS * KEY_SIZE + MSS_MAX_HEIGHT * HASH_SIZE];
+    mss_signature signature;
+    while (!stop_requested && signd_read_fully(client, request, sizeof(request)))
+    {
+        int status = memcmp(request, SIGND_MAGIC, 4) == 0 ? sign_digest(pool, request + 4, &signature) : SIGND_STATUS_ERROR;
+        size_t size = signd_encode_response(status, pool->state.height, &signature, response);
+        int sent = signd_write_fully(client, response, size);
+        OPENSSL_cleanse(&signature, sizeof(signature));
+        if (!sent || status != SIGND_STATUS_OK)
+        {
+            break;
+        }
+    }
+}
@@ -116,6 +116,1031 @@ else
     echo "Given signature verification failed"
     exit 1
 fi
+echo
+
+# Test 8: Every batch hashing kernel and hex codec must agree with the reference files
+echo "9. Testing batch hashing kernels and hex codecs against the reference signature..."
+for kernel in scalar avx2 shani; do
+    LAMPORT_HASH_KERNEL=$kernel ./verify-s89555 document.jpg > /dev/null
+    if [ $? -eq 0 ]; then
+        echo "  $kernel kernel: VALID"
+    else
+        echo "  $kernel kernel verification failed"
+        exit 1
+    fi
+done
+for codec in scalar ssse3 avx2; do
+    LAMPORT_HEX_CODEC=$codec ./verify-s89555 document.jpg > /dev/null
+    if [ $? -eq 0 ]; then
+        echo "  $codec hex codec: VALID"
+    else
+        echo "  $codec hex codec verification failed"
+        exit 1
+    fi
+done
+tr 'a-f' 'A-F' < ref/document.jpg.sign > document.jpg.sign
+./verify-s89555 document.jpg > /dev/null
+if [ $? -ne 0 ]; then
+    echo "Upper-case hex signature was rejected"
+    exit 1
+fi
+sed '7s/^./g/' ref/document.jpg.sign > document.jpg.sign
+./verify-s89555 document.jpg 2> /dev/null
+if [ $? -eq 0 ]; then
+    echo "Malformed hex signature was accepted"
+    exit 1
+fi
+cp ref/document.jpg.sign document.jpg.sign
+echo "  malformed hex correctly rejected"
+echo
+
+# Test 9: Batch verification from a manifest and from a directory tree
+echo "10. Testing batch verification..."
+./keygen-s89555 > /dev/null
+mkdir -p batch/sub
+for i in 1 2 3; do
+    echo "Batch document $i" > batch/doc$i.txt
+    ./sign-s89555 batch/doc$i.txt > /dev/null
+done
+cp test1.txt batch/sub/doc4.txt
+./sign-s89555 batch/sub/doc4.txt > /dev/null
+cat > batch/manifest.lst <<MANIFEST
+# file signature public-key
+batch/doc1.txt batch/doc1.txt.sign lamport-ots.pub
+batch/sub/doc4.txt batch/sub/doc4.txt.sign lamport-ots.pub
+document.jpg document.jpg.sign ref/lamport-ots.pub
+MANIFEST
+./verify-s89555 -m batch/manifest.lst -j 2
+if [ $? -eq 0 ]; then
+    echo "Manifest batch verification successful"
+else
+    echo "Manifest batch verification failed"
+    exit 1
+fi
+echo "MODIFIED" >> batch/doc2.txt
+ln -s .. batch/sub/loop
+./verify-s89555 -d batch -j 2 > batch/report.txt
+if [ $? -eq 1 ] && grep -q "batch/doc2.txt: INVALID" batch/report.txt && [ "$(grep -c ': VALID' batch/report.txt)" -eq 3 ]; then
+    echo "Directory batch verification correctly reported one INVALID file"
+else
+    echo "Directory batch verification failed"
+    cat batch/report.txt
+    exit 1
+fi
+rm -rf batch
+echo
+
+# Test 10: Binary container keys and signatures
+echo "11. Testing binary container format..."
+./keygen-s89555 -b > /dev/null
+cp test1.txt test_bin.txt
+./sign-s89555 test_bin.txt -b > /dev/null && rm -f test_bin.txt.sign && ./verify-s89555 test_bin.txt -b > /dev/null
+if [ $? -ne 0 ]; then
+    echo "Binary container signature failed"
+    exit 1
+fi
+printf '\377' | dd of=test_bin.txt.bin.sign bs=1 seek=200 conv=notrunc 2> /dev/null
+./verify-s89555 test_bin.txt -b 2> /dev/null
+if [ $? -eq 0 ]; then
+    echo "Corrupted binary signature was accepted"
+    exit 1
+fi
+echo "Binary container signature verified, corruption detected"
+echo
+
+# Test 11: Seed private key with on-demand component derivation
+echo "12. Testing seed private keys..."
+./keygen-s89555 -s > /dev/null
+seed_size=$(wc -c < lamport-ots.priv)
+cp test1.txt test_seed.txt
+./sign-s89555 test_seed.txt > /dev/null && ./verify-s89555 test_seed.txt > /dev/null
+if [ $? -eq 0 ] && [ "$seed_size" -eq 65 ]; then
+    echo "Seed key signature verified (private key file: $seed_size bytes)"
+else
+    echo "Seed key signature failed"
+    exit 1
+fi
+echo
+
+# Test 12: Merkle tree (many-time) keys
+echo "13. Testing Merkle tree signatures..."
+./keygen-s89555 -t 3 > /dev/null
+if [ $? -ne 0 ] || [ ! -f "lamport-mss.pub" ] || [ ! -f "lamport-mss.priv" ]; then
+    echo "Merkle key generation failed"
+    exit 1
+fi
+for i in 1 2 3; do
+    echo "Merkle document $i" > test_mss$i.txt
+    ./sign-s89555 test_mss$i.txt -t > /dev/null && ./verify-s89555 test_mss$i.txt -t > /dev/null
+    if [ $? -ne 0 ]; then
+        echo "Merkle signature $i failed"
+        exit 1
+    fi
+done
+echo "MODIFIED" >> test_mss2.txt
+./verify-s89555 test_mss2.txt -t > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Modified document not detected with Merkle signature"
+    exit 1
+fi
+if ! grep -q "^traversal 3$" lamport-mss.priv; then
+    echo "Merkle traversal state not kept in the private key"
+    exit 1
+fi
+# Signing goes on after the traversal state is lost (as after the signing daemon) or damaged
+for i in 4 5 6 7 8; do
+    if [ $i -eq 5 ]; then
+        sed -i '/^traversal/,$d' lamport-mss.priv
+    fi
+    if [ $i -eq 7 ]; then
+        sed -i '/^traversal/{n;s/^./0/;s/^0/1/}' lamport-mss.priv
+    fi
+    if ! ./sign-s89555 test_mss1.txt -t > /dev/null 2>&1 || ! ./verify-s89555 test_mss1.txt -t > /dev/null; then
+        echo "Merkle signature $i failed"
+        exit 1
+    fi
+done
+./sign-s89555 test_mss1.txt -t 2> /dev/null
+if [ $? -eq 0 ]; then
+    echo "Exhausted Merkle key was not rejected"
+    exit 1
+fi
+echo "Merkle signatures verified, modification detected, traversal state rebuilt, exhausted key rejected"
+echo
+
+echo "14. Testing file I/O backends..."
+./keygen-s89555 > /dev/null
+head -c 3000000 /dev/urandom > test_io_large.txt
+: > test_io_empty.txt
+for f in test_io_large.txt test_io_empty.txt; do
+    ./sign-s89555 $f > /dev/null
+    for backend in stdio mmap buffered uring; do
+        LAMPORT_IO=$backend ./verify-s89555 $f > /dev/null
+        if [ $? -ne 0 ]; then
+            echo "Verification of $f with the $backend backend failed"
+            exit 1
+        fi
+    done
+done
+LAMPORT_IO_STATS=1 ./verify-s89555 test_io_large.txt 2>&1 >/dev/null | grep -q "MB/s"
+if [ $? -ne 0 ]; then
+    echo "LAMPORT_IO_STATS did not report throughput"
+    exit 1
+fi
+echo "All I/O backends produce the same digest"
+echo
+
+echo "15. Testing parallel tree-hash digest mode..."
+./keygen-s89555 -b > /dev/null
+head -c 10000000 /dev/urandom > test_tree.txt
+./sign-s89555 test_tree.txt -p -b > /dev/null
+if ! tail -n 1 test_tree.txt.sign | grep -q "^digest tree-sha256 "; then
+    echo "Tree digest mode was not recorded in the signature"
+    exit 1
+fi
+for threads in 1 4; do
+    LAMPORT_DIGEST_THREADS=$threads ./verify-s89555 test_tree.txt > /dev/null &&
+        LAMPORT_DIGEST_THREADS=$threads ./verify-s89555 test_tree.txt -b > /dev/null
+    if [ $? -ne 0 ]; then
+        echo "Tree digest verification with $threads thread(s) failed"
+        exit 1
+    fi
+done
+head -n 256 test_tree.txt.sign > test_tree_plain.txt.sign
+cp test_tree.txt test_tree_plain.txt
+./verify-s89555 test_tree_plain.txt > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Tree signature accepted as a plain SHA-256 signature"
+    exit 1
+fi
+echo "MODIFIED" >> test_tree.txt
+./verify-s89555 test_tree.txt > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Modified document not detected with tree digest"
+    exit 1
+fi
+# The 42 bytes hashed last in tree mode must not verify as a plain file under the stripped signature
+./keygen-s89555 > /dev/null
+head -c 100000 /dev/urandom > test_tree_small.txt
+./sign-s89555 test_tree_small.txt -p > /dev/null
+python3 - test_tree_small.txt > test_tree_forged.txt <<'PY'
+import hashlib, struct, sys
+data = open(sys.argv[1], "rb").read()
+leaf = hashlib.sha256(b"\x00" + data).digest()
+sys.stdout.buffer.write(b"\x02" + struct.pack(">Q", len(data)) + bytes([22]) + leaf)
+PY
+head -n 256 test_tree_small.txt.sign > test_tree_forged.txt.sign
+./verify-s89555 test_tree_forged.txt > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Tree digest preimage accepted as a plain file"
+    exit 1
+fi
+echo "Tree digests match across thread counts, mode is bound to the signature"
+echo
+
+echo "16. Testing the signing daemon..."
+./keygen-s89555 -t 3 > /dev/null
+./signd-s89555 -n 3 > /dev/null &
+SIGND_PID=$!
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+    [ -S lamport-signd.sock ] && break
+    sleep 0.1
+done
+for i in 1 2 3 4 5; do
+    echo "Daemon document $i" > test_signd$i.txt
+    ./sign-s89555 test_signd$i.txt -d > /dev/null && ./verify-s89555 test_signd$i.txt -t > /dev/null
+    if [ $? -ne 0 ]; then
+        kill $SIGND_PID
+        echo "Signing daemon signature $i failed"
+        exit 1
+    fi
+done
+# An idle connection must not hold up other clients
+if command -v python3 > /dev/null; then
+    python3 -c "import socket, time; s = socket.socket(socket.AF_UNIX); s.connect('lamport-signd.sock'); time.sleep(4)" &
+    IDLE_PID=$!
+    sleep 0.2
+    if ! timeout 2 ./sign-s89555 test_signd1.txt -d > /dev/null; then
+        kill $SIGND_PID $IDLE_PID
+        echo "An idle client blocked the signing daemon"
+        exit 1
+    fi
+    wait $IDLE_PID
+fi
+./sign-s89555 test_signd1.txt -t 2> /dev/null
+if [ $? -eq 0 ]; then
+    kill $SIGND_PID
+    echo "Merkle key was usable while the signing daemon held it"
+    exit 1
+fi
+kill -INT $SIGND_PID
+wait $SIGND_PID
+if [ "$(tail -n 1 lamport-mss.priv | cut -d' ' -f2)" -lt 5 ]; then
+    echo "Keys handed out by the signing daemon were not burned on disk"
+    exit 1
+fi
+echo "Daemon signatures verified, clients served concurrently, key locked while in use, used keys burned"
+echo
+
+echo "17. Testing bulk keystore generation..."
+./keygen-s89555 -n 50 -j 4 > /dev/null
+if [ $? -ne 0 ] || [ ! -f "lamport-keystore.priv" ] || [ ! -f "lamport-keystore.pub" ]; then
+    echo "Bulk key generation failed"
+    exit 1
+fi
+perms=$(stat -c "%a" lamport-keystore.priv 2>/dev/null || stat -f "%Lp" lamport-keystore.priv 2>/dev/null)
+if [ "$perms" != "600" ]; then
+    echo "Keystore permissions are $perms, expected 600"
+    exit 1
+fi
+echo "Keystore document" > test_keystore.txt
+./sign-s89555 test_keystore.txt -k 49 > /dev/null && ./verify-s89555 test_keystore.txt -k 49 > /dev/null
+if [ $? -ne 0 ]; then
+    echo "Keystore signature failed"
+    exit 1
+fi
+./verify-s89555 test_keystore.txt -k 48 > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Signature accepted with the wrong keystore key"
+    exit 1
+fi
+./sign-s89555 test_keystore.txt -k 50 2> /dev/null
+if [ $? -eq 0 ]; then
+    echo "Key index outside the keystore was accepted"
+    exit 1
+fi
+echo "Keystore keys sign and verify, wrong key and bad index rejected"
+echo
+
+echo "18. Testing compact public keys..."
+./keygen-s89555 -c > /dev/null
+if [ ! -f "lamport-ots.cpub" ] || [ $(wc -c < lamport-ots.cpub) -ne 65 ]; then
+    echo "Compact public key was not written"
+    exit 1
+fi
+echo "Compact key document" > test_compact.txt
+./sign-s89555 test_compact.txt -c > /dev/null
+mv lamport-ots.pub lamport-ots.pub.saved
+./verify-s89555 test_compact.txt -c > /dev/null
+result=$?
+mv lamport-ots.pub.saved lamport-ots.pub
+if [ $result -ne 0 ]; then
+    echo "Compact signature verification without the full public key failed"
+    exit 1
+fi
+echo "MODIFIED" >> test_compact.txt
+./verify-s89555 test_compact.txt -c > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Modified document not detected with compact key"
+    exit 1
+fi
+echo "Compact signature verified with the 32-byte key alone, modification detected"
+echo
+
+echo "19. Testing Winternitz signatures..."
+echo "Winternitz document" > test_wots.txt
+for w in 4 16 256; do
+    ./keygen-s89555 -w $w > /dev/null && ./sign-s89555 test_wots.txt -w > /dev/null
+    if [ $? -ne 0 ]; then
+        echo "Winternitz signing with w = $w failed"
+        exit 1
+    fi
+    ./verify-s89555 test_wots.txt -w > /dev/null
+    if [ $? -ne 0 ]; then
+        echo "Winternitz signature with w = $w did not verify"
+        exit 1
+    fi
+    echo "w = $w: $(wc -l < test_wots.txt.sign) signature lines"
+done
+if [ $(wc -l < test_wots.txt.sign) -ne 34 ]; then
+    echo "Unexpected Winternitz signature length for w = 256"
+    exit 1
+fi
+echo "MODIFIED" >> test_wots.txt
+./verify-s89555 test_wots.txt -w > /dev/null
+if [ $? -ne 1 ]; then
+    echo "Modified document not detected with Winternitz signature"
+    exit 1
+fi
+if ./keygen-s89555 -w 8 > /dev/null 2>&1; then
+    echo "Unsupported Winternitz parameter accepted"
+    exit 1
+fi
+echo "Winternitz signatures verified for w = 4, 16 and 256, modification detected"
+echo
+
+echo "20. Testing parameter profiles..."
+profile_root=$(mktemp -d)
+for profile in sha512-256 blake2s-256 sha256-192; do
+    dir="$profile_root/$profile"
+    mkdir "$dir"
+    cp *.c *.h Makefile "$dir"
+    if ! make -s -C "$dir" PROFILE=$profile keygen-s89555 sign-s89555 verify-s89555 > /dev/null; then
+        echo "Build with PROFILE=$profile failed"
+        exit 1
+    fi
+    echo "Profile document" > "$dir/test_profile.txt"
+    (cd "$dir" && ./keygen-s89555 > /dev/null && ./sign-s89555 test_profile.txt > /dev/null && ./verify-s89555 test_profile.txt > /dev/null)
+    if [ $? -ne 0 ]; then
+        echo "Sign/verify with PROFILE=$profile failed"
+        exit 1
+    fi
+    if [ "$(tail -n 1 "$dir/lamport-ots.pub")" != "profile $profile" ]; then
+        echo "Public key does not record profile $profile"
+        exit 1
+    fi
+    # The one-block kernels must agree with OpenSSL's implementation of the profile hash
+    if command -v openssl > /dev/null && command -v xxd > /dev/null; then
+        case $profile in
+            sha512-256) md=sha512-256; width=64 ;;
+            blake2s-256) md=blake2s256; width=64 ;;
+            sha256-192) md=sha256; width=48 ;;
+        esac
+        expected=$(head -n 1 "$dir/lamport-ots.priv" | xxd -r -p | openssl dgst -$md -r | cut -c 1-$width)
+        if [ "$(head -n 1 "$dir/lamport-ots.pub")" != "$expected" ]; then
+            echo "hash_batch kernel for $profile disagrees with OpenSSL"
+            exit 1
+        fi
+    fi
+    # Keys from the scalar kernel verify with every other kernel of the profile
+    (cd "$dir" && LAMPORT_HASH_KERNEL=scalar ./keygen-s89555 > /dev/null && ./sign-s89555 test_profile.txt > /dev/null)
+    for kernel in avx2 shani; do
+        if ! (cd "$dir" && LAMPORT_HASH_KERNEL=$kernel ./verify-s89555 test_profile.txt > /dev/null); then
+            echo "The $kernel kernel for $profile disagrees with the scalar kernel"
+            exit 1
+        fi
+    done
+    # Files of one profile are rejected by another
+    cp lamport-ots.pub lamport-ots.pub.saved
+    cp "$dir/lamport-ots.pub" lamport-ots.pub
+    ./verify-s89555 test1.txt 2> profile_error.txt > /dev/null
+    result=$?
+    mv lamport-ots.pub.saved lamport-ots.pub
+    if [ $result -eq 0 ] || ! grep -q "parameter profile $profile" profile_error.txt; then
+        echo "Public key of profile $profile was not rejected by the sha256 build"
+        exit 1
+    fi
+    echo "$profile: public key $(wc -c < "$dir/lamport-ots.pub") bytes, signature $(wc -c < "$dir/test_profile.txt.sign") bytes"
+done
+rm -rf "$profile_root"
+echo "All parameter profiles sign and verify, record their profile and are rejected by other builds"
+echo
+
+echo "21. Testing the in-memory library API..."
+api_dir=$(mktemp -d)
+cat > "$api_dir/api_test.c" << 'EOF'
+#include <pthread.h>
+#include "lamport_api.h"
+
+static lamport_ctx *ctx;
+static unsigned char private_key[LAMPORT_PRIVATE_KEY_BYTES], public_key[LAMPORT_PUBLIC_KEY_BYTES];
+
+typedef struct { const unsigned char *data; size_t len, pos; } source;
+
+// Hand out the message in 7-byte pieces
+static ssize_t read_source(void *arg, unsigned char *buffer, size_t size) {
+    source *src = arg;
+    size_t n = src->len - src->pos < 7 ? src->len - src->pos : 7;
+    n = n < size ? n : size;
+    memcpy(buffer, src->data + src->pos, n);
+    src->pos += n;
+    return (ssize_t)n;
+}
+
+// Several threads sign and verify with one shared context
+static void *worker(void *arg) {
+    unsigned char message[64], signature[LAMPORT_SIGNATURE_BYTES];
+    for (int i = 0; i < 500; i++) {
+        int n = snprintf((char *)message, sizeof(message), "thread %ld message %d", (long)(size_t)arg, i);
+        if (!lamport_sign(ctx, private_key, message, (size_t)n, signature) ||
+            !lamport_verify(ctx, public_key, message, (size_t)n, signature)) {
+            return arg;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    static const char message[] = "in-memory message";
+    unsigned char signature[LAMPORT_SIGNATURE_BYTES], digest[LAMPORT_DIGEST_BYTES], streamed[LAMPORT_DIGEST_BYTES];
+    ctx = lamport_ctx_new();
+    if (ctx == NULL || !lamport_keygen(ctx, private_key, public_key) ||
+        !lamport_sign(ctx, private_key, message, sizeof(message), signature) ||
+        !lamport_verify(ctx, public_key, message, sizeof(message), signature)) {
+        fprintf(stderr, "sign/verify failed\n");
+        return 1;
+    }
+    if (lamport_verify(ctx, public_key, "other message", 13, signature)) {
+        fprintf(stderr, "wrong message accepted\n");
+        return 1;
+    }
+    // A callback stream and a reused hasher give the one-shot digest
+    source src = { (const unsigned char *)message, sizeof(message), 0 };
+    lamport_hasher *hasher = lamport_hasher_new(ctx);
+    lamport_digest(ctx, message, sizeof(message), digest);
+    if (!lamport_digest_stream(ctx, read_source, &src, streamed) || memcmp(digest, streamed, sizeof(digest)) != 0) {
+        fprintf(stderr, "streamed digest differs\n");
+        return 1;
+    }
+    for (int round = 0; round < 2; round++) {
+        lamport_hasher_update(hasher, message, 5);
+        lamport_hasher_update(hasher, message + 5, sizeof(message) - 5);
+        if (!lamport_hasher_final(hasher, streamed) || memcmp(digest, streamed, sizeof(digest)) != 0) {
+            fprintf(stderr, "hasher digest differs in round %d\n", round);
+            return 1;
+        }
+    }
+    lamport_hasher_free(hasher);
+    pthread_t threads[4];
+    void *failed = NULL;
+    for (long t = 0; t < 4; t++) {
+        pthread_create(&threads[t], NULL, worker, (void *)(size_t)(t + 1));
+    }
+    for (int t = 0; t < 4; t++) {
+        void *result;
+        pthread_join(threads[t], &result);
+        failed = failed != NULL ? failed : result;
+    }
+    if (failed != NULL) {
+        fprintf(stderr, "thread %ld failed\n", (long)(size_t)failed);
+        return 1;
+    }
+    // Digest of the last argument, for comparison with the openssl CLI
+    lamport_digest(ctx, argv[argc - 1], strlen(argv[argc - 1]), digest);
+    for (int i = 0; i < LAMPORT_DIGEST_BYTES; i++) {
+        printf("%02x", digest[i]);
+    }
+    printf("\n%s\n", lamport_profile_name());
+    lamport_ctx_free(ctx);
+    return 0;
+}
+EOF
+if ! gcc -std=c99 -D_GNU_SOURCE -I. -o "$api_dir/api_test" "$api_dir/api_test.c" -L. -llamport -Wl,-rpath,"$PWD" -lcrypto -lpthread; then
+    echo "Linking against liblamport.so failed"
+    exit 1
+fi
+api_output=$("$api_dir/api_test" "library digest")
+if [ $? -ne 0 ]; then
+    echo "In-memory API test failed"
+    exit 1
+fi
+if command -v openssl > /dev/null; then
+    expected=$(printf "library digest" | openssl dgst -sha256 -r | cut -c 1-64)
+    if [ "$(echo "$api_output" | head -n 1)" != "$expected" ]; then
+        echo "Library digest disagrees with OpenSSL"
+        exit 1
+    fi
+fi
+rm -rf "$api_dir"
+echo "liblamport ($(echo "$api_output" | tail -n 1)): in-memory keygen, sign and verify, streamed digests, 4 threads on one context"
+echo
+
+echo "22. Testing the benchmark suite..."
+bench_dir=$(mktemp -d)
+if ! make -s bench-s89555 > /dev/null || ! ./bench-s89555 -s 0.01 -o "$bench_dir/bench.json" 2> /dev/null; then
+    echo "Benchmark run failed"
+    exit 1
+fi
+if command -v python3 > /dev/null && ! python3 -m json.tool "$bench_dir/bench.json" > /dev/null; then
+    echo "Benchmark output is not valid JSON"
+    exit 1
+fi
+for name in lamport.keygen lamport.sign lamport.verify lamport.public_key_derivation read_key.hex read_signature.binary hash_file.1024KiB ref.ed25519.verify; do
+    if ! grep -q "\"name\": \"$name\", \"unit\": \"[^\"]*\", \"value\": [1-9]" "$bench_dir/bench.json"; then
+        echo "Benchmark result $name missing"
+        exit 1
+    fi
+done
+# A baseline 1000 times faster than this machine must be reported as a regression
+sed 's/\("name": "lamport.verify", "unit": "ops\/s", "value": \)\([0-9]*\)/\1\2000/' "$bench_dir/bench.json" > "$bench_dir/baseline.json"
+./bench-s89555 -s 0.01 -o "$bench_dir/compare.json" -b "$bench_dir/baseline.json" -t 50 2> /dev/null
+if [ $? -ne 1 ] || ! grep -q '"name": "lamport.verify".*"regression": true' "$bench_dir/compare.json"; then
+    echo "Regression against the baseline not detected"
+    exit 1
+fi
+echo "$(grep -c '"name"' "$bench_dir/bench.json") results, $(grep -c '"available": false' "$bench_dir/bench.json") unavailable in this OpenSSL; baseline regression detected"
+rm -rf "$bench_dir"
+echo
+
+echo "23. Testing --stats instrumentation..."
+stats_dir=$(mktemp -d)
+./keygen-s89555 > /dev/null
+if ! ./sign-s89555 test1.txt --stats > /dev/null 2> "$stats_dir/sign.jsonl"; then
+    echo "Signing with --stats failed"
+    exit 1
+fi
+./verify-s89555 test1.txt --stats > "$stats_dir/verify.out" 2> "$stats_dir/verify.jsonl"
+if [ "$(cat "$stats_dir/verify.out")" != "VALID" ]; then
+    echo "Verification with --stats failed"
+    exit 1
+fi
+for phase in key_load file_hash output_write total; do
+    if ! grep -q "\"tool\": \"sign\", \"phase\": \"$phase\"" "$stats_dir/sign.jsonl"; then
+        echo "Sign stats lack phase $phase"
+        exit 1
+    fi
+done
+for phase in key_load file_hash component_hash compare total; do
+    if ! grep -q "\"tool\": \"verify\", \"phase\": \"$phase\"" "$stats_dir/verify.jsonl"; then
+        echo "Verify stats lack phase $phase"
+        exit 1
+    fi
+done
+if ! grep -q '"phase": "total".*"document_bytes": '"$(stat -c %s test1.txt)"', "hashes": 257}' "$stats_dir/verify.jsonl"; then
+    echo "Verify stats report wrong document bytes or hash count"
+    exit 1
+fi
+if command -v python3 > /dev/null && ! python3 -c 'import json, sys; [json.loads(line) for line in open(sys.argv[1])]' "$stats_dir/verify.jsonl"; then
+    echo "Stats output is not valid JSON lines"
+    exit 1
+fi
+# LAMPORT_STATS=<path> appends to a file and leaves stderr alone
+LAMPORT_STATS="$stats_dir/env.jsonl" ./verify-s89555 test1.txt > /dev/null 2> "$stats_dir/stderr.txt"
+LAMPORT_STATS="$stats_dir/env.jsonl" ./verify-s89555 test1.txt > /dev/null 2>> "$stats_dir/stderr.txt"
+if [ -s "$stats_dir/stderr.txt" ] || [ "$(grep -c '"phase": "total"' "$stats_dir/env.jsonl")" != "2" ]; then
+    echo "LAMPORT_STATS file output failed"
+    exit 1
+fi
+# Without stats nothing extra is printed
+./verify-s89555 test1.txt > /dev/null 2> "$stats_dir/quiet.txt"
+if [ -s "$stats_dir/quiet.txt" ]; then
+    echo "Stats printed without --stats"
+    exit 1
+fi
+echo "$(wc -l < "$stats_dir/verify.jsonl") verify stats lines, LAMPORT_STATS file appended"
+rm -rf "$stats_dir"
+echo
+
+echo "24. Testing batch signing with inclusion proofs..."
+release_dir=$(mktemp -d)
+for i in $(seq 1 13); do
+    head -c $((i * 1000)) /dev/urandom > "$release_dir/file$i.bin"
+done
+ls "$release_dir"/file1[0-3].bin > "$release_dir/list.txt"
+./keygen-s89555 > /dev/null
+if ! ./sign-s89555 -r "$release_dir/release.sign" -j 4 "$release_dir"/file[1-9].bin -m "$release_dir/list.txt" > /dev/null; then
+    echo "Batch signing failed"
+    exit 1
+fi
+for i in $(seq 1 13); do
+    if ! ./verify-s89555 "$release_dir/file$i.bin" -r "$release_dir/release.sign" | grep -q "^VALID (batch entry [0-9]* of 13)"; then
+        echo "Batch entry file$i.bin did not verify"
+        exit 1
+    fi
+done
+# A 13-leaf tree has at most 4 sibling nodes per proof
+if [ "$(wc -l < "$release_dir/file1.bin.proof")" -gt 5 ]; then
+    echo "Inclusion proof is longer than log2(N) nodes"
+    exit 1
+fi
+echo "tampered" >> "$release_dir/file5.bin"
+if ./verify-s89555 "$release_dir/file5.bin" -r "$release_dir/release.sign" > /dev/null 2>&1; then
+    echo "Modified batch entry accepted"
+    exit 1
+fi
+# A proof moved to another file of the batch must not verify
+cp "$release_dir/file1.bin.proof" "$release_dir/file2.bin.proof"
+if ./verify-s89555 "$release_dir/file2.bin" -r "$release_dir/release.sign" > /dev/null 2>&1; then
+    echo "Proof of another file accepted"
+    exit 1
+fi
+# Tree-digest files and a seed key
+./keygen-s89555 -s > /dev/null
+./sign-s89555 -r "$release_dir/tree.sign" -p "$release_dir/file3.bin" "$release_dir/file4.bin" > /dev/null
+if ! grep -q "^digest tree-sha256" "$release_dir/file3.bin.proof" ||
+   ! ./verify-s89555 "$release_dir/file4.bin" -r "$release_dir/tree.sign" > /dev/null; then
+    echo "Batch signing with tree digests failed"
+    exit 1
+fi
+# The batch signature must not verify the signed root as a plain file
+./keygen-s89555 > /dev/null
+./sign-s89555 -r "$release_dir/pair.sign" "$release_dir/file6.bin" "$release_dir/file7.bin" > /dev/null
+python3 - "$release_dir/file6.bin" "$release_dir/file7.bin" > "$release_dir/root.bin" <<'PY'
+import hashlib, struct, sys
+h = lambda data: hashlib.sha256(data).digest()
+leaves = [h(b"\x08" + h(open(name, "rb").read())) for name in sys.argv[1:]]
+sys.stdout.buffer.write(b"\x0a" + struct.pack(">Q", 2) + h(b"\x09" + leaves[0] + leaves[1]))
+PY
+cp "$release_dir/pair.sign" "$release_dir/root.bin.sign"
+if ./verify-s89555 "$release_dir/root.bin" > /dev/null 2>&1; then
+    echo "Batch signature accepted as a plain signature of its root"
+    exit 1
+fi
+echo "13 files signed with one one-time key, every proof verified, tampering detected"
+rm -rf "$release_dir"
+echo
+
+echo "25. Testing the persistent digest cache..."
+cache_dir=$(mktemp -d)
+head -c 3000000 /dev/urandom > "$cache_dir/artifact.bin"
+./keygen-s89555 > /dev/null
+./sign-s89555 "$cache_dir/artifact.bin" > /dev/null
+# Files changed within the last DIGEST_CACHE_RACY_SECONDS are never cached
+sleep 2
+export LAMPORT_DIGEST_CACHE="$cache_dir/digests.cache"
+cached_bytes() {
+    LAMPORT_STATS="$cache_dir/stats.jsonl" ./verify-s89555 "$cache_dir/artifact.bin" > "$cache_dir/verify.out" || return 1
+    grep -q "^VALID" "$cache_dir/verify.out" || return 1
+    tail -n 1 "$cache_dir/stats.jsonl" | sed 's/.*"document_bytes": \([0-9]*\).*/\1/'
+}
+if [ "$(cached_bytes)" != "3000000" ] || [ "$(cached_bytes)" != "0" ]; then
+    echo "Repeat verification did not use the digest cache"
+    exit 1
+fi
+if [ "$(stat -c %a "$LAMPORT_DIGEST_CACHE")" != "600" ]; then
+    echo "Digest cache is not private to the user"
+    exit 1
+fi
+if [ "$(LAMPORT_DIGEST_CACHE_STRICT=1 cached_bytes)" != "3000000" ]; then
+    echo "Strict mode did not bypass the digest cache"
+    exit 1
+fi
+# Same size, new contents: the ctime changes and the stale digest must not be used
+printf 'X' | dd of="$cache_dir/artifact.bin" bs=1 seek=1000 conv=notrunc 2> /dev/null
+if ./verify-s89555 "$cache_dir/artifact.bin" > /dev/null; then
+    echo "Digest cache returned a stale digest for a modified file"
+    exit 1
+fi
+# A cache that others can write is ignored
+chmod 666 "$LAMPORT_DIGEST_CACHE"
+if ! ./verify-s89555 "$cache_dir/artifact.bin" 2>&1 | grep -q "cache disabled"; then
+    echo "Writable digest cache was not rejected"
+    exit 1
+fi
+unset LAMPORT_DIGEST_CACHE
+echo "Repeat verification served from the cache, strict mode and invalidation work"
+rm -rf "$cache_dir"
+echo
+
+echo "26. Testing pipelined verification..."
+pipe_dir=$(mktemp -d)
+head -c 5000000 /dev/urandom > "$pipe_dir/large.bin"
+./keygen-s89555 -b > /dev/null
+./sign-s89555 "$pipe_dir/large.bin" -b > /dev/null
+./sign-s89555 "$pipe_dir/large.bin" -p > /dev/null
+if [ "$(./verify-s89555 "$pipe_dir/large.bin")" != "VALID" ]; then
+    echo "Pipelined verification of a tree digest failed"
+    exit 1
+fi
+# -b only needs the binary public key
+mv lamport-ots.pub "$pipe_dir/"
+if [ "$(./verify-s89555 "$pipe_dir/large.bin" -b)" != "VALID (binary)" ]; then
+    echo "Binary verification needs the hex public key"
+    exit 1
+fi
+# A missing key is reported even while the document is still being hashed
+if ./verify-s89555 "$pipe_dir/large.bin" > /dev/null 2> "$pipe_dir/error.txt" || ! grep -q "Error: Cannot open" "$pipe_dir/error.txt"; then
+    echo "Missing public key not reported"
+    exit 1
+fi
+mv "$pipe_dir/lamport-ots.pub" .
+printf 'X' | dd of="$pipe_dir/large.bin" bs=1 seek=4000000 conv=notrunc 2> /dev/null
+if ./verify-s89555 "$pipe_dir/large.bin" > /dev/null || ./verify-s89555 "$pipe_dir/large.bin" -b > /dev/null; then
+    echo "Pipelined verification accepted a modified document"
+    exit 1
+fi
+echo "Document hashing overlapped with key and signature loading; -b uses only the binary key"
+rm -rf "$pipe_dir"
+echo
+
+echo "27. Testing shared key allocation..."
+alloc_dir=$(mktemp -d)
+./keygen-s89555 -n 24 -j 2 > /dev/null
+if [ ! -f "lamport-keystore.alloc" ]; then
+    echo "Key allocation file was not written"
+    exit 1
+fi
+./sign-s89555 test_keystore.txt -k 5 > /dev/null
+if ./sign-s89555 test_keystore.txt -k 5 > /dev/null 2>&1; then
+    echo "Key index was used twice"
+    exit 1
+fi
+# Concurrent signers never get the same key; -k next skips the explicitly claimed key 5
+for i in $(seq 1 20); do
+    echo "Document $i" > "$alloc_dir/doc$i.txt"
+    ./sign-s89555 "$alloc_dir/doc$i.txt" -k next > "$alloc_dir/out$i.txt" &
+done
+wait
+for i in $(seq 1 20); do
+    index=$(sed -n 's/.*(keystore key \([0-9]*\)).*/\1/p' "$alloc_dir/out$i.txt")
+    if [ -z "$index" ] || [ "$(./verify-s89555 "$alloc_dir/doc$i.txt" -k "$index")" != "VALID" ]; then
+        echo "Concurrent keystore signature $i failed"
+        exit 1
+    fi
+    echo "$index" >> "$alloc_dir/indices.txt"
+done
+if [ "$(sort -u "$alloc_dir/indices.txt" | wc -l)" -ne 20 ] || grep -qx 5 "$alloc_dir/indices.txt"; then
+    echo "Concurrent signers shared a key"
+    exit 1
+fi
+./sign-s89555 test_keystore.txt -k next > /dev/null && ./sign-s89555 test_keystore.txt -k next > /dev/null &&
+    ./sign-s89555 test_keystore.txt -k next > /dev/null
+if [ $? -ne 0 ] || ./sign-s89555 test_keystore.txt -k next > /dev/null 2> "$alloc_dir/error.txt" ||
+    ! grep -q "All 24 keys" "$alloc_dir/error.txt"; then
+    echo "Keystore exhaustion not reported"
+    exit 1
+fi
+# The allocation file is bound to its keystore
+mv lamport-keystore.alloc "$alloc_dir/"
+./keygen-s89555 -n 24 > /dev/null
+mv "$alloc_dir/lamport-keystore.alloc" .
+if ./sign-s89555 test_keystore.txt -k next > /dev/null 2> "$alloc_dir/error.txt" ||
+    ! grep -q "different keystore" "$alloc_dir/error.txt"; then
+    echo "Allocation file of another keystore accepted"
+    exit 1
+fi
+rm lamport-keystore.alloc
+if ! ./sign-s89555 test_keystore.txt -k next 2> "$alloc_dir/error.txt" | grep -q "(keystore key 0)" ||
+    ! grep -q "Warning: No key allocation file" "$alloc_dir/error.txt"; then
+    echo "Missing allocation file not created"
+    exit 1
+fi
+echo "Concurrent signers got distinct keys, reuse and exhaustion rejected, allocation file bound to its keystore"
+rm -rf "$alloc_dir"
+echo
+
+echo "28. Testing HORS few-time signatures..."
+./keygen-s89555 -f 64 4096 > /dev/null
+if [ $? -ne 0 ] || [ ! -f "lamport-hors.priv" ] || [ ! -f "lamport-hors.pub" ]; then
+    echo "HORS key generation failed"
+    exit 1
+fi
+if ./keygen-s89555 -f 16 256 > /dev/null 2>&1 || ./keygen-s89555 -f 16 1000 > /dev/null 2>&1; then
+    echo "HORS parameters without a signature budget were accepted"
+    exit 1
+fi
+# (64, 4096) is good for 16 signatures
+for i in $(seq 1 16); do
+    echo "HORS document $i" > test_hors.txt
+    if ! ./sign-s89555 test_hors.txt -f > /dev/null 2>&1 || [ "$(./verify-s89555 test_hors.txt -f)" != "VALID (HORS, signature $i of 16)" ]; then
+        echo "HORS signature $i failed"
+        exit 1
+    fi
+done
+if ./sign-s89555 test_hors.txt -f > /dev/null 2>&1; then
+    echo "HORS key signed beyond its budget"
+    exit 1
+fi
+echo "Modified HORS document" > test_hors.txt
+if ./verify-s89555 test_hors.txt -f > /dev/null; then
+    echo "HORS signature accepted for a modified document"
+    exit 1
+fi
+echo "HORS document 16" > test_hors.txt
+sed -i '1s/.*/0/' test_hors.txt.sign
+if ./verify-s89555 test_hors.txt -f > /dev/null 2>&1; then
+    echo "HORS signature accepted under another signature number"
+    exit 1
+fi
+sed -i '1s/.*/16/' test_hors.txt.sign
+if ./verify-s89555 test_hors.txt -f > /dev/null 2>&1; then
+    echo "HORS signature number beyond the budget accepted"
+    exit 1
+fi
+echo "HORS signatures verify until the budget is used up, then the key is retired; numbers are authenticated"
+echo
+
+echo "29. Testing the public key directory..."
+keydir_dir=$(mktemp -d)
+repo_dir=$(pwd)
+for n in 1 2 3 4; do
+    mkdir "$keydir_dir/signer$n"
+    (cd "$keydir_dir/signer$n" && "$repo_dir/keygen-s89555" > /dev/null)
+done
+# Signers 1-3 are indexed (signer 2 twice), signer 4 is not
+./keydir-s89555 test.keydir "$keydir_dir"/signer[123]/lamport-ots.pub "$keydir_dir/signer2/lamport-ots.pub" > /dev/null 2> "$keydir_dir/error.txt"
+if [ $? -ne 0 ] || [ ! -f "test.keydir" ] || ! grep -q "already in the directory" "$keydir_dir/error.txt"; then
+    echo "Key directory build failed"
+    exit 1
+fi
+echo "Key directory document" > test_keydir.txt
+for n in 2 3 4; do
+    cp test_keydir.txt "$keydir_dir/signer$n/"
+done
+(cd "$keydir_dir/signer2" && "$repo_dir/sign-s89555" test_keydir.txt -i -p > /dev/null)
+(cd "$keydir_dir/signer3" && "$repo_dir/sign-s89555" test_keydir.txt > /dev/null)
+(cd "$keydir_dir/signer4" && "$repo_dir/sign-s89555" test_keydir.txt -i > /dev/null)
+cp "$keydir_dir/signer2/test_keydir.txt.sign" .
+if [ "$(./verify-s89555 test_keydir.txt -i test.keydir)" != "VALID" ]; then
+    echo "Signature of an indexed signer not verified"
+    exit 1
+fi
+# A verifier that is handed the public key directly skips the signer record
+if [ "$(cd "$keydir_dir/signer2" && "$repo_dir/verify-s89555" test_keydir.txt)" != "VALID" ]; then
+    echo "Signature with a signer record rejected by plain verify"
+    exit 1
+fi
+mkdir "$keydir_dir/tree"
+cp test_keydir.txt test_keydir.txt.sign "$keydir_dir/tree/"
+if ! ./verify-s89555 -d "$keydir_dir/tree" -i test.keydir > /dev/null; then
+    echo "Directory verification through the key directory failed"
+    exit 1
+fi
+echo "Modified key directory document" > test_keydir.txt
+if ./verify-s89555 test_keydir.txt -i test.keydir > /dev/null; then
+    echo "Modified document accepted through the key directory"
+    exit 1
+fi
+echo "Key directory document" > test_keydir.txt
+cp "$keydir_dir/signer4/test_keydir.txt.sign" .
+if ./verify-s89555 test_keydir.txt -i test.keydir > /dev/null 2> "$keydir_dir/error.txt" || ! grep -q "not in the key directory" "$keydir_dir/error.txt"; then
+    echo "Signer outside the key directory accepted"
+    exit 1
+fi
+cp "$keydir_dir/signer3/test_keydir.txt.sign" .
+if ./verify-s89555 test_keydir.txt -i test.keydir > /dev/null 2> "$keydir_dir/error.txt" || ! grep -q "does not name its signer" "$keydir_dir/error.txt"; then
+    echo "Signature without a signer record accepted"
+    exit 1
+fi
+echo "Signers resolved through the key directory, unknown and unnamed signers rejected"
+rm -rf "$keydir_dir"
+echo
+
+echo "30. Testing attached-signature envelopes..."
+./keygen-s89555 > /dev/null
+echo "Envelope document" > test_envelope.txt
+if ! ./sign-s89555 -e < test_envelope.txt 2> /dev/null | ./verify-s89555 -e 2> /dev/null | cmp -s - test_envelope.txt; then
+    echo "Envelope round trip through a pipe failed"
+    exit 1
+fi
+# The envelope signs the same digest as a detached signature
+./sign-s89555 -e < test_envelope.txt > test_envelope.env 2> /dev/null
+./sign-s89555 test_envelope.txt > /dev/null
+if [ "$(tail -c $((32 * 256)) test_envelope.env | head -c 32 | od -An -tx1 | tr -d ' \n')" != "$(head -1 test_envelope.txt.sign)" ]; then
+    echo "Envelope signature differs from the detached signature"
+    exit 1
+fi
+# A small payload that fails to verify is never written out
+python3 -c "import sys; d = bytearray(open(sys.argv[1], 'rb').read()); d[20] ^= 1; open(sys.argv[2], 'wb').write(d)" test_envelope.env test_envelope_bad.env
+if [ -n "$(./verify-s89555 -e < test_envelope_bad.env 2> /dev/null)" ]; then
+    echo "Unverified envelope payload written out"
+    exit 1
+fi
+# A payload larger than the hold-back buffer: -o only creates the output once it is VALID, a redirected
+# stdout is spooled, and a pipe only gets it before the verdict with --unverified
+head -c 20000000 /dev/urandom > test_envelope_big.txt
+./sign-s89555 -e < test_envelope_big.txt > test_envelope_big.env 2> /dev/null
+./verify-s89555 -e -o test_envelope_out.txt < test_envelope_big.env > /dev/null
+if ! cmp -s test_envelope_out.txt test_envelope_big.txt; then
+    echo "Large envelope payload not verified"
+    exit 1
+fi
+if ! ./verify-s89555 -e < test_envelope_big.env > test_envelope_out.txt 2> /dev/null || ! cmp -s test_envelope_out.txt test_envelope_big.txt; then
+    echo "Large envelope payload not spooled to the output file"
+    exit 1
+fi
+if [ "$(./verify-s89555 -e < test_envelope_big.env 2> /dev/null | wc -c)" -ne 0 ] ||
+    ! ./verify-s89555 -e --unverified < test_envelope_big.env 2> /dev/null | cmp -s - test_envelope_big.txt; then
+    echo "Large envelope payload streamed to a pipe without --unverified"
+    exit 1
+fi
+rm test_envelope_big.env
+./sign-s89555 -e < test_envelope_big.txt 2> /dev/null | python3 -c "import sys; d = bytearray(sys.stdin.buffer.read()); d[19000000] ^= 1; sys.stdout.buffer.write(d)" > test_envelope_bad.env
+rm test_envelope_out.txt
+if ./verify-s89555 -e -o test_envelope_out.txt < test_envelope_bad.env > /dev/null 2>&1 || [ -e test_envelope_out.txt ] || [ -e test_envelope_out.txt.tmp ]; then
+    echo "Output file created for a modified envelope"
+    exit 1
+fi
+if ./verify-s89555 -e < test_envelope_bad.env > test_envelope_out.txt 2> /dev/null || [ -s test_envelope_out.txt ]; then
+    echo "Unverified payload left in the output file"
+    exit 1
+fi
+if [ "$(./verify-s89555 -e < test_envelope_bad.env 2> /dev/null | wc -c)" -ne 0 ]; then
+    echo "Unverified payload written to a pipe"
+    exit 1
+fi
+if head -c 1000 test_envelope.env | ./verify-s89555 -e > /dev/null 2>&1; then
+    echo "Truncated envelope accepted"
+    exit 1
+fi
+rm -f test_envelope_big.txt test_envelope_out.txt
+echo "Envelopes stream through pipes, unverified payloads are withheld"
+echo
+
+echo "31. Testing chained one-time keys..."
+chain_dir=$(mktemp -d)
+repo_dir=$(pwd)
+./keygen-s89555 -x > /dev/null
+if [ $? -ne 0 ] || [ ! -f "lamport-chain.priv" ] || [ ! -f "lamport-chain.pub" ]; then
+    echo "Chain key generation failed"
+    exit 1
+fi
+for i in 0 1 2 3 4 5; do
+    echo "Chain document $i" > "test_chain$i.txt"
+    if ! ./sign-s89555 "test_chain$i.txt" -x | grep -q "(chain key $i)"; then
+        echo "Chain signature $i failed"
+        exit 1
+    fi
+done
+# The verifier only gets the first key
+cp lamport-chain.pub test_chain*.txt test_chain*.txt.sign "$chain_dir/"
+cd "$chain_dir"
+if [ "$("$repo_dir/verify-s89555" test_chain0.txt -x)" != "VALID (chain key 0)" ] ||
+    [ "$("$repo_dir/verify-s89555" test_chain1.txt -x)" != "VALID (chain key 1)" ]; then
+    cd "$repo_dir"
+    echo "Chain signatures not verified from the first key"
+    exit 1
+fi
+# Key 4 needs signatures 2 and 3 as links; afterwards the checkpoint holds keys 0 to 5
+if "$repo_dir/verify-s89555" test_chain4.txt -x > /dev/null 2>&1 ||
+    [ "$("$repo_dir/verify-s89555" test_chain4.txt -x test_chain3.txt.sign test_chain2.txt.sign)" != "VALID (chain key 4)" ] ||
+    [ "$(wc -l < lamport-chain.verified)" -ne 6 ] ||
+    [ "$("$repo_dir/verify-s89555" test_chain2.txt -x)" != "VALID (chain key 2)" ]; then
+    cd "$repo_dir"
+    echo "Chain not walked through its links"
+    exit 1
+fi
+echo "Modified chain document" > test_chain5.txt
+if "$repo_dir/verify-s89555" test_chain5.txt -x > /dev/null; then
+    cd "$repo_dir"
+    echo "Modified document accepted in chain mode"
+    exit 1
+fi
+# A checkpoint of another chain is rejected
+(cd "$repo_dir" && ./keygen-s89555 -x > /dev/null)
+cp "$repo_dir/lamport-chain.pub" .
+if "$repo_dir/verify-s89555" test_chain0.txt -x > /dev/null 2>&1; then
+    cd "$repo_dir"
+    echo "Checkpoint of another chain accepted"
+    exit 1
+fi
+cd "$repo_dir"
+echo "Chain followed from its first key with one verification per signature, gaps filled from links"
+rm -rf "$chain_dir"
+echo
+
+echo "32. Testing resumable hashing of append-only files..."
+./keygen-s89555 > /dev/null
+seq 1 50000 > test_midstate.txt
+LAMPORT_MIDSTATE=1 ./sign-s89555 test_midstate.txt > /dev/null
+if [ ! -f test_midstate.txt.midstate ]; then
+    echo "Midstate sidecar was not written"
+    exit 1
+fi
+# Appended lines: only the tail is read, and the digest is the same as a full hash
+echo "appended entry" >> test_midstate.txt
+if ! LAMPORT_MIDSTATE=1 LAMPORT_IO_STATS=1 ./sign-s89555 test_midstate.txt 2>&1 | grep -q "midstate (resumed)" ||
+    [ "$(./verify-s89555 test_midstate.txt)" != "VALID" ] ||
+    [ "$(LAMPORT_MIDSTATE=1 ./verify-s89555 test_midstate.txt 2> /dev/null)" != "VALID" ]; then
+    echo "Resumed hash differs from the full hash"
+    exit 1
+fi
+# A prefix rewritten in place (same inode) is noticed and the file is hashed from the start
+printf 'X' | dd of=test_midstate.txt bs=1 seek=0 conv=notrunc 2> /dev/null
+if LAMPORT_MIDSTATE=1 ./verify-s89555 test_midstate.txt > /dev/null 2> test_midstate_error.txt ||
+    ! grep -q "no longer matches" test_midstate_error.txt; then
+    echo "Modified prefix not detected"
+    exit 1
+fi
+LAMPORT_MIDSTATE=1 ./sign-s89555 test_midstate.txt > /dev/null 2>&1
+chmod 666 test_midstate.txt.midstate
+if ! LAMPORT_MIDSTATE=1 ./verify-s89555 test_midstate.txt 2>&1 | grep -q "must be owned by you"; then
+    echo "Writable midstate sidecar was trusted"
+    exit 1
+fi
+rm -f test_midstate.txt.midstate
+echo "Appended files resume from their midstate, modified prefixes are hashed again"
+echo
 
 echo "=== All tests passed! ==="
 echo
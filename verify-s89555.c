@@ -8,185 +8,588 @@
  * USAGE:
  * Compile with: make verify-s89555
  * Run with: ./verify-s89555 <filename> [-b]
+ * Merkle tree signature: ./verify-s89555 <filename> -t
+ * Compact public key: ./verify-s89555 <filename> -c (only the 32-byte lamport-ots.cpub is needed)
+ * Keystore key: ./verify-s89555 <filename> -k <index> (checked against lamport-keystore.pub)
+ * Winternitz key: ./verify-s89555 <filename> -w (checked against lamport-wots.pub, which also records w)
+ * HORS key: ./verify-s89555 <filename> -f (only the k lines of lamport-hors.pub selected by the hash are read)
+ * Batch-signed file: ./verify-s89555 <filename> -r <batch signature> (uses <filename>.proof and lamport-ots.pub)
+ * Key chain: ./verify-s89555 <filename> -x [<signature>...] (checked against the keys verified so far, which
+ * lamport-chain.verified keeps; earlier signatures of the chain that were not verified yet are passed as links)
+ * Key directory: ./verify-s89555 <filename> -i <directory> (the signature names its signer, sign -i; see lamport_keydir.h)
+ * Envelope: ./verify-s89555 -e [-o <output> | --unverified] < <envelope> (sign -e) writes the payload to stdout, or to
+ * <output>, only once it is VALID; a payload over 16 MiB for a pipe needs --unverified, which streams it before the
+ * verdict. The verdict goes to stderr, or to stdout with -o (see lamport_envelope.h)
+ * The default and -b modes hash the document on a second thread while the key and signature are read and the
+ * signature components are hashed, so a verification takes about as long as its slowest stage.
+ * The digest mode (plain SHA-256 or the parallel tree hash of sign -p) is taken from the signature.
+ * Batch mode: ./verify-s89555 -m <manifest> [-j <threads>]
+ *             ./verify-s89555 -d <directory> [-k <public key> | -i <key directory>] [-j <threads>]
+ * With --stats (or LAMPORT_STATS=1) per-phase timings are printed to stderr as JSON lines at exit (see lamport_stats.h).
  * Run with capture output (enable DEBUG_MODE) and errors: ./verify-s89555 <filename> [-b] > output.txt 2> errors.txt
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 #include "lamport_common.h"
+#include "lamport_api.h"
+#include "lamport_stats.h"
+#include "lamport_batch.h"
+#include "lamport_merkle.h"
+#include "lamport_container.h"
+#include "lamport_digest.h"
+#include "lamport_hex.h"
+#include "lamport_keystore.h"
+#include "lamport_wots.h"
+#include "lamport_hors.h"
+#include "lamport_proof.h"
+#include "lamport_keydir.h"
+#include "lamport_envelope.h"
+#include "lamport_chain.h"
+#include <fcntl.h>
+#include <unistd.h>
 
-int read_signature(const char *sig_filename, unsigned char signature[NUM_BITS][KEY_SIZE]);
-int verify_signature(unsigned char public_key[NUM_BITS][2][KEY_SIZE],
-                     unsigned char signature[NUM_BITS][KEY_SIZE],
-                     unsigned char *hash);
+typedef struct
+{
+    const char *filename;
+    digest_params digest;
+    unsigned char hash[HASH_SIZE];
+    int ok;
+    int threaded;
+    pthread_t thread;
+} hash_task;
+
+static void start_hash_task(hash_task *task, const char *filename, const digest_params *digest);
+static const unsigned char *finish_hash_task(hash_task *task);
+static int run_batch(int argc, char *argv[]);
+static int verify_merkle(const char *filename);
+static int verify_binary(const char *filename);
+static int verify_compact(const char *filename);
+static int verify_keystore(const char *filename, const char *index_arg);
+static int verify_wots(const char *filename);
+static int verify_hors(const char *filename);
+static int verify_batch_entry(const char *filename, const char *batch_sig_filename);
+static int verify_signer(const char *filename, const char *keydir_name);
+static int verify_envelope(const char *output_name, int unverified);
+static int verify_chain(const char *filename, char *link_files[], int num_links);
 
 int main(int argc, char *argv[])
 {
+    stats_init("verify", &argc, argv);
+    if (argc > 1 && (strcmp(argv[1], "-m") == 0 || strcmp(argv[1], "-d") == 0))
+    {
+        return run_batch(argc, argv);
+    }
+    if (argc == 2 && strcmp(argv[1], "-e") == 0)
+    {
+        return verify_envelope(NULL, 0);
+    }
+    if (argc == 3 && strcmp(argv[1], "-e") == 0 && strcmp(argv[2], "--unverified") == 0)
+    {
+        return verify_envelope(NULL, 1);
+    }
+    if (argc == 4 && strcmp(argv[1], "-e") == 0 && strcmp(argv[2], "-o") == 0)
+    {
+        return verify_envelope(argv[3], 0);
+    }
+    if (argc == 4 && strcmp(argv[2], "-k") == 0)
+    {
+        return verify_keystore(argv[1], argv[3]);
+    }
+    if (argc == 4 && strcmp(argv[2], "-r") == 0)
+    {
+        return verify_batch_entry(argv[1], argv[3]);
+    }
+    if (argc == 4 && strcmp(argv[2], "-i") == 0)
+    {
+        return verify_signer(argv[1], argv[3]);
+    }
+    if (argc >= 3 && strcmp(argv[2], "-x") == 0)
+    {
+        return verify_chain(argv[1], argv + 3, argc - 3);
+    }
     if (argc != 2 && argc != 3)
     {
-        fprintf(stderr, "Usage: %s <filename> [-b]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <filename> [-b | -c | -t | -k <index> | -w | -f] [--stats]\n", argv[0]);
+        fprintf(stderr, "       %s <filename> -r <batch signature>\n", argv[0]);
+        fprintf(stderr, "       %s <filename> -i <key directory>\n", argv[0]);
+        fprintf(stderr, "       %s <filename> -x [<earlier signature>...]\n", argv[0]);
+        fprintf(stderr, "       %s -e [-o <output> | --unverified] < <envelope>\n", argv[0]);
+        fprintf(stderr, "       %s -m <manifest> [-j <threads>]\n", argv[0]);
+        fprintf(stderr, "       %s -d <directory> [-k <public key> | -i <key directory>] [-j <threads>]\n", argv[0]);
         return 1;
     }
 
     const char *filename = argv[1];
+    if (argc == 3 && strcmp(argv[2], "-t") == 0)
+    {
+        return verify_merkle(filename);
+    }
+    if (argc == 3 && strcmp(argv[2], "-b") == 0)
+    {
+        return verify_binary(filename);
+    }
+    if (argc == 3 && strcmp(argv[2], "-c") == 0)
+    {
+        return verify_compact(filename);
+    }
+    if (argc == 3 && strcmp(argv[2], "-w") == 0)
+    {
+        return verify_wots(filename);
+    }
+    if (argc == 3 && strcmp(argv[2], "-f") == 0)
+    {
+        return verify_hors(filename);
+    }
     unsigned char public_key[NUM_BITS][2][KEY_SIZE];
     unsigned char signature[NUM_BITS][KEY_SIZE];
-    unsigned char hash[HASH_SIZE];
+    unsigned char computed_hash[NUM_BITS][KEY_SIZE];
+    digest_params digest;
+    hash_task task;
 
     // Create signature filename
     char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
     sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
 
-    // Read public key
-    if (!read_key(PUB_FILE_NAME, public_key))
+    // The digest mode recorded after the signature is all the document hash needs; start it right away
+    if (!digest_read_trailer(sig_filename, (off_t)NUM_BITS * HEX_LINE_SIZE, &digest))
     {
         return 1;
     }
+    start_hash_task(&task, filename, &digest);
 
-    // Read signature
-    if (!read_signature(sig_filename, signature))
+    // Meanwhile read the public key and the signature and hash the signature components
+    if (!read_key(PUB_FILE_NAME, public_key) || !read_signature(sig_filename, signature) ||
+        !hash_batch(&signature[0][0], &computed_hash[0][0], NUM_BITS))
     {
         return 1;
     }
 
-    // Hash the input file
-    if (!hash_file(filename, hash))
+    // Only the comparison waits for the document hash
+    const unsigned char *hash = finish_hash_task(&task);
+    if (hash == NULL)
+    {
+        return 1;
+    }
+    if (verify_hashed_signature(public_key, computed_hash, hash))
     {
+        printf("VALID\n");
+        return 0;
+    }
+    else
+    {
+        printf("INVALID\n");
         return 1;
     }
+}
 
-    // Optionally, check if -b option is provided for binary verification
-    if (argc == 3 && strcmp(argv[2], "-b") == 0)
+// Hash the document on its own thread while the caller loads keys and signatures. A caller that fails
+// before finish_hash_task simply exits; the hashing thread ends with the process.
+static void *run_hash_task(void *arg)
+{
+    hash_task *task = arg;
+    task->ok = digest_file(task->filename, &task->digest, task->hash);
+    return NULL;
+}
+
+static void start_hash_task(hash_task *task, const char *filename, const digest_params *digest)
+{
+    task->filename = filename;
+    task->digest = *digest;
+    task->ok = 0;
+    // Without a thread the document is hashed by finish_hash_task
+    task->threaded = pthread_create(&task->thread, NULL, run_hash_task, task) == 0;
+}
+
+static const unsigned char *finish_hash_task(hash_task *task)
+{
+    if (task->threaded)
     {
-        unsigned char public_binary_key[NUM_BITS][2][KEY_SIZE];
-        if (!read_binary_key(PUB_BINARY_FILE_NAME, public_binary_key))
+        pthread_join(task->thread, NULL);
+    }
+    else
+    {
+        run_hash_task(task);
+    }
+    return task->ok ? task->hash : NULL;
+}
+
+// Binary mode: the public key and <filename>.bin.sign containers are mapped and used in place.
+// The document is hashed while the public key is mapped and the signature components are hashed.
+static int verify_binary(const char *filename)
+{
+    container_map public_key, signature;
+    unsigned char computed_hash[NUM_BITS][KEY_SIZE];
+    digest_params digest;
+    hash_task task;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_BINARY_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_BINARY_EXTENSION);
+
+    if (!container_open(sig_filename, CONTAINER_SIGNATURE, NUM_BITS, &signature))
+    {
+        return 1;
+    }
+    if (!digest_from_container_flags(signature.flags, &digest))
+    {
+        fprintf(stderr, "Error: Unsupported digest mode in signature file %s\n", sig_filename);
+        container_close(&signature);
+        return 1;
+    }
+    start_hash_task(&task, filename, &digest);
+
+    int ok = hash_batch(signature.payload, &computed_hash[0][0], NUM_BITS);
+    container_close(&signature);
+    if (!ok || !container_open(PUB_BINARY_FILE_NAME, CONTAINER_PUBLIC_KEY, NUM_BITS * 2, &public_key))
+    {
+        return 1;
+    }
+    const unsigned char *hash = finish_hash_task(&task);
+    int valid = hash != NULL &&
+                verify_hashed_signature((unsigned char (*)[2][KEY_SIZE])public_key.payload, computed_hash, hash);
+    container_close(&public_key);
+    if (hash == NULL)
+    {
+        return 1;
+    }
+    printf(valid ? "VALID (binary)\n" : "INVALID (binary)\n");
+    return valid ? 0 : 1;
+}
+
+// Compact mode: rebuild the full public key from the signature and compare its hash with the 32-byte key
+static int verify_compact(const char *filename)
+{
+    unsigned char compact_key[HASH_SIZE];
+    unsigned char signature[2 * NUM_BITS][KEY_SIZE];
+    unsigned char hash[HASH_SIZE];
+    digest_params digest;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+
+    if (!hex_read_lines(COMPACT_PUB_FILE_NAME, compact_key, 1, "public key") ||
+        !hex_read_lines(sig_filename, &signature[0][0], 2 * NUM_BITS, "signature") ||
+        !digest_read_trailer(sig_filename, (off_t)2 * NUM_BITS * HEX_LINE_SIZE, &digest) ||
+        !digest_file(filename, &digest, hash))
+    {
+        return 1;
+    }
+    int valid = compact_verify(compact_key, signature, hash);
+    printf(valid ? "VALID (compact key)\n" : "INVALID (compact key)\n");
+    return valid ? 0 : 1;
+}
+
+// Winternitz mode: the signature length follows from the w recorded in the public key
+static int verify_wots(const char *filename)
+{
+    wots_public_key public_key;
+    wots_params params;
+    unsigned char signature[WOTS_MAX_LEN][HASH_SIZE];
+    unsigned char hash[HASH_SIZE];
+    digest_params digest;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+
+    if (!read_wots_public_key(WOTS_PUB_FILE_NAME, &public_key) || !wots_params_init(public_key.w, &params) ||
+        !read_wots_signature(sig_filename, public_key.w, signature) ||
+        !digest_read_trailer(sig_filename, (off_t)params.len * HEX_LINE_SIZE, &digest) ||
+        !digest_file(filename, &digest, hash))
+    {
+        return 1;
+    }
+    int valid = wots_verify(&public_key, signature, hash);
+    printf(valid ? "VALID (Winternitz, w = %u)\n" : "INVALID (Winternitz, w = %u)\n", public_key.w);
+    return valid ? 0 : 1;
+}
+
+// HORS mode: k comes from the public key header; only the k public values the hash selects are read
+static int verify_hors(const char *filename)
+{
+    hors_public_key public_key;
+    unsigned char signature[HORS_MAX_K][HASH_SIZE];
+    unsigned char hash[HASH_SIZE];
+    digest_params digest;
+    uint64_t number;
+    off_t data_size;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+
+    if (!read_hors_public_key(HORS_PUB_FILE_NAME, &public_key) ||
+        !read_hors_signature(sig_filename, public_key.params.k, &number, signature, &data_size) ||
+        !digest_read_trailer(sig_filename, data_size, &digest) || !digest_file(filename, &digest, hash))
+    {
+        return 1;
+    }
+    int valid = hors_verify(&public_key, number, signature, hash);
+    printf(valid ? "VALID (HORS, signature %llu of %llu)\n" : "INVALID (HORS, signature %llu of %llu)\n",
+           (unsigned long long)number + 1, (unsigned long long)public_key.params.max_signatures);
+    return valid ? 0 : 1;
+}
+
+// Keystore mode: the public key is record <index> of the public key bundle, used in place
+static int verify_keystore(const char *filename, const char *index_arg)
+{
+    keystore_map keystore;
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    unsigned char hash[HASH_SIZE];
+    digest_params digest;
+    char *end;
+
+    uint64_t key_index = strtoull(index_arg, &end, 10);
+    if (*index_arg == '\0' || *end != '\0')
+    {
+        fprintf(stderr, "Error: Invalid key index %s\n", index_arg);
+        return 1;
+    }
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+
+    if (!read_signature(sig_filename, signature) ||
+        !digest_read_trailer(sig_filename, (off_t)NUM_BITS * HEX_LINE_SIZE, &digest) ||
+        !digest_file(filename, &digest, hash) ||
+        !keystore_open(KEYSTORE_PUB_FILE_NAME, KEYSTORE_PUBLIC, &keystore))
+    {
+        return 1;
+    }
+    const unsigned char *public_key = keystore_key(&keystore, key_index);
+    int valid = public_key != NULL && lamport_verify_digest(NULL, public_key, &signature[0][0], hash);
+    keystore_close(&keystore);
+    printf(valid ? "VALID\n" : "INVALID\n");
+    return valid ? 0 : 1;
+}
+
+// Batch mode: verify many files on a worker pool and print a per-file VALID/INVALID report
+static int run_batch(int argc, char *argv[])
+{
+    const char *manifest_name = NULL;
+    const char *dir_name = NULL;
+    const char *pub_file_name = PUB_FILE_NAME;
+    const char *keydir_name = NULL;
+    int num_threads = BATCH_DEFAULT_THREADS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
         {
+            fprintf(stderr, "Error: Option %s requires an argument\n", argv[i]);
             return 1;
         }
-        // Verify binary signature
-        if (verify_signature(public_binary_key, signature, hash))
+        if (strcmp(argv[i], "-m") == 0)
         {
-            printf("VALID (binary)\n");
-            return 0;
+            manifest_name = argv[++i];
         }
-        else
+        else if (strcmp(argv[i], "-d") == 0)
         {
-            printf("INVALID (binary)\n");
-            return 1;
+            dir_name = argv[++i];
         }
-    }
-    else
-    {
-        // Verify signature
-        if (verify_signature(public_key, signature, hash))
+        else if (strcmp(argv[i], "-k") == 0)
         {
-            printf("VALID\n");
-            return 0;
+            pub_file_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-i") == 0)
+        {
+            keydir_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-j") == 0)
+        {
+            num_threads = atoi(argv[++i]);
         }
         else
         {
-            printf("INVALID\n");
+            fprintf(stderr, "Error: Unknown option %s\n", argv[i]);
             return 1;
         }
     }
+    if ((manifest_name == NULL) == (dir_name == NULL))
+    {
+        fprintf(stderr, "Error: Specify exactly one of -m <manifest> or -d <directory>\n");
+        return 1;
+    }
+
+    if (manifest_name != NULL)
+    {
+        return verify_manifest(manifest_name, num_threads) ? 0 : 1;
+    }
+    return verify_directory(dir_name, pub_file_name, keydir_name, num_threads) ? 0 : 1;
 }
 
-int read_signature(const char *sig_filename, unsigned char signature[NUM_BITS][KEY_SIZE])
+// Merkle tree mode: check the one-time signature and its authentication path against the root
+static int verify_merkle(const char *filename)
 {
-    FILE *sig_file = fopen(sig_filename, "r");
-    if (sig_file == NULL)
+    mss_public_key public_key;
+    mss_signature signature;
+    unsigned char hash[HASH_SIZE];
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
+
+    if (!read_mss_public_key(MSS_PUB_FILE_NAME, &public_key) ||
+        !read_mss_signature(sig_filename, public_key.height, &signature) ||
+        !digest_file(filename, &signature.digest, hash))
+    {
+        return 1;
+    }
+    if (mss_verify(&public_key, &signature, hash))
     {
-        fprintf(stderr, "Error: Cannot open signature file %s\n", sig_filename);
+        printf("VALID (one-time key %lu)\n", signature.leaf_index);
         return 0;
     }
+    printf("INVALID\n");
+    return 1;
+}
 
-    char line[KEY_SIZE * 2 + 2]; // 2 hex chars per byte + newline + null terminator
-    int i, k;
+// Key directory mode: the signer record of the signature selects the public key, which is used in place
+static int verify_signer(const char *filename, const char *keydir_name)
+{
+    keydir_map keydir;
+    unsigned char fingerprint[HASH_SIZE];
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    unsigned char hash[HASH_SIZE];
+    digest_params digest;
 
-    // Read signature: each line contains exactly 32 bytes (64 hex chars)
-    for (i = 0; i < NUM_BITS; i++)
-    {
-        if (fgets(line, sizeof(line), sig_file) == NULL)
-        {
-            fprintf(stderr, "Error: Invalid signature file format\n");
-            fclose(sig_file);
-            return 0;
-        }
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
 
-        // Convert hex string to bytes
-        for (k = 0; k < KEY_SIZE; k++)
-        {
-            if (sscanf(line + k * 2, "%2hhx", &signature[i][k]) != 1)
-            {
-                fprintf(stderr, "Error: Invalid hex data in signature file\n");
-                fclose(sig_file);
-                return 0;
-            }
-        }
+    if (!keydir_read_signer(sig_filename, fingerprint) || !read_signature(sig_filename, signature) ||
+        !digest_read_trailer(sig_filename, (off_t)NUM_BITS * HEX_LINE_SIZE, &digest) || !digest_file(filename, &digest, hash) ||
+        !keydir_open(keydir_name, &keydir))
+    {
+        return 1;
     }
-
-    fclose(sig_file);
-    return 1;
+    const unsigned char *public_key = keydir_lookup(&keydir, fingerprint);
+    int valid = public_key != NULL && verify_signature((unsigned char (*)[2][KEY_SIZE])public_key, signature, hash);
+    keydir_close(&keydir);
+    if (public_key == NULL)
+    {
+        return 1;
+    }
+    printf(valid ? "VALID\n" : "INVALID\n");
+    return valid ? 0 : 1;
 }
 
-int verify_signature(unsigned char public_key[NUM_BITS][2][KEY_SIZE],
-                     unsigned char signature[NUM_BITS][KEY_SIZE],
-                     unsigned char *hash)
+// Chain mode: the checkpoint supplies the signer's key in one read; links only extend it
+static int verify_chain(const char *filename, char *link_files[], int num_links)
 {
-    int i, j;
-    unsigned char computed_hash[KEY_SIZE];
-    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    chain_checkpoint checkpoint;
+    chain_signature signature;
+    unsigned char hash[HASH_SIZE];
+    digest_params digest;
+    off_t data_size;
+
+    char sig_filename[strlen(filename) + strlen(SIGN_EXTENSION) + 1];
+    sprintf(sig_filename, "%s%s", filename, SIGN_EXTENSION);
 
-    if (mdctx == NULL)
+    if (!read_chain_signature(sig_filename, &signature, &data_size) || !digest_read_trailer(sig_filename, data_size, &digest) ||
+        !digest_file(filename, &digest, hash))
     {
-        fprintf(stderr, "Error: Failed to create hash context\n");
-        return 0;
+        return 1;
+    }
+    if (CRYPTO_memcmp(hash, signature.digest, HASH_SIZE) != 0)
+    {
+        printf("INVALID (chain key %llu)\n", (unsigned long long)signature.number);
+        return 1;
     }
+    chain_signature *links = malloc((size_t)(num_links > 0 ? num_links : 1) * sizeof(chain_signature));
+    if (links == NULL)
+    {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+    int ok = 1;
+    for (int i = 0; ok && i < num_links; i++)
+    {
+        ok = read_chain_signature(link_files[i], &links[i], &data_size);
+    }
+    ok = ok && chain_checkpoint_open(CHAIN_CHECKPOINT_FILE_NAME, CHAIN_PUB_FILE_NAME, &checkpoint);
+    if (!ok)
+    {
+        free(links);
+        return 1;
+    }
+    int valid = chain_checkpoint_verify(&checkpoint, &signature, links, (size_t)num_links);
+    chain_checkpoint_close(&checkpoint);
+    free(links);
+    printf(valid ? "VALID (chain key %llu)\n" : "INVALID (chain key %llu)\n", (unsigned long long)signature.number);
+    return valid ? 0 : 1;
+}
+
+// Envelope: stream the payload out of stdin; an output file only appears under its name once it is VALID,
+// and stdout only gets payload bytes before the verdict with --unverified
+static int verify_envelope(const char *output_name, int unverified)
+{
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    int valid, out_fd = STDOUT_FILENO;
+    struct stat st;
+    int output = fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode) ? ENVELOPE_OUTPUT_SPOOL
+                 : unverified                                          ? ENVELOPE_OUTPUT_STREAM
+                                                                       : ENVELOPE_OUTPUT_HOLD;
 
-    // For each bit in the hash, verify the signature component
-    for (i = 0; i < HASH_SIZE; i++)
+    if (!read_key(PUB_FILE_NAME, public_key))
     {
-        for (j = 0; j < 8; j++)
+        return 1;
+    }
+    char tmp_name[output_name != NULL ? strlen(output_name) + 5 : 1];
+    if (output_name != NULL)
+    {
+        sprintf(tmp_name, "%s.tmp", output_name);
+        out_fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out_fd < 0)
         {
-            int bit_index = i * 8 + j;
-            int bit_value = (hash[i] >> (7 - j)) & 1;
-
-            // Hash the signature component
-            if (EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL) != 1)
-            {
-                fprintf(stderr, "Error: Failed to initialize hash\n");
-                EVP_MD_CTX_free(mdctx);
-                return 0;
-            }
-
-            if (EVP_DigestUpdate(mdctx, signature[bit_index], KEY_SIZE) != 1)
-            {
-                fprintf(stderr, "Error: Failed to update hash\n");
-                EVP_MD_CTX_free(mdctx);
-                return 0;
-            }
-
-            unsigned int hash_len;
-            if (EVP_DigestFinal_ex(mdctx, computed_hash, &hash_len) != 1)
-            {
-                fprintf(stderr, "Error: Failed to finalize hash\n");
-                EVP_MD_CTX_free(mdctx);
-                return 0;
-            }
-            DEBUG_PRINT("Hash byte %d: %02x, using public key[%d][%d]\n", i, computed_hash[i], bit_index, bit_value);
-
-            // Compare with the corresponding public key component
-            if (memcmp(computed_hash, public_key[bit_index][bit_value], KEY_SIZE) != 0)
-            {
-                EVP_MD_CTX_free(mdctx);
-                return 0; // Verification failed
-            }
+            fprintf(stderr, "Error: Cannot create output file %s\n", tmp_name);
+            return 1;
         }
+        output = ENVELOPE_OUTPUT_DIRECT;
+    }
+    int ok = envelope_verify(STDIN_FILENO, out_fd, output, public_key, &valid);
+    if (output_name != NULL)
+    {
+        if (valid && (fsync(out_fd) != 0 || rename(tmp_name, output_name) != 0))
+        {
+            fprintf(stderr, "Error: Cannot write output file %s\n", output_name);
+            valid = ok = 0;
+        }
+        close(out_fd);
+        if (!valid)
+        {
+            unlink(tmp_name);
+        }
+    }
+    if (!ok)
+    {
+        return 1;
     }
+    fprintf(output_name != NULL ? stdout : stderr, valid ? "VALID\n" : "INVALID\n");
+    return valid ? 0 : 1;
+}
 
-    EVP_MD_CTX_free(mdctx);
-    return 1; // Verification successful
+// Batch-signed file: the proof leads from the file digest to the signed root; the batch signature is a plain one
+static int verify_batch_entry(const char *filename, const char *batch_sig_filename)
+{
+    unsigned char public_key[NUM_BITS][2][KEY_SIZE];
+    unsigned char signature[NUM_BITS][KEY_SIZE];
+    unsigned char file_hash[HASH_SIZE], hash[HASH_SIZE];
+    batch_proof proof;
+
+    char proof_filename[strlen(filename) + strlen(PROOF_EXTENSION) + 1];
+    sprintf(proof_filename, "%s%s", filename, PROOF_EXTENSION);
+
+    if (!read_key(PUB_FILE_NAME, public_key) || !read_signature(batch_sig_filename, signature) ||
+        !read_batch_proof(proof_filename, &proof) || !digest_file(filename, &proof.digest, file_hash) ||
+        !batch_proof_digest(&proof, file_hash, hash))
+    {
+        return 1;
+    }
+    if (lamport_verify_digest(NULL, &public_key[0][0][0], &signature[0][0], hash))
+    {
+        printf("VALID (batch entry %llu of %llu)\n", (unsigned long long)proof.index, (unsigned long long)proof.count);
+        return 0;
+    }
+    printf("INVALID\n");
+    return 1;
 }